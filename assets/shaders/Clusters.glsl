@@ -0,0 +1,36 @@
+// Lights of the view frustum cluster a fragment falls in, as assigned by LightClusters
+
+uniform samplerBuffer cluster_lights;       // position and radius, then color
+uniform usamplerBuffer cluster_ranges;      // offset and count in cluster_indices
+uniform usamplerBuffer cluster_indices;
+
+uniform ivec3 cluster_count;
+uniform vec2 cluster_depth;                 // near plane, slices per unit of log(depth)
+uniform mat4 cluster_view;
+
+
+// Offset and count of the lights of the cluster holding `world_position`,
+// shaded at `frag_coord` in a viewport of `resolution`
+uvec2 ClusterRange(vec3 world_position, vec2 frag_coord, vec2 resolution)
+{
+    float depth = -(cluster_view * vec4(world_position, 1)).z;
+
+    ivec3 cell;
+    cell.xy = clamp(ivec2(frag_coord / resolution * vec2(cluster_count.xy)), ivec2(0), cluster_count.xy - 1);
+    cell.z = clamp(int(floor(log(max(depth, cluster_depth.x) / cluster_depth.x) * cluster_depth.y)), 0, cluster_count.z - 1);
+
+    int index = cell.x + cluster_count.x * (cell.y + cluster_count.y * cell.z);
+    return texelFetch(cluster_ranges, index).xy;
+}
+
+
+// Light `i` of the list of a cluster
+void ClusterLight(uint i, out vec3 position, out float radius, out vec3 color)
+{
+    int light = int(texelFetch(cluster_indices, int(i)).x);
+    vec4 position_radius = texelFetch(cluster_lights, 2 * light);
+
+    position = position_radius.xyz;
+    radius = position_radius.w;
+    color = texelFetch(cluster_lights, 2 * light + 1).rgb;
+}
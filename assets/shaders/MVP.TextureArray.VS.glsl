@@ -0,0 +1,24 @@
+#version 330
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_texture_coord;
+layout(location = 5) in float v_texture_layer;
+
+// Uniform properties
+uniform mat4 Model;
+uniform mat4 View;
+uniform mat4 Projection;
+
+// Output
+out vec3 frag_normal;
+out vec3 tex_coord;
+
+
+void main()
+{
+    frag_normal = v_normal;
+    tex_coord = vec3(v_texture_coord, v_texture_layer);
+    gl_Position = Projection * View * Model * vec4(v_position, 1.0);
+}
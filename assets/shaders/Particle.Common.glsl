@@ -0,0 +1,28 @@
+// Shared by the particle compute passes and Particle.VS.glsl
+
+struct Particle
+{
+    vec4 position;      // xyz, w = remaining lifetime, plus the delay left
+    vec4 speed;         // xyz, w = total lifetime
+};
+
+layout(std430, binding = 0) buffer Particles {
+    Particle particles[];
+};
+
+
+uint Hash(uint x)
+{
+    // PCG output permutation
+    uint state = x * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+
+// Uniform in [0, 1], advancing the seed
+float Random(inout uint seed)
+{
+    seed = Hash(seed);
+    return float(seed) * (1.0 / 4294967295.0);
+}
@@ -0,0 +1,25 @@
+#version 430
+
+#include "Particle.Lists.glsl"
+
+layout(local_size_x = 1) in;
+
+
+// Single-thread bookkeeping between the passes, compiled as two variants
+void main()
+{
+#if defined(PREPARE)
+    // Before integrating: one thread per alive particle, and an empty output list
+    dispatchX = (aliveCount[currentList] + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE;
+    dispatchY = 1u;
+    dispatchZ = 1u;
+    aliveCount[1u - currentList] = 0u;
+#elif defined(FINALIZE)
+    // After integrating: draw the output list
+    drawCount = aliveCount[1u - currentList];
+    drawInstanceCount = 1u;
+    drawFirstIndex = 0u;
+    drawBaseVertex = 0;
+    drawBaseInstance = 0u;
+#endif
+}
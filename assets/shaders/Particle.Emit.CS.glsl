@@ -0,0 +1,54 @@
+#version 430
+
+#include "Particle.Common.glsl"
+#include "Particle.Lists.glsl"
+
+layout(local_size_x = PARTICLE_GROUP_SIZE) in;
+
+// Uniform properties
+uniform uint emitCount;
+uniform uint seed;
+
+uniform vec3 emitter_position;
+uniform vec3 emitter_extents;
+uniform vec3 emitter_velocity;
+uniform float emitter_radial_speed;
+uniform float emitter_jitter;
+uniform vec2 emitter_lifetime;
+uniform float emitter_max_delay;
+
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= emitCount)
+        return;
+
+    // Pop a free slot, giving it back if the list was already empty
+    int slot = atomicAdd(deadCount, -1) - 1;
+    if (slot < 0)
+    {
+        atomicAdd(deadCount, 1);
+        return;
+    }
+
+    uint index = deadList[slot];
+    uint rng = Hash(id ^ Hash(seed));
+
+    vec3 offset = vec3(Random(rng), Random(rng), Random(rng)) * 2.0 - 1.0;
+    vec3 jitter = vec3(Random(rng), Random(rng), Random(rng)) * 2.0 - 1.0;
+    vec3 position = emitter_position + offset * emitter_extents;
+
+    vec2 radial = position.xz - emitter_position.xz;
+    radial = (dot(radial, radial) > 0.0) ? normalize(radial) : vec2(0.0);
+
+    vec3 speed = emitter_velocity + vec3(radial.x, 0.0, radial.y) * emitter_radial_speed + jitter * emitter_jitter;
+    float lifetime = mix(emitter_lifetime.x, emitter_lifetime.y, Random(rng));
+    float delay = emitter_max_delay * Random(rng);
+
+    // The delay is spent before the lifetime starts running out
+    particles[index].position = vec4(position, lifetime + delay);
+    particles[index].speed = vec4(speed, lifetime);
+
+    aliveIn[atomicAdd(aliveCount[currentList], 1u)] = index;
+}
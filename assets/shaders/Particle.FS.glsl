@@ -0,0 +1,25 @@
+#version 330
+
+// Input
+in vec2 texture_coord;
+in float geom_life;
+
+// Uniform properties
+uniform sampler2D u_texture_0;
+uniform vec4 particle_color;
+
+// Output
+layout(location = 0) out vec4 out_color;
+
+
+void main()
+{
+    vec4 color = texture(u_texture_0, texture_coord) * particle_color;
+
+    // Fade in quickly, then out over the lifetime
+    color.a *= geom_life * (1.0 - smoothstep(0.9, 1.0, geom_life));
+    if (color.a < 0.01)
+        discard;
+
+    out_color = color;
+}
@@ -0,0 +1,40 @@
+#version 330
+
+// Input and output topologies
+layout(points) in;
+layout(triangle_strip, max_vertices = 4) out;
+
+// Uniform properties
+uniform mat4 View;
+uniform mat4 Projection;
+uniform float particle_size;
+
+in float vert_life[1];
+
+// Output
+out vec2 texture_coord;
+out float geom_life;
+
+
+void main()
+{
+    // Still delayed
+    if (vert_life[0] > 1.0)
+        return;
+
+    // Camera-facing quad, growing as the particle ages
+    vec4 center = View * gl_in[0].gl_Position;
+    float size = particle_size * (1.5 - 0.5 * vert_life[0]);
+
+    const vec2 corners[4] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(-1, 1), vec2(1, 1));
+
+    for (int i = 0; i < 4; i++)
+    {
+        texture_coord = corners[i] * 0.5 + 0.5;
+        geom_life = vert_life[0];
+        gl_Position = Projection * (center + vec4(corners[i] * size, 0, 0));
+        EmitVertex();
+    }
+
+    EndPrimitive();
+}
@@ -0,0 +1,36 @@
+// Slot lists and counters of the particle compute passes. The two alive
+// lists alternate between frames: passes read the list bound at binding 2,
+// whose counter is aliveCount[currentList], and fill the one at binding 3.
+
+layout(std430, binding = 1) buffer DeadList {
+    uint deadList[];
+};
+
+layout(std430, binding = 2) buffer AliveListIn {
+    uint aliveIn[];
+};
+
+layout(std430, binding = 3) buffer AliveListOut {
+    uint aliveOut[];
+};
+
+layout(std430, binding = 4) buffer Counters {
+    // DrawElementsIndirectCommand
+    uint drawCount;
+    uint drawInstanceCount;
+    uint drawFirstIndex;
+    int drawBaseVertex;
+    uint drawBaseInstance;
+
+    // DispatchIndirectCommand
+    uint dispatchX;
+    uint dispatchY;
+    uint dispatchZ;
+
+    int deadCount;
+    uint aliveCount[2];
+};
+
+uniform uint currentList;
+
+#define PARTICLE_GROUP_SIZE 64
@@ -0,0 +1,118 @@
+#version 430
+
+#include "Particle.Common.glsl"
+#include "Particle.Lists.glsl"
+
+layout(local_size_x = PARTICLE_GROUP_SIZE) in;
+
+// Uniform properties
+uniform float deltaTime;
+uniform vec3 gravity;
+uniform float drag;
+
+// Surroundings, see ParticleCollider
+uniform float restitution;
+uniform float friction;
+
+#if defined(HEIGHT_FIELD)
+uniform sampler2D height_field;
+uniform vec2 height_field_min;
+uniform vec2 height_field_max;
+#endif
+
+#if defined(DISTANCE_FIELD)
+uniform sampler3D distance_field;
+uniform vec3 distance_field_min;
+uniform vec3 distance_field_max;
+#endif
+
+
+void Bounce(inout vec3 speed, vec3 normal)
+{
+    float normalSpeed = dot(speed, normal);
+    if (normalSpeed < 0.0)
+        speed = (speed - normalSpeed * normal) * (1.0 - friction) - normalSpeed * restitution * normal;
+}
+
+
+#if defined(HEIGHT_FIELD)
+float GetHeight(vec2 xz)
+{
+    return textureLod(height_field, (xz - height_field_min) / (height_field_max - height_field_min), 0.0).r;
+}
+#endif
+
+
+#if defined(DISTANCE_FIELD)
+float GetDistance(vec3 position)
+{
+    return textureLod(distance_field, (position - distance_field_min) / (distance_field_max - distance_field_min), 0.0).r;
+}
+#endif
+
+
+void Collide(inout vec3 position, inout vec3 speed)
+{
+#if defined(HEIGHT_FIELD)
+    float height = GetHeight(position.xz);
+    if (position.y < height)
+    {
+        vec2 cell = (height_field_max - height_field_min) / vec2(textureSize(height_field, 0));
+        float slopeX = (GetHeight(position.xz + vec2(cell.x, 0.0)) - GetHeight(position.xz - vec2(cell.x, 0.0))) / (2.0 * cell.x);
+        float slopeZ = (GetHeight(position.xz + vec2(0.0, cell.y)) - GetHeight(position.xz - vec2(0.0, cell.y))) / (2.0 * cell.y);
+
+        position.y = height;
+        Bounce(speed, normalize(vec3(-slopeX, 1.0, -slopeZ)));
+    }
+#endif
+
+#if defined(DISTANCE_FIELD)
+    bool inVolume = all(greaterThanEqual(position, distance_field_min)) && all(lessThanEqual(position, distance_field_max));
+    float signedDistance = inVolume ? GetDistance(position) : 1.0;
+    if (signedDistance < 0.0)
+    {
+        vec3 cell = (distance_field_max - distance_field_min) / vec3(textureSize(distance_field, 0));
+        vec3 gradient = vec3(
+            GetDistance(position + vec3(cell.x, 0.0, 0.0)) - GetDistance(position - vec3(cell.x, 0.0, 0.0)),
+            GetDistance(position + vec3(0.0, cell.y, 0.0)) - GetDistance(position - vec3(0.0, cell.y, 0.0)),
+            GetDistance(position + vec3(0.0, 0.0, cell.z)) - GetDistance(position - vec3(0.0, 0.0, cell.z))) / (2.0 * cell);
+        vec3 normal = (length(gradient) > 0.0) ? normalize(gradient) : vec3(0.0, 1.0, 0.0);
+
+        position -= normal * signedDistance;
+        Bounce(speed, normal);
+    }
+#endif
+}
+
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= aliveCount[currentList])
+        return;
+
+    uint index = aliveIn[id];
+    Particle p = particles[index];
+
+    p.position.w -= deltaTime;
+
+    // Expired particles give their slot back
+    if (p.position.w <= 0.0)
+    {
+        deadList[atomicAdd(deadCount, 1)] = index;
+        return;
+    }
+
+    // Delayed particles wait at their spawn position
+    if (p.position.w < p.speed.w)
+    {
+        p.speed.xyz += (gravity - drag * p.speed.xyz) * deltaTime;
+        p.position.xyz += p.speed.xyz * deltaTime;
+        Collide(p.position.xyz, p.speed.xyz);
+    }
+
+    particles[index] = p;
+
+    // Compact the survivors into the other alive list
+    aliveOut[atomicAdd(aliveCount[1u - currentList], 1u)] = index;
+}
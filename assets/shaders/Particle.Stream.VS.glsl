@@ -0,0 +1,15 @@
+#version 330
+
+// Input
+layout(location = 0) in vec4 v_particle;    // xyz, w = fraction of the lifetime left
+
+// Output
+out float vert_life;
+
+
+void main()
+{
+    // Streamed from the CPU particle simulation, one vertex per particle
+    vert_life = max(v_particle.w, 0.0);
+    gl_Position = vec4(v_particle.xyz, 1.0);
+}
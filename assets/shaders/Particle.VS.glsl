@@ -0,0 +1,16 @@
+#version 430
+
+#include "Particle.Common.glsl"
+
+// Output
+out float vert_life;
+
+
+void main()
+{
+    // Drawn with the alive list as index buffer, so the vertex ID is the slot
+    Particle p = particles[gl_VertexID];
+
+    vert_life = max(p.position.w / p.speed.w, 0.0);
+    gl_Position = vec4(p.position.xyz, 1.0);
+}
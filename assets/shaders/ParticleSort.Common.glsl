@@ -0,0 +1,43 @@
+// Shared by the particle sorting passes. Every pass ranks the keys by one
+// digit, and keeps the order of equal digits, so the passes add up to a sort.
+
+#define SORT_GROUP_SIZE 256
+#define SORT_ITEMS_PER_THREAD 4
+#define SORT_TILE_SIZE (SORT_GROUP_SIZE * SORT_ITEMS_PER_THREAD)
+#define SORT_BITS_PER_PASS 4
+#define SORT_BINS 16
+
+layout(std430, binding = 0) readonly buffer KeysIn {
+    uint keysIn[];
+};
+
+layout(std430, binding = 1) readonly buffer ValuesIn {
+    uint valuesIn[];
+};
+
+layout(std430, binding = 2) writeonly buffer KeysOut {
+    uint keysOut[];
+};
+
+layout(std430, binding = 3) writeonly buffer ValuesOut {
+    uint valuesOut[];
+};
+
+// Digit counts of every tile, all tiles of a digit after another, then
+// replaced by where the tile writes its first key of that digit
+layout(std430, binding = 4) buffer Histograms {
+    uint histograms[];
+};
+
+layout(std430, binding = 5) readonly buffer Count {
+    uint count;
+};
+
+// Uniform properties
+uniform uint shift;
+
+
+uint Digit(uint key)
+{
+    return (key >> shift) & uint(SORT_BINS - 1);
+}
@@ -0,0 +1,30 @@
+#version 430
+
+#include "ParticleSort.Common.glsl"
+
+layout(local_size_x = SORT_GROUP_SIZE) in;
+
+shared uint tileCounts[SORT_BINS];
+
+
+void main()
+{
+    uint tid = gl_LocalInvocationID.x;
+    uint tile = gl_WorkGroupID.x;
+
+    if (tid < uint(SORT_BINS))
+        tileCounts[tid] = 0u;
+    barrier();
+
+    uint begin = tile * uint(SORT_TILE_SIZE);
+    for (uint i = 0u; i < uint(SORT_ITEMS_PER_THREAD); i++)
+    {
+        uint id = begin + i * uint(SORT_GROUP_SIZE) + tid;
+        if (id < count)
+            atomicAdd(tileCounts[Digit(keysIn[id])], 1u);
+    }
+    barrier();
+
+    if (tid < uint(SORT_BINS))
+        histograms[tid * gl_NumWorkGroups.x + tile] = tileCounts[tid];
+}
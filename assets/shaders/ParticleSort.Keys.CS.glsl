@@ -0,0 +1,35 @@
+#version 430
+
+#include "ParticleSort.Common.glsl"
+
+layout(local_size_x = SORT_GROUP_SIZE) in;
+
+// The particles, read as floats
+layout(std430, binding = 6) readonly buffer Particles {
+    float particleData[];
+};
+
+// Uniform properties
+uniform mat4 modelView;
+uniform uint stride;            // floats per particle
+uniform uint positionOffset;    // in floats
+
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= count)
+        return;
+
+    uint first = valuesIn[id] * stride + positionOffset;
+    vec3 position = vec3(particleData[first], particleData[first + 1u], particleData[first + 2u]);
+    float depth = -(modelView * vec4(position, 1.0)).z;
+
+    // Flip the sign bit of positive floats, and every bit of negative ones,
+    // so they order as unsigned integers. Inverted, the farthest come first.
+    uint bits = floatBitsToUint(depth);
+    bits ^= ((bits >> 31u) != 0u) ? 0xFFFFFFFFu : 0x80000000u;
+
+    // 24 bits still resolve depth to 1 / 32768 of itself
+    keysOut[id] = ~bits >> 8u;
+}
@@ -0,0 +1,46 @@
+#version 430
+
+#include "ParticleSort.Common.glsl"
+
+// A single group turns the digit counts of all tiles into offsets
+layout(local_size_x = SORT_GROUP_SIZE) in;
+
+// Uniform properties
+uniform uint nrEntries;
+
+shared uint sums[SORT_GROUP_SIZE];
+
+
+void main()
+{
+    uint tid = gl_LocalInvocationID.x;
+
+    // Every thread adds up a consecutive run of entries
+    uint runLength = (nrEntries + uint(SORT_GROUP_SIZE) - 1u) / uint(SORT_GROUP_SIZE);
+    uint begin = min(tid * runLength, nrEntries);
+    uint end = min(begin + runLength, nrEntries);
+
+    uint sum = 0u;
+    for (uint i = begin; i < end; i++)
+        sum += histograms[i];
+
+    sums[tid] = sum;
+    barrier();
+
+    // Inclusive scan of the runs
+    for (uint offset = 1u; offset < uint(SORT_GROUP_SIZE); offset <<= 1u)
+    {
+        uint previous = (tid >= offset) ? sums[tid - offset] : 0u;
+        barrier();
+        sums[tid] += previous;
+        barrier();
+    }
+
+    uint running = sums[tid] - sum;
+    for (uint i = begin; i < end; i++)
+    {
+        uint entry = histograms[i];
+        histograms[i] = running;
+        running += entry;
+    }
+}
@@ -0,0 +1,80 @@
+#version 430
+
+#include "ParticleSort.Common.glsl"
+
+layout(local_size_x = SORT_GROUP_SIZE) in;
+
+// Per thread, how many keys of each digit it and the threads before it hold,
+// as 16-bit counters: digits 0 to 7 in `lowScan`, 8 to 15 in `highScan`
+shared uvec4 lowScan[SORT_GROUP_SIZE];
+shared uvec4 highScan[SORT_GROUP_SIZE];
+shared uint digitOffsets[SORT_BINS];
+
+
+uint GetCounter(uint tid, uint digit)
+{
+    uint word = (digit >> 1u) & 3u;
+    uint packed = (digit < 8u) ? lowScan[tid][word] : highScan[tid][word];
+    return (packed >> ((digit & 1u) * 16u)) & 0xFFFFu;
+}
+
+
+void main()
+{
+    uint tid = gl_LocalInvocationID.x;
+    uint tile = gl_WorkGroupID.x;
+    uint begin = tile * uint(SORT_TILE_SIZE);
+
+    if (begin >= count)
+        return;
+
+    if (tid < uint(SORT_BINS))
+        digitOffsets[tid] = histograms[tid * gl_NumWorkGroups.x + tile];
+
+    // The tile is ranked one key per thread at a time, keeping the key order
+    for (uint i = 0u; i < uint(SORT_ITEMS_PER_THREAD); i++)
+    {
+        uint id = begin + i * uint(SORT_GROUP_SIZE) + tid;
+        bool valid = id < count;
+        uint key = valid ? keysIn[id] : 0u;
+        uint digit = Digit(key);
+
+        uvec4 low = uvec4(0u);
+        uvec4 high = uvec4(0u);
+        if (valid)
+        {
+            uint counter = 1u << ((digit & 1u) * 16u);
+            if (digit < 8u)
+                low[digit >> 1u] = counter;
+            else
+                high[(digit >> 1u) & 3u] = counter;
+        }
+
+        lowScan[tid] = low;
+        highScan[tid] = high;
+        barrier();
+
+        for (uint offset = 1u; offset < uint(SORT_GROUP_SIZE); offset <<= 1u)
+        {
+            uvec4 previousLow = (tid >= offset) ? lowScan[tid - offset] : uvec4(0u);
+            uvec4 previousHigh = (tid >= offset) ? highScan[tid - offset] : uvec4(0u);
+            barrier();
+            lowScan[tid] += previousLow;
+            highScan[tid] += previousHigh;
+            barrier();
+        }
+
+        if (valid)
+        {
+            uint target = digitOffsets[digit] + GetCounter(tid, digit) - 1u;
+            keysOut[target] = key;
+            valuesOut[target] = valuesIn[id];
+        }
+        barrier();
+
+        // The last thread has the totals of the round
+        if (tid < uint(SORT_BINS))
+            digitOffsets[tid] += GetCounter(uint(SORT_GROUP_SIZE) - 1u, tid);
+        barrier();
+    }
+}
@@ -0,0 +1,39 @@
+// Visibility of a directional light, from the cascades of CascadedShadowMap
+
+uniform sampler2DArrayShadow shadow_map;
+uniform mat4 shadow_matrices[4];            // world to texture space of each cascade
+uniform vec4 shadow_splits;                 // view depth where each cascade ends
+uniform vec4 shadow_texel_sizes;            // world size of a texel of each cascade
+uniform int shadow_cascades;
+uniform mat4 shadow_view;
+
+
+// Lit fraction of `world_position`, with a 3x3 filter. Past the last cascade
+// everything is lit.
+float ShadowFactor(vec3 world_position, vec3 world_normal)
+{
+    float depth = -(shadow_view * vec4(world_position, 1)).z;
+
+    int cascade = 0;
+    while (cascade < shadow_cascades && depth > shadow_splits[cascade])
+        cascade++;
+    if (cascade == shadow_cascades)
+        return 1.0;
+
+    // Moved off the surface by a texel, against acne where the light grazes it
+    vec3 position = world_position + normalize(world_normal) * shadow_texel_sizes[cascade];
+    vec3 coord = (shadow_matrices[cascade] * vec4(position, 1)).xyz;
+    if (any(lessThan(coord, vec3(0))) || any(greaterThan(coord, vec3(1))))
+        return 1.0;
+
+    vec2 texel = 1.0 / vec2(textureSize(shadow_map, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            lit += texture(shadow_map, vec4(coord.xy + vec2(x, y) * texel, float(cascade), coord.z));
+        }
+    }
+    return lit / 9.0;
+}
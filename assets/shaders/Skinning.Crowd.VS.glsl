@@ -0,0 +1,72 @@
+#version 330
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_texture_coord;
+layout(location = 3) in ivec4 v_bone_ids;
+layout(location = 4) in vec4 v_bone_weights;
+
+// Per instance, see AnimationCrowd
+layout(location = 6) in mat4 v_model;
+layout(location = 10) in vec3 v_animation;
+
+const int MAX_CLIPS = 16;
+
+// Uniform properties
+uniform mat4 View;
+uniform mat4 Projection;
+
+// Three texels per bone, holding the rows of its transform, and a row per frame
+uniform sampler2D bone_palette;
+
+// First row, number of frames and duration of each clip
+uniform vec4 clip_ranges[MAX_CLIPS];
+uniform float frames_per_second;
+uniform float time;
+
+// Output
+out vec3 frag_normal;
+out vec2 tex_coord;
+
+
+void AddBone(int bone, float weight, ivec2 frames, float blend, inout vec4 rows[3])
+{
+    for (int r = 0; r < 3; r++)
+    {
+        vec4 current = texelFetch(bone_palette, ivec2(3 * bone + r, frames.x), 0);
+        vec4 next = texelFetch(bone_palette, ivec2(3 * bone + r, frames.y), 0);
+        rows[r] += weight * mix(current, next, blend);
+    }
+}
+
+
+void main()
+{
+    vec4 clip = clip_ranges[int(v_animation.x)];
+
+    // Frames on both sides of the time of the instance, the last one wrapping around
+    float clipTime = clip.z > 0.0 ? mod(time * v_animation.z + v_animation.y, clip.z) : 0.0;
+    float frame = min(clipTime * frames_per_second, clip.y - 1.0);
+    int first = int(frame);
+    ivec2 frames = ivec2(clip.x) + ivec2(first, min(first + 1, int(clip.y) - 1));
+    float blend = frame - float(first);
+
+    vec4 rows[3] = vec4[3](vec4(0), vec4(0), vec4(0));
+    for (int i = 0; i < 4; i++)
+    {
+        if (v_bone_weights[i] > 0.0)
+            AddBone(v_bone_ids[i], v_bone_weights[i], frames, blend, rows);
+    }
+
+    // Vertices no bone moves keep their position
+    if (dot(v_bone_weights, vec4(1)) <= 0.0)
+        rows = vec4[3](vec4(1, 0, 0, 0), vec4(0, 1, 0, 0), vec4(0, 0, 1, 0));
+
+    mat4 skin = transpose(mat4(rows[0], rows[1], rows[2], vec4(0, 0, 0, 1)));
+    vec4 position = v_model * skin * vec4(v_position, 1.0);
+
+    frag_normal = normalize(mat3(v_model) * mat3(skin) * v_normal);
+    tex_coord = v_texture_coord;
+    gl_Position = Projection * View * position;
+}
@@ -74,7 +74,6 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("Simple");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Default.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
         shaders[shader->GetName()] = shader;
     }
 
@@ -83,7 +82,6 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("Color");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Color.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
         shaders[shader->GetName()] = shader;
     }
 
@@ -92,7 +90,6 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("VertexNormal");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Normals.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
         shaders[shader->GetName()] = shader;
     }
 
@@ -101,10 +98,17 @@ void SimpleScene::InitResources()
         Shader *shader = new Shader("VertexColor");
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "VertexColor.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
         shaders[shader->GetName()] = shader;
     }
 
+    // Compile all the programs above at once
+    {
+        std::vector<Shader *> programs;
+        for (auto &shader : shaders)
+            programs.push_back(shader.second);
+        Shader::CreateAndLinkAll(programs);
+    }
+
     // Default rendering mode will use depth buffer
     glDepthMask(GL_TRUE);
     glEnable(GL_DEPTH_TEST);
@@ -175,11 +179,15 @@ void SimpleScene::DrawCoordinateSystem(const glm::mat4 & viewMatrix, const glm::
 
 void SimpleScene::RenderMesh(Mesh * mesh, Shader * shader, glm::vec3 position, glm::vec3 scale)
 {
-    if (!mesh || !shader || !shader->program)
+    if (!mesh || !shader)
         return;
 
-    // Render an object using the specified shader and the specified position
+    // Render an object using the specified shader and the specified position.
+    // Use() finishes a program still compiling, so it goes before the check.
     shader->Use();
+    if (!shader->program)
+        return;
+
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
     glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
 
@@ -199,10 +207,13 @@ void SimpleScene::RenderMesh(Mesh * mesh, glm::vec3 position, glm::vec3 scale)
 
 void SimpleScene::RenderMesh2D(Mesh * mesh, Shader * shader, const glm::mat3 &modelMatrix)
 {
-    if (!mesh || !shader || !shader->program)
+    if (!mesh || !shader)
         return;
 
     shader->Use();
+    if (!shader->program)
+        return;
+
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
     glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
 
@@ -222,7 +233,12 @@ void SimpleScene::RenderMesh2D(Mesh * mesh, const glm::mat3 & modelMatrix, const
 {
     Shader* shader = shaders.at("Color");
 
-    if (!mesh || !shader || !shader->program)
+    if (!mesh || !shader)
+        return;
+
+    // Render an object using the specified shader and the specified position
+    shader->Use();
+    if (!shader->program)
         return;
 
     glm::mat3 mm = modelMatrix;
@@ -232,8 +248,6 @@ void SimpleScene::RenderMesh2D(Mesh * mesh, const glm::mat3 & modelMatrix, const
         0.f, 0.f, mm[2][2], 0.f,
         mm[2][0], mm[2][1], 0.f, 1.f);
 
-    // Render an object using the specified shader and the specified position
-    shader->Use();
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
     glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
     glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(model));
@@ -245,11 +259,14 @@ void SimpleScene::RenderMesh2D(Mesh * mesh, const glm::mat3 & modelMatrix, const
 
 void SimpleScene::RenderMesh(Mesh * mesh, Shader * shader, const glm::mat4 & modelMatrix)
 {
-    if (!mesh || !shader || !shader->program)
+    if (!mesh || !shader)
         return;
 
     // Render an object using the specified shader and the specified position
     shader->Use();
+    if (!shader->program)
+        return;
+
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
     glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
     glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
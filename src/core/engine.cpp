@@ -2,6 +2,10 @@
 
 #include <iostream>
 
+#include "core/gpu/shader.h"
+#include "core/managers/asset_watcher.h"
+#include "core/managers/resource_path.h"
+#include "core/managers/shader_cache.h"
 #include "core/managers/texture_manager.h"
 #include "utils/gl_utils.h"
 
@@ -13,9 +17,18 @@ WindowObject* Engine::Init(const WindowProperties & props)
 {
     /* Initialize the library */
     if (!glfwInit())
-        exit(0);
+    {
+        std::cout << "ERROR initializing GLFW" << std::endl;
+        return nullptr;
+    }
 
     window = new WindowObject(props);
+    if (!window->IsCreated())
+    {
+        std::cout << "ERROR creating a window with an OpenGL 3.3 context" << std::endl;
+        Abort();
+        return nullptr;
+    }
 
     glewExperimental = true;
     GLenum err = glewInit();
@@ -23,9 +36,17 @@ WindowObject* Engine::Init(const WindowProperties & props)
     {
         // Serious problem
         fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
-        exit(0);
+        Abort();
+        return nullptr;
     }
 
+    // Let the driver compile shaders on as many threads as it wants
+    if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    ShaderCache::SetDirectory(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::CACHE, "shaders"));
+    Shader::SetIncludeDirectory(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS));
+    AssetWatcher::Init();
     TextureManager::Init(window->props.selfDir);
 
     return window;
@@ -38,10 +59,20 @@ WindowObject* Engine::GetWindow()
 }
 
 
+void Engine::Abort()
+{
+    delete window;
+    window = nullptr;
+    glfwTerminate();
+}
+
+
 void Engine::Exit()
 {
     std::cout << "=====================================================" << std::endl;
     std::cout << "Engine closed. Exit" << std::endl;
+    AssetWatcher::Destroy();
+    TextureManager::Destroy();
     glfwTerminate();
 }
 
@@ -10,6 +10,8 @@
 class Engine
 {
  public:
+    // Returns nullptr, after printing why, if the window or its OpenGL
+    // context cannot be created
     static WindowObject* Init(const WindowProperties &props);
 
     static WindowObject* GetWindow();
@@ -19,6 +21,10 @@ class Engine
 
     static void Exit();
 
+ private:
+    // Releases what a failed Init created
+    static void Abort();
+
  private:
     static WindowObject* window;
 };
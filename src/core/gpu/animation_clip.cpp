@@ -0,0 +1,449 @@
+#include "core/gpu/animation_clip.h"
+
+#include <map>
+#include <mutex>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+
+static const float QUANTIZED_MAX = 65535.0f;
+
+// Smallest three components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)]
+static const float ROTATION_RANGE = 0.70710678f;
+static const float ROTATION_MAX = 32767.0f;
+
+static std::map<std::string, std::weak_ptr<const AnimationClip>> loadedClips;
+static std::mutex loadedClipsMutex;
+
+
+static uint16_t Quantize(float value, float step)
+{
+    if (step <= 0)
+        return 0;
+
+    return static_cast<uint16_t>(glm::clamp(std::floor(value / step + 0.5f), 0.0f, QUANTIZED_MAX));
+}
+
+
+static glm::vec3 Interpolate(const glm::vec3 &a, const glm::vec3 &b, float factor)
+{
+    return glm::mix(a, b, factor);
+}
+
+
+// Normalized linear blend along the shorter arc. Keys are close enough for it
+// to track slerp, for a fraction of the cost.
+static glm::quat Interpolate(const glm::quat &a, const glm::quat &b, float factor)
+{
+    float sign = glm::dot(a, b) < 0 ? -1.0f : 1.0f;
+    return glm::normalize(a * (1.0f - factor) + b * (sign * factor));
+}
+
+
+static float Distance(const glm::vec3 &a, const glm::vec3 &b)
+{
+    return glm::length(a - b);
+}
+
+
+// Angle between two rotations, in radians
+static float Distance(const glm::quat &a, const glm::quat &b)
+{
+    return 2.0f * std::acos(glm::min(std::abs(glm::dot(a, b)), 1.0f));
+}
+
+
+// Indices of the keys to keep, so interpolating between them reproduces every
+// dropped key within `tolerance`
+template <typename T>
+static std::vector<unsigned int> ReduceKeys(const std::vector<float> &times, const std::vector<T> &values, float tolerance)
+{
+    unsigned int nrKeys = static_cast<unsigned int>(values.size());
+    std::vector<unsigned int> kept(1, 0);
+
+    // Stretch the segment starting at the last kept key until one of the keys it skips strays too far
+    unsigned int start = 0;
+    for (unsigned int end = start + 2; end < nrKeys; end++)
+    {
+        for (unsigned int k = start + 1; k < end; k++)
+        {
+            float length = times[end] - times[start];
+            float factor = length > 0 ? (times[k] - times[start]) / length : 0;
+            if (Distance(Interpolate(values[start], values[end], factor), values[k]) > tolerance)
+            {
+                start = end - 1;
+                kept.push_back(start);
+                break;
+            }
+        }
+    }
+
+    if (nrKeys > 1 && (kept.size() > 1 || Distance(values[0], values[nrKeys - 1]) > tolerance))
+        kept.push_back(nrKeys - 1);
+
+    return kept;
+}
+
+
+AnimationClip::AnimationClip()
+{
+    duration = 0;
+    timeScale = 0;
+}
+
+
+bool AnimationClip::Init(const aiAnimation *animation, const aiNode *rootNode, float tolerance)
+{
+    tracks.clear();
+    keyTimes.clear();
+    keyValues.clear();
+    nodeChannels.clear();
+
+    if (!animation || !rootNode)
+    {
+        std::cout << "Animation clip needs an animation and a node hierarchy" << std::endl;
+        return false;
+    }
+
+    name = animation->mName.data;
+
+    // Assimp leaves the rate at zero when the file does not set it
+    float ticksPerSecond = animation->mTicksPerSecond != 0 ? (float)animation->mTicksPerSecond : 25.0f;
+    duration = (float)animation->mDuration / ticksPerSecond;
+    timeScale = duration > 0 ? QUANTIZED_MAX / duration : 0;
+
+    tracks.reserve(TRACKS_PER_CHANNEL * animation->mNumChannels);
+
+    std::vector<float> times;
+    std::vector<glm::vec3> vectors;
+    std::vector<glm::quat> rotations;
+
+    for (unsigned int i = 0; i < animation->mNumChannels; i++)
+    {
+        const aiNodeAnim *nodeAnim = animation->mChannels[i];
+
+        // Missing tracks hold still at the identity
+        times.assign(1, 0.0f);
+        vectors.assign(1, glm::vec3(0));
+        if (nodeAnim->mNumPositionKeys)
+        {
+            times.resize(nodeAnim->mNumPositionKeys);
+            vectors.resize(nodeAnim->mNumPositionKeys);
+            for (unsigned int k = 0; k < nodeAnim->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = nodeAnim->mPositionKeys[k];
+                times[k] = (float)key.mTime / ticksPerSecond;
+                vectors[k] = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+            }
+        }
+        AddVectorTrack(times, vectors, tolerance);
+
+        times.assign(1, 0.0f);
+        rotations.assign(1, glm::quat(1, 0, 0, 0));
+        if (nodeAnim->mNumRotationKeys)
+        {
+            times.resize(nodeAnim->mNumRotationKeys);
+            rotations.resize(nodeAnim->mNumRotationKeys);
+            for (unsigned int k = 0; k < nodeAnim->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = nodeAnim->mRotationKeys[k];
+                times[k] = (float)key.mTime / ticksPerSecond;
+                rotations[k] = glm::normalize(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+        }
+        AddRotationTrack(times, rotations, tolerance);
+
+        times.assign(1, 0.0f);
+        vectors.assign(1, glm::vec3(1));
+        if (nodeAnim->mNumScalingKeys)
+        {
+            times.resize(nodeAnim->mNumScalingKeys);
+            vectors.resize(nodeAnim->mNumScalingKeys);
+            for (unsigned int k = 0; k < nodeAnim->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = nodeAnim->mScalingKeys[k];
+                times[k] = (float)key.mTime / ticksPerSecond;
+                vectors[k] = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+            }
+        }
+        AddVectorTrack(times, vectors, tolerance);
+    }
+
+    keyTimes.shrink_to_fit();
+    keyValues.shrink_to_fit();
+
+    BindNodes(animation, rootNode);
+    return true;
+}
+
+
+std::shared_ptr<const AnimationClip> AnimationClip::Load(const std::string &filePath, unsigned int index, const aiScene *scene)
+{
+    std::string key = filePath + '#' + std::to_string(index);
+    std::lock_guard<std::mutex> lock(loadedClipsMutex);
+
+    std::shared_ptr<const AnimationClip> clip = loadedClips[key].lock();
+    if (clip)
+        return clip;
+
+    if (!scene || index >= scene->mNumAnimations)
+        return nullptr;
+
+    std::shared_ptr<AnimationClip> newClip = std::make_shared<AnimationClip>();
+    if (!newClip->Init(scene->mAnimations[index], scene->mRootNode))
+        return nullptr;
+
+    loadedClips[key] = newClip;
+    return newClip;
+}
+
+
+void AnimationClip::Invalidate(const std::string &filePath)
+{
+    std::string prefix = filePath + '#';
+    std::lock_guard<std::mutex> lock(loadedClipsMutex);
+
+    for (auto it = loadedClips.begin(); it != loadedClips.end(); )
+    {
+        if (it->first.compare(0, prefix.size(), prefix) == 0)
+            it = loadedClips.erase(it);
+        else
+            ++it;
+    }
+}
+
+
+void AnimationClip::BindNodes(const aiAnimation *animation, const aiNode *node)
+{
+    int channelIndex = -1;
+    for (unsigned int i = 0; i < animation->mNumChannels; i++)
+    {
+        if (animation->mChannels[i]->mNodeName == node->mName)
+        {
+            channelIndex = i;
+            break;
+        }
+    }
+    nodeChannels.push_back(channelIndex);
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        BindNodes(animation, node->mChildren[i]);
+    }
+}
+
+
+void AnimationClip::AddVectorTrack(const std::vector<float> &times, const std::vector<glm::vec3> &values, float tolerance)
+{
+    std::vector<unsigned int> kept = ReduceKeys(times, values, tolerance);
+
+    AnimationTrack track;
+    track.firstKey = static_cast<unsigned int>(keyTimes.size());
+    track.numKeys = static_cast<unsigned int>(kept.size());
+
+    glm::vec3 rangeMax = values[kept[0]];
+    track.rangeMin = rangeMax;
+    for (unsigned int k : kept)
+    {
+        track.rangeMin = glm::min(track.rangeMin, values[k]);
+        rangeMax = glm::max(rangeMax, values[k]);
+    }
+    track.rangeStep = (rangeMax - track.rangeMin) / QUANTIZED_MAX;
+
+    for (unsigned int k : kept)
+    {
+        AddKeyTime(times[k]);
+        for (int c = 0; c < 3; c++)
+        {
+            keyValues.push_back(Quantize(values[k][c] - track.rangeMin[c], track.rangeStep[c]));
+        }
+    }
+
+    tracks.push_back(track);
+}
+
+
+void AnimationClip::AddRotationTrack(const std::vector<float> &times, const std::vector<glm::quat> &values, float tolerance)
+{
+    std::vector<unsigned int> kept = ReduceKeys(times, values, tolerance);
+
+    AnimationTrack track;
+    track.firstKey = static_cast<unsigned int>(keyTimes.size());
+    track.numKeys = static_cast<unsigned int>(kept.size());
+    track.rangeMin = glm::vec3(0);
+    track.rangeStep = glm::vec3(0);
+
+    for (unsigned int k : kept)
+    {
+        AddKeyTime(times[k]);
+
+        // Drop the largest component, made positive, since it follows from the others.
+        // Its index goes in the top bits of the first two values.
+        glm::quat q = values[k];
+        int largest = 0;
+        for (int c = 1; c < 4; c++)
+        {
+            if (std::abs(q[c]) > std::abs(q[largest]))
+                largest = c;
+        }
+        if (q[largest] < 0)
+            q = -q;
+
+        uint16_t smallest[3];
+        for (int c = 0, s = 0; c < 4; c++)
+        {
+            if (c == largest)
+                continue;
+            float normalized = glm::clamp(q[c] / ROTATION_RANGE * 0.5f + 0.5f, 0.0f, 1.0f);
+            smallest[s++] = static_cast<uint16_t>(std::floor(normalized * ROTATION_MAX + 0.5f));
+        }
+
+        keyValues.push_back(smallest[0] | ((largest & 1) << 15));
+        keyValues.push_back(smallest[1] | ((largest >> 1) << 15));
+        keyValues.push_back(smallest[2]);
+    }
+
+    tracks.push_back(track);
+}
+
+
+void AnimationClip::AddKeyTime(float time)
+{
+    keyTimes.push_back(Quantize(time, timeScale > 0 ? 1.0f / timeScale : 0.0f));
+}
+
+
+const std::string &AnimationClip::GetName() const
+{
+    return name;
+}
+
+
+float AnimationClip::GetDuration() const
+{
+    return duration;
+}
+
+
+unsigned int AnimationClip::GetNumberOfNodes() const
+{
+    return static_cast<unsigned int>(nodeChannels.size());
+}
+
+
+unsigned int AnimationClip::GetNumberOfChannels() const
+{
+    return static_cast<unsigned int>(tracks.size() / TRACKS_PER_CHANNEL);
+}
+
+
+int AnimationClip::GetNodeChannel(unsigned int nodeIndex) const
+{
+    return nodeIndex < nodeChannels.size() ? nodeChannels[nodeIndex] : -1;
+}
+
+
+const AnimationTrack &AnimationClip::GetTrack(unsigned int channelIndex, unsigned int track) const
+{
+    return tracks[TRACKS_PER_CHANNEL * channelIndex + track];
+}
+
+
+glm::vec3 AnimationClip::SampleVector(const AnimationTrack &track, float time, unsigned int &cursor) const
+{
+    if (track.numKeys == 1)
+        return DecodeVector(track, track.firstKey);
+
+    float factor;
+    unsigned int k = track.firstKey + FindKey(track, time, cursor, factor);
+    return glm::mix(DecodeVector(track, k), DecodeVector(track, k + 1), factor);
+}
+
+
+glm::quat AnimationClip::SampleRotation(const AnimationTrack &track, float time, unsigned int &cursor) const
+{
+    if (track.numKeys == 1)
+        return DecodeRotation(track.firstKey);
+
+    float factor;
+    unsigned int k = track.firstKey + FindKey(track, time, cursor, factor);
+    return Interpolate(DecodeRotation(k), DecodeRotation(k + 1), factor);
+}
+
+
+unsigned int AnimationClip::FindKey(const AnimationTrack &track, float time, unsigned int &cursor, float &factor) const
+{
+    const uint16_t *times = &keyTimes[track.firstKey];
+    unsigned int last = track.numKeys - 2;
+    unsigned int k = cursor;
+
+    // Compare in quantized units, as the keys are stored
+    float t = time * timeScale;
+
+    // Playing forward usually stays on the same key or moves to the next one
+    bool found = false;
+    if (k <= last && times[k] <= t)
+    {
+        for (unsigned int step = 0; ; step++)
+        {
+            if (k == last || t < times[k + 1])
+            {
+                found = true;
+                break;
+            }
+            if (step == MAX_CURSOR_STEPS)
+                break;
+            k++;
+        }
+    }
+
+    // Search the keys after the first and before the last, so the result has a successor
+    if (!found)
+        k = static_cast<unsigned int>(std::upper_bound(times + 1, times + last + 1, t) - times) - 1;
+
+    cursor = k;
+
+    float length = (float)times[k + 1] - times[k];
+    factor = length > 0 ? glm::clamp((t - times[k]) / length, 0.0f, 1.0f) : 0.0f;
+    return k;
+}
+
+
+glm::vec3 AnimationClip::DecodeVector(const AnimationTrack &track, unsigned int key) const
+{
+    const uint16_t *value = &keyValues[3 * key];
+    return track.rangeMin + track.rangeStep * glm::vec3(value[0], value[1], value[2]);
+}
+
+
+glm::quat AnimationClip::DecodeRotation(unsigned int key) const
+{
+    const uint16_t *value = &keyValues[3 * key];
+    int largest = (value[0] >> 15) | ((value[1] >> 15) << 1);
+
+    float smallest[3];
+    float sum = 0;
+    for (int s = 0; s < 3; s++)
+    {
+        smallest[s] = ((value[s] & 0x7FFF) / ROTATION_MAX * 2.0f - 1.0f) * ROTATION_RANGE;
+        sum += smallest[s] * smallest[s];
+    }
+
+    glm::quat q;
+    for (int c = 0, s = 0; c < 4; c++)
+    {
+        q[c] = c == largest ? std::sqrt(glm::max(1.0f - sum, 0.0f)) : smallest[s++];
+    }
+    return q;
+}
+
+
+size_t AnimationClip::GetMemoryUsage() const
+{
+    return sizeof(*this) + name.capacity() +
+        tracks.capacity() * sizeof(AnimationTrack) +
+        keyTimes.capacity() * sizeof(uint16_t) +
+        keyValues.capacity() * sizeof(uint16_t) +
+        nodeChannels.capacity() * sizeof(int);
+}
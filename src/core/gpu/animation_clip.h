@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "utils/glm_utils.h"
+
+#include "assimp/scene.h"
+
+
+// Keys of one position, rotation or scaling track, stored at
+// [firstKey, firstKey + numKeys) in the key arrays of its clip
+struct AnimationTrack
+{
+    unsigned int firstKey;
+    unsigned int numKeys;
+
+    // Positions and scalings are quantized over the box from `rangeMin`,
+    // with `rangeStep` between consecutive values. Unused by rotations.
+    glm::vec3 rangeMin;
+    glm::vec3 rangeStep;
+};
+
+
+// Keyframe animation of a node hierarchy. Nodes are numbered in depth-first
+// order, parents before their children, and each is bound to the channel
+// animating it when the clip is loaded, so sampling never compares names.
+// Every channel has a position, a rotation and a scaling track, whose keys
+// share two contiguous arrays: times, as 16-bit fractions of the duration,
+// and values, as three 16-bit integers each. Rotations keep their three
+// smallest components, positions and scalings their offset in the range of
+// the track. Keys that interpolating their neighbours reproduces within a
+// tolerance are dropped, and constant tracks keep a single key.
+class AnimationClip
+{
+ public:
+    AnimationClip();
+
+    // Compresses the keys of `animation` and binds its channels to the nodes
+    // under `rootNode`. Dropped keys may be off by `tolerance`, in scene units
+    // for positions, radians for rotations and as a factor for scalings.
+    bool Init(const aiAnimation *animation, const aiNode *rootNode, float tolerance = 0.001f);
+
+    // Clip `index` of the scene imported from `filePath`. Meshes loaded from
+    // the same file share their clips, built by the first one. Thread safe.
+    static std::shared_ptr<const AnimationClip> Load(const std::string &filePath, unsigned int index, const aiScene *scene);
+
+    // Makes later loads of `filePath` build new clips, as after it changed.
+    // Clips already loaded are kept by their users.
+    static void Invalidate(const std::string &filePath);
+
+    const std::string &GetName() const;
+
+    // In seconds
+    float GetDuration() const;
+
+    unsigned int GetNumberOfNodes() const;
+    unsigned int GetNumberOfChannels() const;
+
+    // Index of the channel animating node `nodeIndex`, or -1 if none does
+    int GetNodeChannel(unsigned int nodeIndex) const;
+
+    // Track `track` of channel `channelIndex`, one of the *_TRACK constants
+    const AnimationTrack &GetTrack(unsigned int channelIndex, unsigned int track) const;
+
+    // Samples a track at `time` seconds. `cursor` holds the key the previous
+    // lookup of the track ended on; playing forward walks it at most
+    // MAX_CURSOR_STEPS keys, any other jump falls back to a binary search.
+    glm::vec3 SampleVector(const AnimationTrack &track, float time, unsigned int &cursor) const;
+    glm::quat SampleRotation(const AnimationTrack &track, float time, unsigned int &cursor) const;
+
+    // Bytes taken by the keys and the bindings
+    size_t GetMemoryUsage() const;
+
+    static const unsigned int POSITION_TRACK = 0;
+    static const unsigned int ROTATION_TRACK = 1;
+    static const unsigned int SCALING_TRACK = 2;
+    static const unsigned int TRACKS_PER_CHANNEL = 3;
+
+    static const unsigned int MAX_CURSOR_STEPS = 4;
+
+ private:
+    void BindNodes(const aiAnimation *animation, const aiNode *node);
+
+    void AddVectorTrack(const std::vector<float> &times, const std::vector<glm::vec3> &values, float tolerance);
+    void AddRotationTrack(const std::vector<float> &times, const std::vector<glm::quat> &values, float tolerance);
+    void AddKeyTime(float time);
+
+    // Key `k` of `track`, relative to its first key, with keyTimes[k] <= time < keyTimes[k + 1]
+    // clamped to the keys that have a successor, and the blend factor towards the next one
+    unsigned int FindKey(const AnimationTrack &track, float time, unsigned int &cursor, float &factor) const;
+
+    glm::vec3 DecodeVector(const AnimationTrack &track, unsigned int key) const;
+    glm::quat DecodeRotation(unsigned int key) const;
+
+ private:
+    std::string name;
+    float duration;
+
+    // Quantized time units per second
+    float timeScale;
+
+    std::vector<AnimationTrack> tracks;
+    std::vector<uint16_t> keyTimes;
+    std::vector<uint16_t> keyValues;
+
+    std::vector<int> nodeChannels;
+};
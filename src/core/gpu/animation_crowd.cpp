@@ -0,0 +1,188 @@
+#include "core/gpu/animation_crowd.h"
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+#include "core/gpu/animation_instance.h"
+#include "utils/gl_utils.h"
+
+
+// Layout of the instance buffer
+struct CrowdVertex
+{
+    glm::mat4 modelMatrix;
+
+    // Clip, time offset and speed
+    glm::vec4 animation;
+};
+
+
+AnimationCrowd::AnimationCrowd()
+{
+    mesh = nullptr;
+    framesPerSecond = 0;
+    paletteTexture = 0;
+    instanceBuffer = 0;
+    nrInstances = 0;
+    instanceCapacity = 0;
+}
+
+
+AnimationCrowd::~AnimationCrowd()
+{
+    glDeleteTextures(1, &paletteTexture);
+    glDeleteBuffers(1, &instanceBuffer);
+}
+
+
+bool AnimationCrowd::Init(Mesh *mesh, float framesPerSecond)
+{
+    if (!mesh || !mesh->GetBuffers() || mesh->GetBuffers()->m_VAO == 0 || framesPerSecond <= 0)
+        return false;
+
+    unsigned int nrClips = MIN((unsigned int)mesh->animations.size(), MAX_CLIPS);
+    unsigned int nrBones = mesh->skeleton.GetNumberOfBones();
+    if (nrClips == 0 || nrBones == 0)
+    {
+        std::cout << "Crowd mesh " << mesh->GetMeshID() << " has no animations to bake" << std::endl;
+        return false;
+    }
+
+    this->mesh = mesh;
+    this->framesPerSecond = framesPerSecond;
+
+    // One more frame than the duration covers, so the last frame blends into the loop
+    clipRanges.clear();
+    unsigned int nrFrames = 0;
+    for (unsigned int i = 0; i < nrClips; i++)
+    {
+        float duration = mesh->animations[i]->GetDuration();
+        unsigned int clipFrames = (unsigned int)std::ceil(duration * framesPerSecond) + 1;
+        clipRanges.push_back(glm::vec4(nrFrames, clipFrames, duration, 0));
+        nrFrames += clipFrames;
+    }
+
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    unsigned int width = 3 * nrBones;
+    if (width > (unsigned int)maxSize || nrFrames > (unsigned int)maxSize)
+    {
+        std::cout << "Crowd bone palette of " << width << "x" << nrFrames << " texels is too large" << std::endl;
+        return false;
+    }
+
+    // Every frame is posed by an instance of its own, evaluated in parallel
+    std::vector<AnimationInstance> frames(nrFrames);
+    for (unsigned int i = 0; i < nrClips; i++)
+    {
+        const glm::vec4 &range = clipRanges[i];
+        for (unsigned int f = 0; f < (unsigned int)range.y; f++)
+        {
+            AnimationInstance &frame = frames[(unsigned int)range.x + f];
+            frame.SetClip(mesh->animations[i]);
+            frame.SetTime(f / framesPerSecond);
+        }
+    }
+    AnimationInstance::Evaluate(frames.data(), nrFrames, mesh->skeleton);
+
+    std::vector<glm::vec4> texels(width * nrFrames);
+    for (unsigned int f = 0; f < nrFrames; f++)
+    {
+        const std::vector<glm::mat4> &bones = frames[f].GetBoneTransforms();
+        glm::vec4 *row = &texels[f * width];
+        for (unsigned int b = 0; b < nrBones; b++)
+        {
+            glm::mat4 transposed = glm::transpose(bones[b]);
+            row[3 * b + 0] = transposed[0];
+            row[3 * b + 1] = transposed[1];
+            row[3 * b + 2] = transposed[2];
+        }
+    }
+
+    if (paletteTexture == 0)
+        glGenTextures(1, &paletteTexture);
+
+    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, nrFrames, 0, GL_RGBA, GL_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (instanceBuffer == 0)
+        glGenBuffers(1, &instanceBuffer);
+
+    // The attributes advance once per instance
+    glBindVertexArray(mesh->GetBuffers()->m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (unsigned int c = 0; c < 4; c++)
+    {
+        glEnableVertexAttribArray(INSTANCE_LOCATION + c);
+        glVertexAttribPointer(INSTANCE_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdVertex), (void*)(sizeof(glm::vec4) * c));
+        glVertexAttribDivisor(INSTANCE_LOCATION + c, 1);
+    }
+    glEnableVertexAttribArray(INSTANCE_LOCATION + 4);
+    glVertexAttribPointer(INSTANCE_LOCATION + 4, 3, GL_FLOAT, GL_FALSE, sizeof(CrowdVertex), (void*)offsetof(CrowdVertex, animation));
+    glVertexAttribDivisor(INSTANCE_LOCATION + 4, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    CheckOpenGLError();
+    return true;
+}
+
+
+void AnimationCrowd::SetInstances(const std::vector<CrowdInstance> &instances)
+{
+    if (instanceBuffer == 0)
+        return;
+
+    std::vector<CrowdVertex> vertices(instances.size());
+    for (unsigned int i = 0; i < instances.size(); i++)
+    {
+        const CrowdInstance &instance = instances[i];
+        vertices[i].modelMatrix = instance.modelMatrix;
+        vertices[i].animation = glm::vec4(MIN(instance.clip, (unsigned int)clipRanges.size() - 1), instance.timeOffset, instance.speed, 0);
+    }
+
+    nrInstances = (unsigned int)instances.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    if (nrInstances > instanceCapacity)
+    {
+        instanceCapacity = nrInstances;
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CrowdVertex) * instanceCapacity, vertices.data(), GL_STATIC_DRAW);
+    }
+    else if (nrInstances)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(CrowdVertex) * nrInstances, vertices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+unsigned int AnimationCrowd::GetNumberOfInstances() const
+{
+    return nrInstances;
+}
+
+
+void AnimationCrowd::Render(Shader *shader, float time) const
+{
+    if (!mesh || !shader || !shader->program || nrInstances == 0)
+        return;
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(shader->program, "bone_palette"), 1);
+    glUniform1i(glGetUniformLocation(shader->program, "u_texture_0"), 0);
+    glUniform4fv(glGetUniformLocation(shader->program, "clip_ranges"), (GLsizei)clipRanges.size(), glm::value_ptr(clipRanges[0]));
+    glUniform1f(glGetUniformLocation(shader->program, "frames_per_second"), framesPerSecond);
+    glUniform1f(glGetUniformLocation(shader->program, "time"), time);
+
+    mesh->RenderInstanced(nrInstances);
+}
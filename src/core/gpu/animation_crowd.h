@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "utils/glm_utils.h"
+
+
+// One character of a crowd
+struct CrowdInstance
+{
+    CrowdInstance()
+    {
+        modelMatrix = glm::mat4(1);
+        clip = 0;
+        timeOffset = 0;
+        speed = 1;
+    }
+
+    glm::mat4 modelMatrix;
+
+    // Index of the clip played, among the animations of the mesh
+    unsigned int clip;
+
+    // Seconds added to the time of the crowd, so characters are out of step
+    float timeOffset;
+
+    // Playback rate
+    float speed;
+};
+
+
+// Draws many animated copies of a skinned mesh with one instanced call. The
+// bone palettes of every clip are baked once, at a fixed frame rate, into a
+// float texture with a row per frame and three texels per bone, holding the
+// rows of its affine transform. Each instance carries its transform, clip and
+// time offset; Skinning.Crowd.VS.glsl blends the two frames around its time.
+class AnimationCrowd
+{
+ public:
+    AnimationCrowd();
+    ~AnimationCrowd();
+
+    // Bakes every clip of `mesh`, which must outlive the crowd, and adds the
+    // instance attributes to its VAO from INSTANCE_LOCATION on
+    bool Init(Mesh *mesh, float framesPerSecond = 30);
+
+    void SetInstances(const std::vector<CrowdInstance> &instances);
+    unsigned int GetNumberOfInstances() const;
+
+    // Draws every instance at `time` seconds, with `shader` in use. The bone
+    // palette is bound to texture unit 1, unit 0 is left to the mesh materials.
+    void Render(Shader *shader, float time) const;
+
+    // Clips beyond this many are not baked
+    static const unsigned int MAX_CLIPS = 16;
+
+    // First of the five locations taken by the instance attributes: four
+    // for the model matrix, then the clip, time offset and speed
+    static const unsigned int INSTANCE_LOCATION = 6;
+
+ private:
+    AnimationCrowd(const AnimationCrowd &) = delete;
+    AnimationCrowd &operator=(const AnimationCrowd &) = delete;
+
+ private:
+    Mesh *mesh;
+    float framesPerSecond;
+
+    GLuint paletteTexture;
+    GLuint instanceBuffer;
+    unsigned int nrInstances;
+    unsigned int instanceCapacity;
+
+    // First row, number of frames and duration of each baked clip
+    std::vector<glm::vec4> clipRanges;
+};
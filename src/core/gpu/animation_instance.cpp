@@ -0,0 +1,150 @@
+#include "core/gpu/animation_instance.h"
+
+#include <cmath>
+#include <utility>
+
+#include "utils/thread_utils.h"
+
+
+AnimationInstance::AnimationInstance()
+{
+    time = 0;
+}
+
+
+void AnimationInstance::SetClip(std::shared_ptr<const AnimationClip> clip)
+{
+    this->clip = std::move(clip);
+    time = 0;
+    cursors.assign(this->clip ? AnimationClip::TRACKS_PER_CHANNEL * this->clip->GetNumberOfChannels() : 0, 0);
+}
+
+
+const AnimationClip *AnimationInstance::GetClip() const
+{
+    return clip.get();
+}
+
+
+void AnimationInstance::SetTime(float seconds)
+{
+    float duration = clip ? clip->GetDuration() : 0;
+    if (duration <= 0)
+    {
+        time = 0;
+        return;
+    }
+
+    time = std::fmod(seconds, duration);
+    if (time < 0)
+        time += duration;
+}
+
+
+void AnimationInstance::Advance(float deltaTime)
+{
+    SetTime(time + deltaTime);
+}
+
+
+float AnimationInstance::GetTime() const
+{
+    return time;
+}
+
+
+bool AnimationInstance::SampleNode(unsigned int nodeIndex, glm::vec3 &position, glm::quat &rotation, glm::vec3 &scaling)
+{
+    int channelIndex = clip ? clip->GetNodeChannel(nodeIndex) : -1;
+    if (channelIndex < 0)
+        return false;
+
+    unsigned int *cursor = &cursors[AnimationClip::TRACKS_PER_CHANNEL * channelIndex];
+    position = clip->SampleVector(clip->GetTrack(channelIndex, AnimationClip::POSITION_TRACK), time, cursor[0]);
+    rotation = clip->SampleRotation(clip->GetTrack(channelIndex, AnimationClip::ROTATION_TRACK), time, cursor[1]);
+    scaling = clip->SampleVector(clip->GetTrack(channelIndex, AnimationClip::SCALING_TRACK), time, cursor[2]);
+    return true;
+}
+
+
+void AnimationInstance::SamplePose(Pose &pose, const Pose &bindPose)
+{
+    glm::vec3 position, scaling;
+    glm::quat rotation;
+
+    for (unsigned int i = 0; i < pose.nrNodes; i++)
+    {
+        if (SampleNode(i, position, rotation, scaling))
+        {
+            pose.SetNode(i, position, rotation, scaling);
+            continue;
+        }
+
+        pose.translationX[i] = bindPose.translationX[i];
+        pose.translationY[i] = bindPose.translationY[i];
+        pose.translationZ[i] = bindPose.translationZ[i];
+        pose.rotationX[i] = bindPose.rotationX[i];
+        pose.rotationY[i] = bindPose.rotationY[i];
+        pose.rotationZ[i] = bindPose.rotationZ[i];
+        pose.rotationW[i] = bindPose.rotationW[i];
+        pose.scalingX[i] = bindPose.scalingX[i];
+        pose.scalingY[i] = bindPose.scalingY[i];
+        pose.scalingZ[i] = bindPose.scalingZ[i];
+    }
+}
+
+
+void AnimationInstance::Evaluate(const Skeleton &skeleton)
+{
+    unsigned int nrNodes = skeleton.GetNumberOfNodes();
+    localTransforms.resize(nrNodes);
+    modelTransforms.resize(nrNodes);
+    boneTransforms.resize(skeleton.GetNumberOfBones());
+
+    glm::vec3 position, scaling;
+    glm::quat rotation;
+
+    // Nodes without a channel keep their bind transform
+    for (unsigned int i = 0; i < nrNodes; i++)
+    {
+        if (!SampleNode(i, position, rotation, scaling))
+        {
+            localTransforms[i] = skeleton.GetBindTransform(i);
+            continue;
+        }
+
+        glm::mat4 &local = localTransforms[i];
+        local = glm::mat4_cast(rotation);
+        local[0] *= scaling.x;
+        local[1] *= scaling.y;
+        local[2] *= scaling.z;
+        local[3] = glm::vec4(position, 1);
+    }
+
+    skeleton.ComputeModelTransforms(localTransforms.data(), modelTransforms.data());
+    skeleton.ComputeBoneTransforms(modelTransforms.data(), boneTransforms.data());
+}
+
+
+void AnimationInstance::Evaluate(AnimationInstance *instances, unsigned int count, const Skeleton &skeleton)
+{
+    thread_utils::ParallelFor(0, count, INSTANCES_PER_JOB, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            instances[i].Evaluate(skeleton);
+        }
+    });
+}
+
+
+const std::vector<glm::mat4> &AnimationInstance::GetModelTransforms() const
+{
+    return modelTransforms;
+}
+
+
+const std::vector<glm::mat4> &AnimationInstance::GetBoneTransforms() const
+{
+    return boneTransforms;
+}
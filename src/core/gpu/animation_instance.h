@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "core/gpu/animation_clip.h"
+#include "core/gpu/animation_pose.h"
+#include "core/gpu/skeleton.h"
+
+
+// Playback of a clip by one character. Each track remembers the key its last
+// lookup ended on, so playing forward finds the next key in a step or two.
+// Jumps, like seeking or looping, fall back to a binary search. Many
+// instances can share a clip, and keep it alive.
+class AnimationInstance
+{
+ public:
+    AnimationInstance();
+
+    void SetClip(std::shared_ptr<const AnimationClip> clip);
+    const AnimationClip *GetClip() const;
+
+    // Times wrap around the duration of the clip
+    void SetTime(float seconds);
+    void Advance(float deltaTime);
+    float GetTime() const;
+
+    // Samples the local transform of node `nodeIndex` at the current time.
+    // Returns false, leaving the outputs untouched, if no channel animates it.
+    bool SampleNode(unsigned int nodeIndex, glm::vec3 &position, glm::quat &rotation, glm::vec3 &scaling);
+
+    // Samples every node into `pose` at the current time. Nodes without a
+    // channel take their transform from `bindPose`.
+    void SamplePose(Pose &pose, const Pose &bindPose);
+
+    // Poses `skeleton` at the current time. Its buffers only grow, so evaluating
+    // the same skeleton again does not allocate.
+    void Evaluate(const Skeleton &skeleton);
+
+    // Evaluates `count` instances of `skeleton` in parallel on the shared thread pool
+    static void Evaluate(AnimationInstance *instances, unsigned int count, const Skeleton &skeleton);
+
+    // Results of the last evaluation, one per node and one per bone
+    const std::vector<glm::mat4> &GetModelTransforms() const;
+    const std::vector<glm::mat4> &GetBoneTransforms() const;
+
+    // Instances evaluated by each job of the parallel evaluation
+    static const unsigned int INSTANCES_PER_JOB = 8;
+
+ private:
+    std::shared_ptr<const AnimationClip> clip;
+    float time;
+
+    // Position, rotation and scaling cursors of each channel
+    std::vector<unsigned int> cursors;
+
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> modelTransforms;
+    std::vector<glm::mat4> boneTransforms;
+};
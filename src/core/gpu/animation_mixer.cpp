@@ -0,0 +1,229 @@
+#include "core/gpu/animation_mixer.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/math_utils.h"
+
+
+AnimationMixer::AnimationMixer()
+{
+    skeleton = nullptr;
+    maxLayers = 0;
+    bindPose = nullptr;
+    result = nullptr;
+}
+
+
+bool AnimationMixer::Init(const Skeleton *skeleton, unsigned int maxLayers)
+{
+    if (!skeleton || skeleton->GetNumberOfNodes() == 0 || maxLayers == 0)
+        return false;
+
+    this->skeleton = skeleton;
+    this->maxLayers = maxLayers;
+
+    // The bind pose, the result and two poses to sample into, then the two
+    // references of each layer
+    unsigned int nrNodes = skeleton->GetNumberOfNodes();
+    pool.Init(nrNodes, 4 + 2 * maxLayers);
+    bindPose = pool.Acquire();
+    result = pool.Acquire();
+
+    glm::vec3 translation, scaling;
+    glm::quat rotation;
+    for (unsigned int i = 0; i < nrNodes; i++)
+    {
+        Pose::Decompose(skeleton->GetBindTransform(i), translation, rotation, scaling);
+        bindPose->SetNode(i, translation, rotation, scaling);
+    }
+
+    layers.clear();
+    layers.reserve(maxLayers);
+    weights.assign((nrNodes + 3) & ~3u, 0.0f);
+
+    localTransforms.resize(nrNodes);
+    modelTransforms.resize(nrNodes);
+    boneTransforms.resize(skeleton->GetNumberOfBones());
+    return true;
+}
+
+
+int AnimationMixer::AddLayer(bool additive)
+{
+    if (layers.size() >= maxLayers)
+        return -1;
+
+    layers.push_back(Layer());
+    Layer &layer = layers.back();
+    layer.weight = 1;
+    layer.fadeTime = 0;
+    layer.fadeDuration = 0;
+    layer.additive = additive;
+    layer.mask.assign(weights.size(), 1.0f);
+    layer.reference = additive ? pool.Acquire() : nullptr;
+    layer.previousReference = additive ? pool.Acquire() : nullptr;
+
+    return static_cast<int>(layers.size()) - 1;
+}
+
+
+unsigned int AnimationMixer::GetNumberOfLayers() const
+{
+    return static_cast<unsigned int>(layers.size());
+}
+
+
+void AnimationMixer::Play(unsigned int layerIndex, std::shared_ptr<const AnimationClip> clip, float fadeDuration)
+{
+    if (layerIndex >= layers.size())
+        return;
+
+    Layer &layer = layers[layerIndex];
+
+    // The clip playing now becomes the one faded from
+    if (fadeDuration > 0 && layer.current.GetClip())
+    {
+        std::swap(layer.current, layer.previous);
+        std::swap(layer.reference, layer.previousReference);
+    }
+    else
+    {
+        layer.previous.SetClip(nullptr);
+    }
+    layer.fadeTime = 0;
+    layer.fadeDuration = fadeDuration;
+
+    layer.current.SetClip(std::move(clip));
+    if (layer.additive && layer.current.GetClip())
+        layer.current.SamplePose(*layer.reference, *bindPose);
+}
+
+
+const AnimationClip *AnimationMixer::GetClip(unsigned int layer) const
+{
+    return layer < layers.size() ? layers[layer].current.GetClip() : nullptr;
+}
+
+
+void AnimationMixer::SetLayerWeight(unsigned int layer, float weight)
+{
+    if (layer < layers.size())
+        layers[layer].weight = MIN(MAX(weight, 0.0f), 1.0f);
+}
+
+
+void AnimationMixer::SetLayerMask(unsigned int layer, int nodeIndex)
+{
+    if (layer >= layers.size())
+        return;
+
+    std::vector<float> &mask = layers[layer].mask;
+    if (nodeIndex < 0 || nodeIndex >= (int)skeleton->GetNumberOfNodes())
+    {
+        std::fill(mask.begin(), mask.end(), 1.0f);
+        return;
+    }
+
+    std::fill(mask.begin(), mask.end(), 0.0f);
+    std::fill(mask.begin() + nodeIndex, mask.begin() + skeleton->GetSubtreeEnd(nodeIndex), 1.0f);
+}
+
+
+void AnimationMixer::SetLayerMask(unsigned int layer, const std::vector<float> &nodeWeights)
+{
+    if (layer >= layers.size())
+        return;
+
+    std::vector<float> &mask = layers[layer].mask;
+    std::fill(mask.begin(), mask.end(), 0.0f);
+    std::copy(nodeWeights.begin(), nodeWeights.begin() + MIN(nodeWeights.size(), mask.size()), mask.begin());
+}
+
+
+void AnimationMixer::Update(float deltaTime)
+{
+    for (Layer &layer : layers)
+    {
+        layer.current.Advance(deltaTime);
+        if (layer.fadeTime >= layer.fadeDuration)
+            continue;
+
+        layer.previous.Advance(deltaTime);
+        layer.fadeTime += deltaTime;
+        if (layer.fadeTime >= layer.fadeDuration)
+            layer.previous.SetClip(nullptr);
+    }
+}
+
+
+float AnimationMixer::SampleLayer(Layer &layer, Pose &pose, Pose &scratch)
+{
+    layer.current.SamplePose(pose, *bindPose);
+    if (layer.additive)
+        pose_utils::MakeAdditive(pose, pose, *layer.reference);
+
+    if (layer.fadeTime >= layer.fadeDuration)
+        return 1;
+
+    // Fading in from nothing lowers the weight of the layer instead
+    float fade = layer.fadeTime / layer.fadeDuration;
+    if (!layer.previous.GetClip())
+        return fade;
+
+    layer.previous.SamplePose(scratch, *bindPose);
+    if (layer.additive)
+        pose_utils::MakeAdditive(scratch, scratch, *layer.previousReference);
+
+    std::fill(weights.begin(), weights.end(), fade);
+    pose_utils::Blend(pose, scratch, pose, weights.data());
+    return 1;
+}
+
+
+void AnimationMixer::Evaluate()
+{
+    if (!skeleton)
+        return;
+
+    result->CopyFrom(*bindPose);
+
+    Pose *pose = pool.Acquire();
+    Pose *scratch = pool.Acquire();
+
+    for (Layer &layer : layers)
+    {
+        if (layer.weight <= 0 || !layer.current.GetClip())
+            continue;
+
+        float weight = layer.weight * SampleLayer(layer, *pose, *scratch);
+        for (unsigned int i = 0; i < weights.size(); i++)
+        {
+            weights[i] = weight * layer.mask[i];
+        }
+
+        if (layer.additive)
+            pose_utils::AddAdditive(*result, *result, *pose, weights.data());
+        else
+            pose_utils::Blend(*result, *result, *pose, weights.data());
+    }
+
+    pool.Release(scratch);
+    pool.Release(pose);
+
+    result->ComputeLocalTransforms(localTransforms.data());
+    skeleton->ComputeModelTransforms(localTransforms.data(), modelTransforms.data());
+    skeleton->ComputeBoneTransforms(modelTransforms.data(), boneTransforms.data());
+}
+
+
+const std::vector<glm::mat4> &AnimationMixer::GetModelTransforms() const
+{
+    return modelTransforms;
+}
+
+
+const std::vector<glm::mat4> &AnimationMixer::GetBoneTransforms() const
+{
+    return boneTransforms;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "core/gpu/animation_instance.h"
+#include "core/gpu/animation_pose.h"
+#include "core/gpu/skeleton.h"
+
+
+// Layered playback of several clips on one skeleton. Each layer plays a clip
+// and crossfades from the previous one when another starts; layers apply in
+// the order they were added, on top of the bind pose. An override layer
+// blends towards its pose, an additive one adds its difference from the first
+// frame of its clip. A mask weighs the layer per node, to drive a subtree
+// only. Every pose comes from a pool sized by Init, so playing, blending and
+// evaluating do not allocate once the clips have been started.
+class AnimationMixer
+{
+ public:
+    AnimationMixer();
+
+    // Allocates the buffers for up to `maxLayers` layers. `skeleton` must
+    // outlive the mixer.
+    bool Init(const Skeleton *skeleton, unsigned int maxLayers = 4);
+
+    // Returns the index of the new layer, or -1 once `maxLayers` are in use
+    int AddLayer(bool additive = false);
+    unsigned int GetNumberOfLayers() const;
+
+    // Starts `clip` on `layer`, fading it in over `fadeDuration` seconds
+    void Play(unsigned int layer, std::shared_ptr<const AnimationClip> clip, float fadeDuration = 0);
+    const AnimationClip *GetClip(unsigned int layer) const;
+
+    void SetLayerWeight(unsigned int layer, float weight);
+
+    // Restricts the layer to the subtree under `nodeIndex`, or lifts the mask for -1
+    void SetLayerMask(unsigned int layer, int nodeIndex);
+
+    // Weighs the layer by one factor per node
+    void SetLayerMask(unsigned int layer, const std::vector<float> &nodeWeights);
+
+    void Update(float deltaTime);
+
+    // Blends the layers at their current times and poses the skeleton
+    void Evaluate();
+
+    // Results of the last evaluation, one per node and one per bone
+    const std::vector<glm::mat4> &GetModelTransforms() const;
+    const std::vector<glm::mat4> &GetBoneTransforms() const;
+
+ private:
+    AnimationMixer(const AnimationMixer &) = delete;
+    AnimationMixer &operator=(const AnimationMixer &) = delete;
+
+    struct Layer
+    {
+        AnimationInstance current;
+        AnimationInstance previous;
+
+        float weight;
+        float fadeTime;
+        float fadeDuration;
+        bool additive;
+
+        std::vector<float> mask;
+
+        // First frames of the current and previous clips of an additive layer
+        Pose *reference;
+        Pose *previousReference;
+    };
+
+    // Samples the layer into `pose`, crossfading through `scratch`. Returns
+    // the weight the fade leaves to the layer.
+    float SampleLayer(Layer &layer, Pose &pose, Pose &scratch);
+
+ private:
+    const Skeleton *skeleton;
+    unsigned int maxLayers;
+
+    PosePool pool;
+    Pose *bindPose;
+    Pose *result;
+
+    std::vector<Layer> layers;
+    std::vector<float> weights;
+
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> modelTransforms;
+    std::vector<glm::mat4> boneTransforms;
+};
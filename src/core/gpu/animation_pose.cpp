@@ -0,0 +1,310 @@
+#include "core/gpu/animation_pose.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/simd_utils.h"
+
+
+static unsigned int GetStride(unsigned int nrNodes)
+{
+    return (nrNodes + 3) & ~3u;
+}
+
+
+void Pose::SetNode(unsigned int nodeIndex, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scaling)
+{
+    translationX[nodeIndex] = translation.x;
+    translationY[nodeIndex] = translation.y;
+    translationZ[nodeIndex] = translation.z;
+    rotationX[nodeIndex] = rotation.x;
+    rotationY[nodeIndex] = rotation.y;
+    rotationZ[nodeIndex] = rotation.z;
+    rotationW[nodeIndex] = rotation.w;
+    scalingX[nodeIndex] = scaling.x;
+    scalingY[nodeIndex] = scaling.y;
+    scalingZ[nodeIndex] = scaling.z;
+}
+
+
+void Pose::CopyFrom(const Pose &other)
+{
+    // The arrays of a pose are contiguous
+    std::copy(other.translationX, other.translationX + NR_ARRAYS * GetStride(nrNodes), translationX);
+}
+
+
+void Pose::ComputeLocalTransforms(glm::mat4 *localTransforms) const
+{
+    for (unsigned int i = 0; i < nrNodes; i++)
+    {
+        glm::mat4 &local = localTransforms[i];
+        local = glm::mat4_cast(glm::quat(rotationW[i], rotationX[i], rotationY[i], rotationZ[i]));
+        local[0] *= scalingX[i];
+        local[1] *= scalingY[i];
+        local[2] *= scalingZ[i];
+        local[3] = glm::vec4(translationX[i], translationY[i], translationZ[i], 1);
+    }
+}
+
+
+void Pose::Decompose(const glm::mat4 &transform, glm::vec3 &translation, glm::quat &rotation, glm::vec3 &scaling)
+{
+    translation = glm::vec3(transform[3]);
+    scaling = glm::vec3(glm::length(glm::vec3(transform[0])),
+                        glm::length(glm::vec3(transform[1])),
+                        glm::length(glm::vec3(transform[2])));
+
+    glm::mat3 axes(transform);
+    for (int c = 0; c < 3; c++)
+    {
+        if (scaling[c] > 0)
+            axes[c] /= scaling[c];
+    }
+    rotation = glm::normalize(glm::quat_cast(axes));
+}
+
+
+PosePool::PosePool()
+{
+}
+
+
+void PosePool::Init(unsigned int nrNodes, unsigned int capacity)
+{
+    unsigned int stride = GetStride(nrNodes);
+    storage.assign(Pose::NR_ARRAYS * stride * capacity, 0.0f);
+    poses.resize(capacity);
+    freePoses.clear();
+    freePoses.reserve(capacity);
+
+    for (unsigned int p = 0; p < capacity; p++)
+    {
+        float *arrays[Pose::NR_ARRAYS];
+        for (unsigned int a = 0; a < Pose::NR_ARRAYS; a++)
+        {
+            arrays[a] = &storage[(p * Pose::NR_ARRAYS + a) * stride];
+        }
+
+        Pose &pose = poses[p];
+        pose.translationX = arrays[0];
+        pose.translationY = arrays[1];
+        pose.translationZ = arrays[2];
+        pose.rotationX = arrays[3];
+        pose.rotationY = arrays[4];
+        pose.rotationZ = arrays[5];
+        pose.rotationW = arrays[6];
+        pose.scalingX = arrays[7];
+        pose.scalingY = arrays[8];
+        pose.scalingZ = arrays[9];
+        pose.nrNodes = nrNodes;
+
+        freePoses.push_back(&pose);
+    }
+}
+
+
+Pose *PosePool::Acquire()
+{
+    if (freePoses.empty())
+        return nullptr;
+
+    Pose *pose = freePoses.back();
+    freePoses.pop_back();
+    return pose;
+}
+
+
+void PosePool::Release(Pose *pose)
+{
+    // Fits in the capacity reserved by Init
+    if (pose)
+        freePoses.push_back(pose);
+}
+
+
+unsigned int PosePool::GetNumberOfFree() const
+{
+    return static_cast<unsigned int>(freePoses.size());
+}
+
+
+// The poses are padded to a multiple of four nodes
+typedef simd_utils::ScalarLanes ScalarPoseLanes;
+typedef simd_utils::SIMD4Lanes SIMDPoseLanes;
+
+
+// a + (b - a) * t
+template <typename L>
+static inline typename L::Type Lerp(typename L::Type a, typename L::Type b, typename L::Type t)
+{
+    return L::Add(a, L::Mul(L::Sub(b, a), t));
+}
+
+
+template <typename L>
+static inline void Normalize(typename L::Type &x, typename L::Type &y, typename L::Type &z, typename L::Type &w)
+{
+    typedef typename L::Type T;
+    T length = L::Sqrt(L::Add(L::Add(L::Mul(x, x), L::Mul(y, y)), L::Add(L::Mul(z, z), L::Mul(w, w))));
+    x = L::Div(x, length);
+    y = L::Div(y, length);
+    z = L::Div(z, length);
+    w = L::Div(w, length);
+}
+
+
+// Quaternion product a * b
+template <typename L>
+static inline void Multiply(typename L::Type ax, typename L::Type ay, typename L::Type az, typename L::Type aw,
+                            typename L::Type bx, typename L::Type by, typename L::Type bz, typename L::Type bw,
+                            typename L::Type &x, typename L::Type &y, typename L::Type &z, typename L::Type &w)
+{
+    x = L::Add(L::Add(L::Mul(aw, bx), L::Mul(ax, bw)), L::Sub(L::Mul(ay, bz), L::Mul(az, by)));
+    y = L::Add(L::Add(L::Mul(aw, by), L::Mul(ay, bw)), L::Sub(L::Mul(az, bx), L::Mul(ax, bz)));
+    z = L::Add(L::Add(L::Mul(aw, bz), L::Mul(az, bw)), L::Sub(L::Mul(ax, by), L::Mul(ay, bx)));
+    w = L::Sub(L::Mul(aw, bw), L::Add(L::Add(L::Mul(ax, bx), L::Mul(ay, by)), L::Mul(az, bz)));
+}
+
+
+// Processes nodes [begin, end) in steps of the lane width, and returns where it stopped
+template <typename L>
+static unsigned int BlendNodes(Pose &out, const Pose &a, const Pose &b, const float *weights, unsigned int begin, unsigned int end)
+{
+    typedef typename L::Type T;
+    T zero = L::Set(0.0f);
+
+    unsigned int i = begin;
+    for (; i + L::WIDTH <= end; i += L::WIDTH)
+    {
+        T t = L::Load(weights + i);
+
+        L::Store(out.translationX + i, Lerp<L>(L::Load(a.translationX + i), L::Load(b.translationX + i), t));
+        L::Store(out.translationY + i, Lerp<L>(L::Load(a.translationY + i), L::Load(b.translationY + i), t));
+        L::Store(out.translationZ + i, Lerp<L>(L::Load(a.translationZ + i), L::Load(b.translationZ + i), t));
+        L::Store(out.scalingX + i, Lerp<L>(L::Load(a.scalingX + i), L::Load(b.scalingX + i), t));
+        L::Store(out.scalingY + i, Lerp<L>(L::Load(a.scalingY + i), L::Load(b.scalingY + i), t));
+        L::Store(out.scalingZ + i, Lerp<L>(L::Load(a.scalingZ + i), L::Load(b.scalingZ + i), t));
+
+        // Normalized lerp along the shorter arc
+        T ax = L::Load(a.rotationX + i), ay = L::Load(a.rotationY + i), az = L::Load(a.rotationZ + i), aw = L::Load(a.rotationW + i);
+        T bx = L::Load(b.rotationX + i), by = L::Load(b.rotationY + i), bz = L::Load(b.rotationZ + i), bw = L::Load(b.rotationW + i);
+        T dot = L::Add(L::Add(L::Mul(ax, bx), L::Mul(ay, by)), L::Add(L::Mul(az, bz), L::Mul(aw, bw)));
+        T tb = L::Select(L::Less(dot, zero), L::Sub(zero, t), t);
+        T ta = L::Sub(L::Set(1.0f), t);
+
+        T x = L::Add(L::Mul(ax, ta), L::Mul(bx, tb));
+        T y = L::Add(L::Mul(ay, ta), L::Mul(by, tb));
+        T z = L::Add(L::Mul(az, ta), L::Mul(bz, tb));
+        T w = L::Add(L::Mul(aw, ta), L::Mul(bw, tb));
+        Normalize<L>(x, y, z, w);
+
+        L::Store(out.rotationX + i, x);
+        L::Store(out.rotationY + i, y);
+        L::Store(out.rotationZ + i, z);
+        L::Store(out.rotationW + i, w);
+    }
+
+    return i;
+}
+
+
+template <typename L>
+static unsigned int MakeAdditiveNodes(Pose &out, const Pose &pose, const Pose &reference, unsigned int begin, unsigned int end)
+{
+    typedef typename L::Type T;
+    T zero = L::Set(0.0f);
+    T one = L::Set(1.0f);
+
+    unsigned int i = begin;
+    for (; i + L::WIDTH <= end; i += L::WIDTH)
+    {
+        L::Store(out.translationX + i, L::Sub(L::Load(pose.translationX + i), L::Load(reference.translationX + i)));
+        L::Store(out.translationY + i, L::Sub(L::Load(pose.translationY + i), L::Load(reference.translationY + i)));
+        L::Store(out.translationZ + i, L::Sub(L::Load(pose.translationZ + i), L::Load(reference.translationZ + i)));
+
+        // Ratios of the scalings, 1 where the reference collapses an axis
+        T rx = L::Load(reference.scalingX + i), ry = L::Load(reference.scalingY + i), rz = L::Load(reference.scalingZ + i);
+        L::Store(out.scalingX + i, L::Select(L::Less(zero, L::Mul(rx, rx)), L::Div(L::Load(pose.scalingX + i), rx), one));
+        L::Store(out.scalingY + i, L::Select(L::Less(zero, L::Mul(ry, ry)), L::Div(L::Load(pose.scalingY + i), ry), one));
+        L::Store(out.scalingZ + i, L::Select(L::Less(zero, L::Mul(rz, rz)), L::Div(L::Load(pose.scalingZ + i), rz), one));
+
+        // Rotation from the reference to the pose: conjugate(reference) * pose
+        T x, y, z, w;
+        Multiply<L>(L::Sub(zero, L::Load(reference.rotationX + i)), L::Sub(zero, L::Load(reference.rotationY + i)),
+                    L::Sub(zero, L::Load(reference.rotationZ + i)), L::Load(reference.rotationW + i),
+                    L::Load(pose.rotationX + i), L::Load(pose.rotationY + i), L::Load(pose.rotationZ + i), L::Load(pose.rotationW + i),
+                    x, y, z, w);
+
+        L::Store(out.rotationX + i, x);
+        L::Store(out.rotationY + i, y);
+        L::Store(out.rotationZ + i, z);
+        L::Store(out.rotationW + i, w);
+    }
+
+    return i;
+}
+
+
+template <typename L>
+static unsigned int AddAdditiveNodes(Pose &out, const Pose &base, const Pose &additive, const float *weights, unsigned int begin, unsigned int end)
+{
+    typedef typename L::Type T;
+    T zero = L::Set(0.0f);
+    T one = L::Set(1.0f);
+
+    unsigned int i = begin;
+    for (; i + L::WIDTH <= end; i += L::WIDTH)
+    {
+        T t = L::Load(weights + i);
+
+        L::Store(out.translationX + i, L::Add(L::Load(base.translationX + i), L::Mul(L::Load(additive.translationX + i), t)));
+        L::Store(out.translationY + i, L::Add(L::Load(base.translationY + i), L::Mul(L::Load(additive.translationY + i), t)));
+        L::Store(out.translationZ + i, L::Add(L::Load(base.translationZ + i), L::Mul(L::Load(additive.translationZ + i), t)));
+        L::Store(out.scalingX + i, L::Mul(L::Load(base.scalingX + i), Lerp<L>(one, L::Load(additive.scalingX + i), t)));
+        L::Store(out.scalingY + i, L::Mul(L::Load(base.scalingY + i), Lerp<L>(one, L::Load(additive.scalingY + i), t)));
+        L::Store(out.scalingZ + i, L::Mul(L::Load(base.scalingZ + i), Lerp<L>(one, L::Load(additive.scalingZ + i), t)));
+
+        // Scale the additive rotation by blending it from the identity, along the shorter arc
+        T dx = L::Load(additive.rotationX + i), dy = L::Load(additive.rotationY + i), dz = L::Load(additive.rotationZ + i), dw = L::Load(additive.rotationW + i);
+        T td = L::Select(L::Less(dw, zero), L::Sub(zero, t), t);
+        T qx = L::Mul(dx, td);
+        T qy = L::Mul(dy, td);
+        T qz = L::Mul(dz, td);
+        T qw = L::Add(L::Sub(one, t), L::Mul(dw, td));
+        Normalize<L>(qx, qy, qz, qw);
+
+        T x, y, z, w;
+        Multiply<L>(L::Load(base.rotationX + i), L::Load(base.rotationY + i), L::Load(base.rotationZ + i), L::Load(base.rotationW + i),
+                    qx, qy, qz, qw, x, y, z, w);
+        Normalize<L>(x, y, z, w);
+
+        L::Store(out.rotationX + i, x);
+        L::Store(out.rotationY + i, y);
+        L::Store(out.rotationZ + i, z);
+        L::Store(out.rotationW + i, w);
+    }
+
+    return i;
+}
+
+
+void pose_utils::Blend(Pose &out, const Pose &a, const Pose &b, const float *weights)
+{
+    unsigned int tail = BlendNodes<SIMDPoseLanes>(out, a, b, weights, 0, out.nrNodes);
+    BlendNodes<ScalarPoseLanes>(out, a, b, weights, tail, out.nrNodes);
+}
+
+
+void pose_utils::MakeAdditive(Pose &out, const Pose &pose, const Pose &reference)
+{
+    unsigned int tail = MakeAdditiveNodes<SIMDPoseLanes>(out, pose, reference, 0, out.nrNodes);
+    MakeAdditiveNodes<ScalarPoseLanes>(out, pose, reference, tail, out.nrNodes);
+}
+
+
+void pose_utils::AddAdditive(Pose &out, const Pose &base, const Pose &additive, const float *weights)
+{
+    unsigned int tail = AddAdditiveNodes<SIMDPoseLanes>(out, base, additive, weights, 0, out.nrNodes);
+    AddAdditiveNodes<ScalarPoseLanes>(out, base, additive, weights, tail, out.nrNodes);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/glm_utils.h"
+
+
+// Local transforms of the nodes of a skeleton, as a structure of arrays so
+// blending runs over several nodes per instruction. The arrays are owned by
+// the pool the pose comes from and padded to a multiple of four nodes.
+struct Pose
+{
+    float *translationX;
+    float *translationY;
+    float *translationZ;
+
+    float *rotationX;
+    float *rotationY;
+    float *rotationZ;
+    float *rotationW;
+
+    float *scalingX;
+    float *scalingY;
+    float *scalingZ;
+
+    unsigned int nrNodes;
+
+    void SetNode(unsigned int nodeIndex, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scaling);
+    void CopyFrom(const Pose &other);
+
+    // Writes the transform matrix of every node
+    void ComputeLocalTransforms(glm::mat4 *localTransforms) const;
+
+    // Splits an affine transform without shear into its parts
+    static void Decompose(const glm::mat4 &transform, glm::vec3 &translation, glm::quat &rotation, glm::vec3 &scaling);
+
+    static const unsigned int NR_ARRAYS = 10;
+};
+
+
+// Fixed number of poses allocated up front, so poses can be taken and given
+// back every frame without touching the heap
+class PosePool
+{
+ public:
+    PosePool();
+
+    void Init(unsigned int nrNodes, unsigned int capacity);
+
+    // Returns nullptr once every pose is taken
+    Pose *Acquire();
+    void Release(Pose *pose);
+
+    unsigned int GetNumberOfFree() const;
+
+ private:
+    PosePool(const PosePool &) = delete;
+    PosePool &operator=(const PosePool &) = delete;
+
+ private:
+    std::vector<float> storage;
+    std::vector<Pose> poses;
+    std::vector<Pose *> freePoses;
+};
+
+
+// Blends over every node of the poses, which may alias `out`. `weights` holds
+// one factor per node, padded as the poses are.
+namespace pose_utils
+{
+    // out = a towards b by `weights`
+    void Blend(Pose &out, const Pose &a, const Pose &b, const float *weights);
+
+    // Difference of `pose` from `reference`, to be added to other poses
+    void MakeAdditive(Pose &out, const Pose &pose, const Pose &reference);
+
+    // Adds the fraction `weights` of an additive pose to `base`
+    void AddAdditive(Pose &out, const Pose &base, const Pose &additive, const float *weights);
+}
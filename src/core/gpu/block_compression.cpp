@@ -0,0 +1,248 @@
+#include "core/gpu/block_compression.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "utils/math_utils.h"
+#include "utils/thread_utils.h"
+
+
+static unsigned int BlockBytes(GLenum format)
+{
+    return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+}
+
+
+static uint16_t PackColor565(const float color[3])
+{
+    unsigned int r = (unsigned int)(MIN(MAX(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    unsigned int g = (unsigned int)(MIN(MAX(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    unsigned int b = (unsigned int)(MIN(MAX(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+
+static void UnpackColor565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+
+// BC1 colour block: endpoints on the principal axis of the block colours,
+// inset slightly, with every pixel snapped to the closest of the 4 palette entries
+static void EncodeColorBlock(const unsigned char rgba[16][4], unsigned char *out)
+{
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += rgba[i][c] / 16.0f;
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = { rgba[i][0] - mean[0], rgba[i][1] - mean[1], rgba[i][2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // A few power iterations are enough to find the dominant axis
+    float axis[3] = { 0.9f, 1.0f, 0.7f };
+    for (int iter = 0; iter < 4; iter++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = MAX(MAX(x > 0 ? x : -x, y > 0 ? y : -y), z > 0 ? z : -z);
+        if (len < 1e-6f)
+            break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (rgba[i][0] - mean[0]) * axis[0] + (rgba[i][1] - mean[1]) * axis[1] + (rgba[i][2] - mean[2]) * axis[2];
+        minT = MIN(minT, t);
+        maxT = MAX(maxT, t);
+    }
+
+    float inset = (maxT - minT) / 16.0f;
+    minT += inset;
+    maxT -= inset;
+
+    float hi[3], lo[3];
+    for (int c = 0; c < 3; c++)
+    {
+        hi[c] = mean[c] + axis[c] * maxT;
+        lo[c] = mean[c] + axis[c] * minT;
+    }
+
+    uint16_t c0 = PackColor565(hi);
+    uint16_t c1 = PackColor565(lo);
+
+    // c0 > c1 selects the 4 colour mode, which BC3 assumes regardless
+    if (c0 < c1)
+    {
+        uint16_t tmp = c0; c0 = c1; c1 = tmp;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        int palette[4][3];
+        UnpackColor565(c0, palette[0]);
+        UnpackColor565(c1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = rgba[i][0] - palette[p][0];
+                int dg = rgba[i][1] - palette[p][1];
+                int db = rgba[i][2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    out[4] = indices & 0xFF; out[5] = (indices >> 8) & 0xFF;
+    out[6] = (indices >> 16) & 0xFF; out[7] = indices >> 24;
+}
+
+
+// BC4 block: one 8-bit channel interpolated between its min and max in 8 steps
+static void EncodeChannelBlock(const unsigned char rgba[16][4], int channel, unsigned char *out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        lo = MIN(lo, (int)rgba[i][channel]);
+        hi = MAX(hi, (int)rgba[i][channel]);
+    }
+
+    uint64_t indices = 0;
+    if (hi > lo)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            // Step 0 is `hi`, step 7 is `lo`; palette indices 0 and 1 hold
+            // the endpoints, and 2..7 the interpolated values in between
+            int step = ((hi - rgba[i][channel]) * 7 + (hi - lo) / 2) / (hi - lo);
+            uint64_t index = (step == 0) ? 0 : (step == 7) ? 1 : step + 1;
+            indices |= index << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = (indices >> (8 * b)) & 0xFF;
+}
+
+
+GLenum block_compression::ChooseFormat(unsigned int channels, const unsigned char *pixels, unsigned int nrPixels)
+{
+    switch (channels)
+    {
+        case 1: return GL_COMPRESSED_RED_RGTC1;
+        case 2: return GL_COMPRESSED_RG_RGTC2;
+        default: break;
+    }
+
+    if (!GLEW_EXT_texture_compression_s3tc)
+        return 0;
+
+    if (channels == 3)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    for (unsigned int i = 0; i < nrPixels; i++)
+    {
+        if (pixels[4 * i + 3] != 255)
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+
+unsigned int block_compression::GetCompressedSize(GLenum format, unsigned int width, unsigned int height)
+{
+    return ((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+
+std::vector<unsigned char> block_compression::Compress(
+    GLenum format,
+    const unsigned char *pixels,
+    unsigned int width,
+    unsigned int height,
+    unsigned int channels)
+{
+    unsigned int blocksX = (width + 3) / 4;
+    unsigned int blocksY = (height + 3) / 4;
+    unsigned int blockBytes = BlockBytes(format);
+
+    std::vector<unsigned char> out(blocksX * blocksY * blockBytes);
+
+    thread_utils::ParallelFor(0, blocksY, 16, [&](unsigned int rowBegin, unsigned int rowEnd)
+    {
+        unsigned char rgba[16][4];
+
+        for (unsigned int by = rowBegin; by < rowEnd; by++)
+        {
+            for (unsigned int bx = 0; bx < blocksX; bx++)
+            {
+                for (unsigned int i = 0; i < 16; i++)
+                {
+                    unsigned int x = MIN(bx * 4 + i % 4, width - 1);
+                    unsigned int y = MIN(by * 4 + i / 4, height - 1);
+                    const unsigned char *src = pixels + (y * width + x) * channels;
+
+                    rgba[i][0] = src[0];
+                    rgba[i][1] = channels > 1 ? src[1] : 0;
+                    rgba[i][2] = channels > 2 ? src[2] : 0;
+                    rgba[i][3] = channels > 3 ? src[3] : 255;
+                }
+
+                unsigned char *block = &out[(by * blocksX + bx) * blockBytes];
+
+                switch (format)
+                {
+                    case GL_COMPRESSED_RED_RGTC1:
+                        EncodeChannelBlock(rgba, 0, block);
+                        break;
+                    case GL_COMPRESSED_RG_RGTC2:
+                        EncodeChannelBlock(rgba, 0, block);
+                        EncodeChannelBlock(rgba, 1, block + 8);
+                        break;
+                    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                        EncodeChannelBlock(rgba, 3, block);
+                        EncodeColorBlock(rgba, block + 8);
+                        break;
+                    default:
+                        EncodeColorBlock(rgba, block);
+                        break;
+                }
+            }
+        }
+    });
+
+    return out;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+namespace block_compression
+{
+    // -------------------------------------------------------------------------
+    // Picks the block-compressed format for 8-bit images with `channels`
+    // channels: BC4 for red, BC5 for red-green, BC1 for opaque colour and
+    // BC3 for colour with alpha. Returns 0 if the driver lacks the format.
+    GLenum ChooseFormat(unsigned int channels, const unsigned char *pixels, unsigned int nrPixels);
+
+    // Size in bytes of a `width` x `height` image in the given format
+    unsigned int GetCompressedSize(GLenum format, unsigned int width, unsigned int height);
+
+    // Encodes a tightly packed 8-bit image into 4x4 blocks. Partial blocks
+    // at the right and bottom edges replicate the last row and column.
+    std::vector<unsigned char> Compress(
+        GLenum format,
+        const unsigned char *pixels,
+        unsigned int width,
+        unsigned int height,
+        unsigned int channels);
+}
@@ -0,0 +1,265 @@
+#include "core/gpu/cascaded_shadow_map.h"
+
+#include <cmath>
+
+#include "utils/gl_utils.h"
+#include "utils/math_utils.h"
+
+
+// Blend of the logarithmic and the uniform split of the depths between cascades
+static const float SPLIT_LAMBDA = 0.75f;
+
+// Depth offset of the casters, against acne
+static const float OFFSET_FACTOR = 2.0f;
+static const float OFFSET_UNITS = 4.0f;
+
+static const unsigned int STATIC_LAYERS = 0;
+static const unsigned int SHADOW_LAYERS = 1;
+
+// Maps clip space to the texture space of the shadow maps
+static const glm::mat4 TEXTURE_BIAS = glm::mat4(
+    0.5f, 0.0f, 0.0f, 0.0f,
+    0.0f, 0.5f, 0.0f, 0.0f,
+    0.0f, 0.0f, 0.5f, 0.0f,
+    0.5f, 0.5f, 0.5f, 1.0f);
+
+
+CascadedShadowMap::CascadedShadowMap()
+{
+    resolution = 0;
+    nrCascades = 0;
+    nrStaticRenders = 0;
+    casterRange = 100;
+    viewMatrix = glm::mat4(1);
+
+    for (unsigned int i = 0; i < MAX_CASCADES; i++)
+    {
+        cascades[i].projectionMatrix = glm::mat4(1);
+        cascades[i].origin = glm::vec3(0);
+        cascades[i].extent = 0;
+        cascades[i].splitDepth = 0;
+        cascades[i].cached = false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        textures[i] = 0;
+        framebuffers[i] = 0;
+    }
+
+    SetLightDirection(glm::vec3(0, -1, 0));
+}
+
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    glDeleteFramebuffers(2, framebuffers);
+    glDeleteTextures(2, textures);
+}
+
+
+void CascadedShadowMap::Init(unsigned int resolution, unsigned int nrCascades)
+{
+    if (textures[0])
+        return;
+
+    this->resolution = resolution;
+    this->nrCascades = MIN(MAX(nrCascades, 1u), MAX_CASCADES);
+
+    glGenTextures(2, textures);
+    glGenFramebuffers(2, framebuffers);
+
+    for (int i = 0; i < 2; i++)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i]);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, this->nrCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        // Depth only, the layer is attached when drawn
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[i], 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckOpenGLError();
+}
+
+
+void CascadedShadowMap::SetLightDirection(const glm::vec3 &direction)
+{
+    lightDirection = glm::normalize(direction);
+
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+    lightViewMatrix = glm::lookAt(glm::vec3(0), lightDirection, up);
+    Invalidate();
+}
+
+
+void CascadedShadowMap::SetCasterRange(float range)
+{
+    casterRange = range;
+    Invalidate();
+}
+
+
+void CascadedShadowMap::Invalidate()
+{
+    for (unsigned int i = 0; i < MAX_CASCADES; i++)
+    {
+        cascades[i].cached = false;
+    }
+}
+
+
+void CascadedShadowMap::Update(const glm::mat4 &viewMatrix, float fovy, float aspectRatio, float zNear, float shadowDistance)
+{
+    this->viewMatrix = viewMatrix;
+
+    // Tangent of half the angle between the diagonal of the frustum and the view axis
+    float tanHalfFov = std::tan(fovy / 2);
+    float tanHalfDiagonal = tanHalfFov * std::sqrt(1 + aspectRatio * aspectRatio);
+    glm::mat4 cameraMatrix = glm::inverse(viewMatrix);
+
+    float splitNear = zNear;
+    for (unsigned int i = 0; i < nrCascades; i++)
+    {
+        float fraction = (float)(i + 1) / nrCascades;
+        float logSplit = zNear * std::pow(shadowDistance / zNear, fraction);
+        float uniformSplit = zNear + (shadowDistance - zNear) * fraction;
+        float splitFar = SPLIT_LAMBDA * logSplit + (1 - SPLIT_LAMBDA) * uniformSplit;
+
+        FitCascade(cascades[i], cameraMatrix, tanHalfDiagonal, splitNear, splitFar);
+        splitNear = splitFar;
+    }
+}
+
+
+void CascadedShadowMap::FitCascade(Cascade &cascade, const glm::mat4 &cameraMatrix, float tanHalfDiagonal, float zNear, float zFar)
+{
+    // Smallest sphere around the slice of the frustum, centered on the view axis.
+    // It depends on the depths alone, so the size stays put as the camera turns.
+    float k2 = tanHalfDiagonal * tanHalfDiagonal;
+    float depth = 0.5f * (zNear + zFar) * (1 + k2);
+    float radius;
+    if (depth >= zFar)
+    {
+        depth = zFar;
+        radius = zFar * tanHalfDiagonal;
+    }
+    else
+    {
+        radius = std::sqrt((zFar - depth) * (zFar - depth) + zFar * zFar * k2);
+    }
+
+    glm::vec3 center = glm::vec3(lightViewMatrix * cameraMatrix * glm::vec4(0, 0, -depth, 1));
+
+    // The window exceeds the sphere by half the snapping step on every side, so
+    // the sphere stays inside as long as the origin is the nearest step
+    float extent = radius * resolution / (resolution - SNAP_TEXELS);
+    float step = 2 * extent * SNAP_TEXELS / resolution;
+    glm::vec3 origin = glm::floor(center / step + 0.5f) * step;
+
+    cascade.splitDepth = zFar;
+    if (cascade.cached && origin == cascade.origin && extent == cascade.extent)
+        return;
+
+    // Light space looks down -z, so the depth of a point is -z
+    float nearPlane = -origin.z - radius - step - casterRange;
+    float farPlane = -origin.z + radius + step;
+
+    cascade.origin = origin;
+    cascade.extent = extent;
+    cascade.projectionMatrix = glm::ortho(origin.x - extent, origin.x + extent,
+                                          origin.y - extent, origin.y + extent, nearPlane, farPlane);
+    cascade.cached = false;
+}
+
+
+void CascadedShadowMap::Render(const CasterCallback &renderStatic, const CasterCallback &renderDynamic)
+{
+    if (!textures[0])
+        return;
+
+    GLint viewport[4], framebuffer;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+
+    glViewport(0, 0, resolution, resolution);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(OFFSET_FACTOR, OFFSET_UNITS);
+
+    for (unsigned int i = 0; i < nrCascades; i++)
+    {
+        Cascade &cascade = cascades[i];
+
+        if (!cascade.cached)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[STATIC_LAYERS]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[STATIC_LAYERS], 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            renderStatic(lightViewMatrix, cascade.projectionMatrix);
+
+            cascade.cached = true;
+            nrStaticRenders++;
+        }
+
+        // Starts from the static casters, and draws the moving ones over them
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[STATIC_LAYERS]);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[STATIC_LAYERS], 0, i);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[SHADOW_LAYERS]);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textures[SHADOW_LAYERS], 0, i);
+        glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[SHADOW_LAYERS]);
+        renderDynamic(lightViewMatrix, cascade.projectionMatrix);
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    CheckOpenGLError();
+}
+
+
+void CascadedShadowMap::Bind(Shader *shader, unsigned int textureUnit) const
+{
+    glm::mat4 matrices[MAX_CASCADES];
+    glm::vec4 splits(0), texelSizes(0);
+    for (unsigned int i = 0; i < nrCascades; i++)
+    {
+        matrices[i] = TEXTURE_BIAS * cascades[i].projectionMatrix * lightViewMatrix;
+        splits[i] = cascades[i].splitDepth;
+        texelSizes[i] = 2 * cascades[i].extent / resolution;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textures[SHADOW_LAYERS]);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(shader->GetUniformLocation("shadow_map"), textureUnit);
+    glUniformMatrix4fv(shader->GetUniformLocation("shadow_matrices"), nrCascades, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform4fv(shader->GetUniformLocation("shadow_splits"), 1, glm::value_ptr(splits));
+    glUniform4fv(shader->GetUniformLocation("shadow_texel_sizes"), 1, glm::value_ptr(texelSizes));
+    glUniform1i(shader->GetUniformLocation("shadow_cascades"), nrCascades);
+    glUniformMatrix4fv(shader->GetUniformLocation("shadow_view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+}
+
+
+unsigned int CascadedShadowMap::GetNumberOfCascades() const
+{
+    return nrCascades;
+}
+
+
+unsigned int CascadedShadowMap::GetNumberOfStaticRenders() const
+{
+    return nrStaticRenders;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <functional>
+
+#include "core/gpu/shader.h"
+#include "utils/glm_utils.h"
+
+
+// Cascaded shadow maps of a directional light, fitted to the view frustum of
+// a perspective camera. The depths between the near plane and the shadow
+// distance are split in up to MAX_CASCADES ranges, each covered by one layer
+// of a depth texture array. A cascade holds the bounding sphere of its slice
+// of the frustum, so its size does not change as the camera turns, and its
+// origin snaps to whole texels of the light space, so the shadow edges do not
+// shimmer as the camera moves.
+//
+// Static casters are drawn in a layer of their own, which is kept until the
+// cascade moves. The window of a cascade is a few texels larger than the
+// sphere, so the origin only moves every SNAP_TEXELS texels. Every frame the
+// static layer is copied to the layer sampled by the shaders, and the moving
+// casters are drawn over it. See Shadows.glsl for the lookup in the shaders.
+class CascadedShadowMap
+{
+ public:
+    // Draws casters with the given light view and projection matrices
+    typedef std::function<void(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix)> CasterCallback;
+
+    CascadedShadowMap();
+    ~CascadedShadowMap();
+
+    // Layers of `resolution` texels squared, for `nrCascades` cascades
+    void Init(unsigned int resolution, unsigned int nrCascades);
+
+    // Direction the light travels in
+    void SetLightDirection(const glm::vec3 &direction);
+
+    // How far towards the light, past the sphere of a cascade, casters are
+    // kept. Covers casters outside the view frustum that shade inside it.
+    void SetCasterRange(float range);
+
+    // Drops the static layers, for when static casters move
+    void Invalidate();
+
+    // Fits the cascades to the view frustum of `viewMatrix` and the perspective
+    // projection of `fovy`, `aspectRatio`, and `zNear`. Shadows end at
+    // `shadowDistance` from the eye.
+    void Update(const glm::mat4 &viewMatrix, float fovy, float aspectRatio, float zNear, float shadowDistance);
+
+    // Draws the static layers of the cascades that moved, then the layers
+    // the shaders sample. The viewport and framebuffer are restored after.
+    void Render(const CasterCallback &renderStatic, const CasterCallback &renderDynamic);
+
+    // Binds the shadow maps to `textureUnit`, and sets the uniforms of
+    // Shadows.glsl in `shader`, which must be in use
+    void Bind(Shader *shader, unsigned int textureUnit) const;
+
+    unsigned int GetNumberOfCascades() const;
+
+    // Static layers drawn since Init, to check how often the cache is missed
+    unsigned int GetNumberOfStaticRenders() const;
+
+    static const unsigned int MAX_CASCADES = 4;
+    static const unsigned int SNAP_TEXELS = 64;
+
+ private:
+    CascadedShadowMap(const CascadedShadowMap &) = delete;
+    CascadedShadowMap &operator=(const CascadedShadowMap &) = delete;
+
+    struct Cascade
+    {
+        glm::mat4 projectionMatrix;
+
+        // Snapped center in light space, and half the size of the window
+        glm::vec3 origin;
+        float extent;
+
+        // View depth where the cascade ends
+        float splitDepth;
+
+        // Whether the static layer was drawn with the current matrices
+        bool cached;
+    };
+
+    void FitCascade(Cascade &cascade, const glm::mat4 &cameraMatrix, float tanHalfDiagonal, float zNear, float zFar);
+
+ private:
+    unsigned int resolution;
+    unsigned int nrCascades;
+    unsigned int nrStaticRenders;
+    float casterRange;
+
+    glm::vec3 lightDirection;
+    glm::mat4 lightViewMatrix;
+    glm::mat4 viewMatrix;
+    Cascade cascades[MAX_CASCADES];
+
+    // Static layers, and the layers sampled by the shaders
+    GLuint textures[2];
+    GLuint framebuffers[2];
+};
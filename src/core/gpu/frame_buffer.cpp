@@ -14,6 +14,7 @@ glm::vec4 FrameBuffer::defaultClearColor = glm::vec4(0);
 FrameBuffer::FrameBuffer()
 {
     FBO = 0;
+    nrTextures = 0;
     depthTexture = nullptr;
     textures = nullptr;
     DrawBuffers = nullptr;
@@ -31,6 +32,8 @@ void FrameBuffer::Clean()
 {
     if (FBO)
         glDeleteFramebuffers(1, &FBO);
+    FBO = 0;
+    nrTextures = 0;
     SAFE_FREE_ARRAY(textures);
     SAFE_FREE_ARRAY(DrawBuffers)
 }
@@ -40,14 +43,32 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
 {
     Clean();
 
-    precision = (precision / 8) * 8;
+    this->width = width;
+    this->height = height;
+    formats.clear();
+
+    CreateAttachments(nrTextures, hasDepthTexture, (precision / 8) * 8);
+}
+
+
+void FrameBuffer::Generate(int width, int height, const std::vector<GLenum> &formats, bool hasDepthTexture)
+{
+    Clean();
+
+    this->width = width;
+    this->height = height;
+    this->formats = formats;
+
+    CreateAttachments(static_cast<int>(formats.size()), hasDepthTexture, 32);
+}
+
 
+void FrameBuffer::CreateAttachments(int nrTextures, bool hasDepthTexture, int precision)
+{
     #ifdef DEBUG_INFO
         cout << "FBO: " << width << " * " << height << " textures attached: " << nrTextures << endl;
     #endif
 
-    this->width = width;
-    this->height = height;
     this->nrTextures = nrTextures;
 
     // Create FrameBufferObject
@@ -65,7 +86,14 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
         textures = new Texture2D[nrTextures];
         for (int i = 0; i < nrTextures; i++)
         {
-            textures[i].CreateFrameBufferTexture(width, height, i, precision);
+            if (!CreateTexture(i, precision))
+            {
+                // A framebuffer missing an attachment would render to nothing
+                std::cout << "ERROR creating render target " << i << " of the framebuffer" << std::endl;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                Clean();
+                return;
+            }
         }
 
         glDrawBuffers(nrTextures, DrawBuffers);
@@ -95,7 +123,13 @@ void FrameBuffer::Resize(int width, int height, int precision)
 
     for (unsigned int i = 0; i < nrTextures; i++)
     {
-        textures[i].CreateFrameBufferTexture(width, height, i, precision);
+        if (!CreateTexture(i, precision))
+        {
+            std::cout << "ERROR resizing render target " << i << " of the framebuffer" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            Clean();
+            return;
+        }
     }
 
     if (depthTexture) {
@@ -104,6 +138,18 @@ void FrameBuffer::Resize(int width, int height, int precision)
 }
 
 
+bool FrameBuffer::CreateTexture(unsigned int index, int precision)
+{
+    if (formats.empty())
+    {
+        textures[index].CreateFrameBufferTexture(width, height, index, precision);
+        return true;
+    }
+
+    return textures[index].CreateRenderTarget(width, height, index, formats[index]);
+}
+
+
 void FrameBuffer::Bind(bool clearBuffer) const
 {
     glBindFramebuffer(GL_FRAMEBUFFER, FBO);
@@ -14,6 +14,10 @@ class FrameBuffer
     ~FrameBuffer();
     void Clean();
     void Generate(int width, int height, int nrTextures, bool hasDepthTexture = true, int precision = 32);
+
+    // One color attachment per entry of `formats`, each with its own sized
+    // format, like GL_RG16 or GL_RGBA8. Resizing keeps the formats.
+    void Generate(int width, int height, const std::vector<GLenum> &formats, bool hasDepthTexture = true);
     void Resize(int width, int height, int precision = 32);
 
     void Bind(bool clearBuffer = true) const;
@@ -37,6 +41,11 @@ class FrameBuffer
     static void SetViewport(const glm::ivec2 &viewportSize, const glm::ivec2 offset = glm::ivec2(0, 0));
     static void SetDefaultClearColor(glm::vec4 clearColor);
 
+ private:
+    void CreateAttachments(int nrTextures, bool hasDepthTexture, int precision);
+    // Returns false, after printing why, if the format of the target is not supported
+    bool CreateTexture(unsigned int index, int precision);
+
  private:
     Texture2D *textures;
     Texture2D *depthTexture;
@@ -47,6 +56,10 @@ class FrameBuffer
     int width;
     int height;
     unsigned int nrTextures;
+
+    // Formats of the attachments, empty when they share the precision given
+    std::vector<GLenum> formats;
+
     glm::vec4 clearColor;
     static glm::vec4 defaultClearColor;
 };
@@ -0,0 +1,250 @@
+#include "core/gpu/frame_capture.h"
+
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+#include "stb/stb_image_write.h"
+
+
+static const GLenum captureFormat[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+
+// Writes the image in the format named by the extension of the file, and
+// as PNG if it names none of the formats of stb_image_write
+static bool WriteImage(const std::string &fileName, unsigned int width, unsigned int height,
+                       unsigned int channels, const unsigned char *data)
+{
+    std::string extension;
+    size_t dot = fileName.find_last_of('.');
+    if (dot != std::string::npos)
+    {
+        for (size_t i = dot + 1; i < fileName.size(); i++)
+            extension += (char)std::tolower((unsigned char)fileName[i]);
+    }
+
+    if (extension == "jpg" || extension == "jpeg")
+        return stbi_write_jpg(fileName.c_str(), width, height, channels, data, 90) != 0;
+    if (extension == "bmp")
+        return stbi_write_bmp(fileName.c_str(), width, height, channels, data) != 0;
+    if (extension == "tga")
+        return stbi_write_tga(fileName.c_str(), width, height, channels, data) != 0;
+    return stbi_write_png(fileName.c_str(), width, height, channels, data, width * channels) != 0;
+}
+
+
+FrameCapture::FrameCapture(unsigned int nrSlots, unsigned int nrEncoders, unsigned int maxQueuedImages)
+    : encoders(nrEncoders)
+{
+    this->nrSlots = nrSlots ? nrSlots : 1;
+    this->maxQueuedImages = maxQueuedImages ? maxQueuedImages : 1;
+    ring = nullptr;
+    stalls = 0;
+    queuedImages = 0;
+    writtenImages = 0;
+    failedImages = 0;
+}
+
+
+FrameCapture::~FrameCapture()
+{
+    Flush();
+    delete ring;
+}
+
+
+void FrameCapture::CaptureFrameBuffer(int x, int y, unsigned int width, unsigned int height,
+                                      unsigned int channels, const std::string &fileName)
+{
+    if (channels == 0 || channels > 4 || width == 0 || height == 0)
+    {
+        std::cout << "Cannot capture " << width << "x" << height << "x" << channels << " to " << fileName << std::endl;
+        return;
+    }
+
+    int slot = AcquireSlot(width * height * channels);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, width, height, captureFormat[channels], GL_UNSIGNED_BYTE, (void *)0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    ring->Submit(slot);
+
+    pending.push_back({ slot, width, height, channels, true, fileName });
+}
+
+
+void FrameCapture::CaptureTexture(const Texture2D *texture, const std::string &fileName)
+{
+    unsigned int width = texture->GetWidth();
+    unsigned int height = texture->GetHeight();
+    unsigned int channels = texture->GetNrChannels();
+    if (channels == 0 || channels > 4 || width == 0 || height == 0)
+    {
+        std::cout << "Cannot capture " << width << "x" << height << "x" << channels << " to " << fileName << std::endl;
+        return;
+    }
+
+    int slot = AcquireSlot(width * height * channels);
+
+    // Textures are uploaded from the top row, so they are read the same way
+    texture->Bind();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, captureFormat[channels], GL_UNSIGNED_BYTE, (void *)0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    texture->UnBind();
+    ring->Submit(slot);
+
+    pending.push_back({ slot, width, height, channels, false, fileName });
+}
+
+
+void FrameCapture::Update()
+{
+    // In order, so a sequence of frames is written in the order it was captured
+    while (!pending.empty() && ring->IsReady(pending.front().slot) && HasEncoderRoom())
+    {
+        Encode();
+    }
+}
+
+
+void FrameCapture::Flush()
+{
+    while (!pending.empty())
+    {
+        WaitForEncoderRoom();
+        ring->Wait(pending.front().slot);
+        Encode();
+    }
+
+    encoders.Wait();
+}
+
+
+unsigned int FrameCapture::GetNumberOfPendingCaptures() const
+{
+    return (unsigned int)pending.size();
+}
+
+
+unsigned int FrameCapture::GetNumberOfWrittenImages() const
+{
+    return writtenImages;
+}
+
+
+unsigned int FrameCapture::GetNumberOfFailedImages() const
+{
+    return failedImages;
+}
+
+
+unsigned int FrameCapture::GetNumberOfStalls() const
+{
+    return stalls;
+}
+
+
+int FrameCapture::AcquireSlot(unsigned int size)
+{
+    // The slots only grow, once the captures in them are written
+    if (ring == nullptr || ring->GetSlotSize() < size)
+    {
+        Flush();
+        delete ring;
+        ring = new PixelBufferRing(GL_PIXEL_PACK_BUFFER, nrSlots, size);
+    }
+
+    Update();
+
+    int slot = ring->Acquire();
+    if (slot < 0)
+    {
+        // Every slot holds a pending capture, so the oldest is waited for
+        stalls++;
+        WaitForEncoderRoom();
+        ring->Wait(pending.front().slot);
+        Encode();
+        slot = ring->Acquire();
+    }
+
+    return slot;
+}
+
+
+void FrameCapture::Encode()
+{
+    PendingCapture capture = pending.front();
+    pending.pop_front();
+
+    unsigned int rowSize = capture.width * capture.channels;
+    unsigned char *data = new unsigned char[rowSize * capture.height];
+
+    const unsigned char *mapped = static_cast<const unsigned char *>(ring->MapForRead(capture.slot));
+    if (mapped)
+    {
+        if (capture.flipRows)
+        {
+            for (unsigned int row = 0; row < capture.height; row++)
+            {
+                memcpy(data + row * rowSize, mapped + (capture.height - 1 - row) * rowSize, rowSize);
+            }
+        }
+        else
+        {
+            memcpy(data, mapped, rowSize * capture.height);
+        }
+        ring->Unmap(capture.slot);
+    }
+    ring->Release(capture.slot);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (mapped == nullptr)
+    {
+        std::cout << "Cannot read the capture of " << capture.fileName << std::endl;
+        delete[] data;
+        failedImages++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedImages++;
+    }
+
+    encoders.Enqueue([this, capture, data]()
+    {
+        bool written = WriteImage(capture.fileName, capture.width, capture.height, capture.channels, data);
+        delete[] data;
+
+        if (written)
+        {
+            writtenImages++;
+        }
+        else
+        {
+            std::cout << "Cannot write " << capture.fileName << std::endl;
+            failedImages++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queuedImages--;
+        }
+        imageWritten.notify_all();
+    });
+}
+
+
+bool FrameCapture::HasEncoderRoom()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queuedImages < maxQueuedImages;
+}
+
+
+void FrameCapture::WaitForEncoderRoom()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    imageWritten.wait(lock, [this]() { return queuedImages < maxQueuedImages; });
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <condition_variable>
+
+#include "core/gpu/pixel_buffer_ring.h"
+#include "core/gpu/texture2D.h"
+#include "utils/thread_utils.h"
+
+
+// Saves framebuffers and textures to image files without waiting for the
+// GPU. A capture is read into a slot of a ring of pixel buffers, and picked
+// up a few frames later, once its fence has passed. The pixels are then
+// copied out of the slot and written by a pool of encoder threads, so the
+// render thread only pays for the copy.
+//
+// When every slot still waits for the GPU or for an encoder, the next
+// capture waits for the oldest one, and counts a stall. Memory is bounded
+// by the slots and the images waiting for an encoder.
+class FrameCapture
+{
+ public:
+    // `nrSlots` captures can wait for the GPU, and `maxQueuedImages` for
+    // one of `nrEncoders` threads
+    explicit FrameCapture(unsigned int nrSlots = 3, unsigned int nrEncoders = 2, unsigned int maxQueuedImages = 8);
+    ~FrameCapture();
+
+    // Reads a rectangle of the framebuffer bound for reading. The rows are
+    // flipped, so the file starts with the top row.
+    void CaptureFrameBuffer(int x, int y, unsigned int width, unsigned int height,
+                            unsigned int channels, const std::string &fileName);
+
+    // Reads the base level of the texture
+    void CaptureTexture(const Texture2D *texture, const std::string &fileName);
+
+    // Hands the captures the GPU finished to the encoders. Call once a frame.
+    void Update();
+
+    // Blocks until every capture is written
+    void Flush();
+
+    // Captures not yet handed to the encoders
+    unsigned int GetNumberOfPendingCaptures() const;
+
+    unsigned int GetNumberOfWrittenImages() const;
+    unsigned int GetNumberOfFailedImages() const;
+
+    // Captures that had to wait for a free slot
+    unsigned int GetNumberOfStalls() const;
+
+ private:
+    struct PendingCapture
+    {
+        int slot;
+        unsigned int width;
+        unsigned int height;
+        unsigned int channels;
+        bool flipRows;
+        std::string fileName;
+    };
+
+    // Binds a free slot of at least `size` bytes to GL_PIXEL_PACK_BUFFER
+    int AcquireSlot(unsigned int size);
+
+    // Copies the oldest pending capture out of its slot, and queues it
+    void Encode();
+    bool HasEncoderRoom();
+    void WaitForEncoderRoom();
+
+ private:
+    unsigned int nrSlots;
+    unsigned int maxQueuedImages;
+    PixelBufferRing *ring;
+    std::deque<PendingCapture> pending;
+    unsigned int stalls;
+
+    std::mutex mutex;
+    std::condition_variable imageWritten;
+    unsigned int queuedImages;
+    std::atomic<unsigned int> writtenImages;
+    std::atomic<unsigned int> failedImages;
+
+    // Last, so the encoders stop before the rest is destroyed
+    thread_utils::ThreadPool encoders;
+};
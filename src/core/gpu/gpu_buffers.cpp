@@ -16,6 +16,7 @@ GPUBuffers::GPUBuffers()
 {
     m_size = 0;
     m_VAO = 0;
+    m_attributeVBO = 0;
     memset(m_VBO, 0, 6 * sizeof(int));
 }
 
@@ -36,6 +37,43 @@ void GPUBuffers::ReleaseMemory()
         glDeleteBuffers(m_size, m_VBO);
         m_size = 0;
     }
+
+    if (m_attributeVBO)
+    {
+        glDeleteBuffers(1, &m_attributeVBO);
+        m_attributeVBO = 0;
+    }
+}
+
+
+void GPUBuffers::UploadIndices(const std::vector<unsigned int> &indices)
+{
+    if (m_size == 0)
+        return;
+
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_VBO[m_size - 1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    CheckOpenGLError();
+}
+
+
+void GPUBuffers::SetFloatAttribute(GLuint location, const std::vector<float> &values)
+{
+    if (m_VAO == 0 || values.empty())
+        return;
+
+    if (m_attributeVBO == 0)
+        glGenBuffers(1, &m_attributeVBO);
+
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_attributeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(values[0]) * values.size(), &values[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, 1, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindVertexArray(0);
+    CheckOpenGLError();
 }
 
 
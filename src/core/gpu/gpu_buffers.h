@@ -17,9 +17,16 @@ class GPUBuffers
     void CreateBuffers(unsigned int size);
     void ReleaseMemory();
 
+    // Replaces the contents of the index buffer, which is always the last buffer created
+    void UploadIndices(const std::vector<unsigned int> &indices);
+
+    // Sets a per-vertex float attribute at `location`, kept in a buffer of its own
+    void SetFloatAttribute(GLuint location, const std::vector<float> &values);
+
  public:
     GLuint m_VAO;
     GLuint m_VBO[6];
+    GLuint m_attributeVBO;
 
  private:
     unsigned int m_size;
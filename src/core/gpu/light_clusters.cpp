@@ -0,0 +1,253 @@
+#include "core/gpu/light_clusters.h"
+
+#include <cmath>
+
+#include "utils/math_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Lights bounded by each job of the parallel pass
+static const unsigned int LIGHTS_PER_JOB = 256;
+
+static const unsigned int CLUSTERS_PER_SLICE = LightClusters::CLUSTERS_X * LightClusters::CLUSTERS_Y;
+
+// Formats of the light, range and index buffers
+static const GLenum BUFFER_FORMATS[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+
+
+// Tiles covered along one axis of the screen by a sphere at `center` on that
+// axis and `depth` in front of the eye, from the lines through the eye that
+// touch it. `scale` and `offset` are the terms of the projection matrix for
+// that axis. The sphere must lie in front of the eye.
+static glm::ivec2 GetTileRange(float center, float depth, float radius, float scale, float offset, int nrTiles)
+{
+    float tangent = std::sqrt(center * center + depth * depth - radius * radius);
+    float tanCenter = center / depth;
+    float tanSpread = radius / tangent;
+
+    float low = scale * (tanCenter - tanSpread) / (1 + tanCenter * tanSpread) - offset;
+    float high = scale * (tanCenter + tanSpread) / (1 - tanCenter * tanSpread) - offset;
+    if (high < -1 || low > 1)
+        return glm::ivec2(1, 0);
+
+    int first = (int)std::floor((low * 0.5f + 0.5f) * nrTiles);
+    int last = (int)std::floor((high * 0.5f + 0.5f) * nrTiles);
+    return glm::ivec2(MAX(first, 0), MIN(last, nrTiles - 1));
+}
+
+
+LightClusters::LightClusters()
+{
+    viewMatrix = glm::mat4(1);
+    projectionMatrix = glm::mat4(1);
+    zNear = 0;
+    zFar = 0;
+    maxLightsPerCluster = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        buffers[i] = 0;
+        textures[i] = 0;
+    }
+}
+
+
+LightClusters::~LightClusters()
+{
+    glDeleteTextures(3, textures);
+    glDeleteBuffers(3, buffers);
+}
+
+
+void LightClusters::Init()
+{
+    if (buffers[0])
+        return;
+
+    glGenBuffers(3, buffers);
+    glGenTextures(3, textures);
+
+    ranges.assign(CLUSTERS_PER_SLICE * CLUSTERS_Z, glm::uvec2(0));
+    for (int i = 0; i < 3; i++)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(ClusterLight), NULL, GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, BUFFER_FORMATS[i], buffers[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void LightClusters::Update(const std::vector<ClusterLight> &lights, const glm::mat4 &viewMatrix,
+                           const glm::mat4 &projectionMatrix, float zNear, float zFar)
+{
+    this->viewMatrix = viewMatrix;
+    this->projectionMatrix = projectionMatrix;
+    this->zNear = zNear;
+    this->zFar = zFar;
+
+    unsigned int nrLights = static_cast<unsigned int>(lights.size());
+    tileBounds.resize(nrLights);
+    sliceBounds.resize(nrLights);
+    ranges.resize(CLUSTERS_PER_SLICE * CLUSTERS_Z);
+
+    thread_utils::ParallelFor(0, nrLights, LIGHTS_PER_JOB, [&](unsigned int begin, unsigned int end)
+    {
+        ComputeBounds(lights, begin, end);
+    });
+
+    // Every slice owns its clusters, so slices fill without locking
+    thread_utils::ParallelFor(0, CLUSTERS_Z, 1, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int slice = begin; slice < end; slice++)
+        {
+            FillSlice(slice);
+        }
+    });
+
+    indices.clear();
+    maxLightsPerCluster = 0;
+    for (unsigned int slice = 0; slice < CLUSTERS_Z; slice++)
+    {
+        unsigned int base = static_cast<unsigned int>(indices.size());
+        glm::uvec2 *range = &ranges[slice * CLUSTERS_PER_SLICE];
+        for (unsigned int i = 0; i < CLUSTERS_PER_SLICE; i++)
+        {
+            range[i].x += base;
+            maxLightsPerCluster = MAX(maxLightsPerCluster, range[i].y);
+        }
+        indices.insert(indices.end(), sliceIndices[slice].begin(), sliceIndices[slice].end());
+    }
+
+    if (!buffers[0])
+        return;
+
+    // Orphans the previous contents, which the last frame may still be reading
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(ClusterLight) * MAX(nrLights, 1u), nrLights ? lights.data() : NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::uvec2) * ranges.size(), ranges.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(unsigned int) * MAX(indices.size(), (size_t)1), indices.empty() ? NULL : indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+
+void LightClusters::ComputeBounds(const std::vector<ClusterLight> &lights, unsigned int begin, unsigned int end)
+{
+    float sliceScale = CLUSTERS_Z / std::log(zFar / zNear);
+
+    for (unsigned int i = begin; i < end; i++)
+    {
+        const glm::vec4 &light = lights[i].positionRadius;
+        glm::vec3 center = glm::vec3(viewMatrix * glm::vec4(glm::vec3(light), 1));
+        float depth = -center.z;
+        float radius = light.w;
+
+        sliceBounds[i] = glm::ivec2(1, 0);
+        if (depth + radius <= 0 || depth - radius > zFar)
+            continue;
+
+        float nearest = MAX(depth - radius, zNear);
+        float farthest = MIN(depth + radius, zFar);
+        int firstSlice = (int)std::floor(std::log(nearest / zNear) * sliceScale);
+        int lastSlice = (int)std::floor(std::log(farthest / zNear) * sliceScale);
+
+        // A sphere reaching the first slice may cover any tile
+        glm::ivec2 x(0, CLUSTERS_X - 1), y(0, CLUSTERS_Y - 1);
+        if (depth - radius > zNear)
+        {
+            x = GetTileRange(center.x, depth, radius, projectionMatrix[0][0], projectionMatrix[2][0], CLUSTERS_X);
+            y = GetTileRange(center.y, depth, radius, projectionMatrix[1][1], projectionMatrix[2][1], CLUSTERS_Y);
+            if (x.x > x.y || y.x > y.y)
+                continue;
+        }
+
+        tileBounds[i] = glm::ivec4(x, y);
+        sliceBounds[i] = glm::clamp(glm::ivec2(firstSlice, lastSlice), 0, (int)CLUSTERS_Z - 1);
+    }
+}
+
+
+void LightClusters::FillSlice(unsigned int slice)
+{
+    glm::uvec2 *range = &ranges[slice * CLUSTERS_PER_SLICE];
+    for (unsigned int i = 0; i < CLUSTERS_PER_SLICE; i++)
+    {
+        range[i] = glm::uvec2(0);
+    }
+
+    // Counts the lights of each cluster, then places them after the ones before
+    unsigned int nrLights = static_cast<unsigned int>(sliceBounds.size());
+    for (unsigned int i = 0; i < nrLights; i++)
+    {
+        if ((int)slice < sliceBounds[i].x || (int)slice > sliceBounds[i].y)
+            continue;
+
+        const glm::ivec4 &tiles = tileBounds[i];
+        for (int y = tiles.z; y <= tiles.w; y++)
+        {
+            for (int x = tiles.x; x <= tiles.y; x++)
+            {
+                range[y * CLUSTERS_X + x].y++;
+            }
+        }
+    }
+
+    unsigned int total = 0;
+    for (unsigned int i = 0; i < CLUSTERS_PER_SLICE; i++)
+    {
+        range[i].x = total;
+        total += range[i].y;
+        range[i].y = 0;
+    }
+
+    std::vector<unsigned int> &list = sliceIndices[slice];
+    list.resize(total);
+    for (unsigned int i = 0; i < nrLights; i++)
+    {
+        if ((int)slice < sliceBounds[i].x || (int)slice > sliceBounds[i].y)
+            continue;
+
+        const glm::ivec4 &tiles = tileBounds[i];
+        for (int y = tiles.z; y <= tiles.w; y++)
+        {
+            for (int x = tiles.x; x <= tiles.y; x++)
+            {
+                glm::uvec2 &cluster = range[y * CLUSTERS_X + x];
+                list[cluster.x + cluster.y++] = i;
+            }
+        }
+    }
+}
+
+
+void LightClusters::Bind(Shader *shader, unsigned int firstTextureUnit) const
+{
+    static const char *samplers[3] = { "cluster_lights", "cluster_ranges", "cluster_indices" };
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        glActiveTexture(GL_TEXTURE0 + firstTextureUnit + i);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        glUniform1i(shader->GetUniformLocation(samplers[i]), firstTextureUnit + i);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform3i(shader->GetUniformLocation("cluster_count"), CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z);
+    glUniform2f(shader->GetUniformLocation("cluster_depth"), zNear, CLUSTERS_Z / std::log(zFar / zNear));
+    glUniformMatrix4fv(shader->GetUniformLocation("cluster_view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+}
+
+
+unsigned int LightClusters::GetNumberOfIndices() const
+{
+    return static_cast<unsigned int>(indices.size());
+}
+
+
+unsigned int LightClusters::GetMaxLightsPerCluster() const
+{
+    return maxLightsPerCluster;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "core/gpu/shader.h"
+#include "utils/glm_utils.h"
+
+
+// Point light as stored in the light buffer, two texels per light
+struct ClusterLight
+{
+    // World space position, and the distance the light reaches
+    glm::vec4 positionRadius;
+    glm::vec4 color;
+};
+
+
+// Assigns point lights to the cells of a view frustum grid, so shading a pixel
+// only visits the lights whose sphere overlaps the cell it falls in. The grid
+// splits the screen in CLUSTERS_X by CLUSTERS_Y tiles, and the depth between
+// the near and far planes in CLUSTERS_Z exponentially thicker slices. Each
+// light is bounded by the tiles and slices its sphere covers, then the slices
+// are filled in parallel on the shared thread pool, into one compact list of
+// light indices.
+//
+// The lights, the offset and count of each cell in the index list, and the
+// indices are uploaded to texture buffers, which OpenGL 3.3 has; see
+// Clusters.glsl for the lookup in the shaders.
+class LightClusters
+{
+ public:
+    LightClusters();
+    ~LightClusters();
+
+    void Init();
+
+    // Assigns `lights` to the clusters of the perspective frustum of `viewMatrix`
+    // and `projectionMatrix`, and uploads the result. The slices split the depths
+    // from `zNear` to `zFar`, and nearer ones fall in the first slice, so `zNear`
+    // may lie past the near plane to spend fewer slices right in front of the eye.
+    void Update(const std::vector<ClusterLight> &lights, const glm::mat4 &viewMatrix,
+                const glm::mat4 &projectionMatrix, float zNear, float zFar);
+
+    // Binds the buffers to three texture units from `firstTextureUnit` on, and
+    // sets the uniforms of Clusters.glsl in `shader`, which must be in use
+    void Bind(Shader *shader, unsigned int firstTextureUnit) const;
+
+    // Sum of the lights of every cluster, and the most any cluster holds
+    unsigned int GetNumberOfIndices() const;
+    unsigned int GetMaxLightsPerCluster() const;
+
+    static const unsigned int CLUSTERS_X = 16;
+    static const unsigned int CLUSTERS_Y = 9;
+    static const unsigned int CLUSTERS_Z = 24;
+
+ private:
+    LightClusters(const LightClusters &) = delete;
+    LightClusters &operator=(const LightClusters &) = delete;
+
+    void ComputeBounds(const std::vector<ClusterLight> &lights, unsigned int begin, unsigned int end);
+    void FillSlice(unsigned int slice);
+
+ private:
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    float zNear;
+    float zFar;
+
+    // First and last tile in x and y, and first and last slice, of each light.
+    // Lights outside of the frustum get an empty range of slices.
+    std::vector<glm::ivec4> tileBounds;
+    std::vector<glm::ivec2> sliceBounds;
+
+    // Light indices of every slice, and the offset and count of each of its
+    // clusters, relative to the slice
+    std::vector<unsigned int> sliceIndices[CLUSTERS_Z];
+    std::vector<glm::uvec2> ranges;
+    std::vector<unsigned int> indices;
+    unsigned int maxLightsPerCluster;
+
+    GLuint buffers[3];
+    GLuint textures[3];
+};
@@ -6,10 +6,13 @@
 #include "assimp/postprocess.h"         // Post processing flags
 
 #include "core/gpu/gpu_buffers.h"
+#include "core/gpu/mesh_simplifier.h"
 #include "core/gpu/texture2D.h"
+#include "core/managers/asset_watcher.h"
 #include "core/managers/texture_manager.h"
 
 #include "utils/memory_utils.h"
+#include "utils/text_utils.h"
 
 
 static_assert(sizeof(aiColor4D) == sizeof(glm::vec4), "WARNING! glm::vec4 and aiColor4D size differs!");
@@ -22,17 +25,19 @@ Mesh::Mesh(std::string meshID)
     useMaterial = true;
     glDrawMode = GL_TRIANGLES;
     buffers = new GPUBuffers();
+    boundingCenter = glm::vec3(0);
+    boundingRadius = 0;
+    textureArray = nullptr;
 }
 
 
 Mesh::~Mesh()
 {
+    AssetWatcher::Unwatch(this);
+
     ClearData();
     meshEntries.clear();
     SAFE_FREE(buffers);
-
-    ClearAnimations(anim, numAnim);
-    ClearRootNode(rootNode);
 }
 
 
@@ -62,72 +67,88 @@ void Mesh::ClearData()
     m_BoneInfo.clear();
     m_BoneMapping.clear();
     m_BoneInfo.clear();
+    m_NumBones = 0;
+    skeleton.Clear();
 }
 
-void Mesh::DeleteAnimationKeys(aiNodeAnim* nodeAnim) {
-    delete[] nodeAnim->mPositionKeys;
-    delete[] nodeAnim->mRotationKeys;
-    delete[] nodeAnim->mScalingKeys;
-}
-
-void Mesh::ClearAnimations(aiAnimation** animations, unsigned int numAnimations)
+bool Mesh::LoadMesh(const std::string& fileLocation,
+    const std::string& fileName)
 {
-    for (unsigned int animIndex = 0; animIndex < numAnimations; ++animIndex) {
-        aiAnimation* animation = animations[animIndex];
+    ClearData();
+    this->fileLocation = fileLocation;
+    std::string file = (fileLocation + '/' + fileName).c_str();
+
+    Assimp::Importer Importer;
 
-        for (unsigned int channelIndex = 0; channelIndex < animation->mNumChannels; ++channelIndex) {
-            DeleteAnimationKeys(animation->mChannels[channelIndex]);
-            delete animation->mChannels[channelIndex];
+    const aiScene* pScene = ImportScene(Importer, file, glDrawMode);
+
+    if (pScene) {
+        // Clips are shared by the meshes loaded from the same file
+        filePath = file;
+        m_GlobalInverseTransform = glm::inverse(ConvertMatrix(pScene->mRootNode->mTransformation));
+        if (!InitFromScene(pScene)) {
+            filePath.clear();
+            return false;
         }
 
-        delete[] animation->mChannels;
-        delete animation;
+        AssetWatcher::Watch(this);
+        return true;
     }
 
-    delete[] animations;
-}   
+    // pScene is freed when returning because of Importer
 
-void Mesh::ClearRootNode(aiNode* node)
-{
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        ClearRootNode(node->mChildren[childIndex]);
-    }
+    printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
+    return false;
+}
 
-    // Release memory for mMeshes array
-    delete[] node->mMeshes;
 
-    // Release memory for mChildren array and the node itself
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        delete node->mChildren[childIndex];
-    }
+const aiScene* Mesh::ImportScene(Assimp::Importer& importer,
+    const std::string& filePath, GLenum drawMode)
+{
+    unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
+    if (drawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
 
-    delete[] node->mChildren;
-    delete node;
+    return importer.ReadFile(filePath, flags);
 }
 
-bool Mesh::LoadMesh(const std::string& fileLocation,
-    const std::string& fileName)
+
+bool Mesh::ReloadFromScene(const aiScene* pScene)
 {
+    if (pScene == nullptr || filePath.empty())
+        return false;
+
     ClearData();
-    this->fileLocation = fileLocation;
-    std::string file = (fileLocation + '/' + fileName).c_str();
 
-    Assimp::Importer Importer;
+    // The clips of the old file stay with the meshes still using them
+    animations.clear();
+    AnimationClip::Invalidate(filePath);
 
-    unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
-    if (glDrawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
+    meshEntries.clear();
+    batchLODs.clear();
 
-    const aiScene* pScene = Importer.ReadFile(file, flags);
+    // Levels of detail and texture array layers are rebuilt for the new data
+    std::vector<float> screenSizes;
+    screenSizes.swap(lodScreenSizes);
+    TextureArray *array = textureArray;
+    textureArray = nullptr;
 
-    if (pScene) {
-        m_GlobalInverseTransform = glm::inverse(ConvertMatrix(pScene->mRootNode->mTransformation));
-        return InitFromScene(pScene);
-    }
+    m_GlobalInverseTransform = glm::inverse(ConvertMatrix(pScene->mRootNode->mTransformation));
+    if (!InitFromScene(pScene))
+        return false;
 
-    // pScene is freed when returning because of Importer
+    if (!screenSizes.empty())
+        GenerateLODs(lodRatios, screenSizes);
 
-    printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
-    return false;
+    if (array && UseTextureArray(array))
+        array->Build();
+
+    return true;
+}
+
+
+const std::string& Mesh::GetFilePath() const
+{
+    return filePath;
 }
 
 
@@ -206,9 +227,7 @@ bool Mesh::InitFromData(const std::vector<glm::vec3>& positions,
 
 bool Mesh::InitFromScene(const aiScene* pScene)
 {
-    
-    CopyAnimations(pScene);
-    rootNode = CopyRoot(pScene->mRootNode);
+    LoadAnimations(pScene);
 
     meshEntries.resize(pScene->mNumMeshes);
     materials.resize(pScene->mNumMaterials);
@@ -242,6 +261,9 @@ bool Mesh::InitFromScene(const aiScene* pScene)
         InitMesh(i, paiMesh);
     }
 
+    // Needs the bones of every entry
+    skeleton.Init(pScene->mRootNode, m_BoneMapping, m_BoneInfo, m_GlobalInverseTransform);
+
     if (useMaterial && !InitMaterials(pScene))
         return false;
 
@@ -250,88 +272,18 @@ bool Mesh::InitFromScene(const aiScene* pScene)
     return buffers->m_VAO != 0;
 }
 
-void Mesh::CopyAnimations(const aiScene* pScene)
+void Mesh::LoadAnimations(const aiScene* pScene)
 {
-    // Create a new aiAnimation instance for the destination animation
-    numAnim = pScene->mNumAnimations;
-    anim = new aiAnimation*[pScene->mNumAnimations];
+    animations.clear();
 
     for (unsigned int i = 0; i < pScene->mNumAnimations; i++)
     {
-        // Copy animation properties
-        anim[i] = new aiAnimation();
-        anim[i]->mName = pScene->mAnimations[i]->mName;
-        anim[i]->mDuration = pScene->mAnimations[i]->mDuration;
-        anim[i]->mTicksPerSecond = pScene->mAnimations[i]->mTicksPerSecond;
-
-        anim[i]->mNumChannels = pScene->mAnimations[i]->mNumChannels;
-        anim[i]->mChannels = new aiNodeAnim * [anim[i]->mNumChannels];
-
-        // Copy position, rotation, and scaling keyframes
-        for (int j = 0; j < anim[i]->mNumChannels; j++)
-        {
-            anim[i]->mChannels[j] = new aiNodeAnim();
-            anim[i]->mChannels[j]->mNodeName = pScene->mAnimations[i]->mChannels[j]->mNodeName;
-            anim[i]->mChannels[j]->mPostState = pScene->mAnimations[i]->mChannels[j]->mPostState;
-            anim[i]->mChannels[j]->mPreState = pScene->mAnimations[i]->mChannels[j]->mPreState;
-
-            anim[i]->mChannels[j]->mNumPositionKeys = pScene->mAnimations[i]->mChannels[j]->mNumPositionKeys;
-            anim[i]->mChannels[j]->mPositionKeys = new aiVectorKey[anim[i]->mChannels[j]->mNumPositionKeys];
-            memcpy(anim[i]->mChannels[j]->mPositionKeys, pScene->mAnimations[i]->mChannels[j]->mPositionKeys,
-                anim[i]->mChannels[j]->mNumPositionKeys * sizeof(aiVectorKey));
-
-            anim[i]->mChannels[j]->mNumRotationKeys = pScene->mAnimations[i]->mChannels[j]->mNumRotationKeys;
-            anim[i]->mChannels[j]->mRotationKeys = new aiQuatKey[anim[i]->mChannels[j]->mNumRotationKeys];
-            memcpy(anim[i]->mChannels[j]->mRotationKeys, pScene->mAnimations[i]->mChannels[j]->mRotationKeys,
-                anim[i]->mChannels[j]->mNumRotationKeys * sizeof(aiQuatKey));
-
-            anim[i]->mChannels[j]->mNumScalingKeys = pScene->mAnimations[i]->mChannels[j]->mNumScalingKeys;
-            anim[i]->mChannels[j]->mScalingKeys = new aiVectorKey[anim[i]->mChannels[j]->mNumScalingKeys];
-            memcpy(anim[i]->mChannels[j]->mScalingKeys, pScene->mAnimations[i]->mChannels[j]->mScalingKeys,
-                anim[i]->mChannels[j]->mNumScalingKeys * sizeof(aiVectorKey));
-        }
-
-        anim[i]->mNumMeshChannels = pScene->mAnimations[i]->mNumMeshChannels;
-        anim[i]->mMeshChannels = new aiMeshAnim * [anim[i]->mNumMeshChannels];
-
-        for (int j = 0; j < anim[i]->mNumMeshChannels; j++)
-        {
-            anim[i]->mMeshChannels[j] = new aiMeshAnim();
-            anim[i]->mMeshChannels[j]->mName = pScene->mAnimations[i]->mMeshChannels[j]->mName;
-            anim[i]->mMeshChannels[j]->mNumKeys = pScene->mAnimations[i]->mMeshChannels[j]->mNumKeys;
-            anim[i]->mMeshChannels[j]->mKeys = new aiMeshKey(pScene->mAnimations[i]->mMeshChannels[j]->mKeys->mTime,
-                pScene->mAnimations[i]->mMeshChannels[j]->mKeys->mValue);
-        }
+        std::shared_ptr<const AnimationClip> clip = AnimationClip::Load(filePath, i, pScene);
+        if (clip)
+            animations.push_back(clip);
     }
 }
 
-aiNode* Mesh::CopyRoot(const aiNode* sourceNode)
-{
-    // Create a new aiNode instance for the destination node
-    aiNode* destNode = new aiNode();
-
-    // Copy node properties
-    destNode->mName = sourceNode->mName;
-    destNode->mTransformation = sourceNode->mTransformation;
-    destNode->mMeshes = new unsigned int[sourceNode->mNumMeshes];
-    for (unsigned int i = 0; i < sourceNode->mNumMeshes; ++i) {
-        destNode->mMeshes[i] = sourceNode->mMeshes[i];
-    }
-    destNode->mNumMeshes = sourceNode->mNumMeshes;
-    destNode->mParent = nullptr; // Set parent to nullptr for now
-
-    // Copy child nodes recursively
-    destNode->mNumChildren = sourceNode->mNumChildren;
-    destNode->mChildren = new aiNode * [sourceNode->mNumChildren];
-
-    for (unsigned int childIndex = 0; childIndex < sourceNode->mNumChildren; ++childIndex) {
-        destNode->mChildren[childIndex] = CopyRoot(sourceNode->mChildren[childIndex]);
-        destNode->mChildren[childIndex]->mParent = destNode; // Set the parent for the child
-    }
-
-    return destNode;
-}
-
 void Mesh::InitMesh(int index, const aiMesh* paiMesh)
 {
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
@@ -414,6 +366,7 @@ bool Mesh::InitMaterials(const aiScene* pScene)
             if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
             {
                 materials[i]->texture = TextureManager::LoadTexture(fileLocation, Path.data);
+                materials[i]->textureFile = fileLocation + PATH_SEPARATOR + Path.data;
             }
         }
 
@@ -453,9 +406,240 @@ void Mesh::UseMaterials(bool value)
 }
 
 
+bool Mesh::GenerateLODs(const std::vector<float> &ratios, const std::vector<float> &screenSizes)
+{
+    if (glDrawMode != GL_TRIANGLES || ratios.empty() || ratios.size() != screenSizes.size())
+        return false;
+
+    // Loaded meshes keep their positions, meshes built from `VertexFormat` keep vertices
+    std::vector<glm::vec3> vertexPositions = positions;
+    if (vertexPositions.empty())
+    {
+        vertexPositions.reserve(vertices.size());
+        for (auto &v : vertices)
+            vertexPositions.push_back(v.position);
+    }
+
+    if (vertexPositions.empty() || indices.empty())
+        return false;
+
+    glm::vec3 minPos = vertexPositions[0];
+    glm::vec3 maxPos = vertexPositions[0];
+    for (auto &p : vertexPositions)
+    {
+        minPos = glm::min(minPos, p);
+        maxPos = glm::max(maxPos, p);
+    }
+
+    boundingCenter = (minPos + maxPos) * 0.5f;
+    boundingRadius = 0;
+    for (auto &p : vertexPositions)
+        boundingRadius = MAX(boundingRadius, glm::distance(boundingCenter, p));
+
+    // Drop a previously generated chain, keeping only the original ranges
+    unsigned int nrOriginalIndices = 0;
+    for (auto &entry : meshEntries)
+        nrOriginalIndices = MAX(nrOriginalIndices, entry.baseIndex + entry.nrIndices);
+    indices.resize(nrOriginalIndices);
+
+    for (auto &entry : meshEntries)
+    {
+        entry.lods.clear();
+
+        unsigned int nrVertices = 0;
+        for (unsigned int i = 0; i < entry.nrIndices; i++)
+            nrVertices = MAX(nrVertices, indices[entry.baseIndex + i] + 1);
+        nrVertices = MIN(nrVertices, (unsigned int)vertexPositions.size() - entry.baseVertex);
+
+        for (unsigned int lod = 0; lod < ratios.size(); lod++)
+        {
+            MeshLOD range;
+            unsigned int target = static_cast<unsigned int>(entry.nrIndices * ratios[lod]);
+
+            if (target >= entry.nrIndices)
+            {
+                range.baseIndex = entry.baseIndex;
+                range.nrIndices = entry.nrIndices;
+            } else {
+                std::vector<unsigned int> simplified = mesh_simplifier::Simplify(
+                    &vertexPositions[entry.baseVertex], nrVertices,
+                    &indices[entry.baseIndex], entry.nrIndices, target);
+
+                range.baseIndex = (unsigned int)indices.size();
+                range.nrIndices = (unsigned int)simplified.size();
+                indices.insert(indices.end(), simplified.begin(), simplified.end());
+            }
+
+            entry.lods.push_back(range);
+        }
+    }
+
+    lodRatios = ratios;
+    lodScreenSizes = screenSizes;
+
+    // Batches are rebuilt with a range per level
+    bool batched = !batchLODs.empty();
+    batchLODs.clear();
+    if (batched)
+        BuildBatch();
+
+    buffers->UploadIndices(indices);
+    return true;
+}
+
+
+unsigned int Mesh::GetNumberOfLODs() const
+{
+    return lodScreenSizes.empty() ? 1 : (unsigned int)lodScreenSizes.size();
+}
+
+
+unsigned int Mesh::SelectLOD(const glm::mat4 &modelMatrix,
+                             const glm::mat4 &viewMatrix,
+                             const glm::mat4 &projectionMatrix) const
+{
+    if (lodScreenSizes.empty())
+        return 0;
+
+    glm::vec3 center = glm::vec3(viewMatrix * modelMatrix * glm::vec4(boundingCenter, 1));
+    float scale = MAX(glm::length(glm::vec3(modelMatrix[0])),
+                  MAX(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    float radius = boundingRadius * scale;
+    float distance = glm::length(center);
+
+    if (distance <= radius)
+        return 0;
+
+    // Fraction of the viewport height covered by the projected bounding sphere
+    float screenSize = radius * projectionMatrix[1][1] / distance;
+
+    for (unsigned int lod = 0; lod < lodScreenSizes.size(); lod++)
+    {
+        if (screenSize >= lodScreenSizes[lod])
+            return lod;
+    }
+
+    return (unsigned int)lodScreenSizes.size() - 1;
+}
+
+
+bool Mesh::UseTextureArray(TextureArray *textureArray)
+{
+    unsigned int nrVertices = (unsigned int)(positions.empty() ? vertices.size() : positions.size());
+
+    if (textureArray == nullptr || nrVertices == 0 || glDrawMode != GL_TRIANGLES || buffers->m_VAO == 0)
+        return false;
+
+    // Untextured materials get a white layer, from the empty file name
+    for (auto material : materials)
+    {
+        if (material)
+            material->layer = textureArray->AddLayer(material->texture ? material->textureFile : std::string());
+    }
+
+    std::vector<float> layers(nrVertices, 0);
+    for (unsigned int i = 0; i < meshEntries.size(); i++)
+    {
+        const MeshEntry &entry = meshEntries[i];
+        unsigned int end = (i + 1 < meshEntries.size()) ? meshEntries[i + 1].baseVertex : nrVertices;
+
+        float layer = (entry.materialIndex != INVALID_MATERIAL && materials[entry.materialIndex])
+            ? (float)materials[entry.materialIndex]->layer
+            : (float)textureArray->AddLayer(std::string());
+
+        for (unsigned int v = entry.baseVertex; v < end; v++)
+            layers[v] = layer;
+    }
+
+    buffers->SetFloatAttribute(TEXTURE_LAYER_LOCATION, layers);
+    this->textureArray = textureArray;
+
+    if (batchLODs.empty())
+    {
+        BuildBatch();
+        buffers->UploadIndices(indices);
+    }
+
+    return true;
+}
+
+
+void Mesh::BuildBatch()
+{
+    batchLODs.clear();
+
+    for (unsigned int lod = 0; lod < GetNumberOfLODs(); lod++)
+    {
+        MeshLOD batch;
+        batch.baseIndex = (unsigned int)indices.size();
+
+        for (auto &entry : meshEntries)
+        {
+            const MeshLOD *range = entry.lods.empty() ? nullptr : &entry.lods[MIN(lod, (unsigned int)entry.lods.size() - 1)];
+            unsigned int baseIndex = range ? range->baseIndex : entry.baseIndex;
+            unsigned int nrIndices = range ? range->nrIndices : entry.nrIndices;
+
+            for (unsigned int i = 0; i < nrIndices; i++)
+            {
+                unsigned int index = indices[baseIndex + i] + entry.baseVertex;
+                indices.push_back(index);
+            }
+        }
+
+        batch.nrIndices = (unsigned int)indices.size() - batch.baseIndex;
+        batchLODs.push_back(batch);
+    }
+}
+
+
 void Mesh::Render() const
+{
+    Render(0);
+}
+
+
+void Mesh::Render(unsigned int lod) const
+{
+    Draw(lod, 0);
+}
+
+
+void Mesh::RenderInstanced(unsigned int nrInstances, unsigned int lod) const
+{
+    if (nrInstances)
+        Draw(lod, nrInstances);
+}
+
+
+void Mesh::BatchEntries()
+{
+    if (batchLODs.empty() && !indices.empty())
+    {
+        BuildBatch();
+        buffers->UploadIndices(indices);
+    }
+}
+
+
+void Mesh::Draw(unsigned int lod, unsigned int nrInstances) const
 {
     glBindVertexArray(buffers->m_VAO);
+
+    // A texture array holds every material, and without materials no texture changes between entries
+    if ((textureArray || !useMaterial) && !batchLODs.empty())
+    {
+        if (textureArray && useMaterial)
+            textureArray->BindToTextureUnit(GL_TEXTURE0);
+
+        const MeshLOD &batch = batchLODs[MIN(lod, (unsigned int)batchLODs.size() - 1)];
+        if (nrInstances)
+            glDrawElementsInstanced(glDrawMode, batch.nrIndices, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * batch.baseIndex), nrInstances);
+        else
+            glDrawElements(glDrawMode, batch.nrIndices, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * batch.baseIndex));
+        glBindVertexArray(0);
+        return;
+    }
+
     for (unsigned int i = 0; i < meshEntries.size(); i++)
     {
         if (useMaterial)
@@ -469,9 +653,27 @@ void Mesh::Render() const
             }
         }
 
-        glDrawElementsBaseVertex(glDrawMode, meshEntries[i].nrIndices,
-            GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * meshEntries[i].baseIndex),
-            meshEntries[i].baseVertex);
+        unsigned int nrIndices = meshEntries[i].nrIndices;
+        unsigned int baseIndex = meshEntries[i].baseIndex;
+        if (!meshEntries[i].lods.empty())
+        {
+            const MeshLOD &range = meshEntries[i].lods[MIN(lod, (unsigned int)meshEntries[i].lods.size() - 1)];
+            nrIndices = range.nrIndices;
+            baseIndex = range.baseIndex;
+        }
+
+        if (nrInstances)
+        {
+            glDrawElementsInstancedBaseVertex(glDrawMode, nrIndices,
+                GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * baseIndex),
+                nrInstances, meshEntries[i].baseVertex);
+        }
+        else
+        {
+            glDrawElementsBaseVertex(glDrawMode, nrIndices,
+                GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * baseIndex),
+                meshEntries[i].baseVertex);
+        }
     }
     glBindVertexArray(0);
 }
@@ -3,20 +3,31 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
+#include "core/gpu/animation_clip.h"
+#include "core/gpu/skeleton.h"
 #include "core/gpu/vertex_format.h"
 #include "core/gpu/texture2D.h"
+#include "core/gpu/texture_array.h"
 #include "core/gpu/gpu_buffers.h"
 
 #include "assimp/scene.h"   // Output data structure
 
 
+namespace Assimp
+{
+    class Importer;
+}
+
+
 class Material
 {
  public:
     Material()
     {
         texture = nullptr;
+        layer = 0;
     }
 
     glm::vec4 ambient;
@@ -26,10 +37,29 @@ class Material
     float shininess;
 
     Texture2D* texture;
+
+    // Source of `texture`, and its layer once the mesh uses a texture array
+    std::string textureFile;
+    unsigned int layer;
 };
 
 static const unsigned int INVALID_MATERIAL = std::numeric_limits<unsigned int>::max();
 
+// Vertex attribute holding the texture array layer of each vertex, as a float
+static const unsigned int TEXTURE_LAYER_LOCATION = 5;
+
+class MeshLOD
+{
+ public:
+    MeshLOD()
+    {
+        nrIndices = 0;
+        baseIndex = 0;
+    }
+    unsigned int nrIndices;
+    unsigned int baseIndex;
+};
+
 class MeshEntry
 {
  public:
@@ -44,6 +74,10 @@ class MeshEntry
     unsigned int baseVertex;
     unsigned int baseIndex;
     unsigned int materialIndex;
+
+    // Index ranges of each level of detail, all sharing `baseVertex`.
+    // Empty if no chain was generated, in which case LOD 0 is used.
+    std::vector<MeshLOD> lods;
 };
 
 class Mesh
@@ -78,6 +112,19 @@ class Mesh
     bool LoadMesh(const std::string& fileLocation,
                   const std::string& fileName);
 
+    // Reads a model file the way LoadMesh does, without touching the GPU, so it
+    // can run on any thread. The scene is owned by `importer`.
+    static const aiScene* ImportScene(Assimp::Importer& importer,
+                                      const std::string& filePath,
+                                      GLenum drawMode);
+
+    // Replaces the contents of a mesh loaded with LoadMesh by a newly imported
+    // scene, regenerating its levels of detail and texture array layers
+    bool ReloadFromScene(const aiScene* pScene);
+
+    // File the mesh was loaded from, empty for meshes built from data
+    const std::string& GetFilePath() const;
+
     glm::mat4 ConvertMatrix(const aiMatrix4x4& aiMat);
     void UseMaterials(bool value);
 
@@ -87,6 +134,35 @@ class Mesh
     GLenum GetDrawMode() const;
 
     void Render() const;
+    void Render(unsigned int lod) const;
+
+    // Draws `nrInstances` copies of the mesh. Per-instance attributes come from
+    // buffers the caller adds to the VAO, at locations above TEXTURE_LAYER_LOCATION.
+    void RenderInstanced(unsigned int nrInstances, unsigned int lod = 0) const;
+
+    // Appends, per level of detail, one index range covering every entry. Meshes
+    // drawn without materials then render with a single call, as meshes using a
+    // texture array do.
+    void BatchEntries();
+
+    // Builds a chain of simplified index ranges appended to the index buffer of the
+    // mesh, so every level of detail reuses the same VAO. Each ratio is the fraction
+    // of triangles kept by that level; each screen size is the smallest fraction of
+    // the viewport height the bounding sphere must cover for that level to be used.
+    bool GenerateLODs(const std::vector<float> &ratios = { 1.0f, 0.5f, 0.25f, 0.1f },
+                      const std::vector<float> &screenSizes = { 0.25f, 0.1f, 0.04f, 0.0f });
+    unsigned int GetNumberOfLODs() const;
+
+    // Adds the diffuse texture of every material as a layer of `textureArray` and stores
+    // the layer of each vertex at TEXTURE_LAYER_LOCATION. From then on, the mesh binds
+    // only the array and draws all its entries with one call. Several meshes can share
+    // an array; call TextureArray::Build() once they are all added.
+    bool UseTextureArray(TextureArray *textureArray);
+
+    // Picks the level of detail from the projected screen-space size of the bounding sphere
+    unsigned int SelectLOD(const glm::mat4 &modelMatrix,
+                           const glm::mat4 &viewMatrix,
+                           const glm::mat4 &projectionMatrix) const;
 
     const GPUBuffers* GetBuffers() const;
     const char* GetMeshID() const;
@@ -99,12 +175,14 @@ class Mesh
     bool InitMaterials(const aiScene* pScene);
     bool InitFromScene(const aiScene* pScene);
 
-    aiNode* CopyRoot(const aiNode* sourceNode);
-    void CopyAnimations(const aiScene* pScene);
+    void LoadAnimations(const aiScene* pScene);
+
+    // Appends, per level of detail, one index range covering every entry,
+    // rebased so it can be drawn without a base vertex
+    void BuildBatch();
 
-    void DeleteAnimationKeys(aiNodeAnim* nodeAnim);
-    void ClearAnimations(aiAnimation** animations, unsigned int numAnimations);
-    void ClearRootNode(aiNode* node);
+    // Draws without instancing when `nrInstances` is 0
+    void Draw(unsigned int lod, unsigned int nrInstances) const;
 
  private:
     std::string meshID;
@@ -119,13 +197,13 @@ class Mesh
     std::vector<BoneInfo> m_BoneInfo;
     std::map<std::string, int> m_BoneMapping;
     glm::mat4 m_GlobalInverseTransform;
-    aiAnimation** anim;
-    aiNode* rootNode;
+    std::vector<std::shared_ptr<const AnimationClip>> animations;
+    Skeleton skeleton;
     int m_NumBones = 0;
-    int numAnim;
 
  protected:
     std::string fileLocation;
+    std::string filePath;
 
     bool useMaterial;
     GLenum glDrawMode;
@@ -133,4 +211,12 @@ class Mesh
 
     std::vector<MeshEntry> meshEntries;
     std::vector<Material*> materials;
+
+    std::vector<float> lodRatios;
+    std::vector<float> lodScreenSizes;
+    glm::vec3 boundingCenter;
+    float boundingRadius;
+
+    TextureArray *textureArray;
+    std::vector<MeshLOD> batchLODs;
 };
@@ -0,0 +1,285 @@
+#include "core/gpu/mesh_simplifier.h"
+
+#include <queue>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+
+// Weight of the planes that keep open borders (and UV seams) in place
+static const double BOUNDARY_WEIGHT = 10.0;
+
+// Minimum cosine between a triangle normal before and after a collapse
+static const float MAX_NORMAL_FLIP = 0.2f;
+
+
+// Symmetric 4x4 error quadric, stored as its 10 unique coefficients
+struct Quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+    Quadric()
+    {
+        a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0;
+    }
+
+    void AddPlane(const glm::vec3 &n, float d, double weight)
+    {
+        double a = n.x, b = n.y, c = n.z;
+        a2 += weight * a * a;   ab += weight * a * b;   ac += weight * a * c;   ad += weight * a * d;
+        b2 += weight * b * b;   bc += weight * b * c;   bd += weight * b * d;
+        c2 += weight * c * c;   cd += weight * c * d;
+        d2 += weight * d * d;
+    }
+
+    void Add(const Quadric &q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+    }
+
+    double Evaluate(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+             + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+             + c2 * z * z + 2 * cd * z
+             + d2;
+    }
+};
+
+
+struct Collapse
+{
+    double cost;
+    unsigned int from;
+    unsigned int to;
+    unsigned int fromVersion;
+    unsigned int toVersion;
+
+    bool operator>(const Collapse &other) const
+    {
+        return cost > other.cost;
+    }
+};
+
+
+static inline uint64_t EdgeKey(unsigned int a, unsigned int b)
+{
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+
+static inline glm::vec3 TriangleNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+{
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+
+std::vector<unsigned int> mesh_simplifier::Simplify(
+    const glm::vec3 *positions,
+    unsigned int nrVertices,
+    const unsigned int *indices,
+    unsigned int nrIndices,
+    unsigned int targetNrIndices)
+{
+    std::vector<unsigned int> triangles(indices, indices + nrIndices);
+    unsigned int nrTriangles = nrIndices / 3;
+    unsigned int targetTriangles = targetNrIndices / 3;
+
+    if (targetTriangles >= nrTriangles || nrVertices == 0)
+        return triangles;
+
+    std::vector<Quadric> quadrics(nrVertices);
+    std::vector<std::vector<unsigned int>> vertexTriangles(nrVertices);
+    std::unordered_map<uint64_t, unsigned int> edgeUsage;
+
+    // Accumulate the area weighted plane of each triangle into its vertices
+    for (unsigned int t = 0; t < nrTriangles; t++)
+    {
+        const unsigned int *tri = &triangles[3 * t];
+        glm::vec3 n = TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+        float length = glm::length(n);
+
+        for (int k = 0; k < 3; k++)
+        {
+            vertexTriangles[tri[k]].push_back(t);
+            edgeUsage[EdgeKey(tri[k], tri[(k + 1) % 3])]++;
+        }
+
+        if (length == 0)
+            continue;
+
+        n /= length;
+        float d = -glm::dot(n, positions[tri[0]]);
+        for (int k = 0; k < 3; k++)
+            quadrics[tri[k]].AddPlane(n, d, 0.5 * length);
+    }
+
+    // Constrain open edges with planes perpendicular to the surface
+    for (unsigned int t = 0; t < nrTriangles; t++)
+    {
+        const unsigned int *tri = &triangles[3 * t];
+        glm::vec3 n = TriangleNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+        if (glm::length(n) == 0)
+            continue;
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v0 = tri[k];
+            unsigned int v1 = tri[(k + 1) % 3];
+            if (edgeUsage[EdgeKey(v0, v1)] != 1)
+                continue;
+
+            glm::vec3 edge = positions[v1] - positions[v0];
+            glm::vec3 side = glm::cross(edge, n);
+            float length = glm::length(side);
+            if (length == 0)
+                continue;
+
+            side /= length;
+            float d = -glm::dot(side, positions[v0]);
+            double weight = BOUNDARY_WEIGHT * glm::dot(edge, edge);
+            quadrics[v0].AddPlane(side, d, weight);
+            quadrics[v1].AddPlane(side, d, weight);
+        }
+    }
+
+    std::vector<bool> removed(nrTriangles, false);
+    std::vector<bool> collapsed(nrVertices, false);
+    std::vector<unsigned int> version(nrVertices, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    auto pushEdge = [&](unsigned int u, unsigned int v)
+    {
+        Quadric q = quadrics[u];
+        q.Add(quadrics[v]);
+
+        // Collapse onto whichever endpoint introduces the smaller error
+        double costUV = q.Evaluate(positions[v]);
+        double costVU = q.Evaluate(positions[u]);
+
+        Collapse c;
+        c.cost = costUV <= costVU ? costUV : costVU;
+        c.from = costUV <= costVU ? u : v;
+        c.to = costUV <= costVU ? v : u;
+        c.fromVersion = version[c.from];
+        c.toVersion = version[c.to];
+        heap.push(c);
+    };
+
+    for (auto &edge : edgeUsage)
+    {
+        pushEdge((unsigned int)(edge.first >> 32), (unsigned int)(edge.first & 0xFFFFFFFF));
+    }
+
+    unsigned int liveTriangles = nrTriangles;
+    std::vector<unsigned int> neighbours;
+
+    while (liveTriangles > targetTriangles && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+
+        if (collapsed[c.from] || collapsed[c.to])
+            continue;
+        if (version[c.from] != c.fromVersion || version[c.to] != c.toVersion)
+            continue;
+
+        // Reject collapses that would fold triangles over
+        bool flips = false;
+        for (unsigned int t : vertexTriangles[c.from])
+        {
+            if (removed[t])
+                continue;
+
+            const unsigned int *tri = &triangles[3 * t];
+            if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                continue;
+
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = positions[tri[k]];
+                q[k] = positions[tri[k] == c.from ? c.to : tri[k]];
+            }
+
+            glm::vec3 before = TriangleNormal(p[0], p[1], p[2]);
+            glm::vec3 after = TriangleNormal(q[0], q[1], q[2]);
+            float lengths = glm::length(before) * glm::length(after);
+            if (lengths == 0 || glm::dot(before, after) < MAX_NORMAL_FLIP * lengths)
+            {
+                flips = true;
+                break;
+            }
+        }
+
+        if (flips)
+            continue;
+
+        // Move every triangle of `from` onto `to`, dropping the degenerate ones
+        for (unsigned int t : vertexTriangles[c.from])
+        {
+            if (removed[t])
+                continue;
+
+            unsigned int *tri = &triangles[3 * t];
+            bool hasTarget = (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to);
+            for (int k = 0; k < 3; k++)
+            {
+                if (tri[k] == c.from)
+                    tri[k] = c.to;
+            }
+
+            if (hasTarget)
+            {
+                removed[t] = true;
+                liveTriangles--;
+            } else {
+                vertexTriangles[c.to].push_back(t);
+            }
+        }
+
+        quadrics[c.to].Add(quadrics[c.from]);
+        collapsed[c.from] = true;
+        vertexTriangles[c.from].clear();
+        version[c.from]++;
+        version[c.to]++;
+
+        // Re-evaluate the edges around the surviving vertex
+        neighbours.clear();
+        for (unsigned int t : vertexTriangles[c.to])
+        {
+            if (removed[t])
+                continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = triangles[3 * t + k];
+                if (v != c.to)
+                    neighbours.push_back(v);
+            }
+        }
+
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+
+        for (unsigned int v : neighbours)
+        {
+            pushEdge(c.to, v);
+        }
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(3 * liveTriangles);
+    for (unsigned int t = 0; t < nrTriangles; t++)
+    {
+        if (!removed[t])
+            result.insert(result.end(), &triangles[3 * t], &triangles[3 * t] + 3);
+    }
+
+    return result;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/glm_utils.h"
+
+
+namespace mesh_simplifier
+{
+    // -------------------------------------------------------------------------
+    // Reduce a triangle list to at most `targetNrIndices` indices using
+    // quadric-error edge collapses. Vertices are only ever collapsed onto
+    // other existing vertices, so the result indexes the same vertex buffer
+    // as the input and can be appended to the original index buffer.
+    std::vector<unsigned int> Simplify(
+        const glm::vec3 *positions,
+        unsigned int nrVertices,
+        const unsigned int *indices,
+        unsigned int nrIndices,
+        unsigned int targetNrIndices);
+}
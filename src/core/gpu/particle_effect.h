@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <chrono>
+#include <string>
 
 #include "utils/gl_utils.h"
 #include "utils/glm_utils.h"
@@ -12,6 +13,7 @@
 #include "core/gpu/shader.h"
 #include "core/gpu/texture2D.h"
 #include "core/gpu/ssbo.h"
+#include "core/gpu/particle_sorter.h"
 
 
 // TODO(developer): Decouple gfxc components from this class
@@ -26,6 +28,10 @@ class ParticleEffect
     virtual void FillRandomData(std::function<T(void)> generator);
     virtual void Render(gfxc::Camera *camera, Shader *shader, unsigned int nrParticles = -1);
 
+    // Sorts the particles back to front on the GPU before each render, from
+    // now on. `positionOffset` is where the position lies in `T`, in bytes.
+    virtual bool EnableSorting(const std::string &shaderDirectory, unsigned int positionOffset = 0);
+
     virtual SSBO<T>* GetParticleBuffer() const
     {
         return particles;
@@ -43,7 +49,11 @@ class ParticleEffect
     unsigned int particleCount;
     GLuint VAO;
     GLuint VBO;
+    GLuint IBO;
     SSBO<T> *particles;
+
+    ParticleSorter *sorter;
+    unsigned int positionOffset;
 };
 
 
@@ -52,6 +62,11 @@ ParticleEffect<T>::ParticleEffect()
 {
     source = new gfxc::Transform();
     particles = nullptr;
+    particleCount = 0;
+    VAO = 0;
+    IBO = 0;
+    sorter = nullptr;
+    positionOffset = 0;
 }
 
 
@@ -60,12 +75,44 @@ ParticleEffect<T>::~ParticleEffect()
 {
     SAFE_FREE(source);
     SAFE_FREE(particles);
+    SAFE_FREE(sorter);
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &IBO);
+}
+
+
+template <class T>
+bool ParticleEffect<T>::EnableSorting(const std::string &shaderDirectory, unsigned int positionOffset)
+{
+    if (sorter == nullptr)
+    {
+        sorter = new ParticleSorter();
+        if (!sorter->Init(shaderDirectory))
+        {
+            SAFE_FREE(sorter);
+            return false;
+        }
+    }
+
+    this->positionOffset = positionOffset;
+    return true;
 }
 
 
 template <class T>
 void ParticleEffect<T>::Render(gfxc::Camera *camera, Shader *shader, unsigned int nrParticles)
 {
+    unsigned int count = MIN(particleCount, nrParticles);
+
+    // Sorting uses its own programs, so the shader is bound again afterwards
+    if (sorter)
+    {
+        glm::mat4 modelView = camera->GetViewMatrix() * source->GetModel();
+        sorter->Sort(particles->GetBufferID(), sizeof(T), positionOffset, IBO, count, modelView);
+        shader->Use();
+    }
+
     // Bind MVP
     glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(source->GetModel()));
     glUniformMatrix4fv(shader->loc_view_matrix, 1, false, glm::value_ptr(camera->GetViewMatrix()));
@@ -77,7 +124,7 @@ void ParticleEffect<T>::Render(gfxc::Camera *camera, Shader *shader, unsigned in
 
     // Render Particles
     glBindVertexArray(VAO);
-    glDrawElements(GL_POINTS, MIN(particleCount, nrParticles), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_POINTS, count, GL_UNSIGNED_INT, 0);
 }
 
 
@@ -97,7 +144,9 @@ void ParticleEffect<T>::Generate(unsigned int particleCount, bool createLocalBuf
         p++;
     }
 
-    GLuint IBO;
+    // Regenerating starts over with new buffers
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &IBO);
 
     glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
@@ -0,0 +1,404 @@
+#include "core/gpu/particle_simulator.h"
+
+#include <utility>
+
+#include "utils/math_utils.h"
+#include "utils/simd_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Same as Hash() in Particle.Common.glsl
+static uint32_t Hash(uint32_t x)
+{
+    uint32_t state = x * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+
+static float Random(uint32_t &seed)
+{
+    seed = Hash(seed);
+    return (float)seed * (1.0f / 4294967295.0f);
+}
+
+
+using simd_utils::ScalarLanes;
+using simd_utils::SIMDLanes;
+
+
+struct IntegrateParams
+{
+    float deltaTime;
+
+    // Speed is scaled by `damping` then gains `acceleration`, as in
+    // speed += (gravity - drag * speed) * deltaTime
+    float damping;
+    glm::vec3 acceleration;
+};
+
+
+// Integrates the particles in [begin, end) that fill whole registers, and
+// returns where it stopped. Matches Particle.Simulate.CS.glsl, where the delay
+// is folded into the remaining lifetime.
+template <class Lanes>
+static unsigned int Integrate(ParticleArrays &p, unsigned int begin, unsigned int end, const IntegrateParams &params)
+{
+    typedef typename Lanes::Type V;
+
+    const V zero = Lanes::Set(0);
+    const V deltaTime = Lanes::Set(params.deltaTime);
+    const V damping = Lanes::Set(params.damping);
+    const V accelerationX = Lanes::Set(params.acceleration.x);
+    const V accelerationY = Lanes::Set(params.acceleration.y);
+    const V accelerationZ = Lanes::Set(params.acceleration.z);
+
+    float *position[3] = { p.positionX.data(), p.positionY.data(), p.positionZ.data() };
+    float *speed[3] = { p.speedX.data(), p.speedY.data(), p.speedZ.data() };
+    const V acceleration[3] = { accelerationX, accelerationY, accelerationZ };
+
+    unsigned int i = begin;
+    for (; i + Lanes::WIDTH <= end; i += Lanes::WIDTH)
+    {
+        // Whatever the delay went below zero is taken off the lifetime
+        V delay = Lanes::Sub(Lanes::Load(&p.delay[i]), deltaTime);
+        V moving = Lanes::Less(delay, zero);
+        V lifetime = Lanes::Load(&p.lifetime[i]);
+
+        Lanes::Store(&p.lifetime[i], Lanes::Select(moving, Lanes::Add(lifetime, delay), lifetime));
+        Lanes::Store(&p.delay[i], Lanes::Select(moving, zero, delay));
+
+        for (unsigned int axis = 0; axis < 3; axis++)
+        {
+            V s = Lanes::Load(&speed[axis][i]);
+            V x = Lanes::Load(&position[axis][i]);
+            V newSpeed = Lanes::Add(Lanes::Mul(s, damping), acceleration[axis]);
+            V newPosition = Lanes::Add(x, Lanes::Mul(newSpeed, deltaTime));
+
+            Lanes::Store(&speed[axis][i], Lanes::Select(moving, newSpeed, s));
+            Lanes::Store(&position[axis][i], Lanes::Select(moving, newPosition, x));
+        }
+    }
+
+    return i;
+}
+
+
+// -------------------------------------------------------------------------
+
+// Position of `x` in a grid of `resolution` cells over [low, high], in cells
+// from the first center, clamped to the grid as with GL_CLAMP_TO_EDGE
+static float GridCoordinate(float x, float low, float high, int resolution, int &first)
+{
+    float u = (x - low) / (high - low) * resolution - 0.5f;
+    u = glm::clamp(u, 0.0f, (float)(resolution - 1));
+    first = MIN((int)u, resolution - 2 < 0 ? 0 : resolution - 2);
+    return u - first;
+}
+
+
+static void Bounce(glm::vec3 &speed, const glm::vec3 &normal, float restitution, float friction)
+{
+    float normalSpeed = glm::dot(speed, normal);
+    if (normalSpeed < 0)
+        speed = (speed - normalSpeed * normal) * (1 - friction) - normalSpeed * restitution * normal;
+}
+
+
+ParticleCollider::ParticleCollider()
+{
+    heightResolution = glm::ivec2(0);
+    heightMin = heightMax = glm::vec2(0);
+    distanceResolution = glm::ivec3(0);
+    distanceMin = distanceMax = glm::vec3(0);
+    restitution = 0.3f;
+    friction = 0.2f;
+}
+
+
+float ParticleCollider::GetHeight(float x, float z) const
+{
+    int i, j;
+    float fx = GridCoordinate(x, heightMin.x, heightMax.x, heightResolution.x, i);
+    float fz = GridCoordinate(z, heightMin.y, heightMax.y, heightResolution.y, j);
+    int di = (heightResolution.x > 1) ? 1 : 0;
+    int dj = (heightResolution.y > 1) ? heightResolution.x : 0;
+
+    const float *h = &heights[i + j * heightResolution.x];
+    return glm::mix(glm::mix(h[0], h[di], fx), glm::mix(h[dj], h[dj + di], fx), fz);
+}
+
+
+glm::vec3 ParticleCollider::GetHeightNormal(float x, float z) const
+{
+    glm::vec2 cell = (heightMax - heightMin) / glm::vec2(heightResolution);
+    float slopeX = (GetHeight(x + cell.x, z) - GetHeight(x - cell.x, z)) / (2 * cell.x);
+    float slopeZ = (GetHeight(x, z + cell.y) - GetHeight(x, z - cell.y)) / (2 * cell.y);
+    return glm::normalize(glm::vec3(-slopeX, 1, -slopeZ));
+}
+
+
+float ParticleCollider::GetDistance(const glm::vec3 &position) const
+{
+    int i, j, k;
+    float fx = GridCoordinate(position.x, distanceMin.x, distanceMax.x, distanceResolution.x, i);
+    float fy = GridCoordinate(position.y, distanceMin.y, distanceMax.y, distanceResolution.y, j);
+    float fz = GridCoordinate(position.z, distanceMin.z, distanceMax.z, distanceResolution.z, k);
+    int di = (distanceResolution.x > 1) ? 1 : 0;
+    int dj = (distanceResolution.y > 1) ? distanceResolution.x : 0;
+    int dk = (distanceResolution.z > 1) ? distanceResolution.x * distanceResolution.y : 0;
+
+    const float *d = &distances[i + (j + k * distanceResolution.y) * distanceResolution.x];
+    float near = glm::mix(glm::mix(d[0], d[di], fx), glm::mix(d[dj], d[dj + di], fx), fy);
+    float far = glm::mix(glm::mix(d[dk], d[dk + di], fx), glm::mix(d[dk + dj], d[dk + dj + di], fx), fy);
+    return glm::mix(near, far, fz);
+}
+
+
+glm::vec3 ParticleCollider::GetDistanceNormal(const glm::vec3 &position) const
+{
+    glm::vec3 cell = (distanceMax - distanceMin) / glm::vec3(distanceResolution);
+    glm::vec3 gradient;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        glm::vec3 step(0);
+        step[axis] = cell[axis];
+        gradient[axis] = (GetDistance(position + step) - GetDistance(position - step)) / (2 * cell[axis]);
+    }
+
+    float length = glm::length(gradient);
+    return (length > 0) ? gradient / length : glm::vec3(0, 1, 0);
+}
+
+
+void ParticleCollider::Collide(glm::vec3 &position, glm::vec3 &speed) const
+{
+    if (!heights.empty())
+    {
+        float height = GetHeight(position.x, position.z);
+        if (position.y < height)
+        {
+            position.y = height;
+            Bounce(speed, GetHeightNormal(position.x, position.z), restitution, friction);
+        }
+    }
+
+    bool inVolume = glm::all(glm::greaterThanEqual(position, distanceMin))
+        && glm::all(glm::lessThanEqual(position, distanceMax));
+
+    if (!distances.empty() && inVolume)
+    {
+        float distance = GetDistance(position);
+        if (distance < 0)
+        {
+            glm::vec3 normal = GetDistanceNormal(position);
+            position -= normal * distance;
+            Bounce(speed, normal, restitution, friction);
+        }
+    }
+}
+
+
+// -------------------------------------------------------------------------
+
+void ParticleArrays::Resize(unsigned int size)
+{
+    positionX.resize(size);
+    positionY.resize(size);
+    positionZ.resize(size);
+    speedX.resize(size);
+    speedY.resize(size);
+    speedZ.resize(size);
+    delay.resize(size);
+    lifetime.resize(size);
+    totalLifetime.resize(size);
+}
+
+
+ParticleSimulator::ParticleSimulator(unsigned int maxParticles)
+{
+    this->maxParticles = maxParticles;
+    aliveCount = 0;
+    collider = nullptr;
+
+    particles.Resize(maxParticles);
+    compacted.Resize(maxParticles);
+    chunkOffsets.resize((maxParticles + CHUNK_SIZE - 1) / CHUNK_SIZE + 1);
+}
+
+
+void ParticleSimulator::SetCollider(const ParticleCollider *collider)
+{
+    this->collider = collider;
+}
+
+
+unsigned int ParticleSimulator::GetSIMDWidth()
+{
+    return SIMDLanes::WIDTH;
+}
+
+
+const ParticleArrays &ParticleSimulator::GetParticles() const
+{
+    return particles;
+}
+
+
+unsigned int ParticleSimulator::GetAliveCount() const
+{
+    return aliveCount;
+}
+
+
+unsigned int ParticleSimulator::GetMaxParticles() const
+{
+    return maxParticles;
+}
+
+
+void ParticleSimulator::Emit(const ParticleEmitter &emitter, unsigned int count, uint32_t seed)
+{
+    count = MIN(count, maxParticles - aliveCount);
+    uint32_t seedHash = Hash(seed);
+
+    for (unsigned int id = 0; id < count; id++)
+    {
+        uint32_t rng = Hash(id ^ seedHash);
+
+        glm::vec3 offset, jitter;
+        offset.x = Random(rng);
+        offset.y = Random(rng);
+        offset.z = Random(rng);
+        jitter.x = Random(rng);
+        jitter.y = Random(rng);
+        jitter.z = Random(rng);
+
+        glm::vec3 position = emitter.position + (offset * 2.0f - 1.0f) * emitter.extents;
+
+        glm::vec2 radial = glm::vec2(position.x - emitter.position.x, position.z - emitter.position.z);
+        radial = (glm::dot(radial, radial) > 0) ? glm::normalize(radial) : glm::vec2(0);
+
+        glm::vec3 speed = emitter.velocity + glm::vec3(radial.x, 0, radial.y) * emitter.radialSpeed
+            + (jitter * 2.0f - 1.0f) * emitter.velocityJitter;
+        float lifetime = glm::mix(emitter.minLifetime, emitter.maxLifetime, Random(rng));
+        float delay = emitter.maxDelay * Random(rng);
+
+        unsigned int index = aliveCount++;
+        particles.positionX[index] = position.x;
+        particles.positionY[index] = position.y;
+        particles.positionZ[index] = position.z;
+        particles.speedX[index] = speed.x;
+        particles.speedY[index] = speed.y;
+        particles.speedZ[index] = speed.z;
+        particles.delay[index] = delay;
+        particles.lifetime[index] = lifetime;
+        particles.totalLifetime[index] = lifetime;
+    }
+}
+
+
+void ParticleSimulator::Update(float deltaTime, const glm::vec3 &gravity, float drag, glm::vec4 *vertices)
+{
+    if (aliveCount == 0)
+        return;
+
+    IntegrateParams params;
+    params.deltaTime = deltaTime;
+    params.damping = 1 - drag * deltaTime;
+    params.acceleration = gravity * deltaTime;
+
+    // Integrate each chunk and count its survivors
+    thread_utils::ParallelFor(0, aliveCount, CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+    {
+        unsigned int tail = Integrate<SIMDLanes>(particles, begin, end, params);
+        Integrate<ScalarLanes>(particles, tail, end, params);
+
+        // Only the particles that moved can have run into something
+        if (collider)
+        {
+            for (unsigned int i = begin; i < end; i++)
+            {
+                if (particles.delay[i] > 0 || particles.lifetime[i] <= 0)
+                    continue;
+
+                glm::vec3 position(particles.positionX[i], particles.positionY[i], particles.positionZ[i]);
+                glm::vec3 speed(particles.speedX[i], particles.speedY[i], particles.speedZ[i]);
+                collider->Collide(position, speed);
+
+                particles.positionX[i] = position.x;
+                particles.positionY[i] = position.y;
+                particles.positionZ[i] = position.z;
+                particles.speedX[i] = speed.x;
+                particles.speedY[i] = speed.y;
+                particles.speedZ[i] = speed.z;
+            }
+        }
+
+        unsigned int survivors = 0;
+        for (unsigned int i = begin; i < end; i++)
+            survivors += (particles.lifetime[i] > 0);
+
+        chunkOffsets[begin / CHUNK_SIZE + 1] = survivors;
+    });
+
+    unsigned int nrChunks = (aliveCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunkOffsets[0] = 0;
+    for (unsigned int i = 0; i < nrChunks; i++)
+        chunkOffsets[i + 1] += chunkOffsets[i];
+
+    // Then move the survivors of each chunk after those of the previous ones,
+    // keeping their order, while streaming out the vertices. Nothing moves
+    // when no particle expired.
+    bool compact = chunkOffsets[nrChunks] != aliveCount;
+
+    thread_utils::ParallelFor(0, aliveCount, CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+    {
+        unsigned int j = chunkOffsets[begin / CHUNK_SIZE];
+
+        for (unsigned int i = begin; i < end; i++)
+        {
+            if (particles.lifetime[i] <= 0)
+                continue;
+
+            if (compact)
+            {
+                compacted.positionX[j] = particles.positionX[i];
+                compacted.positionY[j] = particles.positionY[i];
+                compacted.positionZ[j] = particles.positionZ[i];
+                compacted.speedX[j] = particles.speedX[i];
+                compacted.speedY[j] = particles.speedY[i];
+                compacted.speedZ[j] = particles.speedZ[i];
+                compacted.delay[j] = particles.delay[i];
+                compacted.lifetime[j] = particles.lifetime[i];
+                compacted.totalLifetime[j] = particles.totalLifetime[i];
+            }
+
+            if (vertices)
+            {
+                float life = (particles.lifetime[i] + particles.delay[i]) / particles.totalLifetime[i];
+                vertices[j] = glm::vec4(particles.positionX[i], particles.positionY[i], particles.positionZ[i], life);
+            }
+
+            j++;
+        }
+    });
+
+    aliveCount = chunkOffsets[nrChunks];
+    if (compact)
+        std::swap(particles, compacted);
+}
+
+
+void ParticleSimulator::WriteVertices(glm::vec4 *vertices, const unsigned int *order) const
+{
+    thread_utils::ParallelFor(0, aliveCount, CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int j = begin; j < end; j++)
+        {
+            unsigned int i = order ? order[j] : j;
+            float life = (particles.lifetime[i] + particles.delay[i]) / particles.totalLifetime[i];
+            vertices[j] = glm::vec4(particles.positionX[i], particles.positionY[i], particles.positionZ[i], life);
+        }
+    });
+}
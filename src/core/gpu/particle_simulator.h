@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "utils/glm_utils.h"
+
+
+// Where and how new particles are spawned
+struct ParticleEmitter
+{
+    ParticleEmitter()
+    {
+        position = glm::vec3(0);
+        extents = glm::vec3(0);
+        velocity = glm::vec3(0);
+        radialSpeed = 0;
+        velocityJitter = 0;
+        minLifetime = 1;
+        maxLifetime = 1;
+        maxDelay = 0;
+        rate = 0;
+    }
+
+    glm::vec3 position;
+
+    // Half size of the box around `position` particles spawn in
+    glm::vec3 extents;
+
+    glm::vec3 velocity;
+
+    // Horizontal speed away from the vertical axis through `position`
+    float radialSpeed;
+
+    // Largest random velocity added along each axis
+    float velocityJitter;
+
+    float minLifetime;
+    float maxLifetime;
+
+    // Longest random wait before a new particle starts moving. Waiting
+    // particles stay hidden at their spawn position.
+    float maxDelay;
+
+    // Particles spawned per second
+    float rate;
+};
+
+
+// Surroundings particles bounce off: a height field over the XZ plane and a
+// signed distance volume. Each holds values at the centers of a grid of cells,
+// sampled with linear filtering as textures are, and may be left empty.
+struct ParticleCollider
+{
+    ParticleCollider();
+
+    float GetHeight(float x, float z) const;
+    glm::vec3 GetHeightNormal(float x, float z) const;
+    float GetDistance(const glm::vec3 &position) const;
+    glm::vec3 GetDistanceNormal(const glm::vec3 &position) const;
+
+    // Pushes `position` out of the surroundings, and bounces `speed` off them
+    // when heading in; see Particle.Simulate.CS.glsl
+    void Collide(glm::vec3 &position, glm::vec3 &speed) const;
+
+    // Heights row by row along X, over the rectangle from `heightMin` to `heightMax`
+    std::vector<float> heights;
+    glm::ivec2 heightResolution;
+    glm::vec2 heightMin;
+    glm::vec2 heightMax;
+
+    // Distances to the nearest surface, negative inside, over the box from
+    // `distanceMin` to `distanceMax`. X varies fastest, then Y, then Z.
+    std::vector<float> distances;
+    glm::ivec3 distanceResolution;
+    glm::vec3 distanceMin;
+    glm::vec3 distanceMax;
+
+    // Fraction of the speed into a surface that bounces back
+    float restitution;
+
+    // Fraction of the speed along a surface lost on contact
+    float friction;
+};
+
+
+// Structure of arrays of the particle state, one entry per alive particle
+struct ParticleArrays
+{
+    void Resize(unsigned int size);
+
+    std::vector<float> positionX;
+    std::vector<float> positionY;
+    std::vector<float> positionZ;
+    std::vector<float> speedX;
+    std::vector<float> speedY;
+    std::vector<float> speedZ;
+    std::vector<float> delay;
+    std::vector<float> lifetime;
+    std::vector<float> totalLifetime;
+};
+
+
+// CPU implementation of the particle simulation of `ParticleSystem`, used where
+// compute shaders are missing and as a reference for the GPU passes. Particles
+// are processed in chunks on the shared thread pool, with SSE or AVX kernels
+// when the compiler targets them, and stay packed at the front of the arrays.
+class ParticleSimulator
+{
+ public:
+    explicit ParticleSimulator(unsigned int maxParticles);
+
+    // Spawns up to `count` particles the way Particle.Emit.CS.glsl does
+    void Emit(const ParticleEmitter &emitter, unsigned int count, uint32_t seed);
+
+    // Ages and integrates the particles and drops the expired ones. If given,
+    // `vertices` receives one entry per survivor: its position, and the fraction
+    // of its lifetime left, above 1 while still delayed.
+    void Update(float deltaTime, const glm::vec3 &gravity, float drag, glm::vec4 *vertices = nullptr);
+
+    // Particles collide with `collider` while it is set, and it must outlive them
+    void SetCollider(const ParticleCollider *collider);
+
+    // Writes the vertices as `Update` does, for the particles in `order` if given
+    void WriteVertices(glm::vec4 *vertices, const unsigned int *order = nullptr) const;
+
+    const ParticleArrays &GetParticles() const;
+    unsigned int GetAliveCount() const;
+    unsigned int GetMaxParticles() const;
+
+    // Number of floats processed per instruction by the integration kernel
+    static unsigned int GetSIMDWidth();
+
+    static const unsigned int CHUNK_SIZE = 16384;
+
+ private:
+    unsigned int maxParticles;
+    unsigned int aliveCount;
+    const ParticleCollider *collider;
+
+    // Survivors are scattered from `particles` into `compacted`, then the two swap
+    ParticleArrays particles;
+    ParticleArrays compacted;
+    std::vector<unsigned int> chunkOffsets;
+};
@@ -0,0 +1,309 @@
+#include "core/gpu/particle_sorter.h"
+
+#include <cstring>
+#include <utility>
+
+#include "utils/math_utils.h"
+#include "utils/memory_utils.h"
+#include "utils/text_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Must match ParticleSort.Common.glsl
+static const unsigned int SORT_GROUP_SIZE = 256;
+static const unsigned int SORT_TILE_SIZE = SORT_GROUP_SIZE * 4;
+static const unsigned int SORT_BITS_PER_PASS = 4;
+static const unsigned int SORT_BINS = 1 << SORT_BITS_PER_PASS;
+
+static const GLuint KEYS_IN_BINDING = 0;
+static const GLuint VALUES_IN_BINDING = 1;
+static const GLuint KEYS_OUT_BINDING = 2;
+static const GLuint VALUES_OUT_BINDING = 3;
+static const GLuint HISTOGRAM_BINDING = 4;
+static const GLuint COUNT_BINDING = 5;
+static const GLuint PARTICLE_BINDING = 6;
+
+// Depth keys keep the top 24 bits of the depth. An even number of passes
+// leaves the sorted indices in the buffer they started in.
+static const unsigned int KEY_BITS = 24;
+static const unsigned int NR_GPU_PASSES = KEY_BITS / SORT_BITS_PER_PASS;
+
+// The CPU sort takes 12 bits per pass, so its histograms stay in cache
+static const unsigned int CPU_BITS_PER_PASS = 12;
+static const unsigned int CPU_BINS = 1 << CPU_BITS_PER_PASS;
+static const unsigned int CPU_CHUNK_SIZE = 65536;
+
+
+// Same as ParticleSort.Keys.CS.glsl
+static uint32_t DepthKey(float depth)
+{
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    bits ^= (bits >> 31) ? 0xFFFFFFFFu : 0x80000000u;
+    return ~bits >> (32 - KEY_BITS);
+}
+
+
+ParticleSorter::ParticleSorter()
+{
+    initialized = false;
+    capacity = 0;
+
+    keysShader = nullptr;
+    countShader = nullptr;
+    scanShader = nullptr;
+    scatterShader = nullptr;
+
+    keyBuffers[0] = keyBuffers[1] = 0;
+    valueBuffer = 0;
+    histogramBuffer = 0;
+    keyCountBuffer = 0;
+}
+
+
+ParticleSorter::~ParticleSorter()
+{
+    glDeleteBuffers(2, keyBuffers);
+    glDeleteBuffers(1, &valueBuffer);
+    glDeleteBuffers(1, &histogramBuffer);
+    glDeleteBuffers(1, &keyCountBuffer);
+
+    SAFE_FREE(keysShader);
+    SAFE_FREE(countShader);
+    SAFE_FREE(scanShader);
+    SAFE_FREE(scatterShader);
+}
+
+
+bool ParticleSorter::IsSupported()
+{
+    return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+}
+
+
+bool ParticleSorter::Init(const std::string &shaderDirectory)
+{
+    if (initialized)
+        return true;
+
+    if (!IsSupported())
+        return false;
+
+    keysShader = new Shader("ParticleSortKeys");
+    keysShader->AddShader(PATH_JOIN(shaderDirectory, "ParticleSort.Keys.CS.glsl"), GL_COMPUTE_SHADER);
+
+    countShader = new Shader("ParticleSortCount");
+    countShader->AddShader(PATH_JOIN(shaderDirectory, "ParticleSort.Count.CS.glsl"), GL_COMPUTE_SHADER);
+
+    scanShader = new Shader("ParticleSortScan");
+    scanShader->AddShader(PATH_JOIN(shaderDirectory, "ParticleSort.Scan.CS.glsl"), GL_COMPUTE_SHADER);
+
+    scatterShader = new Shader("ParticleSortScatter");
+    scatterShader->AddShader(PATH_JOIN(shaderDirectory, "ParticleSort.Scatter.CS.glsl"), GL_COMPUTE_SHADER);
+
+    Shader::CreateAndLinkAll({ keysShader, countShader, scanShader, scatterShader });
+
+    glGenBuffers(2, keyBuffers);
+    glGenBuffers(1, &valueBuffer);
+    glGenBuffers(1, &histogramBuffer);
+
+    glGenBuffers(1, &keyCountBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    initialized = true;
+    return true;
+}
+
+
+void ParticleSorter::Reserve(unsigned int maxCount)
+{
+    if (maxCount <= capacity)
+        return;
+
+    capacity = maxCount;
+    unsigned int nrTiles = (capacity + SORT_TILE_SIZE - 1) / SORT_TILE_SIZE;
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(uint32_t), NULL, GL_DYNAMIC_COPY);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, valueBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)capacity * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)nrTiles * SORT_BINS * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+void ParticleSorter::Sort(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+                          GLuint indexBuffer, unsigned int count, const glm::mat4 &modelView)
+{
+    if (!initialized || count < 2)
+        return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, keyCountBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Dispatch(particleBuffer, stride, positionOffset, indexBuffer, count, modelView);
+}
+
+
+void ParticleSorter::SortIndirect(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+                                  GLuint indexBuffer, unsigned int maxCount, GLuint countBuffer, GLintptr countOffset,
+                                  const glm::mat4 &modelView)
+{
+    if (!initialized || maxCount < 2)
+        return;
+
+    // The count may just have been written by a compute pass
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, countBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, keyCountBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, countOffset, 0, sizeof(unsigned int));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    Dispatch(particleBuffer, stride, positionOffset, indexBuffer, maxCount, modelView);
+}
+
+
+void ParticleSorter::Dispatch(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+                              GLuint indexBuffer, unsigned int maxCount, const glm::mat4 &modelView)
+{
+    Reserve(maxCount);
+    unsigned int nrTiles = (maxCount + SORT_TILE_SIZE - 1) / SORT_TILE_SIZE;
+
+    // Positions may have been written by shaders, as in Lab4
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, HISTOGRAM_BINDING, histogramBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNT_BINDING, keyCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffer);
+
+    keysShader->Use();
+    GLuint program = keysShader->GetProgramID();
+    glUniformMatrix4fv(glGetUniformLocation(program, "modelView"), 1, GL_FALSE, glm::value_ptr(modelView));
+    glUniform1ui(glGetUniformLocation(program, "stride"), stride / sizeof(float));
+    glUniform1ui(glGetUniformLocation(program, "positionOffset"), positionOffset / sizeof(float));
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VALUES_IN_BINDING, indexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, KEYS_OUT_BINDING, keyBuffers[0]);
+    glDispatchCompute((maxCount + SORT_GROUP_SIZE - 1) / SORT_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    for (unsigned int pass = 0; pass < NR_GPU_PASSES; pass++)
+    {
+        unsigned int in = pass % 2;
+        GLuint values[2] = { indexBuffer, valueBuffer };
+        GLuint shift = pass * SORT_BITS_PER_PASS;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, KEYS_IN_BINDING, keyBuffers[in]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VALUES_IN_BINDING, values[in]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, KEYS_OUT_BINDING, keyBuffers[1 - in]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VALUES_OUT_BINDING, values[1 - in]);
+
+        countShader->Use();
+        glUniform1ui(glGetUniformLocation(countShader->GetProgramID(), "shift"), shift);
+        glDispatchCompute(nrTiles, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scanShader->Use();
+        glUniform1ui(glGetUniformLocation(scanShader->GetProgramID(), "nrEntries"), nrTiles * SORT_BINS);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scatterShader->Use();
+        glUniform1ui(glGetUniformLocation(scatterShader->GetProgramID(), "shift"), shift);
+        glDispatchCompute(nrTiles, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // The index buffer is drawn from next
+    glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+    CheckOpenGLError();
+}
+
+
+const unsigned int *ParticleSorter::SortOnCPU(const ParticleArrays &particles, unsigned int count, const glm::mat4 &viewMatrix)
+{
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        if (keys[i].size() < count)
+        {
+            keys[i].resize(count);
+            values[i].resize(count);
+        }
+    }
+
+    unsigned int nrChunks = (count + CPU_CHUNK_SIZE - 1) / CPU_CHUNK_SIZE;
+    digitOffsets.resize((size_t)nrChunks * CPU_BINS);
+
+    // Only the view depth is needed, so only the third row of the matrix
+    glm::vec4 depthRow = -glm::vec4(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2], viewMatrix[3][2]);
+
+    thread_utils::ParallelFor(0, count, CPU_CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            float depth = depthRow.x * particles.positionX[i] + depthRow.y * particles.positionY[i]
+                + depthRow.z * particles.positionZ[i] + depthRow.w;
+            keys[0][i] = DepthKey(depth);
+            values[0][i] = i;
+        }
+    });
+
+    for (unsigned int shift = 0; shift < KEY_BITS; shift += CPU_BITS_PER_PASS)
+    {
+        const uint32_t *keysIn = keys[0].data();
+        const unsigned int *valuesIn = values[0].data();
+        uint32_t *keysOut = keys[1].data();
+        unsigned int *valuesOut = values[1].data();
+
+        thread_utils::ParallelFor(0, count, CPU_CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            unsigned int *histogram = &digitOffsets[(size_t)(begin / CPU_CHUNK_SIZE) * CPU_BINS];
+            memset(histogram, 0, CPU_BINS * sizeof(unsigned int));
+
+            for (unsigned int i = begin; i < end; i++)
+                histogram[(keysIn[i] >> shift) & (CPU_BINS - 1)]++;
+        });
+
+        // Each chunk writes a digit after all smaller digits, and after the
+        // same digit in the chunks before it
+        unsigned int running = 0;
+        for (unsigned int digit = 0; digit < CPU_BINS; digit++)
+        {
+            for (unsigned int chunk = 0; chunk < nrChunks; chunk++)
+            {
+                unsigned int &entry = digitOffsets[(size_t)chunk * CPU_BINS + digit];
+                unsigned int chunkCount = entry;
+                entry = running;
+                running += chunkCount;
+            }
+        }
+
+        thread_utils::ParallelFor(0, count, CPU_CHUNK_SIZE, [&](unsigned int begin, unsigned int end)
+        {
+            unsigned int *offsets = &digitOffsets[(size_t)(begin / CPU_CHUNK_SIZE) * CPU_BINS];
+
+            for (unsigned int i = begin; i < end; i++)
+            {
+                unsigned int target = offsets[(keysIn[i] >> shift) & (CPU_BINS - 1)]++;
+                keysOut[target] = keysIn[i];
+                valuesOut[target] = valuesIn[i];
+            }
+        });
+
+        std::swap(keys[0], keys[1]);
+        std::swap(values[0], values[1]);
+    }
+
+    return values[0].data();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "core/gpu/shader.h"
+#include "core/gpu/particle_simulator.h"
+#include "utils/glm_utils.h"
+
+
+// Orders particles back to front by their view depth, so alpha blending
+// composites them correctly. Depths become 24-bit keys that a radix sort
+// orders, in compute passes over index buffers on the GPU, or on the shared
+// thread pool for particles simulated on the CPU.
+class ParticleSorter
+{
+ public:
+    ParticleSorter();
+    ~ParticleSorter();
+
+    // Compute shaders and storage buffers, as in OpenGL 4.3
+    static bool IsSupported();
+
+    // Compiles the passes found in `shaderDirectory`. Only needed for the GPU sort.
+    bool Init(const std::string &shaderDirectory);
+
+    // Reorders the first `count` indices of `indexBuffer`, which pick particles
+    // out of `particleBuffer`. Each particle takes `stride` bytes, and starts
+    // with its position after `positionOffset` bytes, both multiples of 4.
+    void Sort(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+              GLuint indexBuffer, unsigned int count, const glm::mat4 &modelView);
+
+    // Same as `Sort`, for a count only known on the GPU, read from `countBuffer`
+    // at `countOffset` bytes. `maxCount` sizes the dispatches.
+    void SortIndirect(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+                      GLuint indexBuffer, unsigned int maxCount, GLuint countBuffer, GLintptr countOffset,
+                      const glm::mat4 &modelView);
+
+    // Returns the indices of the first `count` particles of `particles`, back to front
+    const unsigned int *SortOnCPU(const ParticleArrays &particles, unsigned int count, const glm::mat4 &viewMatrix);
+
+ private:
+    ParticleSorter(const ParticleSorter &) = delete;
+    ParticleSorter &operator=(const ParticleSorter &) = delete;
+
+    void Reserve(unsigned int maxCount);
+    void Dispatch(GLuint particleBuffer, unsigned int stride, unsigned int positionOffset,
+                  GLuint indexBuffer, unsigned int maxCount, const glm::mat4 &modelView);
+
+ private:
+    bool initialized;
+
+    Shader *keysShader;
+    Shader *countShader;
+    Shader *scanShader;
+    Shader *scatterShader;
+
+    // Capacity of the buffers below, in keys
+    unsigned int capacity;
+
+    // Keys ping-pong between the two buffers, and indices between the index
+    // buffer being sorted and `valueBuffer`
+    GLuint keyBuffers[2];
+    GLuint valueBuffer;
+    GLuint histogramBuffer;
+    GLuint keyCountBuffer;
+
+    // The CPU sort
+    std::vector<uint32_t> keys[2];
+    std::vector<unsigned int> values[2];
+    std::vector<unsigned int> digitOffsets;
+};
@@ -0,0 +1,518 @@
+#include "core/gpu/particle_system.h"
+
+#include <vector>
+#include <iostream>
+
+#include "utils/memory_utils.h"
+#include "utils/text_utils.h"
+
+
+// Must match Particle.Common.glsl and Particle.Lists.glsl
+static const unsigned int PARTICLE_SIZE = 2 * sizeof(glm::vec4);
+static const unsigned int PARTICLE_GROUP_SIZE = 64;
+
+static const GLuint PARTICLE_BINDING = 0;
+static const GLuint DEAD_LIST_BINDING = 1;
+static const GLuint ALIVE_IN_BINDING = 2;
+static const GLuint ALIVE_OUT_BINDING = 3;
+static const GLuint COUNTER_BINDING = 4;
+
+// Offsets in the counter buffer, in 32-bit words
+static const unsigned int DRAW_COMMAND_OFFSET = 0;
+static const unsigned int DISPATCH_COMMAND_OFFSET = 5;
+static const unsigned int DEAD_COUNT_OFFSET = 8;
+static const unsigned int NR_COUNTERS = 11;
+
+
+ParticleSystem::ParticleSystem(unsigned int maxParticles)
+{
+    this->maxParticles = maxParticles;
+    initialized = false;
+
+    gravity = glm::vec3(0, -9.81f, 0);
+    drag = 0;
+    emitAccumulator = 0;
+    frame = 0;
+    currentList = 0;
+
+    particleBuffer = 0;
+    deadListBuffer = 0;
+    aliveListBuffers[0] = aliveListBuffers[1] = 0;
+    counterBuffer = 0;
+    VAOs[0] = VAOs[1] = 0;
+
+    emitShader = nullptr;
+    simulateShader = nullptr;
+    counterShader = nullptr;
+    prepareFeature = 0;
+    finalizeFeature = 0;
+
+    heightTexture = 0;
+    distanceTexture = 0;
+    heightFieldFeature = 0;
+    distanceFieldFeature = 0;
+
+    sorter = nullptr;
+    sortView = glm::mat4(1);
+
+    simulator = nullptr;
+    streamBuffer = 0;
+    streamVAO = 0;
+    streamMapping = nullptr;
+    streamRegion = 0;
+    for (unsigned int i = 0; i < NR_STREAM_REGIONS; i++)
+        streamFences[i] = 0;
+}
+
+
+ParticleSystem::~ParticleSystem()
+{
+    glDeleteVertexArrays(2, VAOs);
+    glDeleteBuffers(1, &particleBuffer);
+    glDeleteBuffers(1, &deadListBuffer);
+    glDeleteBuffers(2, aliveListBuffers);
+    glDeleteBuffers(1, &counterBuffer);
+    glDeleteTextures(1, &heightTexture);
+    glDeleteTextures(1, &distanceTexture);
+
+    SAFE_FREE(emitShader);
+    SAFE_FREE(simulateShader);
+    SAFE_FREE(counterShader);
+
+    for (unsigned int i = 0; i < NR_STREAM_REGIONS; i++)
+    {
+        if (streamFences[i])
+            glDeleteSync(streamFences[i]);
+    }
+
+    // Deleting the buffer also unmaps it
+    glDeleteVertexArrays(1, &streamVAO);
+    glDeleteBuffers(1, &streamBuffer);
+    SAFE_FREE(simulator);
+    SAFE_FREE(sorter);
+}
+
+
+bool ParticleSystem::IsSupported()
+{
+    return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object
+        && GLEW_ARB_draw_indirect && GLEW_ARB_shader_image_load_store);
+}
+
+
+bool ParticleSystem::Init(const std::string &shaderDirectory, bool useCompute)
+{
+    if (initialized || maxParticles == 0)
+        return initialized;
+
+    this->shaderDirectory = shaderDirectory;
+
+    if (useCompute && !IsSupported())
+    {
+        std::cout << "Particle system: compute shaders are not supported, simulating on the CPU" << std::endl;
+        useCompute = false;
+    }
+
+    if (!useCompute)
+    {
+        initialized = InitStream();
+        return initialized;
+    }
+
+    emitShader = new Shader("ParticleEmit");
+    emitShader->AddShader(PATH_JOIN(shaderDirectory, "Particle.Emit.CS.glsl"), GL_COMPUTE_SHADER);
+
+    simulateShader = new Shader("ParticleSimulate");
+    simulateShader->AddShader(PATH_JOIN(shaderDirectory, "Particle.Simulate.CS.glsl"), GL_COMPUTE_SHADER);
+    heightFieldFeature = simulateShader->AddFeature("HEIGHT_FIELD");
+    distanceFieldFeature = simulateShader->AddFeature("DISTANCE_FIELD");
+
+    // The bookkeeping before and after integrating are variants of one shader
+    counterShader = new Shader("ParticleCounters");
+    counterShader->AddShader(PATH_JOIN(shaderDirectory, "Particle.Counters.CS.glsl"), GL_COMPUTE_SHADER);
+    prepareFeature = counterShader->AddFeature("PREPARE");
+    finalizeFeature = counterShader->AddFeature("FINALIZE");
+
+    Shader::CreateAndLinkAll({ emitShader, simulateShader });
+    counterShader->GetVariant(prepareFeature);
+    counterShader->GetVariant(finalizeFeature);
+
+    // Every slot starts out free
+    std::vector<unsigned int> slots(maxParticles);
+    for (unsigned int i = 0; i < maxParticles; i++)
+        slots[i] = maxParticles - 1 - i;
+
+    glGenBuffers(1, &particleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)maxParticles * PARTICLE_SIZE, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &deadListBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, deadListBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, slots.size() * sizeof(unsigned int), slots.data(), GL_DYNAMIC_DRAW);
+
+    unsigned int counters[NR_COUNTERS] = {};
+    counters[DRAW_COMMAND_OFFSET + 1] = 1;
+    counters[DISPATCH_COMMAND_OFFSET + 1] = 1;
+    counters[DISPATCH_COMMAND_OFFSET + 2] = 1;
+    counters[DEAD_COUNT_OFFSET] = maxParticles;
+
+    glGenBuffers(1, &counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(counters), counters, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(2, aliveListBuffers);
+    glGenVertexArrays(2, VAOs);
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glBindVertexArray(VAOs[i]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aliveListBuffers[i]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)maxParticles * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+    }
+
+    glBindVertexArray(0);
+    CheckOpenGLError();
+
+    initialized = true;
+    return true;
+}
+
+
+void ParticleSystem::SetEmitter(const ParticleEmitter &emitter)
+{
+    this->emitter = emitter;
+}
+
+
+ParticleEmitter &ParticleSystem::GetEmitter()
+{
+    return emitter;
+}
+
+
+void ParticleSystem::SetGravity(const glm::vec3 &gravity)
+{
+    this->gravity = gravity;
+}
+
+
+void ParticleSystem::SetDrag(float drag)
+{
+    this->drag = drag;
+}
+
+
+// Replaces `texture` with one holding `values`, or deletes it without values
+static void UploadField(GLuint &texture, GLenum target, const std::vector<float> &values, const glm::ivec3 &size)
+{
+    if (values.empty())
+    {
+        glDeleteTextures(1, &texture);
+        texture = 0;
+        return;
+    }
+
+    if (texture == 0)
+        glGenTextures(1, &texture);
+
+    glBindTexture(target, texture);
+    if (target == GL_TEXTURE_3D)
+        glTexImage3D(target, 0, GL_R32F, size.x, size.y, size.z, 0, GL_RED, GL_FLOAT, values.data());
+    else
+        glTexImage2D(target, 0, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, values.data());
+
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(target, 0);
+}
+
+
+void ParticleSystem::SetCollider(const ParticleCollider &collider)
+{
+    if (!initialized)
+        return;
+
+    this->collider = collider;
+
+    if (simulator)
+    {
+        simulator->SetCollider(&this->collider);
+        return;
+    }
+
+    glm::ivec2 heightSize = collider.heightResolution;
+    UploadField(heightTexture, GL_TEXTURE_2D, collider.heights, glm::ivec3(heightSize, 1));
+    UploadField(distanceTexture, GL_TEXTURE_3D, collider.distances, collider.distanceResolution);
+    CheckOpenGLError();
+
+    // Start compiling the variant now rather than on the next update
+    simulateShader->GetVariant((heightTexture ? heightFieldFeature : 0) | (distanceTexture ? distanceFieldFeature : 0));
+}
+
+
+unsigned int ParticleSystem::GetMaxParticles() const
+{
+    return maxParticles;
+}
+
+
+void ParticleSystem::SetSortView(const glm::mat4 &viewMatrix)
+{
+    sortView = viewMatrix;
+
+    if (initialized && sorter == nullptr)
+    {
+        sorter = new ParticleSorter();
+        if (simulator == nullptr)
+            sorter->Init(shaderDirectory);
+    }
+}
+
+
+bool ParticleSystem::UsesCompute() const
+{
+    return initialized && simulator == nullptr;
+}
+
+
+void ParticleSystem::BindBuffers() const
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_LIST_BINDING, deadListBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_IN_BINDING, aliveListBuffers[currentList]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ALIVE_OUT_BINDING, aliveListBuffers[1 - currentList]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, counterBuffer);
+}
+
+
+void ParticleSystem::Update(float deltaTime)
+{
+    if (!initialized)
+        return;
+
+    // Fractional particles carry over, so low rates still emit
+    emitAccumulator += emitter.rate * deltaTime;
+    unsigned int emitCount = MIN((unsigned int)emitAccumulator, maxParticles);
+    emitAccumulator -= (float)(unsigned int)emitAccumulator;
+
+    if (simulator)
+    {
+        UpdateStream(deltaTime, emitCount);
+        frame++;
+        return;
+    }
+
+    BindBuffers();
+
+    if (emitCount)
+    {
+        emitShader->Use();
+        GLuint program = emitShader->GetProgramID();
+        glUniform1ui(glGetUniformLocation(program, "currentList"), currentList);
+        glUniform1ui(glGetUniformLocation(program, "emitCount"), emitCount);
+        glUniform1ui(glGetUniformLocation(program, "seed"), frame);
+        glUniform3fv(glGetUniformLocation(program, "emitter_position"), 1, glm::value_ptr(emitter.position));
+        glUniform3fv(glGetUniformLocation(program, "emitter_extents"), 1, glm::value_ptr(emitter.extents));
+        glUniform3fv(glGetUniformLocation(program, "emitter_velocity"), 1, glm::value_ptr(emitter.velocity));
+        glUniform1f(glGetUniformLocation(program, "emitter_radial_speed"), emitter.radialSpeed);
+        glUniform1f(glGetUniformLocation(program, "emitter_jitter"), emitter.velocityJitter);
+        glUniform2f(glGetUniformLocation(program, "emitter_lifetime"), emitter.minLifetime, emitter.maxLifetime);
+        glUniform1f(glGetUniformLocation(program, "emitter_max_delay"), emitter.maxDelay);
+
+        glDispatchCompute((emitCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Size the integration to the alive count, without reading it back
+    Shader *prepare = counterShader->GetVariant(prepareFeature);
+    prepare->Use();
+    glUniform1ui(glGetUniformLocation(prepare->GetProgramID(), "currentList"), currentList);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    Shader *simulate = simulateShader->GetVariant((heightTexture ? heightFieldFeature : 0) | (distanceTexture ? distanceFieldFeature : 0));
+    simulate->Use();
+    GLuint program = simulate->GetProgramID();
+    glUniform1ui(glGetUniformLocation(program, "currentList"), currentList);
+    glUniform1f(glGetUniformLocation(program, "deltaTime"), deltaTime);
+    glUniform3fv(glGetUniformLocation(program, "gravity"), 1, glm::value_ptr(gravity));
+    glUniform1f(glGetUniformLocation(program, "drag"), drag);
+    glUniform1f(glGetUniformLocation(program, "restitution"), collider.restitution);
+    glUniform1f(glGetUniformLocation(program, "friction"), collider.friction);
+
+    if (heightTexture)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, heightTexture);
+        glUniform1i(glGetUniformLocation(program, "height_field"), 0);
+        glUniform2fv(glGetUniformLocation(program, "height_field_min"), 1, glm::value_ptr(collider.heightMin));
+        glUniform2fv(glGetUniformLocation(program, "height_field_max"), 1, glm::value_ptr(collider.heightMax));
+    }
+
+    if (distanceTexture)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_3D, distanceTexture);
+        glUniform1i(glGetUniformLocation(program, "distance_field"), 1);
+        glUniform3fv(glGetUniformLocation(program, "distance_field_min"), 1, glm::value_ptr(collider.distanceMin));
+        glUniform3fv(glGetUniformLocation(program, "distance_field_max"), 1, glm::value_ptr(collider.distanceMax));
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+    glDispatchComputeIndirect(DISPATCH_COMMAND_OFFSET * sizeof(unsigned int));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    Shader *finalize = counterShader->GetVariant(finalizeFeature);
+    finalize->Use();
+    glUniform1ui(glGetUniformLocation(finalize->GetProgramID(), "currentList"), currentList);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_ELEMENT_ARRAY_BARRIER_BIT);
+
+    // The survivors are the current particles from now on
+    currentList = 1 - currentList;
+    frame++;
+
+    // The draw command holds the survivor count
+    if (sorter)
+    {
+        sorter->SortIndirect(particleBuffer, PARTICLE_SIZE, 0, aliveListBuffers[currentList], maxParticles,
+                             counterBuffer, DRAW_COMMAND_OFFSET * sizeof(unsigned int), sortView);
+    }
+
+    CheckOpenGLError();
+}
+
+
+void ParticleSystem::Render(Shader *shader, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix)
+{
+    if (!initialized || !shader || !shader->GetProgramID())
+        return;
+
+    shader->Use();
+    glm::vec3 eyePosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+    glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    glUniform3fv(shader->loc_eye_pos, 1, glm::value_ptr(eyePosition));
+
+    if (simulator)
+    {
+        glBindVertexArray(streamVAO);
+        glDrawArrays(GL_POINTS, streamRegion * maxParticles, simulator->GetAliveCount());
+        glBindVertexArray(0);
+
+        // The region is not written again before this draw is done
+        if (streamMapping)
+        {
+            if (streamFences[streamRegion])
+                glDeleteSync(streamFences[streamRegion]);
+            streamFences[streamRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        CheckOpenGLError();
+        return;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BINDING, particleBuffer);
+
+    // The count was written by the last update
+    glBindVertexArray(VAOs[currentList]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, counterBuffer);
+    glDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, (void *)(DRAW_COMMAND_OFFSET * sizeof(unsigned int)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    CheckOpenGLError();
+}
+
+
+bool ParticleSystem::InitStream()
+{
+    simulator = new ParticleSimulator(maxParticles);
+
+    GLsizeiptr size = (GLsizeiptr)NR_STREAM_REGIONS * maxParticles * sizeof(glm::vec4);
+    glGenBuffers(1, &streamBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+
+    // Map the buffer once and let the simulation write straight into it
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        streamMapping = (glm::vec4 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+        // Immutable storage cannot be reallocated for the fallback below
+        if (streamMapping == nullptr)
+        {
+            glDeleteBuffers(1, &streamBuffer);
+            glGenBuffers(1, &streamBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+        }
+    }
+
+    // Otherwise, the vertices are written to memory and uploaded every frame
+    if (streamMapping == nullptr)
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        streamStaging.resize(maxParticles);
+    }
+
+    glGenVertexArrays(1, &streamVAO);
+    glBindVertexArray(streamVAO);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    CheckOpenGLError();
+
+    return true;
+}
+
+
+void ParticleSystem::UpdateStream(float deltaTime, unsigned int emitCount)
+{
+    simulator->Emit(emitter, emitCount, frame);
+
+    streamRegion = (streamRegion + 1) % NR_STREAM_REGIONS;
+    glm::vec4 *vertices = streamStaging.data();
+
+    if (streamMapping)
+    {
+        // Drawn from NR_STREAM_REGIONS frames ago, so this rarely blocks
+        GLsync &fence = streamFences[streamRegion];
+        if (fence)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fence);
+            fence = 0;
+        }
+
+        vertices = streamMapping + (size_t)streamRegion * maxParticles;
+    }
+
+    // Sorting needs the final positions, so the vertices are written afterwards
+    if (sorter)
+    {
+        simulator->Update(deltaTime, gravity, drag);
+        simulator->WriteVertices(vertices, sorter->SortOnCPU(simulator->GetParticles(), simulator->GetAliveCount(), sortView));
+    }
+    else
+    {
+        simulator->Update(deltaTime, gravity, drag, vertices);
+    }
+
+    unsigned int aliveCount = simulator->GetAliveCount();
+    if (streamMapping == nullptr && aliveCount)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, streamBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)streamRegion * maxParticles * sizeof(glm::vec4),
+                        aliveCount * sizeof(glm::vec4), vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
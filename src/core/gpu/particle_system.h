@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core/gpu/shader.h"
+#include "core/gpu/particle_simulator.h"
+#include "core/gpu/particle_sorter.h"
+#include "utils/glm_utils.h"
+
+
+// Particle simulation running entirely on the GPU. Every frame, compute passes
+// spawn particles into slots popped from a dead list, integrate the alive list
+// while compacting the survivors into a second list and pushing expired slots
+// back, and write the survivor count into an indirect draw command. The CPU
+// only sets uniforms and dispatches, whatever the number of particles.
+//
+// Without compute support, a `ParticleSimulator` runs the same simulation on
+// the CPU and streams the particles into a persistently mapped vertex buffer.
+class ParticleSystem
+{
+ public:
+    explicit ParticleSystem(unsigned int maxParticles);
+    ~ParticleSystem();
+
+    // Compute shaders, storage buffers and indirect draws, as in OpenGL 4.3
+    static bool IsSupported();
+
+    // Compiles the passes found in `shaderDirectory` and allocates the buffers.
+    // The CPU simulation is used when `useCompute` is false or unsupported.
+    bool Init(const std::string &shaderDirectory, bool useCompute = true);
+
+    // Whether the compute passes run the simulation, once initialized
+    bool UsesCompute() const;
+
+    void SetEmitter(const ParticleEmitter &emitter);
+    ParticleEmitter &GetEmitter();
+
+    void SetGravity(const glm::vec3 &gravity);
+
+    // Fraction of the speed lost per second
+    void SetDrag(float drag);
+
+    // Once initialized, particles collide with a copy of `collider`. The compute
+    // passes sample it from textures, within the simulation pass.
+    void SetCollider(const ParticleCollider &collider);
+
+    void Update(float deltaTime);
+
+    // From the next update on, the particles are sorted to be drawn back to
+    // front as seen through `viewMatrix`, for alpha blending
+    void SetSortView(const glm::mat4 &viewMatrix);
+
+    // Draws the alive particles as GL_POINTS. With compute, the particle storage
+    // buffer is bound at binding 0, and the vertex ID is the slot of the particle
+    // in it; see Particle.VS.glsl. Otherwise, attribute 0 holds the position and
+    // the fraction of the lifetime left; see Particle.Stream.VS.glsl. Blend and
+    // depth state are left to the caller.
+    void Render(Shader *shader, const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix);
+
+    unsigned int GetMaxParticles() const;
+
+ private:
+    ParticleSystem(const ParticleSystem &) = delete;
+    ParticleSystem &operator=(const ParticleSystem &) = delete;
+
+    void BindBuffers() const;
+
+    bool InitStream();
+    void UpdateStream(float deltaTime, unsigned int emitCount);
+
+ private:
+    unsigned int maxParticles;
+    bool initialized;
+
+    std::string shaderDirectory;
+    ParticleEmitter emitter;
+    glm::vec3 gravity;
+    float drag;
+    float emitAccumulator;
+    unsigned int frame;
+
+    // Index of the alive list holding the current particles
+    unsigned int currentList;
+
+    GLuint particleBuffer;
+    GLuint deadListBuffer;
+    GLuint aliveListBuffers[2];
+    GLuint counterBuffer;
+
+    // One per alive list, each using its list as index buffer
+    GLuint VAOs[2];
+
+    Shader *emitShader;
+    Shader *simulateShader;
+    Shader *counterShader;
+    uint64_t prepareFeature;
+    uint64_t finalizeFeature;
+
+    ParticleCollider collider;
+    GLuint heightTexture;
+    GLuint distanceTexture;
+    uint64_t heightFieldFeature;
+    uint64_t distanceFieldFeature;
+
+    // Created once sorting is asked for
+    ParticleSorter *sorter;
+    glm::mat4 sortView;
+
+    // CPU simulation, when compute is not used
+    ParticleSimulator *simulator;
+
+    // The stream buffer holds NR_STREAM_REGIONS regions of `maxParticles` vertices,
+    // written in turn, so the GPU can still read one while the next is filled
+    static const unsigned int NR_STREAM_REGIONS = 3;
+    GLuint streamBuffer;
+    GLuint streamVAO;
+    glm::vec4 *streamMapping;
+    GLsync streamFences[NR_STREAM_REGIONS];
+    unsigned int streamRegion;
+    std::vector<glm::vec4> streamStaging;
+};
@@ -0,0 +1,140 @@
+#include "core/gpu/pixel_buffer_ring.h"
+
+
+PixelBufferRing::PixelBufferRing(GLenum target, unsigned int nrSlots, unsigned int slotSize)
+{
+    this->target = target;
+    this->slotSize = slotSize;
+    nextSlot = 0;
+
+    GLenum usage = (target == GL_PIXEL_PACK_BUFFER) ? GL_STREAM_READ : GL_STREAM_DRAW;
+
+    slots.resize(nrSlots);
+    for (auto &slot : slots)
+    {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(target, slot.buffer);
+        glBufferData(target, slotSize, NULL, usage);
+        slot.fence = 0;
+        slot.inUse = false;
+    }
+
+    glBindBuffer(target, 0);
+    CheckOpenGLError();
+}
+
+
+PixelBufferRing::~PixelBufferRing()
+{
+    for (auto &slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+
+int PixelBufferRing::Acquire()
+{
+    for (unsigned int i = 0; i < slots.size(); i++)
+    {
+        unsigned int index = (nextSlot + i) % slots.size();
+        Slot &slot = slots[index];
+
+        if (slot.inUse || !IsReady(index))
+            continue;
+
+        slot.inUse = true;
+        nextSlot = (index + 1) % slots.size();
+        glBindBuffer(target, slot.buffer);
+        return index;
+    }
+
+    return -1;
+}
+
+
+void *PixelBufferRing::MapForWrite(int slot)
+{
+    glBindBuffer(target, slots[slot].buffer);
+    return glMapBufferRange(target, 0, slotSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+
+const void *PixelBufferRing::MapForRead(int slot)
+{
+    glBindBuffer(target, slots[slot].buffer);
+    return glMapBufferRange(target, 0, slotSize, GL_MAP_READ_BIT);
+}
+
+
+void PixelBufferRing::Unmap(int slot)
+{
+    glBindBuffer(target, slots[slot].buffer);
+    glUnmapBuffer(target);
+    CheckOpenGLError();
+}
+
+
+void PixelBufferRing::Submit(int slot)
+{
+    if (slots[slot].fence)
+        glDeleteSync(slots[slot].fence);
+
+    slots[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(target, 0);
+    CheckOpenGLError();
+}
+
+
+bool PixelBufferRing::IsReady(int slot)
+{
+    GLsync &fence = slots[slot].fence;
+    if (fence == 0)
+        return true;
+
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+    {
+        glDeleteSync(fence);
+        fence = 0;
+        return true;
+    }
+
+    return false;
+}
+
+
+void PixelBufferRing::Wait(int slot)
+{
+    GLsync &fence = slots[slot].fence;
+    while (fence)
+    {
+        // Client waits take a finite timeout, so wait a second at a time
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status != GL_TIMEOUT_EXPIRED)
+        {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+}
+
+
+void PixelBufferRing::Release(int slot)
+{
+    slots[slot].inUse = false;
+}
+
+
+unsigned int PixelBufferRing::GetSlotSize() const
+{
+    return slotSize;
+}
+
+
+GLenum PixelBufferRing::GetTarget() const
+{
+    return target;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Ring of pixel buffer objects used to stream pixel data to or from the GPU
+// without stalling. Each slot is guarded by a fence, and a slot is only
+// handed out again once the GPU has finished with its previous contents.
+class PixelBufferRing
+{
+ public:
+    // `target` is GL_PIXEL_UNPACK_BUFFER for uploads or GL_PIXEL_PACK_BUFFER for readbacks
+    PixelBufferRing(GLenum target, unsigned int nrSlots, unsigned int slotSize);
+    ~PixelBufferRing();
+
+    // Returns the index of a free slot and binds its buffer to the target,
+    // or -1 if all slots are still in use by the GPU. Never blocks.
+    int Acquire();
+
+    // Maps the bound slot for writing. Only valid for unpack rings.
+    void *MapForWrite(int slot);
+    void Unmap(int slot);
+
+    // Maps the slot for reading. Only call once IsReady(slot) returns true.
+    const void *MapForRead(int slot);
+
+    // Inserts a fence after the commands that use the slot and unbinds it
+    void Submit(int slot);
+
+    // Returns true once the GPU finished the commands submitted for the slot
+    bool IsReady(int slot);
+
+    // Blocks until the GPU finished the commands submitted for the slot
+    void Wait(int slot);
+
+    // Returns the slot to the ring
+    void Release(int slot);
+
+    unsigned int GetSlotSize() const;
+    GLenum GetTarget() const;
+
+ private:
+    struct Slot
+    {
+        GLuint buffer;
+        GLsync fence;
+        bool inUse;
+    };
+
+    GLenum target;
+    unsigned int slotSize;
+    unsigned int nextSlot;
+    std::vector<Slot> slots;
+};
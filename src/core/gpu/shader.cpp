@@ -1,12 +1,26 @@
 #include "core/gpu/shader.h"
 
 #include <fstream>
+#include <sstream>
 #include <iostream>
+#include <algorithm>
+
+#include "core/managers/asset_watcher.h"
+#include "core/managers/shader_cache.h"
+#include "utils/text_utils.h"
+
+
+std::list<Shader *> Shader::pendingShaders;
+std::string Shader::includeDirectory;
 
 
 Shader::Shader(const std::string &name)
 {
     program = 0;
+    pending = false;
+    pendingProgram = 0;
+    pendingFrames = 0;
+    pendingKey = 0;
     shaderName = name;
     shaderFiles.reserve(5);
 }
@@ -14,6 +28,19 @@ Shader::Shader(const std::string &name)
 
 Shader::~Shader()
 {
+    AssetWatcher::Unwatch(this);
+
+    for (auto &variant : variants)
+        delete variant.second;
+
+    if (pending)
+    {
+        pendingShaders.remove(this);
+        for (auto &S : pendingStages)
+            glDeleteShader(S.object);
+        glDeleteProgram(pendingProgram);
+    }
+
     glDeleteProgram(program);
 }
 
@@ -30,8 +57,13 @@ GLuint Shader::GetProgramID() const
 }
 
 
-void Shader::Use() const
+void Shader::Use()
 {
+    // Shaders still compiling in the background are finished on first use,
+    // while reloads keep drawing with the previous program until they are done
+    if (pending && (program == 0 || IsReady()))
+        Finish();
+
     if (program)
     {
         glUseProgram(program);
@@ -42,15 +74,19 @@ void Shader::Use() const
 
 unsigned int Shader::Reload()
 {
-    if (program) {
-        glDeleteProgram(program);
-        program = 0;
-    }
+    for (auto &variant : variants)
+        variant.second->Reload();
 
     return CreateAndLink();
 }
 
 
+bool Shader::ReloadAsync()
+{
+    return CreateAndLinkAsync();
+}
+
+
 void Shader::BindTexturesUnits()
 {
     for (int i = 0; i < MAX_2D_TEXTURES; i++) {
@@ -129,55 +165,67 @@ void Shader::AddShaderCode(const std::string &shaderCode, GLenum shaderType)
 }
 
 
-unsigned int Shader::CreateAndLink()
+void Shader::AddDefine(const std::string &name, const std::string &value)
 {
-    std::vector<unsigned int> shaders;
+    defines.push_back(std::make_pair(name, value));
+}
 
-    // Compile shaders
-    for (auto S : shaderFiles) {
-        auto shaderID = Shader::CreateShader(S.file, S.type);
-        if (shaderID) {
-            shaders.push_back(shaderID);
-        } else {
-            return 0;
-        }
-    }
 
-    for (auto S : shaderCodes)
-    {
-        auto shaderID = Shader::CompileShader(S.file, S.type);
-        if (shaderID) {
-            shaders.push_back(shaderID);
-        } else {
-            return 0;
-        }
+uint64_t Shader::AddFeature(const std::string &define)
+{
+    auto it = std::find(features.begin(), features.end(), define);
+    if (it != features.end())
+        return 1ull << (it - features.begin());
+
+    if (features.size() == 64) {
+        std::cout << "\tPROGRAM = " << shaderName << " has too many features: " << define << std::endl;
+        return 0;
     }
 
-    // Create Program and Link
-    if (shaders.size()) {
-        program = Shader::CreateProgram(shaders);
+    features.push_back(define);
+    return 1ull << (features.size() - 1);
+}
+
 
-        if (program)
-        {
-            glUseProgram(program);
-            GetUniforms();
-            for (auto Observer : loadObservers) {
-                Observer();
-            }
-            return program;
-        }
+Shader *Shader::GetVariant(uint64_t featureMask)
+{
+    if (featureMask == 0)
+        return this;
+
+    auto it = variants.find(featureMask);
+    if (it != variants.end())
+        return it->second;
+
+    // The mask is part of the name, so every permutation has its own cache entry
+    char suffix[24];
+    sprintf(suffix, "#%llx", (unsigned long long)featureMask);
+
+    Shader *variant = new Shader(shaderName + suffix);
+    variant->shaderFiles = shaderFiles;
+    variant->shaderCodes = shaderCodes;
+    variant->loadObservers = loadObservers;
+    variant->defines = defines;
+
+    for (unsigned int i = 0; i < features.size(); i++) {
+        if (featureMask & (1ull << i))
+            variant->AddDefine(features[i]);
     }
-    return 0;
+
+    variants[featureMask] = variant;
+
+    // Compiled in the background, and finished by the first Use() at the latest
+    variant->CreateAndLinkAsync();
+    return variant;
 }
 
 
-void Shader::ClearShaders()
+const std::vector<std::string> &Shader::GetDependencies() const
 {
-    shaderFiles.clear();
+    return dependencies;
 }
 
 
-static std::string InjectDefines(const std::string &shaderCode)
+static std::string InjectDefines(const std::string &shaderCode, const std::string &shaderDefines)
 {
     std::string defines;
     size_t pos = shaderCode.find_first_of("\n");
@@ -186,16 +234,272 @@ static std::string InjectDefines(const std::string &shaderCode)
     defines += "\n#define SOLVED";
 #endif
 
+    defines += shaderDefines;
+
     if (pos == std::string::npos)
     {
         return shaderCode + defines;
     }
 
+    // Keep the line numbers of compile errors matching the file
+    if (!defines.empty())
+        defines += "\n#line 2 0";
+
     return shaderCode.substr(0, pos) + defines + shaderCode.substr(pos, std::string::npos);
 }
 
 
-unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderType)
+unsigned int Shader::CreateAndLink()
+{
+    if (!CreateAndLinkAsync())
+        return 0;
+
+    return Finish();
+}
+
+
+bool Shader::CreateAndLinkAsync()
+{
+    // A previous submission must not be left half finished
+    Finish();
+
+    std::vector<ShaderFile> sources;
+    std::string shaderDefines;
+
+    for (auto &D : defines)
+        shaderDefines += "\n#define " + D.first + (D.second.empty() ? "" : " " + D.second);
+
+    // Gather the final code of every stage, files first
+    dependencies.clear();
+    for (auto S : shaderFiles) {
+        ShaderFile source;
+        source.file = InjectDefines(PreprocessShaderFile(S.file, dependencies.size()), shaderDefines);
+        source.type = S.type;
+        sources.push_back(source);
+    }
+
+    for (auto S : shaderCodes) {
+        S.file = InjectDefines(S.file, shaderDefines);
+        sources.push_back(S);
+    }
+
+    if (sources.empty())
+        return false;
+
+    // The cache entry is named after the program, and only used while
+    // the exact sources and the driver are the same as when it was stored
+    pendingIdentity = shaderName;
+    pendingKey = ShaderCache::GetDriverKey();
+
+    for (auto &S : shaderFiles)
+        pendingIdentity += "|" + S.file;
+
+    for (auto &S : sources) {
+        pendingKey = text_utils::Hash(std::to_string(S.type), pendingKey);
+        pendingKey = text_utils::Hash(S.file, pendingKey);
+    }
+
+    pendingProgram = ShaderCache::Load(pendingIdentity, pendingKey);
+    pendingStages.clear();
+
+    if (pendingProgram)
+    {
+        std::cout << "\tPROGRAM = " << shaderName << " ..... CACHED" << std::endl;
+    }
+    else
+    {
+        // Compile and link without querying any status, so the driver can
+        // overlap the work with other programs submitted in the same batch
+        for (unsigned int i = 0; i < sources.size(); i++) {
+            PendingStage stage;
+            stage.object = Shader::SubmitShader(sources[i].file, sources[i].type);
+            stage.type = sources[i].type;
+            stage.name = (i < shaderFiles.size()) ? shaderFiles[i].file : shaderName;
+
+            if (stage.object == 0) {
+                for (auto &S : pendingStages)
+                    glDeleteShader(S.object);
+                pendingStages.clear();
+                return false;
+            }
+
+            pendingStages.push_back(stage);
+        }
+
+        pendingProgram = glCreateProgram();
+
+        for (auto &S : pendingStages)
+            glAttachShader(pendingProgram, S.object);
+
+        ShaderCache::PrepareProgram(pendingProgram);
+        glLinkProgram(pendingProgram);
+    }
+
+    pending = true;
+    pendingFrames = 0;
+    pendingShaders.push_back(this);
+    return true;
+}
+
+
+bool Shader::IsReady()
+{
+    if (!pending)
+        return true;
+
+    if (GLEW_ARB_parallel_shader_compile && !pendingStages.empty())
+    {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_ARB, &completed);
+        if (completed == GL_FALSE)
+            return false;
+    }
+    else if (!pendingStages.empty() && pendingFrames < FALLBACK_COMPILE_FRAMES)
+    {
+        // Without the extension the status queries block, so give drivers
+        // that compile on their own threads a few frames before asking
+        return false;
+    }
+
+    Finish();
+    return true;
+}
+
+
+unsigned int Shader::Finish()
+{
+    if (!pending)
+        return program;
+
+    pending = false;
+    pendingShaders.remove(this);
+
+    bool compiled = true;
+    for (auto &S : pendingStages)
+    {
+        std::cout << "\tFILE = " << S.name;
+        compiled = Shader::CheckShader(S.object, S.type) && compiled;
+    }
+
+    bool linked = compiled && Shader::CheckProgram(pendingProgram);
+
+    for (auto &S : pendingStages)
+        glDeleteShader(S.object);
+
+    if (!linked)
+    {
+        // A failed reload keeps the previous program
+        glDeleteProgram(pendingProgram);
+        pendingProgram = 0;
+        pendingStages.clear();
+        return 0;
+    }
+
+    if (!pendingStages.empty())
+        ShaderCache::Store(pendingIdentity, pendingKey, pendingProgram);
+    pendingStages.clear();
+
+    // Swap in the new program, so users never see a half built one
+    glDeleteProgram(program);
+    program = pendingProgram;
+    pendingProgram = 0;
+
+    AssetWatcher::Watch(this);
+
+    glUseProgram(program);
+    GetUniforms();
+    for (auto Observer : loadObservers) {
+        Observer();
+    }
+
+    CheckOpenGLError();
+    return program;
+}
+
+
+void Shader::CreateAndLinkAll(const std::vector<Shader *> &shaders)
+{
+    for (auto shader : shaders)
+        shader->CreateAndLinkAsync();
+}
+
+
+unsigned int Shader::UpdatePending()
+{
+    // IsReady may remove the shader from the list
+    std::list<Shader *> shaders = pendingShaders;
+    for (auto shader : shaders) {
+        shader->pendingFrames++;
+        shader->IsReady();
+    }
+
+    return (unsigned int)pendingShaders.size();
+}
+
+
+void Shader::SetIncludeDirectory(const std::string &directory)
+{
+    includeDirectory = directory;
+}
+
+
+void Shader::ClearShaders()
+{
+    shaderFiles.clear();
+}
+
+
+std::string Shader::PreprocessShaderFile(const std::string &shaderFile, size_t firstDependency)
+{
+    // The position among the dependencies of the stage is the GLSL source string
+    // number of the file, so errors inside included code can be traced back to it
+    size_t sourceIndex = dependencies.size() - firstDependency;
+    dependencies.push_back(shaderFile);
+
+    std::string directory = shaderFile.substr(0, shaderFile.find_last_of("/\\") + 1);
+    std::istringstream input(ReadShaderFile(shaderFile));
+    std::string output, line;
+    int lineNumber = 0;
+
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            output += line + "\n";
+            continue;
+        }
+
+        // #include "file", relative to the including file, or #include <file>,
+        // relative to the include directory
+        size_t open = line.find_first_of("\"<", start + 8);
+        size_t close = (open == std::string::npos) ? open : line.find_first_of("\">", open + 1);
+        if (close == std::string::npos) {
+            std::cout << "\tInvalid #include in " << shaderFile << " (" << lineNumber << "): " << line << std::endl;
+            output += "\n";
+            continue;
+        }
+
+        std::string includeName = line.substr(open + 1, close - open - 1);
+        std::string includeFile = (line[open] == '<') ? PATH_JOIN(includeDirectory, includeName) : directory + includeName;
+
+        // Every file is included once, which also breaks include cycles
+        if (std::find(dependencies.begin() + firstDependency, dependencies.end(), includeFile) != dependencies.end()) {
+            output += "\n";
+            continue;
+        }
+
+        output += "#line 1 " + std::to_string(dependencies.size() - firstDependency) + "\n";
+        output += PreprocessShaderFile(includeFile, firstDependency);
+        output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceIndex) + "\n";
+    }
+
+    return output;
+}
+
+
+std::string Shader::ReadShaderFile(const std::string &shaderFile)
 {
     std::string shader_code;
     std::ifstream file(shaderFile.c_str(), std::ios::in);
@@ -205,8 +509,6 @@ unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderTy
         std::terminate();
     }
 
-    std::cout << "\tFILE = " << shaderFile;
-
     // Get file content
     file.seekg(0, std::ios::end);
     shader_code.resize((unsigned int)file.tellg());
@@ -214,18 +516,14 @@ unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderTy
     file.read(&shader_code[0], shader_code.size());
     file.close();
 
-    return CompileShader(InjectDefines(shader_code), shaderType);
+    return shader_code;
 }
 
 
-unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderType)
+unsigned int Shader::SubmitShader(const std::string &shaderCode, GLenum shaderType)
 {
-    int infoLogLength = 0;
-    int compileResult = 0;
-    unsigned int glShaderObject;
-
     // Create new shader object
-    glShaderObject = glCreateShader(shaderType);
+    unsigned int glShaderObject = glCreateShader(shaderType);
     if (glShaderObject == 0) {
         std::cout << "\t ..... ERROR " << std::endl;
         return 0;
@@ -236,6 +534,16 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
 
     glShaderSource(glShaderObject, 1, &shader_code_ptr, &shader_code_size);
     glCompileShader(glShaderObject);
+
+    return glShaderObject;
+}
+
+
+bool Shader::CheckShader(unsigned int glShaderObject, GLenum shaderType)
+{
+    int infoLogLength = 0;
+    int compileResult = 0;
+
     glGetShaderiv(glShaderObject, GL_COMPILE_STATUS, &compileResult);
 
     // LOG COMPILE ERRORS
@@ -253,7 +561,7 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
         if (shaderType == GL_COMPUTE_SHADER)             str_shader_type="COMPUTE";
 
         glGetShaderiv(glShaderObject, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> shader_log(infoLogLength);
+        std::vector<char> shader_log(infoLogLength + 1);
         glGetShaderInfoLog(glShaderObject, infoLogLength, NULL, &shader_log[0]);
 
         std::cout << "\n-----------------------------------------------------\n";
@@ -261,46 +569,35 @@ unsigned int Shader::CompileShader(const std::string shaderCode, GLenum shaderTy
         std::cout << &shader_log[0] << "\n";
         std::cout << "-----------------------------------------------------" << std::endl;
 
-        return 0;
+        return false;
     }
 
     std::cout << "\t ..... COMPILED " << std::endl;
 
-    return glShaderObject;
+    return true;
 }
 
 
-unsigned int Shader::CreateProgram(const std::vector<unsigned int> &shaderObjects)
+bool Shader::CheckProgram(unsigned int glProgramObject)
 {
     int infoLogLength = 0;
     int linkResult = 0;
 
-    // build OpenGL program object and link all the OpenGL shader objects
-    unsigned int glProgramObject = glCreateProgram();
-
-    for (auto shader : shaderObjects)
-        glAttachShader(glProgramObject, shader);
-
-    glLinkProgram(glProgramObject);
     glGetProgramiv(glProgramObject, GL_LINK_STATUS, &linkResult);
 
     // LOG LINK ERRORS
     if (linkResult == GL_FALSE) {
         glGetProgramiv(glProgramObject, GL_INFO_LOG_LENGTH, &infoLogLength);
-        std::vector<char> program_log(infoLogLength);
+        std::vector<char> program_log(infoLogLength + 1);
         glGetProgramInfoLog(glProgramObject, infoLogLength, NULL, &program_log[0]);
 
         std::cout << "Shader Loader : LINK ERROR" << std::endl;
         std::cout << &program_log[0] << std::endl;
 
-        return 0;
+        return false;
     }
 
-    // Delete the shader objects because we do not need them any more
-    for (auto shader : shaderObjects)
-        glDeleteShader(shader);
-
     CheckOpenGLError();
 
-    return glProgramObject;
+    return true;
 }
@@ -3,7 +3,9 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <cstdint>
 #include <functional>
+#include <unordered_map>
 
 #include "utils/gl_utils.h"
 
@@ -21,24 +23,68 @@ class Shader
     const char *GetName() const;
     GLuint GetProgramID() const;
 
-    void Use() const;
+    void Use();
     unsigned int Reload();
 
+    // Recompiles in the background while the current program stays in use. The
+    // new program replaces it between draws once linked, and is discarded if it
+    // fails to compile, so a typo never leaves the scene without a shader.
+    bool ReloadAsync();
+
     void AddShader(const std::string &shaderFile, GLenum shaderType);
     void AddShaderCode(const std::string &shaderCode, GLenum shaderType);
     void ClearShaders();
     unsigned int CreateAndLink();
 
+    // Submits compilation and linking without waiting for the driver. The program
+    // is finished, and errors are reported, by IsReady(), Finish() or the first Use().
+    bool CreateAndLinkAsync();
+
+    // Polls the driver, without blocking if it supports ARB_parallel_shader_compile
+    bool IsReady();
+
+    // Waits for the driver and returns the program, or 0 on failure
+    unsigned int Finish();
+
+    // Submits every shader before checking any of them, so compilation overlaps
+    static void CreateAndLinkAll(const std::vector<Shader *> &shaders);
+
+    // Finishes the submitted shaders the driver is done with. Called once per frame
+    // by `World`; returns how many are still compiling.
+    static unsigned int UpdatePending();
+
+    // Directory of `#include <file>`, while `#include "file"` is relative to the
+    // including file. Set by the engine to the shaders under RESOURCE_PATH::SHADERS.
+    static void SetIncludeDirectory(const std::string &directory);
+
     void BindTexturesUnits();
     GLint GetUniformLocation(const char * uniformName) const;
 
     void OnLoad(std::function<void()> onLoad);
 
+    // Adds `#define name value` to every stage, right after the #version line.
+    // Takes effect on the next CreateAndLink() or Reload().
+    void AddDefine(const std::string &name, const std::string &value = "");
+
+    // Registers a feature that variants may enable, and returns its bit.
+    // At most 64 features per shader.
+    uint64_t AddFeature(const std::string &define);
+
+    // Returns the program compiled with the defines of the features set in
+    // `featureMask`, so branches on them are resolved by the preprocessor.
+    // Each permutation is compiled on first request and cached.
+    Shader *GetVariant(uint64_t featureMask);
+
+    // Files read by the last compilation, including the #include'd ones
+    const std::vector<std::string> &GetDependencies() const;
+
  private:
     void GetUniforms();
-    static unsigned int CreateShader(const std::string &shaderFile, GLenum shaderType);
-    static unsigned int CompileShader(const std::string shaderCode, GLenum shaderType);
-    static unsigned int CreateProgram(const std::vector<unsigned int> &shaderObjects);
+    std::string PreprocessShaderFile(const std::string &shaderFile, size_t firstDependency);
+    static std::string ReadShaderFile(const std::string &shaderFile);
+    static unsigned int SubmitShader(const std::string &shaderCode, GLenum shaderType);
+    static bool CheckShader(unsigned int glShaderObject, GLenum shaderType);
+    static bool CheckProgram(unsigned int glProgramObject);
 
  public:
     GLuint program;
@@ -76,8 +122,35 @@ class Shader
         GLenum type;
     };
 
+    struct PendingStage
+    {
+        GLuint object;
+        GLenum type;
+        std::string name;
+    };
+
     std::string shaderName;
     std::vector<ShaderFile> shaderFiles;
     std::vector<ShaderFile> shaderCodes;
     std::list<std::function<void()>> loadObservers;
+
+    // Preprocessor state
+    std::vector<std::pair<std::string, std::string>> defines;
+    std::vector<std::string> features;
+    std::unordered_map<uint64_t, Shader *> variants;
+    std::vector<std::string> dependencies;
+
+    // Submitted but not finished yet
+    bool pending;
+    GLuint pendingProgram;
+    unsigned int pendingFrames;
+    std::vector<PendingStage> pendingStages;
+    std::string pendingIdentity;
+    uint64_t pendingKey;
+
+    static std::list<Shader *> pendingShaders;
+    static std::string includeDirectory;
+
+    // Frames to wait before polling a program without ARB_parallel_shader_compile
+    static const unsigned int FALLBACK_COMPILE_FRAMES = 2;
 };
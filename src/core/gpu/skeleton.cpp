@@ -0,0 +1,166 @@
+#include "core/gpu/skeleton.h"
+
+#include "utils/simd_utils.h"
+
+
+// out = a * b, for column-major matrices. `out` may not alias `b`.
+static inline void MultiplyMatrices(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+{
+#if defined(SIMD_SSE2)
+    const float *pa = glm::value_ptr(a);
+    const float *pb = glm::value_ptr(b);
+    float *po = glm::value_ptr(out);
+
+    __m128 a0 = _mm_loadu_ps(pa);
+    __m128 a1 = _mm_loadu_ps(pa + 4);
+    __m128 a2 = _mm_loadu_ps(pa + 8);
+    __m128 a3 = _mm_loadu_ps(pa + 12);
+
+    // Each column of the result blends the columns of `a` by a column of `b`
+    for (int c = 0; c < 4; c++)
+    {
+        const float *column = pb + 4 * c;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+        _mm_storeu_ps(po + 4 * c, r);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+
+static glm::mat4 ConvertMatrix(const aiMatrix4x4 &m)
+{
+    return glm::transpose(glm::make_mat4(&m.a1));
+}
+
+
+Skeleton::Skeleton()
+{
+    globalInverseTransform = glm::mat4(1);
+}
+
+
+void Skeleton::Init(const aiNode *rootNode,
+                    const std::map<std::string, int> &boneMapping,
+                    const std::vector<BoneInfo> &boneInfo,
+                    const glm::mat4 &globalInverseTransform)
+{
+    Clear();
+    this->globalInverseTransform = globalInverseTransform;
+
+    boneNodes.assign(boneInfo.size(), 0);
+    boneOffsets.resize(boneInfo.size());
+    for (unsigned int i = 0; i < boneInfo.size(); i++)
+    {
+        boneOffsets[i] = boneInfo[i].boneOffset;
+    }
+
+    if (rootNode)
+        AddNode(rootNode, -1, boneMapping);
+}
+
+
+void Skeleton::Clear()
+{
+    parents.clear();
+    bindTransforms.clear();
+    names.clear();
+    boneNodes.clear();
+    boneOffsets.clear();
+}
+
+
+void Skeleton::AddNode(const aiNode *node, int parent, const std::map<std::string, int> &boneMapping)
+{
+    int nodeIndex = static_cast<int>(parents.size());
+    parents.push_back(parent);
+    bindTransforms.push_back(ConvertMatrix(node->mTransformation));
+    names.push_back(node->mName.data);
+
+    auto it = boneMapping.find(node->mName.data);
+    if (it != boneMapping.end() && it->second < (int)boneNodes.size())
+        boneNodes[it->second] = nodeIndex;
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        AddNode(node->mChildren[i], nodeIndex, boneMapping);
+    }
+}
+
+
+unsigned int Skeleton::GetNumberOfNodes() const
+{
+    return static_cast<unsigned int>(parents.size());
+}
+
+
+unsigned int Skeleton::GetNumberOfBones() const
+{
+    return static_cast<unsigned int>(boneNodes.size());
+}
+
+
+int Skeleton::GetParent(unsigned int nodeIndex) const
+{
+    return parents[nodeIndex];
+}
+
+
+int Skeleton::FindNode(const std::string &name) const
+{
+    for (unsigned int i = 0; i < names.size(); i++)
+    {
+        if (names[i] == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+
+unsigned int Skeleton::GetSubtreeEnd(unsigned int nodeIndex) const
+{
+    // Descendants follow the node until the first one whose parent precedes it
+    unsigned int end = nodeIndex + 1;
+    while (end < parents.size() && parents[end] >= (int)nodeIndex)
+    {
+        end++;
+    }
+    return end;
+}
+
+
+const glm::mat4 &Skeleton::GetBindTransform(unsigned int nodeIndex) const
+{
+    return bindTransforms[nodeIndex];
+}
+
+
+void Skeleton::ComputeModelTransforms(const glm::mat4 *localTransforms, glm::mat4 *modelTransforms) const
+{
+    unsigned int nrNodes = GetNumberOfNodes();
+    for (unsigned int i = 0; i < nrNodes; i++)
+    {
+        int parent = parents[i];
+        if (parent < 0)
+            modelTransforms[i] = localTransforms[i];
+        else
+            MultiplyMatrices(modelTransforms[parent], localTransforms[i], modelTransforms[i]);
+    }
+}
+
+
+void Skeleton::ComputeBoneTransforms(const glm::mat4 *modelTransforms, glm::mat4 *boneTransforms) const
+{
+    glm::mat4 boneTransform;
+
+    unsigned int nrBones = GetNumberOfBones();
+    for (unsigned int i = 0; i < nrBones; i++)
+    {
+        MultiplyMatrices(modelTransforms[boneNodes[i]], boneOffsets[i], boneTransform);
+        MultiplyMatrices(globalInverseTransform, boneTransform, boneTransforms[i]);
+    }
+}
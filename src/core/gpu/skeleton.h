@@ -0,0 +1,63 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "core/gpu/vertex_bone_data.h"
+#include "utils/glm_utils.h"
+
+#include "assimp/scene.h"
+
+
+// Node hierarchy of a skinned mesh, flattened into arrays in depth-first
+// order, the order AnimationClip numbers nodes in. Parents come before their
+// children, so transforms propagate from the root in one pass over the nodes.
+class Skeleton
+{
+ public:
+    Skeleton();
+
+    // Flattens the nodes under `rootNode`, and binds each bone of `boneMapping`
+    // to its node. `globalInverseTransform` brings the root back to mesh space.
+    void Init(const aiNode *rootNode,
+              const std::map<std::string, int> &boneMapping,
+              const std::vector<BoneInfo> &boneInfo,
+              const glm::mat4 &globalInverseTransform);
+    void Clear();
+
+    unsigned int GetNumberOfNodes() const;
+    unsigned int GetNumberOfBones() const;
+
+    // Index of the parent of node `nodeIndex`, or -1 for the root
+    int GetParent(unsigned int nodeIndex) const;
+
+    // Index of the node named `name`, or -1 if there is none
+    int FindNode(const std::string &name) const;
+
+    // One past the last node under `nodeIndex`, so [nodeIndex, end) is its subtree
+    unsigned int GetSubtreeEnd(unsigned int nodeIndex) const;
+
+    // Transform of node `nodeIndex` relative to its parent when not animated
+    const glm::mat4 &GetBindTransform(unsigned int nodeIndex) const;
+
+    // Transforms of every node relative to the root, from their local ones
+    void ComputeModelTransforms(const glm::mat4 *localTransforms, glm::mat4 *modelTransforms) const;
+
+    // Skinning matrices of the bones, from the model transforms of the nodes
+    void ComputeBoneTransforms(const glm::mat4 *modelTransforms, glm::mat4 *boneTransforms) const;
+
+ private:
+    void AddNode(const aiNode *node, int parent, const std::map<std::string, int> &boneMapping);
+
+ private:
+    std::vector<int> parents;
+    std::vector<glm::mat4> bindTransforms;
+    std::vector<std::string> names;
+
+    // Node of each bone, and the transform from mesh space to the bone
+    std::vector<unsigned int> boneNodes;
+    std::vector<glm::mat4> boneOffsets;
+
+    glm::mat4 globalInverseTransform;
+};
@@ -44,6 +44,11 @@ class SSBO
         Unbind();
     }
 
+    GLuint GetBufferID() const
+    {
+        return ssbo;
+    }
+
     void BindBuffer(GLuint index) const
     {
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, ssbo);
@@ -1,6 +1,5 @@
 #include "core/gpu/texture2D.h"
 
-#include <thread>
 #include <iostream>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -8,16 +7,11 @@
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
+#include "core/gpu/block_compression.h"
+#include "utils/math_utils.h"
 #include "utils/memory_utils.h"
 
 
-void write_image_thread(const char* fileName, unsigned int width, unsigned int height, unsigned int channels, const unsigned char *data)
-{
-    stbi_write_png(fileName, width, height, channels, data, width * channels);
-    delete data;
-}
-
-
 const GLint pixelFormat[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
 const GLint internalFormat[][5] = {
     { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 },
@@ -27,18 +21,55 @@ const GLint internalFormat[][5] = {
 };
 
 
+unsigned int Texture2D::currentFrame = 0;
+
+
+// Channels and bits per texel of the uncompressed formats in `internalFormat`
+static bool GetFormatLayout(GLenum format, unsigned int &channels, unsigned int &bitsPerTexel)
+{
+    static const unsigned int bitsPerChannel[] = { 8, 16, 16, 32 };
+    for (unsigned int precision = 0; precision < 4; precision++)
+    {
+        for (unsigned int chn = 1; chn <= 4; chn++)
+        {
+            if ((GLenum)internalFormat[precision][chn] == format)
+            {
+                channels = chn;
+                bitsPerTexel = chn * bitsPerChannel[precision];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// Bytes of one mip level; RGB8 is assumed to be padded to 4 bytes per texel by the driver
+static unsigned int LevelMemorySize(unsigned int width, unsigned int height, unsigned int channels, GLenum compressedFormat)
+{
+    if (compressedFormat)
+        return block_compression::GetCompressedSize(compressedFormat, width, height);
+    return width * height * (channels == 3 ? 4 : channels);
+}
+
+
 Texture2D::Texture2D()
 {
     width = 0;
     height = 0;
     channels = 0;
     textureID = 0;
+    imageData = nullptr;
     bitsPerPixel = 8;
     cacheInMemory = false;
     targetType = GL_TEXTURE_2D;
     wrappingMode = GL_REPEAT;
     textureMinFilter = GL_LINEAR;
     textureMagFilter = GL_LINEAR;
+    compressedFormat = 0;
+    memorySize = 0;
+    lastUseFrame = 0;
+    fallback = nullptr;
 }
 
 
@@ -87,6 +118,9 @@ bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
     glBindTexture(targetType, 0);
     CheckOpenGLError();
 
+    // A full mip chain adds a third on top of the base level
+    memorySize = LevelMemorySize(width, height, chn, 0) / 3 * 4;
+
     if (cacheInMemory == false)
     {
         stbi_image_free(imageData);
@@ -96,6 +130,56 @@ bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
 }
 
 
+void Texture2D::CreateMipChain(unsigned int width, unsigned int height, unsigned int channels, unsigned int levels, GLenum wrapping_mode, GLenum compressed_format)
+{
+    textureMinFilter = GL_LINEAR_MIPMAP_LINEAR;
+    wrappingMode = wrapping_mode;
+
+    Init2DTexture(width, height, channels);
+    compressedFormat = compressed_format;
+    memorySize = 0;
+
+    for (unsigned int level = 0; level < levels; level++)
+    {
+        memorySize += LevelMemorySize(MAX(width >> level, 1u), MAX(height >> level, 1u), channels, compressedFormat);
+    }
+
+    // Compressed levels are allocated by glCompressedTexImage2D as they arrive
+    for (unsigned int level = 0; level < levels && !compressedFormat; level++)
+    {
+        glTexImage2D(targetType, level, internalFormat[0][channels], MAX(width >> level, 1u), MAX(height >> level, 1u),
+            0, pixelFormat[channels], GL_UNSIGNED_BYTE, NULL);
+    }
+
+    glTexParameteri(targetType, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(targetType, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    UnBind();
+}
+
+
+void Texture2D::UploadMipLevel(unsigned int level, const void *data, unsigned int dataSize)
+{
+    glBindTexture(targetType, textureID);
+
+    if (compressedFormat)
+    {
+        glCompressedTexImage2D(targetType, level, compressedFormat, MAX(width >> level, 1u), MAX(height >> level, 1u),
+            0, dataSize, data);
+    }
+    else
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(targetType, level, 0, 0, MAX(width >> level, 1u), MAX(height >> level, 1u),
+            pixelFormat[channels], GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    glTexParameteri(targetType, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(targetType, 0);
+    CheckOpenGLError();
+}
+
+
 void Texture2D::SaveToFile(const char *fileName)
 {
     if (imageData == nullptr)
@@ -189,6 +273,25 @@ void Texture2D::CreateFrameBufferTexture(unsigned int width, unsigned int height
 }
 
 
+bool Texture2D::CreateRenderTarget(unsigned int width, unsigned int height, unsigned int targetID, GLenum format)
+{
+    unsigned int chn, bits;
+    if (!GetFormatLayout(format, chn, bits))
+    {
+        std::cout << "Unsupported render target format 0x" << std::hex << format << std::dec << std::endl;
+        return false;
+    }
+
+    bitsPerPixel = bits;
+    Init2DTexture(width, height, chn);
+    memorySize = width * height * (bits / 8);
+    glTexImage2D(targetType, 0, format, width, height, 0, pixelFormat[chn], GL_UNSIGNED_BYTE, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + targetID, GL_TEXTURE_2D, textureID, 0);
+    UnBind();
+    return true;
+}
+
+
 void Texture2D::CreateDepthBufferTexture(unsigned int width, unsigned int height)
 {
     Init2DTexture(width, height, 1);
@@ -200,15 +303,18 @@ void Texture2D::CreateDepthBufferTexture(unsigned int width, unsigned int height
 
 void Texture2D::Bind() const
 {
+    lastUseFrame = currentFrame;
     glBindTexture(GL_TEXTURE_2D, textureID);
 }
 
 
 void Texture2D::BindToTextureUnit(GLenum TextureUnit) const
 {
-    if (!textureID) return;
+    lastUseFrame = currentFrame;
+    GLuint boundID = (textureID || !fallback) ? textureID : fallback->textureID;
+    if (!boundID) return;
     glActiveTexture(TextureUnit);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    glBindTexture(GL_TEXTURE_2D, boundID);
 }
 
 
@@ -306,6 +412,8 @@ void Texture2D::Init2DTexture(unsigned int width, unsigned int height, unsigned
     this->width = width;
     this->height = height;
     this->channels = channels;
+    compressedFormat = 0;
+    memorySize = LevelMemorySize(width, height, channels, 0);
 
     if (textureID)
         glDeleteTextures(1, &textureID);
@@ -315,3 +423,50 @@ void Texture2D::Init2DTexture(unsigned int width, unsigned int height, unsigned
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
     CheckOpenGLError();
 }
+
+
+void Texture2D::Release()
+{
+    if (textureID)
+        glDeleteTextures(1, &textureID);
+
+    textureID = 0;
+    memorySize = 0;
+    CheckOpenGLError();
+}
+
+
+bool Texture2D::IsResident() const
+{
+    return textureID != 0;
+}
+
+
+void Texture2D::SetFallback(const Texture2D *texture)
+{
+    fallback = texture;
+}
+
+
+unsigned int Texture2D::GetMemorySize() const
+{
+    return memorySize;
+}
+
+
+unsigned int Texture2D::GetLastUseFrame() const
+{
+    return lastUseFrame;
+}
+
+
+unsigned int Texture2D::GetCurrentFrame()
+{
+    return currentFrame;
+}
+
+
+void Texture2D::AdvanceFrame()
+{
+    currentFrame++;
+}
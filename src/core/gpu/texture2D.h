@@ -22,9 +22,25 @@ class Texture2D
 
     void CreateCubeTexture(const float *data, unsigned int width, unsigned int height, unsigned int chn);
     void CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision = 32);
+
+    // Color attachment `targetID` with a sized `format`, like GL_RG16 or GL_RGBA8
+    bool CreateRenderTarget(unsigned int width, unsigned int height, unsigned int targetID, GLenum format);
     void CreateDepthBufferTexture(unsigned int width, unsigned int height);
 
     bool Load2D(const char* fileName, GLenum wrappingMode = GL_REPEAT);
+
+    // Allocates a mip chain without data. Levels are then filled with UploadMipLevel,
+    // from the smallest to the largest, and the texture samples the finest level uploaded so far.
+    // A non-zero `compressedFormat` selects a block-compressed internal format.
+    void CreateMipChain(unsigned int width, unsigned int height, unsigned int channels, unsigned int levels,
+                        GLenum wrappingMode = GL_REPEAT, GLenum compressedFormat = 0);
+
+    // `data` is a client pointer, or an offset if a GL_PIXEL_UNPACK_BUFFER is bound.
+    // `dataSize` is only needed for compressed textures.
+    void UploadMipLevel(unsigned int level, const void *data, unsigned int dataSize = 0);
+
+    // Blocks until the texture is read back and written as PNG.
+    // FrameCapture does both without stalling the render thread.
     void SaveToFile(const char* fileName);
     void CacheInMemory(bool state);
 
@@ -40,6 +56,21 @@ class Texture2D
 
     GLuint GetTextureID() const;
 
+    // Frees the GPU storage but keeps the texture settings, so it can be loaded again
+    void Release();
+    bool IsResident() const;
+
+    // Texture that BindToTextureUnit() samples instead while this one has no GPU storage
+    void SetFallback(const Texture2D *texture);
+
+    // Approximate GPU memory used by all mip levels, in bytes
+    unsigned int GetMemorySize() const;
+
+    // Index of the last frame the texture was bound in, see `AdvanceFrame`
+    unsigned int GetLastUseFrame() const;
+    static unsigned int GetCurrentFrame();
+    static void AdvanceFrame();
+
  private:
     void SetTextureParameters();
     void Init2DTexture(unsigned int width, unsigned int height, unsigned int channels);
@@ -56,6 +87,12 @@ class Texture2D
     GLenum wrappingMode;
     GLenum textureMinFilter;
     GLenum textureMagFilter;
+    GLenum compressedFormat;
+    unsigned int memorySize;
+    mutable unsigned int lastUseFrame;
+    const Texture2D *fallback;
 
     unsigned char *imageData;
+
+    static unsigned int currentFrame;
 };
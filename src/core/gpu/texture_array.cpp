@@ -0,0 +1,221 @@
+#include "core/gpu/texture_array.h"
+
+#include <iostream>
+
+#include "core/gpu/block_compression.h"
+#include "core/managers/texture_loader.h"
+#include "utils/math_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Bilinear resample of an image to `size` x `size` RGBA
+static std::vector<unsigned char> ResampleToRGBA(const TextureImage &image, unsigned int size)
+{
+    std::vector<unsigned char> out(size * size * 4);
+    const unsigned char *src = image.GetLevelData(0);
+    unsigned int chn = image.channels;
+
+    for (unsigned int y = 0; y < size; y++)
+    {
+        float fy = MAX((y + 0.5f) * image.height / size - 0.5f, 0.0f);
+        unsigned int y0 = MIN((unsigned int)fy, image.height - 1);
+        unsigned int y1 = MIN(y0 + 1, image.height - 1);
+        float ty = fy - y0;
+
+        for (unsigned int x = 0; x < size; x++)
+        {
+            float fx = MAX((x + 0.5f) * image.width / size - 0.5f, 0.0f);
+            unsigned int x0 = MIN((unsigned int)fx, image.width - 1);
+            unsigned int x1 = MIN(x0 + 1, image.width - 1);
+            float tx = fx - x0;
+
+            for (unsigned int c = 0; c < 4; c++)
+            {
+                // Grey images are replicated to RGB, missing alpha is opaque
+                unsigned int sc = (chn >= 3) ? c : (c < 3 ? 0 : 1);
+                if (sc >= chn)
+                {
+                    out[(y * size + x) * 4 + c] = 255;
+                    continue;
+                }
+
+                float a = src[(y0 * image.width + x0) * chn + sc] * (1 - tx) + src[(y0 * image.width + x1) * chn + sc] * tx;
+                float b = src[(y1 * image.width + x0) * chn + sc] * (1 - tx) + src[(y1 * image.width + x1) * chn + sc] * tx;
+                out[(y * size + x) * 4 + c] = (unsigned char)(a * (1 - ty) + b * ty + 0.5f);
+            }
+        }
+    }
+
+    return out;
+}
+
+
+TextureArray::TextureArray(unsigned int maxLayerSize)
+{
+    this->maxLayerSize = maxLayerSize;
+    layerSize = 0;
+    nrBuiltLayers = 0;
+    textureID = 0;
+}
+
+
+TextureArray::~TextureArray()
+{
+    if (textureID)
+        glDeleteTextures(1, &textureID);
+}
+
+
+unsigned int TextureArray::AddLayer(const std::string &fileName)
+{
+    for (unsigned int i = 0; i < layerFiles.size(); i++)
+    {
+        if (layerFiles[i] == fileName)
+            return i;
+    }
+
+    layerFiles.push_back(fileName);
+    return (unsigned int)layerFiles.size() - 1;
+}
+
+
+bool TextureArray::Build()
+{
+    if (layerFiles.empty() || nrBuiltLayers == layerFiles.size())
+        return nrBuiltLayers != 0;
+
+    unsigned int nrLayers = (unsigned int)layerFiles.size();
+    std::vector<TextureImage> images(nrLayers);
+
+    thread_utils::ParallelFor(0, nrLayers, 1, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            if (!TextureLoader::Decode(layerFiles[i], images[i], false))
+                std::cout << "ERROR loading texture array layer: " << layerFiles[i] << std::endl;
+        }
+    });
+
+    // The layer size is the largest image, rounded up to a power of two
+    layerSize = 1;
+    for (auto &image : images)
+    {
+        while (layerSize < MIN(MAX(image.width, image.height), maxLayerSize))
+            layerSize *= 2;
+    }
+
+    // Images that failed to load become white layers
+    bool hasAlpha = false;
+    thread_utils::ParallelFor(0, nrLayers, 1, [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            TextureImage &image = images[i];
+            std::vector<unsigned char> pixels = image.levels.empty()
+                ? std::vector<unsigned char>(layerSize * layerSize * 4, 255)
+                : ResampleToRGBA(image, layerSize);
+
+            image.width = image.height = layerSize;
+            image.channels = 4;
+            image.levels.assign(1, std::move(pixels));
+            TextureLoader::GenerateMipChain(image);
+        }
+    });
+
+    for (auto &image : images)
+    {
+        for (unsigned int p = 3; p < image.levels[0].size() && !hasAlpha; p += 4)
+            hasAlpha = image.levels[0][p] != 255;
+    }
+
+    GLenum format = GLEW_EXT_texture_compression_s3tc
+        ? (hasAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        : 0;
+    unsigned int nrLevels = (unsigned int)images[0].levels.size();
+
+    if (textureID)
+        glDeleteTextures(1, &textureID);
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, nrLevels - 1);
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (unsigned int level = 0; level < nrLevels; level++)
+    {
+        unsigned int size = MAX(layerSize >> level, 1u);
+
+        if (format)
+        {
+            unsigned int levelSize = block_compression::GetCompressedSize(format, size, size);
+            std::vector<unsigned char> blocks(levelSize * nrLayers);
+
+            thread_utils::ParallelFor(0, nrLayers, 1, [&](unsigned int begin, unsigned int end)
+            {
+                for (unsigned int i = begin; i < end; i++)
+                {
+                    std::vector<unsigned char> layer = block_compression::Compress(format, images[i].levels[level].data(), size, size, 4);
+                    std::copy(layer.begin(), layer.end(), blocks.begin() + i * levelSize);
+                }
+            });
+
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, size, size, nrLayers, 0,
+                (GLsizei)blocks.size(), blocks.data());
+        }
+        else
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, nrLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            for (unsigned int i = 0; i < nrLayers; i++)
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, i, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                    images[i].levels[level].data());
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+
+    nrBuiltLayers = nrLayers;
+    return true;
+}
+
+
+void TextureArray::BindToTextureUnit(GLenum textureUnit) const
+{
+    if (!textureID) return;
+    glActiveTexture(textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+}
+
+
+void TextureArray::UnBind() const
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+}
+
+
+unsigned int TextureArray::GetNumberOfLayers() const
+{
+    return (unsigned int)layerFiles.size();
+}
+
+
+unsigned int TextureArray::GetLayerSize() const
+{
+    return layerSize;
+}
+
+
+GLuint TextureArray::GetTextureID() const
+{
+    return textureID;
+}
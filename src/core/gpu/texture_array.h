@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// GL_TEXTURE_2D_ARRAY built from image files. Every image is resized to a
+// common layer size, so many small material textures share a single
+// binding and meshes using them can be drawn without texture switches.
+class TextureArray
+{
+ public:
+    // Layers are at most `maxLayerSize` texels wide and high
+    explicit TextureArray(unsigned int maxLayerSize = 1024);
+    ~TextureArray();
+
+    // Returns the layer that will hold the image, adding it if it is new.
+    // Layers added after Build() are uploaded by the next Build().
+    unsigned int AddLayer(const std::string &fileName);
+
+    // Decodes every layer on the thread pool, then uploads the whole array
+    bool Build();
+
+    void BindToTextureUnit(GLenum textureUnit) const;
+    void UnBind() const;
+
+    unsigned int GetNumberOfLayers() const;
+    unsigned int GetLayerSize() const;
+    GLuint GetTextureID() const;
+
+ private:
+    std::vector<std::string> layerFiles;
+    unsigned int maxLayerSize;
+    unsigned int layerSize;
+    unsigned int nrBuiltLayers;
+    GLuint textureID;
+};
@@ -0,0 +1,196 @@
+#include "core/managers/asset_watcher.h"
+
+#include <list>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "assimp/Importer.hpp"
+
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "core/managers/texture_manager.h"
+#include "utils/file_utils.h"
+#include "utils/memory_utils.h"
+#include "utils/thread_utils.h"
+
+
+struct MeshImport
+{
+    Mesh *mesh;
+    std::string filePath;
+    Assimp::Importer importer;
+    const aiScene *scene;
+    std::atomic<bool> done;
+};
+
+
+static file_utils::FileWatcher *watcher = nullptr;
+static std::unordered_map<Shader *, std::vector<std::string>> shaderFiles;
+static std::unordered_map<Mesh *, std::string> meshFiles;
+static std::unordered_set<std::string> textureFiles;
+static std::list<std::shared_ptr<MeshImport>> meshImports;
+
+
+void AssetWatcher::Init()
+{
+    if (watcher == nullptr)
+        watcher = new file_utils::FileWatcher();
+}
+
+
+void AssetWatcher::Destroy()
+{
+    SAFE_FREE(watcher);
+
+    // Imports still running own their data, and are dropped when they finish
+    meshImports.clear();
+    shaderFiles.clear();
+    meshFiles.clear();
+    textureFiles.clear();
+}
+
+
+bool AssetWatcher::IsEnabled()
+{
+    return watcher != nullptr;
+}
+
+
+static void ReloadMesh(Mesh *mesh, const std::string &filePath)
+{
+    std::shared_ptr<MeshImport> job = std::make_shared<MeshImport>();
+    job->mesh = mesh;
+    job->filePath = filePath;
+    job->scene = nullptr;
+    job->done = false;
+
+    GLenum drawMode = mesh->GetDrawMode();
+    thread_utils::GetThreadPool().Enqueue([job, drawMode]()
+    {
+        job->scene = Mesh::ImportScene(job->importer, job->filePath, drawMode);
+        job->done = true;
+    });
+
+    meshImports.push_back(job);
+}
+
+
+void AssetWatcher::Update()
+{
+    if (watcher == nullptr)
+        return;
+
+    for (auto &fileName : watcher->GetChangedFiles())
+    {
+        std::cout << "Reloading " << fileName << std::endl;
+
+        // Reloading re-registers the shader, so collect them first
+        std::vector<Shader *> shaders;
+        for (auto &shader : shaderFiles)
+        {
+            const std::vector<std::string> &files = shader.second;
+            if (std::find(files.begin(), files.end(), fileName) != files.end())
+                shaders.push_back(shader.first);
+        }
+
+        for (auto shader : shaders)
+            shader->ReloadAsync();
+
+        for (auto &mesh : meshFiles)
+        {
+            if (mesh.second == fileName)
+                ReloadMesh(mesh.first, fileName);
+        }
+
+        if (textureFiles.count(fileName))
+            TextureManager::Reload(fileName);
+    }
+
+    for (auto it = meshImports.begin(); it != meshImports.end();)
+    {
+        MeshImport &job = **it;
+        if (!job.done)
+        {
+            ++it;
+            continue;
+        }
+
+        // The mesh may have been deleted, or loaded from elsewhere, meanwhile
+        auto mesh = meshFiles.find(job.mesh);
+        if (mesh != meshFiles.end() && mesh->second == job.filePath)
+        {
+            if (job.scene == nullptr || !job.mesh->ReloadFromScene(job.scene))
+                std::cout << "ERROR reloading mesh: " << job.filePath << " " << job.importer.GetErrorString() << std::endl;
+        }
+
+        it = meshImports.erase(it);
+    }
+}
+
+
+void AssetWatcher::Watch(Shader *shader)
+{
+    if (watcher == nullptr)
+        return;
+
+    // The #include'd files may have changed since the last compilation
+    std::vector<std::string> files = shader->GetDependencies();
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+
+    for (auto &fileName : files)
+        watcher->Watch(fileName);
+
+    Unwatch(shader);
+    shaderFiles[shader] = files;
+}
+
+
+void AssetWatcher::Watch(Mesh *mesh)
+{
+    if (watcher == nullptr || mesh->GetFilePath().empty())
+        return;
+
+    watcher->Watch(mesh->GetFilePath());
+
+    Unwatch(mesh);
+    meshFiles[mesh] = mesh->GetFilePath();
+}
+
+
+void AssetWatcher::WatchTexture(const std::string &fileName)
+{
+    if (watcher == nullptr || fileName.empty())
+        return;
+
+    if (textureFiles.insert(fileName).second)
+        watcher->Watch(fileName);
+}
+
+
+void AssetWatcher::Unwatch(Shader *shader)
+{
+    auto it = shaderFiles.find(shader);
+    if (watcher == nullptr || it == shaderFiles.end())
+        return;
+
+    for (auto &fileName : it->second)
+        watcher->Unwatch(fileName);
+
+    shaderFiles.erase(it);
+}
+
+
+void AssetWatcher::Unwatch(Mesh *mesh)
+{
+    auto it = meshFiles.find(mesh);
+    if (watcher == nullptr || it == meshFiles.end())
+        return;
+
+    watcher->Unwatch(it->second);
+    meshFiles.erase(it);
+}
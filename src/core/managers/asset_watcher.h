@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+
+
+class Shader;
+class Mesh;
+
+
+// Reloads shaders, meshes and textures when their files change on disk.
+// Changes are detected by a `file_utils::FileWatcher` thread, and reloads
+// never stall the frame: shaders recompile in the background and replace
+// the old program once linked, meshes are imported on the thread pool, and
+// textures are decoded and streamed in by `TextureLoader`.
+class AssetWatcher
+{
+ public:
+    static void Init();
+    static void Destroy();
+
+    // Starts reloading the files changed since the last call and finishes the
+    // meshes imported since. Called once per frame by `World`.
+    static void Update();
+
+    // Shaders and meshes register themselves once loaded, and textures are
+    // registered by `TextureManager`. Does nothing before Init().
+    static void Watch(Shader *shader);
+    static void Watch(Mesh *mesh);
+    static void WatchTexture(const std::string &fileName);
+
+    static void Unwatch(Shader *shader);
+    static void Unwatch(Mesh *mesh);
+
+    static bool IsEnabled();
+
+ protected:
+    AssetWatcher() = delete;
+    ~AssetWatcher() = delete;
+};
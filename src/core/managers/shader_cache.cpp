@@ -0,0 +1,171 @@
+#include "core/managers/shader_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include "utils/file_utils.h"
+#include "utils/text_utils.h"
+
+
+std::string ShaderCache::directory;
+
+
+static const uint32_t CACHE_MAGIC = 0x50584647;    // "GFXP"
+
+
+struct ProgramBinaryHeader
+{
+    uint32_t magic;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+    uint32_t reserved;
+    uint64_t key;
+};
+
+
+void ShaderCache::SetDirectory(const std::string &directory)
+{
+    ShaderCache::directory.clear();
+
+    if (directory.empty())
+        return;
+
+    GLint nrFormats = 0;
+    if (GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nrFormats);
+
+    // Some drivers expose the extension without any binary format
+    if (nrFormats == 0)
+        return;
+
+    if (!file_utils::CreateDirectories(directory))
+    {
+        std::cout << "ERROR creating shader cache directory: " << directory << std::endl;
+        return;
+    }
+
+    ShaderCache::directory = directory;
+}
+
+
+bool ShaderCache::IsEnabled()
+{
+    return !directory.empty();
+}
+
+
+uint64_t ShaderCache::GetDriverKey()
+{
+    uint64_t key = text_utils::Hash("");
+    const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+    for (GLenum name : names)
+    {
+        const GLubyte *value = glGetString(name);
+        key = text_utils::Hash(value ? reinterpret_cast<const char *>(value) : "", key);
+    }
+
+    return key;
+}
+
+
+std::string ShaderCache::GetCachePath(const std::string &identity)
+{
+    std::ostringstream os;
+    os << directory << PATH_SEPARATOR << std::hex << text_utils::Hash(identity) << ".bin";
+    return os.str();
+}
+
+
+GLuint ShaderCache::Load(const std::string &identity, uint64_t key)
+{
+    if (directory.empty())
+        return 0;
+
+    file_utils::MappedFile file;
+    if (!file.Open(GetCachePath(identity)) || file.GetSize() < sizeof(ProgramBinaryHeader))
+        return 0;
+
+    ProgramBinaryHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+
+    if (header.magic != CACHE_MAGIC || header.key != key
+        || sizeof(header) + header.binaryLength > file.GetSize())
+    {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, file.GetData() + sizeof(header), header.binaryLength);
+
+    GLint linkResult = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkResult);
+
+    // The driver may refuse binaries from an older build of itself
+    if (linkResult == GL_FALSE)
+    {
+        glDeleteProgram(program);
+        program = 0;
+    }
+
+    // Drop any error raised by a rejected binary
+    while (glGetError() != GL_NO_ERROR);
+
+    return program;
+}
+
+
+void ShaderCache::PrepareProgram(GLuint program)
+{
+    if (!directory.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+
+bool ShaderCache::Store(const std::string &identity, uint64_t key, GLuint program)
+{
+    if (directory.empty())
+        return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    std::vector<unsigned char> binary(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    ProgramBinaryHeader header;
+    header.magic = CACHE_MAGIC;
+    header.binaryFormat = binaryFormat;
+    header.binaryLength = length;
+    header.reserved = 0;
+    header.key = key;
+
+    std::string cacheFile = GetCachePath(identity);
+    std::string tempFile = cacheFile + ".tmp";
+
+    FILE *file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool status = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(binary.data(), 1, length, file) == (size_t)length;
+    status = (fclose(file) == 0) && status;
+
+    if (status)
+    {
+        remove(cacheFile.c_str());
+        status = rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+    }
+
+    if (!status)
+        remove(tempFile.c_str());
+
+    CheckOpenGLError();
+    return status;
+}
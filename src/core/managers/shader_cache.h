@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include "utils/gl_utils.h"
+
+
+// On-disk cache of linked program binaries (ARB_get_program_binary).
+// Entries are keyed by a hash of the final shader sources and of the
+// driver, so edited shaders and driver updates fall back to compiling.
+class ShaderCache
+{
+ public:
+    // Creates the directory if needed. An empty string disables the cache.
+    static void SetDirectory(const std::string &directory);
+
+    static bool IsEnabled();
+
+    // Starts a key, seeded with the vendor, renderer and version strings of the driver
+    static uint64_t GetDriverKey();
+
+    // Creates a program from the binary stored for `identity`, or returns 0 if
+    // there is none, its key differs, or the driver rejects it
+    static GLuint Load(const std::string &identity, uint64_t key);
+
+    // Asks the driver to keep the binary of `program`. Call before linking.
+    static void PrepareProgram(GLuint program);
+
+    // Stores the binary of a linked program
+    static bool Store(const std::string &identity, uint64_t key, GLuint program);
+
+ protected:
+    ShaderCache() = delete;
+    ~ShaderCache() = delete;
+
+ private:
+    static std::string GetCachePath(const std::string &identity);
+
+ private:
+    static std::string directory;
+};
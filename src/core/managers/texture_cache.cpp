@@ -0,0 +1,221 @@
+#include "core/managers/texture_cache.h"
+
+#include <cstdio>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+
+#include "core/gpu/block_compression.h"
+#include "utils/file_utils.h"
+#include "utils/math_utils.h"
+#include "utils/text_utils.h"
+
+
+std::string TextureCache::directory;
+
+
+static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+
+struct KTXHeader
+{
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+
+static const GLenum baseFormat[5] = { 0, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+
+static bool IsFormatSupported(GLenum format)
+{
+    switch (format)
+    {
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2:
+            return true;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return GLEW_EXT_texture_compression_s3tc != 0;
+        default:
+            return false;
+    }
+}
+
+
+void TextureCache::SetDirectory(const std::string &directory)
+{
+    if (!directory.empty() && !file_utils::CreateDirectories(directory))
+    {
+        std::cout << "ERROR creating texture cache directory: " << directory << std::endl;
+        TextureCache::directory.clear();
+        return;
+    }
+
+    TextureCache::directory = directory;
+}
+
+
+std::string TextureCache::GetCachePath(const std::string &sourceFile)
+{
+    if (directory.empty())
+        return std::string();
+
+    // Sources in different folders may share a name, so the full path is hashed
+    uint64_t hash = text_utils::Hash(sourceFile);
+
+    size_t pos = sourceFile.find_last_of("\\/");
+    std::string baseName = (pos == std::string::npos) ? sourceFile : sourceFile.substr(pos + 1);
+
+    std::ostringstream os;
+    os << directory << PATH_SEPARATOR << baseName << "-" << std::hex << hash << ".ktx";
+    return os.str();
+}
+
+
+bool TextureCache::Read(const std::string &sourceFile, TextureImage &image)
+{
+    std::string cacheFile = GetCachePath(sourceFile);
+    time_t sourceTime, cacheTime;
+
+    if (cacheFile.empty()
+        || !file_utils::GetModificationTime(cacheFile, cacheTime)
+        || (file_utils::GetModificationTime(sourceFile, sourceTime) && sourceTime > cacheTime))
+    {
+        return false;
+    }
+
+    std::shared_ptr<file_utils::MappedFile> file = std::make_shared<file_utils::MappedFile>();
+    if (!file->Open(cacheFile) || file->GetSize() < sizeof(KTXHeader))
+        return false;
+
+    KTXHeader header;
+    memcpy(&header, file->GetData(), sizeof(KTXHeader));
+
+    if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0
+        || header.endianness != KTX_ENDIANNESS
+        || header.glType != 0
+        || !IsFormatSupported(header.glInternalFormat)
+        || header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1
+        || header.numberOfFaces != 1 || header.numberOfArrayElements != 0
+        || header.numberOfMipmapLevels == 0)
+    {
+        return false;
+    }
+
+    unsigned int channels = 0;
+    for (unsigned int i = 1; i < 5; i++)
+    {
+        if (baseFormat[i] == (GLenum)header.glBaseInternalFormat)
+            channels = i;
+    }
+
+    if (channels == 0)
+        return false;
+
+    image.width = header.pixelWidth;
+    image.height = header.pixelHeight;
+    image.channels = channels;
+    image.compressedFormat = header.glInternalFormat;
+    image.levels.clear();
+    image.mappedLevels.clear();
+    image.mappedLevelSizes.clear();
+
+    size_t offset = sizeof(KTXHeader) + header.bytesOfKeyValueData;
+
+    for (unsigned int level = 0; level < header.numberOfMipmapLevels; level++)
+    {
+        uint32_t imageSize;
+        unsigned int expectedSize = block_compression::GetCompressedSize(image.compressedFormat,
+            MAX(image.width >> level, 1u), MAX(image.height >> level, 1u));
+
+        if (offset + sizeof(uint32_t) > file->GetSize())
+            return false;
+
+        memcpy(&imageSize, file->GetData() + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+
+        if (imageSize != expectedSize || offset + imageSize > file->GetSize())
+            return false;
+
+        image.mappedLevels.push_back(file->GetData() + offset);
+        image.mappedLevelSizes.push_back(imageSize);
+        offset += (imageSize + 3) & ~3u;
+    }
+
+    image.file = file;
+    return true;
+}
+
+
+bool TextureCache::Write(const std::string &sourceFile, const TextureImage &image)
+{
+    std::string cacheFile = GetCachePath(sourceFile);
+
+    if (cacheFile.empty() || image.compressedFormat == 0)
+        return false;
+
+    KTXHeader header;
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glType = 0;
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = image.compressedFormat;
+    header.glBaseInternalFormat = baseFormat[image.channels];
+    header.pixelWidth = image.width;
+    header.pixelHeight = image.height;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = image.GetNumberOfLevels();
+    header.bytesOfKeyValueData = 0;
+
+    // Written under a temporary name first, so readers never map a partial file
+    std::string tempFile = cacheFile + ".tmp";
+    FILE *file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool status = fwrite(&header, sizeof(header), 1, file) == 1;
+    const unsigned char padding[4] = { 0, 0, 0, 0 };
+
+    for (unsigned int level = 0; level < header.numberOfMipmapLevels && status; level++)
+    {
+        uint32_t imageSize = image.GetLevelSize(level);
+        status = fwrite(&imageSize, sizeof(imageSize), 1, file) == 1
+            && fwrite(image.GetLevelData(level), 1, imageSize, file) == imageSize
+            && fwrite(padding, 1, (4 - imageSize % 4) % 4, file) == (4 - imageSize % 4) % 4;
+    }
+
+    status = (fclose(file) == 0) && status;
+
+    if (status)
+    {
+        remove(cacheFile.c_str());
+        status = rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+    }
+
+    if (!status)
+    {
+        std::cout << "ERROR writing texture cache: " << cacheFile << std::endl;
+        remove(tempFile.c_str());
+    }
+
+    return status;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include "core/managers/texture_loader.h"
+
+
+// On-disk cache of GPU-ready textures. Each source image is stored as a
+// KTX 1.1 file with its full, block-compressed mip chain, so later runs
+// skip decoding and mip generation and upload straight from a memory
+// mapping of the file.
+class TextureCache
+{
+ public:
+    // Creates the directory if needed. An empty string disables the cache.
+    static void SetDirectory(const std::string &directory);
+
+    // Maps the cached version of `sourceFile` into `image`. Fails if there is
+    // none, if it is older than the source, or if the driver cannot sample it.
+    // Thread safe.
+    static bool Read(const std::string &sourceFile, TextureImage &image);
+
+    // Stores a block-compressed image for `sourceFile`. Thread safe.
+    static bool Write(const std::string &sourceFile, const TextureImage &image);
+
+ protected:
+    TextureCache() = delete;
+    ~TextureCache() = delete;
+
+ private:
+    static std::string GetCachePath(const std::string &sourceFile);
+
+ private:
+    static std::string directory;
+};
@@ -0,0 +1,320 @@
+#include "core/managers/texture_loader.h"
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_set>
+#include <thread>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#include "stb/stb_image.h"
+
+#include "core/gpu/block_compression.h"
+#include "core/gpu/pixel_buffer_ring.h"
+#include "core/managers/texture_cache.h"
+#include "utils/math_utils.h"
+#include "utils/thread_utils.h"
+
+
+struct PendingUpload
+{
+    Texture2D *texture;
+    std::string fileName;
+    GLenum wrappingMode;
+    TextureImage image;
+    int nextLevel;
+};
+
+
+static const unsigned int STAGING_SLOTS = 4;
+static const unsigned int STAGING_SLOT_SIZE = 4 * 1024 * 1024;
+
+static std::mutex decodedMutex;
+static std::list<PendingUpload *> decodedQueue;
+static std::list<PendingUpload *> uploadQueue;
+static std::unordered_set<const Texture2D *> loadingTextures;
+static std::unordered_set<const Texture2D *> failedTextures;
+static std::atomic<unsigned int> pendingDecodes(0);
+static PixelBufferRing *stagingRing = nullptr;
+
+
+bool TextureLoader::Decode(const std::string &fileName, TextureImage &image, bool generateMips)
+{
+    int width, height, chn;
+    unsigned char *data = stbi_load(fileName.c_str(), &width, &height, &chn, 0);
+
+    if (data == NULL)
+        return false;
+
+    image.width = width;
+    image.height = height;
+    image.channels = chn;
+    image.levels.clear();
+    image.levels.push_back(std::vector<unsigned char>(data, data + width * height * chn));
+    stbi_image_free(data);
+
+    if (generateMips)
+        GenerateMipChain(image);
+
+    return true;
+}
+
+
+void TextureLoader::GenerateMipChain(TextureImage &image)
+{
+    unsigned int chn = image.channels;
+    unsigned int width = image.width;
+    unsigned int height = image.height;
+
+    image.levels.resize(1);
+
+    while (width > 1 || height > 1)
+    {
+        unsigned int newWidth = MAX(width / 2, 1u);
+        unsigned int newHeight = MAX(height / 2, 1u);
+
+        const std::vector<unsigned char> &src = image.levels.back();
+        std::vector<unsigned char> dst(newWidth * newHeight * chn);
+
+        for (unsigned int y = 0; y < newHeight; y++)
+        {
+            unsigned int y0 = MIN(2 * y, height - 1);
+            unsigned int y1 = MIN(2 * y + 1, height - 1);
+
+            for (unsigned int x = 0; x < newWidth; x++)
+            {
+                unsigned int x0 = MIN(2 * x, width - 1);
+                unsigned int x1 = MIN(2 * x + 1, width - 1);
+
+                for (unsigned int c = 0; c < chn; c++)
+                {
+                    unsigned int sum = src[(y0 * width + x0) * chn + c] + src[(y0 * width + x1) * chn + c]
+                                     + src[(y1 * width + x0) * chn + c] + src[(y1 * width + x1) * chn + c];
+                    dst[(y * newWidth + x) * chn + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        image.levels.push_back(std::move(dst));
+        width = newWidth;
+        height = newHeight;
+    }
+}
+
+
+bool TextureLoader::Compress(TextureImage &image)
+{
+    if (image.compressedFormat || image.levels.empty())
+        return image.compressedFormat != 0;
+
+    GLenum format = block_compression::ChooseFormat(image.channels, image.levels[0].data(), image.width * image.height);
+    if (format == 0)
+        return false;
+
+    for (unsigned int level = 0; level < image.levels.size(); level++)
+    {
+        image.levels[level] = block_compression::Compress(format, image.levels[level].data(),
+            MAX(image.width >> level, 1u), MAX(image.height >> level, 1u), image.channels);
+    }
+
+    // Opaque RGBA images are stored without alpha
+    if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        image.channels = 3;
+
+    image.compressedFormat = format;
+    return true;
+}
+
+
+static bool PrepareImage(const std::string &fileName, TextureImage &image)
+{
+    if (TextureCache::Read(fileName, image))
+        return true;
+
+    if (!TextureLoader::Decode(fileName, image))
+        return false;
+
+    if (TextureLoader::Compress(image))
+        TextureCache::Write(fileName, image);
+
+    return true;
+}
+
+
+void TextureLoader::LoadAsync(Texture2D *texture, const std::string &fileName, GLenum wrappingMode)
+{
+    PendingUpload *upload = new PendingUpload();
+    upload->texture = texture;
+    upload->fileName = fileName;
+    upload->wrappingMode = wrappingMode;
+    upload->nextLevel = -1;
+
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        loadingTextures.insert(texture);
+        failedTextures.erase(texture);
+    }
+
+    pendingDecodes++;
+    thread_utils::GetThreadPool().Enqueue([upload]()
+    {
+        if (PrepareImage(upload->fileName, upload->image))
+        {
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            decodedQueue.push_back(upload);
+        }
+        else
+        {
+            std::cout << "ERROR loading texture: " << upload->fileName << std::endl;
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            loadingTextures.erase(upload->texture);
+            failedTextures.insert(upload->texture);
+            delete upload;
+        }
+        pendingDecodes--;
+    });
+}
+
+
+static bool UploadNextLevel(PendingUpload *upload, bool allowDirectUpload)
+{
+    TextureImage &image = upload->image;
+
+    if (upload->nextLevel < 0)
+    {
+        upload->texture->CreateMipChain(image.width, image.height, image.channels,
+            image.GetNumberOfLevels(), upload->wrappingMode, image.compressedFormat);
+        upload->nextLevel = (int)image.GetNumberOfLevels() - 1;
+    }
+
+    const unsigned char *levelData = image.GetLevelData(upload->nextLevel);
+    unsigned int levelSize = image.GetLevelSize(upload->nextLevel);
+
+    if (stagingRing == nullptr)
+    {
+        stagingRing = new PixelBufferRing(GL_PIXEL_UNPACK_BUFFER, STAGING_SLOTS, STAGING_SLOT_SIZE);
+    }
+
+    int slot = (levelSize <= stagingRing->GetSlotSize()) ? stagingRing->Acquire() : -1;
+
+    if (slot >= 0)
+    {
+        void *staging = stagingRing->MapForWrite(slot);
+        memcpy(staging, levelData, levelSize);
+        stagingRing->Unmap(slot);
+
+        // With an unpack buffer bound, the data pointer is an offset into it
+        upload->texture->UploadMipLevel(upload->nextLevel, (const void *)0, levelSize);
+        stagingRing->Submit(slot);
+        stagingRing->Release(slot);
+    }
+    else if (allowDirectUpload || levelSize > stagingRing->GetSlotSize())
+    {
+        upload->texture->UploadMipLevel(upload->nextLevel, levelData, levelSize);
+    }
+    else
+    {
+        // The ring is still in use by the GPU, try again next frame
+        return false;
+    }
+
+    if (!image.file)
+        std::vector<unsigned char>().swap(image.levels[upload->nextLevel]);
+    upload->nextLevel--;
+    return true;
+}
+
+
+bool TextureLoader::Load(Texture2D *texture, const std::string &fileName, GLenum wrappingMode)
+{
+    PendingUpload upload;
+    upload.texture = texture;
+    upload.fileName = fileName;
+    upload.wrappingMode = wrappingMode;
+    upload.nextLevel = -1;
+
+    if (!PrepareImage(fileName, upload.image))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        failedTextures.erase(texture);
+    }
+
+    do
+    {
+        UploadNextLevel(&upload, true);
+    } while (upload.nextLevel >= 0);
+
+    return true;
+}
+
+
+void TextureLoader::Update(unsigned int byteBudget)
+{
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        uploadQueue.splice(uploadQueue.end(), decodedQueue);
+    }
+
+    unsigned int uploadedBytes = 0;
+
+    while (!uploadQueue.empty() && uploadedBytes < byteBudget)
+    {
+        PendingUpload *upload = uploadQueue.front();
+        const TextureImage &image = upload->image;
+        unsigned int levelSize = image.GetLevelSize(upload->nextLevel < 0 ? image.GetNumberOfLevels() - 1 : upload->nextLevel);
+
+        if (!UploadNextLevel(upload, byteBudget == UINT_MAX))
+            break;
+
+        uploadedBytes += levelSize;
+
+        if (upload->nextLevel < 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                loadingTextures.erase(upload->texture);
+            }
+            uploadQueue.pop_front();
+            delete upload;
+        }
+    }
+}
+
+
+void TextureLoader::Flush()
+{
+    while (GetPendingCount())
+    {
+        Update(UINT_MAX);
+
+        if (uploadQueue.empty())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+unsigned int TextureLoader::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    return pendingDecodes + (unsigned int)(decodedQueue.size() + uploadQueue.size());
+}
+
+
+bool TextureLoader::IsLoading(const Texture2D *texture)
+{
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    return loadingTextures.count(texture) != 0;
+}
+
+
+bool TextureLoader::HasFailed(const Texture2D *texture)
+{
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    return failedTextures.count(texture) != 0;
+}
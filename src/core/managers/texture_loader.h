@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "core/gpu/texture2D.h"
+#include "utils/file_utils.h"
+
+
+// Decoded image together with its mip chain, level 0 being the full image
+struct TextureImage
+{
+    TextureImage()
+    {
+        width = 0;
+        height = 0;
+        channels = 0;
+        compressedFormat = 0;
+    }
+
+    unsigned int GetNumberOfLevels() const
+    {
+        return (unsigned int)(file ? mappedLevels.size() : levels.size());
+    }
+
+    const unsigned char *GetLevelData(unsigned int level) const
+    {
+        return file ? mappedLevels[level] : levels[level].data();
+    }
+
+    unsigned int GetLevelSize(unsigned int level) const
+    {
+        return (unsigned int)(file ? mappedLevelSizes[level] : levels[level].size());
+    }
+
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+
+    // Block-compressed format of the levels, or 0 for raw 8-bit pixels
+    GLenum compressedFormat;
+    std::vector<std::vector<unsigned char>> levels;
+
+    // Images read from the texture cache point into the mapped file instead
+    std::shared_ptr<file_utils::MappedFile> file;
+    std::vector<const unsigned char *> mappedLevels;
+    std::vector<unsigned int> mappedLevelSizes;
+};
+
+
+// Decodes textures and builds their mip chains on the shared thread pool,
+// then streams the levels to the GPU through a ring of pixel buffer objects.
+// Levels are uploaded smallest first, so textures sharpen progressively
+// and the render thread never waits on disk or decompression. Results are
+// block compressed and kept in the `TextureCache` for the next run.
+class TextureLoader
+{
+ public:
+    // Decodes an image file and optionally builds its mip chain. Thread safe.
+    static bool Decode(const std::string &fileName, TextureImage &image, bool generateMips = true);
+
+    // Appends box-filtered levels down to 1x1 after level 0. Thread safe.
+    static void GenerateMipChain(TextureImage &image);
+
+    // Block compresses every level, if the driver supports a suitable format. Thread safe.
+    static bool Compress(TextureImage &image);
+
+    // Loads the texture from the cache, or decodes and caches it, then uploads
+    // every level before returning. Must be called from the GL context thread.
+    static bool Load(Texture2D *texture, const std::string &fileName, GLenum wrappingMode = GL_REPEAT);
+
+    // Queues the texture for decoding on a worker thread. The texture has
+    // no GPU storage until Update() starts uploading it.
+    static void LoadAsync(Texture2D *texture, const std::string &fileName, GLenum wrappingMode = GL_REPEAT);
+
+    // Uploads decoded levels, spending at most `byteBudget` bytes this call.
+    // Must be called from the thread that owns the GL context.
+    static void Update(unsigned int byteBudget = DEFAULT_UPLOAD_BUDGET);
+
+    // Blocks until every queued texture is decoded and uploaded
+    static void Flush();
+
+    static unsigned int GetPendingCount();
+
+    // True while the texture is queued for decoding or upload
+    static bool IsLoading(const Texture2D *texture);
+
+    // True if the last LoadAsync() of the texture could not read its file
+    static bool HasFailed(const Texture2D *texture);
+
+    static const unsigned int DEFAULT_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+ protected:
+    TextureLoader() = delete;
+    ~TextureLoader() = delete;
+};
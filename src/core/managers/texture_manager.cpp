@@ -1,34 +1,121 @@
 #include "core/managers/texture_manager.h"
 
+#include <algorithm>
+
 #include "core/gpu/texture2D.h"
+#include "core/managers/asset_watcher.h"
 #include "core/managers/resource_path.h"
+#include "core/managers/texture_cache.h"
+#include "core/managers/texture_loader.h"
 #include "utils/memory_utils.h"
 
 
 std::unordered_map<std::string, Texture2D*> TextureManager::mapTextures;
 std::vector<Texture2D*> TextureManager::vTextures;
+std::vector<TextureManager::TextureSource> TextureManager::vSources;
+size_t TextureManager::memoryBudget = TextureManager::DEFAULT_MEMORY_BUDGET;
+TextureStats TextureManager::stats = {};
 
 
 void TextureManager::Init(const std::string &selfDir)
 {
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "default.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "white.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "black.jpg");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "noise.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "random.jpg");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "particle.png");
+    TextureCache::SetDirectory(PATH_JOIN(selfDir, RESOURCE_PATH::CACHE, "textures"));
+
+    // Decode the built-in textures in parallel. They must be resident before the
+    // first frame, since `vTextures[0]` is the fallback for failed loads.
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "default.png");
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "white.png");
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "black.jpg");
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "noise.png");
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "random.jpg");
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "particle.png");
+    TextureLoader::Flush();
+
+    // The fallback texture stays resident
+    vSources[0].filePath.clear();
+}
+
+
+void TextureManager::Destroy()
+{
+    // Uploads still in flight reference the textures
+    TextureLoader::Flush();
+
+    for (Texture2D *texture : vTextures)
+    {
+        texture->Release();
+        SAFE_FREE(texture);
+    }
+
+    vTextures.clear();
+    vSources.clear();
+    mapTextures.clear();
 }
 
 
-#if 0
-TextureManager::~TextureManager()
+void TextureManager::Update()
 {
-    // Delete textures
-    unsigned int size = (unsigned int) vTextures.size();
-    for (unsigned int i=0; i <size; ++i)
-        SAFE_FREE(vTextures[i]);
+    TextureLoader::Update();
+
+    unsigned int lastFrame = Texture2D::GetCurrentFrame();
+    std::vector<unsigned int> evictable;
+
+    stats.residentTextures = 0;
+    stats.evictedTextures = 0;
+    stats.residentBytes = 0;
+    stats.budgetBytes = memoryBudget;
+
+    for (unsigned int i = 0; i < vTextures.size(); i++)
+    {
+        Texture2D *texture = vTextures[i];
+        bool reloadable = !vSources[i].filePath.empty();
+
+        if (texture->IsResident() || TextureLoader::IsLoading(texture))
+        {
+            stats.residentTextures++;
+            stats.residentBytes += texture->GetMemorySize();
+
+            // Textures used in the last frame are never evicted, to avoid thrashing
+            if (reloadable && texture->GetLastUseFrame() != lastFrame && !TextureLoader::IsLoading(texture))
+                evictable.push_back(i);
+        }
+        else if (reloadable && TextureLoader::HasFailed(texture))
+        {
+            // Its file is read again only once it changes, see Reload()
+            texture->SetFallback(vTextures[0]);
+        }
+        else if (reloadable)
+        {
+            stats.evictedTextures++;
+
+            // Bound while evicted: it sampled nothing and has to come back
+            if (texture->GetLastUseFrame() == lastFrame)
+            {
+                TextureLoader::LoadAsync(texture, vSources[i].filePath, vSources[i].wrappingMode);
+                stats.misses++;
+            }
+        }
+    }
+
+    if (stats.residentBytes > memoryBudget)
+    {
+        std::sort(evictable.begin(), evictable.end(), [](unsigned int a, unsigned int b) {
+            return vTextures[a]->GetLastUseFrame() < vTextures[b]->GetLastUseFrame();
+        });
+
+        for (unsigned int i = 0; i < evictable.size() && stats.residentBytes > memoryBudget; i++)
+        {
+            Texture2D *texture = vTextures[evictable[i]];
+            stats.residentBytes -= texture->GetMemorySize();
+            stats.residentTextures--;
+            stats.evictedTextures++;
+            stats.evictions++;
+            texture->Release();
+        }
+    }
+
+    Texture2D::AdvanceFrame();
 }
-#endif
 
 
 Texture2D *TextureManager::LoadTexture(const std::string &path, const char *fileName, const char *key, bool forceLoad, bool cacheInRAM)
@@ -38,27 +125,97 @@ Texture2D *TextureManager::LoadTexture(const std::string &path, const char *file
 
     if (forceLoad || texture == nullptr)
     {
-        if (texture == nullptr)
+        bool isNew = (texture == nullptr);
+        if (isNew)
         {
             texture = new Texture2D();
         }
 
+        // Textures kept in RAM need their raw pixels, so they bypass the compressed cache
+        std::string filePath = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
         texture->CacheInMemory(cacheInRAM);
-        bool status = texture->Load2D((path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "")).c_str());
+        bool status = cacheInRAM ? texture->Load2D(filePath.c_str()) : TextureLoader::Load(texture, filePath);
 
         if (status == false)
         {
-            delete texture;
+            if (isNew)
+            {
+                delete texture;
+            }
             return vTextures[0];
         }
 
-        vTextures.push_back(texture);
-        mapTextures[uid] = texture;
+        // Textures kept in RAM are edited by their users, so they cannot be reloaded from disk
+        if (isNew)
+        {
+            AddTexture(uid, texture, cacheInRAM ? std::string() : filePath, GL_REPEAT);
+        }
+        else
+        {
+            auto it = std::find(vTextures.begin(), vTextures.end(), texture);
+            if (it != vTextures.end())
+                vSources[it - vTextures.begin()].filePath = cacheInRAM ? std::string() : filePath;
+        }
+
+        if (!cacheInRAM)
+            AssetWatcher::WatchTexture(filePath);
     }
     return texture;
 }
 
 
+Texture2D *TextureManager::LoadTextureAsync(const std::string &path, const char *fileName, const char *key, GLenum wrappingMode)
+{
+    std::string uid = key ? std::string(key) : std::string(fileName);
+    Texture2D *texture = GetTexture(uid.c_str());
+
+    if (texture == nullptr)
+    {
+        std::string filePath = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
+        texture = new Texture2D();
+        TextureLoader::LoadAsync(texture, filePath, wrappingMode);
+        AddTexture(uid, texture, filePath, wrappingMode);
+        AssetWatcher::WatchTexture(filePath);
+    }
+    return texture;
+}
+
+
+unsigned int TextureManager::Reload(const std::string &filePath)
+{
+    unsigned int count = 0;
+
+    for (unsigned int i = 0; i < vTextures.size(); i++)
+    {
+        Texture2D *texture = vTextures[i];
+
+        // Evicted textures read the new file whenever they are used again,
+        // while textures whose file failed to load are only retried here
+        if (vSources[i].filePath != filePath || TextureLoader::IsLoading(texture))
+            continue;
+        if (!texture->IsResident() && !TextureLoader::HasFailed(texture))
+            continue;
+
+        TextureLoader::LoadAsync(texture, filePath, vSources[i].wrappingMode);
+        count++;
+    }
+
+    return count;
+}
+
+
+void TextureManager::AddTexture(const std::string &uid, Texture2D *texture, const std::string &filePath, GLenum wrappingMode)
+{
+    TextureSource source;
+    source.filePath = filePath;
+    source.wrappingMode = wrappingMode;
+
+    vTextures.push_back(texture);
+    vSources.push_back(source);
+    mapTextures[uid] = texture;
+}
+
+
 void TextureManager::SetTexture(std::string name, Texture2D *texture)
 {
     mapTextures[name] = texture;
@@ -67,8 +224,9 @@ void TextureManager::SetTexture(std::string name, Texture2D *texture)
 
 Texture2D* TextureManager::GetTexture(const char* name)
 {
-    if (mapTextures[name])
-        return mapTextures[name];
+    auto it = mapTextures.find(name);
+    if (it != mapTextures.end())
+        return it->second;
     return NULL;
 }
 
@@ -79,3 +237,15 @@ Texture2D* TextureManager::GetTexture(unsigned int textureID)
         return vTextures[textureID];
     return NULL;
 }
+
+
+void TextureManager::SetMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+}
+
+
+TextureStats TextureManager::GetStats()
+{
+    return stats;
+}
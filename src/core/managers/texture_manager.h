@@ -7,21 +7,73 @@
 #include "core/gpu/texture2D.h"
 
 
+// Counters describing texture residency, see `TextureManager::GetStats`
+struct TextureStats
+{
+    unsigned int residentTextures;
+    unsigned int evictedTextures;
+    size_t residentBytes;
+    size_t budgetBytes;
+
+    // Cumulative since startup. A miss is a bind of an evicted texture,
+    // which then gets reloaded.
+    unsigned int misses;
+    unsigned int evictions;
+};
+
+
 class TextureManager
 {
  public:
     static void Init(const std::string &selfDir);
+
+    // Deletes every texture owned by the manager
+    static void Destroy();
+
+    // Streams pending uploads, reloads evicted textures bound during the last frame,
+    // and evicts the least recently used textures while over the memory budget.
+    // Called once per frame by `World`.
+    static void Update();
+
     static Texture2D *LoadTexture(const std::string &Path, const char *fileName, const char *key = nullptr, bool forceLoad = false, bool cacheInRAM = false);
+
+    // Returns immediately; the image is decoded on a worker thread and streamed
+    // to the GPU over the next frames. See `TextureLoader` for details.
+    static Texture2D *LoadTextureAsync(const std::string &path, const char *fileName, const char *key = nullptr, GLenum wrappingMode = GL_REPEAT);
+    // Streams the resident textures loaded from `filePath` in again, after the
+    // file changed on disk. Returns how many textures are being reloaded.
+    static unsigned int Reload(const std::string &filePath);
+
     static void SetTexture(const std::string name, Texture2D * texture);
     static Texture2D* GetTexture(const char* name);
     static Texture2D* GetTexture(unsigned int textureID);
 
+    // GPU memory allowed for textures loaded from files. Textures kept in RAM,
+    // render targets and textures added with SetTexture are never evicted.
+    static void SetMemoryBudget(size_t bytes);
+    static TextureStats GetStats();
+
+    static const size_t DEFAULT_MEMORY_BUDGET = 512 * 1024 * 1024;
+
  protected:
     TextureManager() = delete;
     ~TextureManager() = delete;
 
+ private:
+    static void AddTexture(const std::string &uid, Texture2D *texture, const std::string &filePath, GLenum wrappingMode);
+
+    // Source of an owned texture; an empty path means it cannot be reloaded
+    struct TextureSource
+    {
+        std::string filePath;
+        GLenum wrappingMode;
+    };
+
  private:
     static std::unordered_map<std::string, Texture2D*> mapTextures;
     static std::vector<Texture2D*> vTextures;
+    static std::vector<TextureSource> vSources;
     static std::string selfDir;
+    static size_t memoryBudget;
+    static TextureStats stats;
 };
@@ -62,6 +62,9 @@ WindowObject::WindowObject(WindowProperties properties)
 
     // Init OpenGL Window
     props.fullScreen ? FullScreen() : WindowMode();
+    if (window->handle == nullptr)
+        return;
+
     SetVSync(props.vSync);
 
     // Set default state
@@ -84,6 +87,12 @@ WindowObject::~WindowObject()
 }
 
 
+bool WindowObject::IsCreated() const
+{
+    return window->handle != nullptr;
+}
+
+
 void WindowObject::Show()
 {
     props.visible = true;
@@ -201,7 +210,8 @@ void WindowObject::FullScreen()
     GLFWmonitor *monitor = glfwGetPrimaryMonitor();
     const GLFWvidmode *videoDisplay = glfwGetVideoMode(monitor);
     window->handle = glfwCreateWindow(videoDisplay->width, videoDisplay->height, props.name.c_str(), monitor, NULL);
-    assert(window->handle != nullptr);
+    if (window->handle == nullptr)
+        return;
 
     glfwMakeContextCurrent(window->handle);
     SetSize(videoDisplay->width, videoDisplay->height);
@@ -220,7 +230,8 @@ void WindowObject::WindowMode()
     glfwSetErrorCallback(error_callback);
     if (!glfwInit()) { fprintf(stderr, "Failed to initialize GLFW\n"); }
     window->handle = glfwCreateWindow(props.resolution.x, props.resolution.y, props.name.c_str(), NULL, NULL);
-    assert(window->handle != nullptr);
+    if (window->handle == nullptr)
+        return;
     glfwMakeContextCurrent(window->handle);
 
     // Centers the window on the primary display
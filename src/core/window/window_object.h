@@ -50,6 +50,9 @@ class WindowObject
     explicit WindowObject(WindowProperties properties);
     ~WindowObject();
 
+    // False if the window, or its OpenGL context, could not be created
+    bool IsCreated() const;
+
     void Show();
     void Hide();
     void Close();
@@ -1,6 +1,9 @@
 #include "core/world.h"
 
 #include "core/engine.h"
+#include "core/gpu/shader.h"
+#include "core/managers/asset_watcher.h"
+#include "core/managers/texture_manager.h"
 #include "components/camera_input.h"
 #include "components/transform.h"
 
@@ -69,6 +72,15 @@ void World::LoopUpdate()
     // OnInputUpdate will be called each frame, the other functions are called only if an event is registered
     window->UpdateObservers();
 
+    // Reloads the assets changed on disk
+    AssetWatcher::Update();
+
+    // Streams textures decoded in the background and keeps texture memory within budget
+    TextureManager::Update();
+
+    // Finishes shaders compiled in the background
+    Shader::UpdatePending();
+
     // Frame processing
     FrameStart();
     Update(static_cast<float>(deltaTime));
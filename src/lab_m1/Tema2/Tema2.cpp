@@ -1,17 +1,39 @@
 #include "Tema2.h"
 #include "core/gpu/shader.h"
 #include "core/engine.h"
+#include "utils/thread_utils.h"
+#include "utils/file_utils.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <random>
+#include <limits>
+#include <ctime>
+#include <cstdio>
 #include <iostream>
 
 using namespace m1;
 
-Tema2::Tema2() {}
+Tema2::Tema2() {
+    particleShader = nullptr;
+    rotorWash = nullptr;
+    dust = nullptr;
+    crowdShader = nullptr;
+    crowd = nullptr;
+    shadows = nullptr;
+    propTextures = nullptr;
+    capture = nullptr;
+    recording = false;
+    recordedFrames = 0;
+}
 
 Tema2::~Tema2() {
     delete camera;
+    delete rotorWash;
+    delete dust;
+    delete crowd;
+    delete shadows;
+    delete propTextures;
+    delete capture;
 }
 
 void Tema2::Init() {
@@ -27,6 +49,7 @@ void Tema2::Init() {
     if (!sphere->LoadMesh(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "sphere.obj")) {
         std::cerr << "Failed to load sphere mesh" << std::endl;
     }
+    sphere->GenerateLODs();
     meshes["sphere"] = sphere;
 
     Mesh* cylinder = new Mesh("cylinder");
@@ -43,23 +66,44 @@ void Tema2::Init() {
     basicShader = new Shader("VertexColor");
     basicShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "VertexColor.glsl"), GL_VERTEX_SHADER);
     basicShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "FragmentColor.glsl"), GL_FRAGMENT_SHADER);
-    if (!basicShader->CreateAndLink()) {
-        std::cerr << "Failed to create and link VertexColor shader" << std::endl;
-    }
     shaders["VertexColor"] = basicShader;
 
     terrainShader = new Shader("TerrainShader");
     terrainShader->AddShader(PATH_JOIN(window->props.selfDir, "src", "lab_m1", "Tema2", "TerrainVertexShader.glsl"), GL_VERTEX_SHADER);
     terrainShader->AddShader(PATH_JOIN(window->props.selfDir, "src", "lab_m1", "Tema2", "TerrainFragmentShader.glsl"), GL_FRAGMENT_SHADER);
-    if (!terrainShader->CreateAndLink()) {
-        std::cerr << "Failed to create and link TerrainShader" << std::endl;
-    }
     shaders["TerrainShader"] = terrainShader;
 
+    // Same displacement, for the shadow maps, which only keep the depth
+    terrainDepthShader = new Shader("TerrainDepth");
+    terrainDepthShader->AddShader(PATH_JOIN(window->props.selfDir, "src", "lab_m1", "Tema2", "TerrainVertexShader.glsl"), GL_VERTEX_SHADER);
+    terrainDepthShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "FragmentColor.glsl"), GL_FRAGMENT_SHADER);
+    shaders["TerrainDepth"] = terrainDepthShader;
+
+    // Props sample their material from a layer of a texture array, see Mesh::UseTextureArray
+    propShader = new Shader("TextureArray");
+    propShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.TextureArray.VS.glsl"), GL_VERTEX_SHADER);
+    propShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "TextureArray.FS.glsl"), GL_FRAGMENT_SHADER);
+    shaders["TextureArray"] = propShader;
+
+    // The programs compile in parallel and are finished on first use
+    Shader::CreateAndLinkAll({ basicShader, terrainShader, terrainDepthShader, propShader });
+
     projectionMatrix = glm::perspective(glm::radians(60.0f), window->props.aspectRatio, 0.1f, 200.0f);
 
+    // Sunlight along the terrain light, from its position towards the origin
+    shadows = new CascadedShadowMap();
+    shadows->Init(2048, 4);
+    shadows->SetLightDirection(-glm::vec3(10.0f, 50.0f, 10.0f));
+
     GenerateTrees(10);
     GenerateRocks(10);
+    GenerateProps(30);
+
+    InitParticles();
+    InitCrowd(2000);
+
+    // A second of 60 Hz frames can wait for the encoders
+    capture = new FrameCapture(3, 2, 60);
 }
 
 void Tema2::FrameStart() {
@@ -82,10 +126,21 @@ void Tema2::Update(float deltaTimeSeconds) {
         drone.SetPosition(glm::mix(dronePos, newPos, 0.1f));
     }
 
+    UpdateParticles(deltaTimeSeconds);
+    RenderShadows();
     RenderScene(deltaTimeSeconds);
 }
 
-void Tema2::FrameEnd() {}
+void Tema2::FrameEnd() {
+    capture->Update();
+
+    if (recording) {
+        glm::ivec2 resolution = window->GetResolution();
+        char fileName[32];
+        snprintf(fileName, sizeof(fileName), "frame_%05u.tga", recordedFrames++);
+        capture->CaptureFrameBuffer(0, 0, resolution.x, resolution.y, 3, PATH_JOIN(recordingDirectory, fileName));
+    }
+}
 
 void Tema2::OnInputUpdate(float deltaTime, int mods) {
     float movementSpeed = 8.0f * deltaTime;
@@ -117,7 +172,11 @@ void Tema2::OnInputUpdate(float deltaTime, int mods) {
     }
 }
 
-void Tema2::OnKeyPress(int key, int mods) {}
+void Tema2::OnKeyPress(int key, int mods) {
+    if (key == GLFW_KEY_F9) {
+        ToggleRecording();
+    }
+}
 void Tema2::OnKeyRelease(int key, int mods) {}
 void Tema2::OnMouseMove(int mouseX, int mouseY, int deltaX, int deltaY) {}
 void Tema2::OnMouseBtnPress(int mouseX, int mouseY, int button, int mods) {}
@@ -247,6 +306,59 @@ void Tema2::GenerateRocks(int count) {
     }
 }
 
+void Tema2::GenerateProps(int count) {
+    struct PropModel {
+        std::string name;
+        std::string directory;
+        float minScale;
+        float maxScale;
+    };
+
+    std::vector<PropModel> models = {
+        { "oildrum", "props", 1.5f, 2.5f },
+        { "concrete_wall", "props", 0.1f, 0.2f },
+        { "bamboo", PATH_JOIN("vegetation", "bamboo"), 0.08f, 0.15f },
+    };
+
+    // The models share the array, so switching between them binds no textures
+    propTextures = new TextureArray(512);
+    std::vector<Mesh*> propMeshes;
+    for (const auto& model : models) {
+        Mesh* mesh = new Mesh(model.name);
+        if (!mesh->LoadMesh(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, model.directory), model.name + ".obj")) {
+            std::cerr << "Failed to load " << model.name << " mesh" << std::endl;
+            delete mesh;
+            propMeshes.push_back(nullptr);
+            continue;
+        }
+        mesh->UseTextureArray(propTextures);
+        meshes[mesh->GetMeshID()] = mesh;
+        propMeshes.push_back(mesh);
+    }
+    propTextures->Build();
+
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<float> distPos(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> distUnit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> distModel(0, static_cast<int>(models.size()) - 1);
+
+    for (int i = 0; i < count; ++i) {
+        int model = distModel(rng);
+        if (!propMeshes[model]) {
+            continue;
+        }
+
+        Prop p;
+        p.mesh = propMeshes[model];
+        float x = distPos(rng);
+        float z = distPos(rng);
+        p.position = glm::vec3(x, GetTerrainHeightAt(x, z), z);
+        p.scale = glm::mix(models[model].minScale, models[model].maxScale, distUnit(rng));
+        p.angle = distUnit(rng) * glm::two_pi<float>();
+        props.push_back(p);
+    }
+}
+
 float Tema2::GetTerrainHeightAt(float x, float z) {
     float frequency = 0.1f;
     float amplitude = 2.0f;
@@ -254,6 +366,25 @@ float Tema2::GetTerrainHeightAt(float x, float z) {
     return noise;
 }
 
+void Tema2::ToggleRecording() {
+    if (recording) {
+        recording = false;
+        std::cout << "Recorded " << recordedFrames << " frames to " << recordingDirectory
+                  << ", " << capture->GetNumberOfStalls() << " capture stalls" << std::endl;
+        return;
+    }
+
+    recordingDirectory = PATH_JOIN(window->props.selfDir, "recordings", "flight_" + std::to_string(std::time(nullptr)));
+    if (!file_utils::CreateDirectories(recordingDirectory)) {
+        std::cerr << "Cannot create " << recordingDirectory << std::endl;
+        return;
+    }
+
+    recording = true;
+    recordedFrames = 0;
+    std::cout << "Recording to " << recordingDirectory << std::endl;
+}
+
 void Tema2::UpdateCamera() {
     glm::vec3 dronePos = drone.GetPosition();
     glm::vec3 droneForward = drone.GetForward();
@@ -263,23 +394,28 @@ void Tema2::UpdateCamera() {
     camera->Set(cameraPos, dronePos, glm::vec3(0, 1, 0));
 }
 
-void Tema2::RenderTerrain() {
-    terrainShader->Use();
+void Tema2::RenderTerrain(Shader* shader, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    shader->Use();
 
     glm::mat4 modelMatrix = glm::mat4(1.0f);
-    GLint loc_model = glGetUniformLocation(terrainShader->program, "Model");
+    GLint loc_model = glGetUniformLocation(shader->program, "Model");
     glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(modelMatrix));
 
-    glm::mat4 viewMatrix = camera->GetViewMatrix();
-    GLint loc_view = glGetUniformLocation(terrainShader->program, "View");
+    GLint loc_view = glGetUniformLocation(shader->program, "View");
     glUniformMatrix4fv(loc_view, 1, GL_FALSE, glm::value_ptr(viewMatrix));
 
-    GLint loc_projection = glGetUniformLocation(terrainShader->program, "Projection");
+    GLint loc_projection = glGetUniformLocation(shader->program, "Projection");
     glUniformMatrix4fv(loc_projection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
 
-    GLint loc_freq = glGetUniformLocation(terrainShader->program, "frequency");
+    GLint loc_freq = glGetUniformLocation(shader->program, "frequency");
     glUniform1f(loc_freq, 0.1f);
 
+    // The shadow maps only need the shape
+    if (shader != terrainShader) {
+        terrainMesh->Render();
+        return;
+    }
+
     GLint loc_low = glGetUniformLocation(terrainShader->program, "terrain_color_low");
     glUniform3f(loc_low, 0.1f, 0.4f, 0.1f);
 
@@ -298,18 +434,19 @@ void Tema2::RenderTerrain() {
     GLint loc_drone_altitude = glGetUniformLocation(terrainShader->program, "drone_altitude");
     glUniform1f(loc_drone_altitude, droneAltitude);
 
+    shadows->Bind(terrainShader, 1);
+
     terrainMesh->Render();
 }
 
 
-void Tema2::RenderTrees() {
+void Tema2::RenderTrees(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
     basicShader->Use();
     float trunkHeight = 10.5f;
     float trunkWidth = 1.0f;
     float foliageRadius = 3.2f;
 
     for (auto& t : trees) {
-        glm::mat4 viewMatrix = camera->GetViewMatrix();
         GLint loc_view = glGetUniformLocation(basicShader->program, "View");
         glUniformMatrix4fv(loc_view, 1, GL_FALSE, glm::value_ptr(viewMatrix));
 
@@ -335,18 +472,17 @@ void Tema2::RenderTrees() {
         glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(foliageModel));
 
         glUniform4f(glGetUniformLocation(basicShader->program, "object_color"), 0.0f, 0.5f, 0.0f, 1.0f);
-        meshes["sphere"]->Render();
+        meshes["sphere"]->Render(meshes["sphere"]->SelectLOD(foliageModel, viewMatrix, projectionMatrix));
     }
 }
 
-void Tema2::RenderRocks() {
+void Tema2::RenderRocks(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
     basicShader->Use();
     float baseHeight = 2.0f;
     float baseRadius = 0.8f;
     float capRadius = 0.7f;
 
     for (auto& r : rocks) {
-        glm::mat4 viewMatrix = camera->GetViewMatrix();
         GLint loc_view = glGetUniformLocation(basicShader->program, "View");
         glUniformMatrix4fv(loc_view, 1, GL_FALSE, glm::value_ptr(viewMatrix));
 
@@ -370,19 +506,28 @@ void Tema2::RenderRocks() {
         glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(capModel));
 
         glUniform4f(glGetUniformLocation(basicShader->program, "object_color"), 0.6f, 0.6f, 0.6f, 1.0f);
-        meshes["sphere"]->Render();
+        meshes["sphere"]->Render(meshes["sphere"]->SelectLOD(capModel, viewMatrix, projectionMatrix));
     }
 }
 
-void Tema2::RenderScene(float deltaTimeSeconds) {
-    glm::vec3 dronePos = drone.GetPosition();
-    glm::vec3 droneFwd = drone.GetForward();
-    glm::vec3 droneRight = glm::normalize(glm::cross(glm::vec3(0, 1, 0), droneFwd));
-    glm::vec3 droneUp = glm::normalize(glm::cross(droneFwd, droneRight));
-
-    glm::vec3 cameraPos = dronePos - droneFwd * 3.0f + droneUp * 1.0f;
-    glm::mat4 viewMatrix = glm::lookAt(cameraPos, dronePos, droneUp);
+void Tema2::RenderProps(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    propShader->Use();
+    glUniformMatrix4fv(glGetUniformLocation(propShader->program, "View"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(glGetUniformLocation(propShader->program, "Projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    glUniform1i(glGetUniformLocation(propShader->program, "u_texture_0"), 0);
+
+    // Every prop is a single draw, with the array bound by the mesh
+    GLint loc_model = glGetUniformLocation(propShader->program, "Model");
+    for (const auto& p : props) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), p.position);
+        model = glm::rotate(model, p.angle, glm::vec3(0, 1, 0));
+        model = glm::scale(model, glm::vec3(p.scale));
+        glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(model));
+        p.mesh->Render();
+    }
+}
 
+void Tema2::RenderDrone(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
     basicShader->Use();
     {
         GLint loc_view = glGetUniformLocation(basicShader->program, "View");
@@ -396,10 +541,297 @@ void Tema2::RenderScene(float deltaTimeSeconds) {
         glUniformMatrix4fv(loc_model, 1, GL_FALSE, glm::value_ptr(modelMatrix));
         mesh->Render();
     });
+}
+
+void Tema2::RenderShadows() {
+    float aspectRatio = projectionMatrix[1][1] / projectionMatrix[0][0];
+    shadows->Update(camera->GetViewMatrix(), glm::radians(60.0f), aspectRatio, 0.1f, 100.0f);
+
+    // The static casters are drawn again only in the cascades that moved
+    shadows->Render(
+        [&](const glm::mat4& lightView, const glm::mat4& lightProjection) {
+            RenderTerrain(terrainDepthShader, lightView, lightProjection);
+            RenderTrees(lightView, lightProjection);
+            RenderRocks(lightView, lightProjection);
+            RenderProps(lightView, lightProjection);
+        },
+        [&](const glm::mat4& lightView, const glm::mat4& lightProjection) {
+            RenderDrone(lightView, lightProjection);
+        });
+}
+
+void Tema2::RenderScene(float deltaTimeSeconds) {
+    glm::vec3 dronePos = drone.GetPosition();
+    glm::vec3 droneFwd = drone.GetForward();
+    glm::vec3 droneRight = glm::normalize(glm::cross(glm::vec3(0, 1, 0), droneFwd));
+    glm::vec3 droneUp = glm::normalize(glm::cross(droneFwd, droneRight));
+
+    glm::vec3 cameraPos = dronePos - droneFwd * 3.0f + droneUp * 1.0f;
+    RenderDrone(glm::lookAt(cameraPos, dronePos, droneUp), projectionMatrix);
+
+    glm::mat4 viewMatrix = camera->GetViewMatrix();
+    RenderTerrain(terrainShader, viewMatrix, projectionMatrix);
+    RenderTrees(viewMatrix, projectionMatrix);
+    RenderRocks(viewMatrix, projectionMatrix);
+    RenderProps(viewMatrix, projectionMatrix);
+    RenderCrowd();
+    RenderParticles();
+}
+
+void Tema2::InitParticles() {
+    std::string shaderPath = PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS);
+
+    // Both systems fall back to the CPU simulation without compute shaders
+    rotorWash = new ParticleSystem(1 << 14);
+    rotorWash->Init(shaderPath);
+    dust = new ParticleSystem(1 << 16);
+    dust->Init(shaderPath);
+
+    const char* vertexShader = rotorWash->UsesCompute() ? "Particle.VS.glsl" : "Particle.Stream.VS.glsl";
+
+    particleShader = new Shader("Particle");
+    particleShader->AddShader(PATH_JOIN(shaderPath, vertexShader), GL_VERTEX_SHADER);
+    particleShader->AddShader(PATH_JOIN(shaderPath, "Particle.GS.glsl"), GL_GEOMETRY_SHADER);
+    particleShader->AddShader(PATH_JOIN(shaderPath, "Particle.FS.glsl"), GL_FRAGMENT_SHADER);
+    particleShader->CreateAndLinkAsync();
+    shaders["Particle"] = particleShader;
+
+    // Air pushed down through the rotors
+    rotorWash->SetDrag(0.5f);
+    ParticleEmitter& wash = rotorWash->GetEmitter();
+    wash.extents = glm::vec3(1.2f, 0.05f, 1.2f);
+    wash.velocity = glm::vec3(0, -8.0f, 0);
+    wash.radialSpeed = 1.0f;
+    wash.velocityJitter = 0.5f;
+    wash.minLifetime = 0.3f;
+    wash.maxLifetime = 0.6f;
+    wash.rate = 3000.0f;
+
+    // Dust blown away from the spot under the drone
+    dust->SetGravity(glm::vec3(0, -1.0f, 0));
+    dust->SetDrag(1.5f);
+    ParticleEmitter& cloud = dust->GetEmitter();
+    cloud.extents = glm::vec3(2.0f, 0, 2.0f);
+    cloud.velocity = glm::vec3(0, 1.2f, 0);
+    cloud.velocityJitter = 0.6f;
+    cloud.minLifetime = 0.8f;
+    cloud.maxLifetime = 1.6f;
+    cloud.maxDelay = 0.2f;
+
+    // Rotor wash hits the ground and blows the dust around trees and rocks
+    ParticleCollider collider = BakeParticleCollider();
+    rotorWash->SetCollider(collider);
+    dust->SetCollider(collider);
+}
+
+ParticleCollider Tema2::BakeParticleCollider() {
+    ParticleCollider collider;
+
+    // One height per terrain vertex
+    const int gridSize = 100;
+    collider.heightResolution = glm::ivec2(2 * gridSize + 1);
+    collider.heightMin = glm::vec2(-gridSize - 0.5f);
+    collider.heightMax = glm::vec2(gridSize + 0.5f);
+    collider.heights.resize(collider.heightResolution.x * collider.heightResolution.y);
+
+    for (int j = 0; j < collider.heightResolution.y; ++j) {
+        for (int i = 0; i < collider.heightResolution.x; ++i) {
+            collider.heights[j * collider.heightResolution.x + i] = GetTerrainHeightAt((float)(i - gridSize), (float)(j - gridSize));
+        }
+    }
+
+    // Shapes as drawn by RenderTrees and RenderRocks, the rock base as a cylinder.
+    // Round obstacles are spheres if their half size is the same along every
+    // axis, and upright cylinders otherwise.
+    struct Obstacle {
+        glm::vec3 center;
+        glm::vec3 halfSize;
+        bool round;
+    };
+
+    std::vector<Obstacle> obstacles;
+    for (auto& t : trees) {
+        obstacles.push_back({ t.position, glm::vec3(0.5f, 5.25f, 0.5f), false });
+        obstacles.push_back({ t.position + glm::vec3(0, 5.25f, 0), glm::vec3(1.6f), true });
+    }
+    for (auto& r : rocks) {
+        obstacles.push_back({ r.position, glm::vec3(0.8f, 2.0f, 0.8f), true });
+        obstacles.push_back({ r.position + glm::vec3(0, 2.0f, 0), glm::vec3(0.35f), true });
+    }
+
+    if (obstacles.empty()) {
+        return collider;
+    }
+
+    glm::vec3 boxMin(std::numeric_limits<float>::max());
+    glm::vec3 boxMax(-std::numeric_limits<float>::max());
+    for (auto& o : obstacles) {
+        boxMin = glm::min(boxMin, o.center - o.halfSize);
+        boxMax = glm::max(boxMax, o.center + o.halfSize);
+    }
+
+    // Coarse cells, with a margin so the surfaces fall inside the volume
+    const float cellSize = 0.5f;
+    collider.distanceMin = boxMin - glm::vec3(2 * cellSize);
+    collider.distanceResolution = glm::ivec3(glm::ceil((boxMax - boxMin) / cellSize)) + 4;
+    collider.distanceMax = collider.distanceMin + glm::vec3(collider.distanceResolution) * cellSize;
+    collider.distances.resize(collider.distanceResolution.x * collider.distanceResolution.y * collider.distanceResolution.z);
+
+    glm::ivec3 res = collider.distanceResolution;
+    thread_utils::ParallelFor(0, res.z, 1, [&](unsigned int begin, unsigned int end) {
+        for (int k = begin; k < (int)end; ++k) {
+            for (int j = 0; j < res.y; ++j) {
+                for (int i = 0; i < res.x; ++i) {
+                    glm::vec3 p = collider.distanceMin + (glm::vec3(i, j, k) + 0.5f) * cellSize;
+                    float distance = std::numeric_limits<float>::max();
+
+                    for (auto& o : obstacles) {
+                        glm::vec3 d = p - o.center;
+                        float obstacleDistance;
+                        if (!o.round) {
+                            glm::vec3 q = glm::abs(d) - o.halfSize;
+                            obstacleDistance = glm::length(glm::max(q, 0.0f)) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+                        } else if (o.halfSize.x == o.halfSize.y) {
+                            obstacleDistance = glm::length(d) - o.halfSize.x;
+                        } else {
+                            glm::vec2 q = glm::vec2(glm::length(glm::vec2(d.x, d.z)) - o.halfSize.x, std::abs(d.y) - o.halfSize.y);
+                            obstacleDistance = glm::length(glm::max(q, 0.0f)) + std::min(std::max(q.x, q.y), 0.0f);
+                        }
+                        distance = std::min(distance, obstacleDistance);
+                    }
+
+                    collider.distances[(k * res.y + j) * res.x + i] = distance;
+                }
+            }
+        }
+    });
+
+    return collider;
+}
+
+void Tema2::UpdateParticles(float deltaTimeSeconds) {
+    if (!rotorWash || !dust) {
+        return;
+    }
+
+    glm::vec3 dronePos = drone.GetPosition();
+    float groundHeight = GetTerrainHeightAt(dronePos.x, dronePos.z);
+
+    // The closer to the ground, the more dust is raised and the further it is blown
+    float proximity = glm::clamp(1.0f - (dronePos.y - groundHeight) / 8.0f, 0.0f, 1.0f);
+
+    // Sorted for the camera, as the particles are alpha blended
+    glm::mat4 viewMatrix = camera->GetViewMatrix();
+    rotorWash->SetSortView(viewMatrix);
+    dust->SetSortView(viewMatrix);
+
+    rotorWash->GetEmitter().position = dronePos;
+    rotorWash->Update(deltaTimeSeconds);
+
+    ParticleEmitter& cloud = dust->GetEmitter();
+    cloud.position = glm::vec3(dronePos.x, groundHeight, dronePos.z);
+    cloud.radialSpeed = 6.0f * proximity;
+    cloud.rate = 4000.0f * proximity;
+    dust->Update(deltaTimeSeconds);
+}
+
+void Tema2::RenderParticles() {
+    if (!rotorWash || !dust) {
+        return;
+    }
+
+    glm::mat4 viewMatrix = camera->GetViewMatrix();
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    particleShader->Use();
+    TextureManager::GetTexture("particle.png")->BindToTextureUnit(GL_TEXTURE0);
+
+    glUniform1f(glGetUniformLocation(particleShader->program, "particle_size"), 0.15f);
+    glUniform4f(glGetUniformLocation(particleShader->program, "particle_color"), 0.9f, 0.95f, 1.0f, 0.35f);
+    rotorWash->Render(particleShader, viewMatrix, projectionMatrix);
+
+    glUniform1f(glGetUniformLocation(particleShader->program, "particle_size"), 0.4f);
+    glUniform4f(glGetUniformLocation(particleShader->program, "particle_color"), 0.55f, 0.45f, 0.3f, 0.5f);
+    dust->Render(particleShader, viewMatrix, projectionMatrix);
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
+
+void Tema2::InitCrowd(int count) {
+    std::string archerPath = PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "characters", "archer");
+
+    Mesh* archer = new Mesh("archer");
+    if (!archer->LoadMesh(archerPath, "Archer.fbx")) {
+        std::cerr << "Failed to load archer mesh" << std::endl;
+        delete archer;
+        return;
+    }
+
+    // The diffuse texture is bound for the whole mesh, so its entries draw together
+    archer->UseMaterials(false);
+    archer->BatchEntries();
+    meshes["archer"] = archer;
+    TextureManager::LoadTexture(PATH_JOIN(archerPath, "Akai_E_Espiritu.fbm"), "akai_diffuse.png");
+
+    crowd = new AnimationCrowd();
+    if (!crowd->Init(archer)) {
+        delete crowd;
+        crowd = nullptr;
+        return;
+    }
+
+    crowdShader = new Shader("Crowd");
+    crowdShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Skinning.Crowd.VS.glsl"), GL_VERTEX_SHADER);
+    crowdShader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Default.FS.glsl"), GL_FRAGMENT_SHADER);
+    crowdShader->CreateAndLinkAsync();
+    shaders["Crowd"] = crowdShader;
+
+    // A few rows of spectators around the ring the drone races along, facing its center
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<float> distJitter(-0.4f, 0.4f);
+    std::uniform_real_distribution<float> distOffset(0.0f, 10.0f);
+    std::uniform_real_distribution<float> distSpeed(0.8f, 1.2f);
+    std::uniform_int_distribution<unsigned int> distClip(0, (unsigned int)archer->animations.size() - 1);
+
+    const int rows = 4;
+    const float innerRadius = 70.0f;
+    const float rowSpacing = 1.5f;
+    int perRow = (count + rows - 1) / rows;
+
+    std::vector<CrowdInstance> spectators;
+    for (int i = 0; i < count; ++i) {
+        float angle = glm::two_pi<float>() * ((i % perRow) + 0.5f + distJitter(rng)) / perRow;
+        float radius = innerRadius + (i / perRow) * rowSpacing + distJitter(rng);
+        float x = radius * sin(angle);
+        float z = radius * cos(angle);
+
+        CrowdInstance spectator;
+        spectator.modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(x, GetTerrainHeightAt(x, z), z));
+        spectator.modelMatrix = glm::rotate(spectator.modelMatrix, angle + glm::pi<float>(), glm::vec3(0, 1, 0));
+        spectator.modelMatrix = glm::scale(spectator.modelMatrix, glm::vec3(0.01f));
+        spectator.clip = distClip(rng);
+        spectator.timeOffset = distOffset(rng);
+        spectator.speed = distSpeed(rng);
+        spectators.push_back(spectator);
+    }
+    crowd->SetInstances(spectators);
+}
+
+void Tema2::RenderCrowd() {
+    if (!crowd) {
+        return;
+    }
+
+    crowdShader->Use();
+    glUniformMatrix4fv(glGetUniformLocation(crowdShader->program, "View"), 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+    glUniformMatrix4fv(glGetUniformLocation(crowdShader->program, "Projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    TextureManager::GetTexture("akai_diffuse.png")->BindToTextureUnit(GL_TEXTURE0);
 
-    RenderTerrain();
-    RenderTrees();
-    RenderRocks();
+    crowd->Render(crowdShader, (float)Engine::GetElapsedTime());
 }
 
 Mesh* Tema2::CreateCubeMesh(const std::string& name) {
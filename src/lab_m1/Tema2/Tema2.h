@@ -1,6 +1,11 @@
 #pragma once
 
 #include "components/simple_scene.h"
+#include "core/gpu/particle_system.h"
+#include "core/gpu/animation_crowd.h"
+#include "core/gpu/cascaded_shadow_map.h"
+#include "core/gpu/frame_capture.h"
+#include "core/gpu/texture_array.h"
 #include "Drone.h"
 #include "lab_m1/Tema2/cameras.h"
 #include <vector>
@@ -18,6 +23,14 @@ struct Rock {
     float scale;
 };
 
+// Textured model scattered on the terrain, like an oil drum or bamboo
+struct Prop {
+    Mesh* mesh;
+    glm::vec3 position;
+    float scale;
+    float angle;
+};
+
 namespace m1
 {
     class Tema2 : public gfxc::SimpleScene
@@ -46,9 +59,27 @@ namespace m1
 
         // Rendering methods
         void RenderScene(float deltaTimeSeconds);
-        void RenderTerrain();
-        void RenderTrees();
-        void RenderRocks();
+        void RenderDrone(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+        void RenderTerrain(Shader* shader, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+        void RenderTrees(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+        void RenderRocks(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+        void RenderProps(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+        // Sun shadows, with the terrain, trees, rocks and props cached between frames
+        void RenderShadows();
+
+        // Records every frame of the flight to a new directory, as TGA images
+        void ToggleRecording();
+
+        // Rotor wash and dust kicked up near the ground
+        void InitParticles();
+        void UpdateParticles(float deltaTimeSeconds);
+        void RenderParticles();
+        ParticleCollider BakeParticleCollider();
+
+        // Spectators lining the course, drawn with one instanced call
+        void InitCrowd(int count);
+        void RenderCrowd();
 
         // Mesh creation
         Mesh* CreateCubeMesh(const std::string& name);
@@ -59,6 +90,9 @@ namespace m1
         void GenerateTrees(int count);
         void GenerateRocks(int count);
 
+        // Oil drums, concrete walls and bamboo, with their textures in one array
+        void GenerateProps(int count);
+
         // Utility methods
         void UpdateCamera();
         float GetTerrainHeightAt(float x, float z);
@@ -69,8 +103,22 @@ namespace m1
         Mesh* terrainMesh;
         Shader* basicShader;
         Shader* terrainShader; 
+        Shader* terrainDepthShader;
+        Shader* propShader;
+        TextureArray* propTextures;
+        CascadedShadowMap* shadows;
+        Shader* particleShader;
+        ParticleSystem* rotorWash;
+        ParticleSystem* dust;
+        Shader* crowdShader;
+        AnimationCrowd* crowd;
+        FrameCapture* capture;
+        bool recording;
+        unsigned int recordedFrames;
+        std::string recordingDirectory;
         glm::mat4 projectionMatrix;
         std::vector<Tree> trees;
         std::vector<Rock> rocks;
+        std::vector<Prop> props;
     };
 }
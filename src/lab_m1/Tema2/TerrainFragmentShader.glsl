@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "../../../assets/shaders/Shadows.glsl"
+
 in vec3 frag_normal;
 in vec3 frag_position;
 in vec2 frag_texcoord;
@@ -45,6 +47,9 @@ void main()
     float texturePattern = sin(frag_texcoord.x * 10.0) * cos(frag_texcoord.y * 10.0);
     terrainColor *= (0.9 + 0.1 * texturePattern);
 
-    vec3 finalColor = ambient + diff * terrainColor;
+    // Shadows of the trees, rocks and drone, from the sun the light stands for
+    float shadow = ShadowFactor(frag_position, normal);
+
+    vec3 finalColor = ambient + diff * shadow * terrainColor;
     FragColor = vec4(finalColor, 1.0);
 }
@@ -44,7 +44,7 @@ struct Particle
 };
 
 
-ParticleEffect<Particle> *particleEffect;
+ParticleEffect<Particle> *particleEffect = nullptr;
 
 
 /*
@@ -100,8 +100,10 @@ void Lab4::ResetParticlesFireworks(int xSize, int ySize, int zSize)
 {
     unsigned int nrParticles = 5000;
 
+    SAFE_FREE(particleEffect);
     particleEffect = new ParticleEffect<Particle>();
     particleEffect->Generate(nrParticles, true);
+    particleEffect->EnableSorting(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS));
 
     auto particleSSBO = particleEffect->GetParticleBuffer();
     Particle* data = const_cast<Particle*>(particleSSBO->GetBuffer());
@@ -132,8 +134,10 @@ void Lab4::ResetParticlesRainSnow(int xSize, int ySize, int zSize)
 {
     unsigned int nrParticles = 5000;
 
+    SAFE_FREE(particleEffect);
     particleEffect = new ParticleEffect<Particle>();
     particleEffect->Generate(nrParticles, true);
+    particleEffect->EnableSorting(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS));
 
     auto particleSSBO = particleEffect->GetParticleBuffer();
     Particle* data = const_cast<Particle*>(particleSSBO->GetBuffer());
@@ -168,8 +172,10 @@ void Lab4::ResetParticlesFire(float radius)
 {
     unsigned int nrParticles = 5000;
 
+    SAFE_FREE(particleEffect);
     particleEffect = new ParticleEffect<Particle>();
     particleEffect->Generate(nrParticles, true);
+    particleEffect->EnableSorting(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS));
 
     auto particleSSBO = particleEffect->GetParticleBuffer();
     Particle* data = const_cast<Particle*>(particleSSBO->GetBuffer());
@@ -211,9 +217,10 @@ void Lab4::Update(float deltaTimeSeconds)
 {
     glLineWidth(3);
 
+    // The particles are sorted back to front, so they can cover each other
     glEnable(GL_BLEND);
     glDisable(GL_DEPTH_TEST);
-    glBlendFunc(GL_ONE, GL_ONE);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     glBlendEquation(GL_FUNC_ADD);
     if (scene == 0)
     {
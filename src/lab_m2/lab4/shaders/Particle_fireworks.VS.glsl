@@ -1,40 +1,6 @@
 #version 430
 
-// Input
-layout(location = 0) in vec3 v_position;
-layout(location = 1) in vec3 v_normal;
-layout(location = 2) in vec2 v_texture_coord;
-
-// Uniform properties
-uniform mat4 Model;
-uniform vec3 generator_position;
-uniform float deltaTime;
-
-out float vert_lifetime;
-out float vert_iLifetime;
-
-struct Particle
-{
-    vec4 position;
-    vec4 speed;
-    vec4 iposition;
-    vec4 ispeed;
-    float delay;
-    float iDelay;
-    float lifetime;
-    float iLifetime;
-};
-
-
-layout(std430, binding = 0) buffer particles {
-    Particle data[];
-};
-
-
-float rand(vec2 co)
-{
-    return fract(sin(dot(co.xy, vec2(12.9898, 78.233))) * 43758.5453);
-}
+#include "Particle_common.glsl"
 
 
 void main()
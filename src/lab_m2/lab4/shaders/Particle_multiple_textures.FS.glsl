@@ -25,5 +25,8 @@ void main()
     vec2 tex_coord = vec2(0, 0);
     
     vec3 color = texture(texture_1, tex_coord).xyz;
-    out_color = vec4(color, 1);
+
+    // The textures have black backgrounds, so brightness stands in for
+    // coverage, with the color already weighted by it
+    out_color = vec4(color, max(color.r, max(color.g, color.b)));
 }
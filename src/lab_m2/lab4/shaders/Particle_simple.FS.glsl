@@ -13,5 +13,8 @@ layout(location = 0) out vec4 out_color;
 void main()
 {
     vec3 color = texture(texture_1, texture_coord).xyz;
-    out_color = vec4(color, 1);
+
+    // The textures have black backgrounds, so brightness stands in for
+    // coverage, with the color already weighted by it
+    out_color = vec4(color, max(color.r, max(color.g, color.b)));
 }
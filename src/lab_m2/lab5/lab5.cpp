@@ -1,6 +1,8 @@
 #include "lab_m2/lab5/lab5.h"
 
 #include <vector>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
 using namespace std;
@@ -21,17 +23,20 @@ inline float Rand01()
 
 Lab5::Lab5()
 {
+    lightClusters = nullptr;
 }
 
 
 Lab5::~Lab5()
 {
+    delete lightClusters;
 }
 
 
 void Lab5::Init()
 {
     outputType = 0;
+    useClusters = true;
 
     auto camera = GetSceneCamera();
     camera->SetPositionAndRotation(glm::vec3(0, 2, 3.5), glm::quat(glm::vec3(-20 * TO_RADIANS, 0, 0)));
@@ -71,12 +76,17 @@ void Lab5::Init()
     LoadShader("Render2Texture");
     LoadShader("Composition");
     LoadShader("LightPass");
+    LoadShader("ClusteredLightPass");
+
+    lightClusters = new LightClusters();
+    lightClusters->Init();
 
     auto resolution = window->GetResolution();
 
     frameBuffer = new FrameBuffer();
-    frameBuffer->Generate(resolution.x, resolution.y, 3);
-    //frameBuffer contains 3 textures (position, normal and color)
+    frameBuffer->Generate(resolution.x, resolution.y, { GL_RG16, GL_RGBA8 });
+    //frameBuffer contains 2 textures (octahedral normal and color) and the depth,
+    //from which the world space position is reconstructed
 
     lightBuffer = new FrameBuffer();
     lightBuffer->Generate(resolution.x, resolution.y, 1, false);
@@ -166,48 +176,59 @@ void Lab5::Update(float deltaTimeSeconds)
         glBlendEquation(GL_FUNC_ADD);
         glBlendFunc(GL_ONE, GL_ONE);
 
-        auto shader = shaders["LightPass"];
-        shader->Use();
-
+        // Either one full-screen pass over the lights of each cluster, or a
+        // light volume drawn per light
+        if (useClusters)
         {
-            int texturePositionsLoc = shader->GetUniformLocation("texture_position");
-            glUniform1i(texturePositionsLoc, 0);
-            frameBuffer->BindTexture(0, GL_TEXTURE0);
+            RenderClusteredLights();
         }
-
-        {
-            int textureNormalsLoc = shader->GetUniformLocation("texture_normal");
-            glUniform1i(textureNormalsLoc, 1);
-            frameBuffer->BindTexture(1, GL_TEXTURE0 + 1);
-        }
-
-        auto camera = GetSceneCamera();
-        glm::vec3 cameraPos = camera->m_transform->GetWorldPosition();
-        int loc_eyePosition = shader->GetUniformLocation("eye_position");
-        glUniform3fv(loc_eyePosition, 1, glm::value_ptr(cameraPos));
-
-        auto resolution = window->GetResolution();
-        int loc_resolution = shader->GetUniformLocation("resolution");
-        glUniform2i(loc_resolution, resolution.x, resolution.y);
-
-        //Front face culling
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
-
-        for (auto& lightInfo : lights)
+        else
         {
-            // TODO(student): Set the shader uniforms 'light_position', 'light_color' and 'light_radius'
-            // with the values from the light source. Use shader 'shader'.
+            auto shader = shaders["LightPass"];
+            shader->Use();
+
+            {
+                int textureDepthLoc = shader->GetUniformLocation("texture_depth");
+                glUniform1i(textureDepthLoc, 0);
+                frameBuffer->BindDepthTexture(GL_TEXTURE0);
+            }
+
+            {
+                int textureNormalsLoc = shader->GetUniformLocation("texture_normal");
+                glUniform1i(textureNormalsLoc, 1);
+                frameBuffer->BindTexture(0, GL_TEXTURE0 + 1);
+            }
+
+            SendInverseViewProjection(shader);
+
+            auto camera = GetSceneCamera();
+            glm::vec3 cameraPos = camera->m_transform->GetWorldPosition();
+            int loc_eyePosition = shader->GetUniformLocation("eye_position");
+            glUniform3fv(loc_eyePosition, 1, glm::value_ptr(cameraPos));
+
+            auto resolution = window->GetResolution();
+            int loc_resolution = shader->GetUniformLocation("resolution");
+            glUniform2i(loc_resolution, resolution.x, resolution.y);
+
+            //Front face culling
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+
+            for (auto& lightInfo : lights)
+            {
+                // TODO(student): Set the shader uniforms 'light_position', 'light_color' and 'light_radius'
+                // with the values from the light source. Use shader 'shader'.
             
 
 
-            // TODO(student): Draw the mesh "sphere" at the position of the light source
-            // and scaled 2 times the light source radius.
-            // Use RenderMesh(mesh, shader, position, scale). Use shader 'shader'.
+                // TODO(student): Draw the mesh "sphere" at the position of the light source
+                // and scaled 2 times the light source radius.
+                // Use RenderMesh(mesh, shader, position, scale). Use shader 'shader'.
 
-        }
+            }
 
-        glDisable(GL_CULL_FACE);
+            glDisable(GL_CULL_FACE);
+        }
 
         glDepthMask(GL_TRUE);
         glDisable(GL_BLEND);
@@ -224,22 +245,16 @@ void Lab5::Update(float deltaTimeSeconds)
         int outputTypeLoc = shader->GetUniformLocation("output_type");
         glUniform1i(outputTypeLoc, outputType);
 
-        {
-            int texturePositionsLoc = shader->GetUniformLocation("texture_position");
-            glUniform1i(texturePositionsLoc, 1);
-            frameBuffer->BindTexture(0, GL_TEXTURE0 + 1);
-        }
-
         {
             int textureNormalsLoc = shader->GetUniformLocation("texture_normal");
             glUniform1i(textureNormalsLoc, 2);
-            frameBuffer->BindTexture(1, GL_TEXTURE0 + 2);
+            frameBuffer->BindTexture(0, GL_TEXTURE0 + 2);
         }
 
         {
             int textureColorLoc = shader->GetUniformLocation("texture_color");
             glUniform1i(textureColorLoc, 3);
-            frameBuffer->BindTexture(2, GL_TEXTURE0 + 3);
+            frameBuffer->BindTexture(1, GL_TEXTURE0 + 3);
         }
 
         {
@@ -254,6 +269,8 @@ void Lab5::Update(float deltaTimeSeconds)
             lightBuffer->BindTexture(0, GL_TEXTURE0 + 5);
         }
 
+        SendInverseViewProjection(shader);
+
         // Render the object again but with different properties
         RenderMesh(meshes["quad"], shader, glm::vec3(0, 0, 0));
     }
@@ -266,6 +283,110 @@ void Lab5::FrameEnd()
 }
 
 
+void Lab5::RenderClusteredLights()
+{
+    auto camera = GetSceneCamera();
+    auto projectionInfo = camera->GetProjectionInfo();
+
+    clusterLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        clusterLights[i].positionRadius = glm::vec4(lights[i].position, lights[i].radius);
+        clusterLights[i].color = glm::vec4(lights[i].color, 1);
+    }
+    // The scene lies a few units away from the camera, so no slices are spent
+    // on the first unit in front of it
+    lightClusters->Update(clusterLights, camera->GetViewMatrix(), camera->GetProjectionMatrix(),
+                          MAX(projectionInfo.zNear, 1.0f), projectionInfo.zFar);
+
+    auto shader = shaders["ClusteredLightPass"];
+    shader->Use();
+
+    glUniform1i(shader->GetUniformLocation("texture_depth"), 0);
+    frameBuffer->BindDepthTexture(GL_TEXTURE0);
+    glUniform1i(shader->GetUniformLocation("texture_normal"), 1);
+    frameBuffer->BindTexture(0, GL_TEXTURE0 + 1);
+    lightClusters->Bind(shader, 2);
+    SendInverseViewProjection(shader);
+
+    glm::vec3 cameraPos = camera->m_transform->GetWorldPosition();
+    glUniform3fv(shader->GetUniformLocation("eye_position"), 1, glm::value_ptr(cameraPos));
+
+    auto resolution = window->GetResolution();
+    glUniform2i(shader->GetUniformLocation("resolution"), resolution.x, resolution.y);
+
+    RenderMesh(meshes["quad"], shader, glm::vec3(0, 0, 0));
+}
+
+
+void Lab5::RunLightBenchmark()
+{
+    static const unsigned int lightCounts[] = { 40, 100, 250, 1000, 2500, 5000, 10000 };
+    static const int kNrFrames = 20;
+
+    std::vector<LightInfo> sceneLights = lights;
+    bool sceneClusters = useClusters;
+    useClusters = true;
+
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    cout << "lights\tassign + upload (ms)\tshading (ms)\tlights per cluster (avg / max)" << endl;
+    for (unsigned int count : lightCounts)
+    {
+        // The radius shrinks as lights are added, so they light the same
+        // volume of the scene together
+        float radiusScale = std::cbrt(40.0f / count);
+        lights.resize(count);
+        for (auto &l : lights)
+        {
+            l.position = glm::vec3(Rand01() * 20 - 10, Rand01() * 3, Rand01() * 20 - 10);
+            l.color = glm::vec3(Rand01(), Rand01(), Rand01());
+            l.radius = (3 + Rand01()) * radiusScale;
+        }
+
+        lightBuffer->Bind();
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        double assignTime = 0;
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int frame = 0; frame < kNrFrames; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            RenderClusteredLights();
+            assignTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+
+        // Waits for the GPU
+        GLuint64 shadingTime = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &shadingTime);
+
+        unsigned int nrClusters = LightClusters::CLUSTERS_X * LightClusters::CLUSTERS_Y * LightClusters::CLUSTERS_Z;
+        cout << count << "\t" << assignTime / kNrFrames << "\t" << shadingTime / 1e6 / kNrFrames << "\t"
+             << (float)lightClusters->GetNumberOfIndices() / nrClusters << " / " << lightClusters->GetMaxLightsPerCluster() << endl;
+    }
+
+    glDeleteQueries(1, &query);
+
+    lights = sceneLights;
+    useClusters = sceneClusters;
+}
+
+
+void Lab5::SendInverseViewProjection(Shader *shader)
+{
+    auto camera = GetSceneCamera();
+    glm::mat4 inverseViewProjection = glm::inverse(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+    glUniformMatrix4fv(shader->GetUniformLocation("inverse_view_projection"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+}
+
+
 void Lab5::LoadShader(const std::string &name)
 {
     std::string shaderPath = PATH_JOIN(window->props.selfDir, SOURCE_PATH::M2, "lab5", "shaders");
@@ -306,6 +427,17 @@ void Lab5::OnKeyPress(int key, int mods)
     {
         outputType = index;
     }
+
+    // Switch between light volumes and clustered lighting
+    if (key == GLFW_KEY_C)
+    {
+        useClusters = !useClusters;
+    }
+
+    if (key == GLFW_KEY_B)
+    {
+        RunLightBenchmark();
+    }
 }
 
 
@@ -6,6 +6,7 @@
 #include "components/simple_scene.h"
 #include "components/transform.h"
 #include "core/gpu/frame_buffer.h"
+#include "core/gpu/light_clusters.h"
 
 
 namespace m2
@@ -41,10 +42,24 @@ namespace m2
 
         void LoadShader(const std::string &fileName);
 
+        // The G-buffer keeps no positions, so shaders rebuild them from depth
+        void SendInverseViewProjection(Shader *shader);
+
+        // Accumulates every light in one full-screen pass, reading only
+        // the lights assigned to the cluster of each pixel
+        void RenderClusteredLights();
+
+        // Times the clustered lighting from 40 to 10000 lights
+        void RunLightBenchmark();
+
      private:
         FrameBuffer *frameBuffer;
         FrameBuffer *lightBuffer;
         std::vector<LightInfo> lights;
         int outputType;
+
+        LightClusters *lightClusters;
+        std::vector<ClusterLight> clusterLights;
+        bool useClusters;
     };
 }   // namespace m2
@@ -0,0 +1,78 @@
+#version 330
+
+#include <Clusters.glsl>
+#include "GBuffer.glsl"
+
+// Uniform properties
+uniform sampler2D texture_depth;
+uniform sampler2D texture_normal;
+
+uniform mat4 inverse_view_projection;
+uniform ivec2 resolution;
+uniform vec3 eye_position;
+
+// Output
+layout(location = 0) out vec4 out_color;
+
+// Local variables and functions
+const vec3 LD = vec3 (0.3);             // diffuse factor
+const vec3 LS = vec3 (0.3);             // specular factor
+const float SHININESS = 40.0;   // specular exponent
+
+// Computes the output color using Phong lighting model.
+// w_pos - world space position of the fragment.
+// w_N   - world space normal vector of the fragment.
+vec3 PhongLight(vec3 w_pos, vec3 w_N, vec3 light_position, float light_radius, vec3 light_color)
+{
+    vec3 L = normalize(light_position - w_pos);
+
+    float dist = distance(light_position, w_pos);
+
+    // Ignore fragments outside of the
+    // light influence zone (radius)
+    if (dist > light_radius)
+        return vec3(0);
+
+    float att = pow(light_radius - dist, 2);
+
+    float dot_specular = dot(w_N, L);
+    vec3 specular = vec3(0);
+    if (dot_specular > 0)
+    {
+        vec3 V = normalize(eye_position - w_pos);
+        vec3 H = normalize(L + V);
+        specular = LS * pow(max(dot(w_N, H), 0), SHININESS);
+    }
+
+    vec3 diffuse = LD * max(dot_specular, 0);
+
+    return att * (diffuse + specular) * light_color;
+}
+
+
+void main()
+{
+    vec2 tex_coord = gl_FragCoord.xy / resolution;
+
+    // Nothing was drawn here
+    float depth = texture(texture_depth, tex_coord).x;
+    if (depth == 1.0)
+        discard;
+
+    vec3 wPos = ReconstructPosition(tex_coord, depth, inverse_view_projection);
+    vec3 wNorm = DecodeNormal(texture(texture_normal, tex_coord).xy);
+
+    // Only the lights whose sphere reaches the cluster of the fragment
+    uvec2 range = ClusterRange(wPos, gl_FragCoord.xy, vec2(resolution));
+
+    vec3 color = vec3(0);
+    for (uint i = range.x; i < range.x + range.y; i++)
+    {
+        vec3 light_position, light_color;
+        float light_radius;
+        ClusterLight(i, light_position, light_radius, light_color);
+        color += PhongLight(wPos, wNorm, light_position, light_radius, light_color);
+    }
+
+    out_color = vec4(color, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330
+
+// Input
+layout(location = 0) in vec3 v_position;
+
+
+void main()
+{
+    gl_Position = vec4(v_position, 1.0);
+}
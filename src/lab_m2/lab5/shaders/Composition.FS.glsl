@@ -1,15 +1,17 @@
 #version 330
 
+#include "GBuffer.glsl"
+
 // Input
 in vec2 texture_coord;
 
 // Uniform properties
-uniform sampler2D texture_position;
 uniform sampler2D texture_normal;
 uniform sampler2D texture_color;
 uniform sampler2D texture_depth;
 uniform sampler2D texture_light;
 
+uniform mat4 inverse_view_projection;
 uniform int output_type;
 
 // Output
@@ -31,13 +33,13 @@ vec3 color()
 
 vec3 world_normal()
 {
-    return texture(texture_normal, texture_coord).xyz;
+    return DecodeNormal(texture(texture_normal, texture_coord).xy);
 }
 
 
 vec3 world_position()
 {
-    return texture(texture_position, texture_coord).xyz;
+    return ReconstructPosition(texture_coord, texture(texture_depth, texture_coord).x, inverse_view_projection);
 }
 
 
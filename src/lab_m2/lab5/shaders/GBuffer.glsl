@@ -0,0 +1,36 @@
+// Compact G-buffer of Lab5: octahedral normals in RG16, albedo in RGBA8, and
+// world positions rebuilt from the depth buffer
+
+
+vec2 SignNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+
+// Maps a unit vector onto the octahedron, unfolded into [0, 1]^2
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+    return e * 0.5 + 0.5;
+}
+
+
+vec3 DecodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * SignNotZero(n.xy);
+    return normalize(n);
+}
+
+
+// World space position of the pixel at `tex_coord`, from the value of the
+// depth buffer there and the inverse of the projection times the view matrix
+vec3 ReconstructPosition(vec2 tex_coord, float depth, mat4 inverse_view_projection)
+{
+    vec4 position = inverse_view_projection * vec4(vec3(tex_coord, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
@@ -1,9 +1,12 @@
 #version 330
 
+#include "GBuffer.glsl"
+
 // Uniform properties
-uniform sampler2D texture_position;
+uniform sampler2D texture_depth;
 uniform sampler2D texture_normal;
 
+uniform mat4 inverse_view_projection;
 uniform ivec2 resolution;
 uniform vec3 eye_position;
 uniform vec3 light_position;
@@ -53,12 +56,14 @@ void main()
 {
     vec2 tex_coord = gl_FragCoord.xy / resolution;
 
-    // TODO(student): Sample the texture 'texture_position' at tex_coord to obtain
+    // TODO(student): Sample the texture 'texture_depth' at tex_coord, and pass
+    // the depth to 'ReconstructPosition' with 'inverse_view_projection' to obtain
     // the world space position of the light source.
     vec3 wPos = vec3(0.0);
 
-    // TODO(student): Sample the texture 'texture_normal' at tex_coord to obtain
-    // the world space normal vector of the light source.
+    // TODO(student): Sample the texture 'texture_normal' at tex_coord, and pass
+    // the two channels to 'DecodeNormal' to obtain the world space normal
+    // vector of the light source.
     vec3 wNorm = vec3(0.0);
 
     // TODO(student): Compute out_color.rgb using 'PhongLight' method with the world space position 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "components/simple_scene.h"
+#include "core/gpu/animation_mixer.h"
 
 
 namespace m2
@@ -29,17 +30,10 @@ namespace m2
         void OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY) override;
         void OnWindowResize(int width, int height) override;
 
-        void BoneTransform(Mesh* mesh, float timeInSeconds);
-        void ReadNodeHierarchy(Mesh* mesh, float animationTime, const aiNode* pNode, const glm::mat4& parentTransform, aiAnimation** anim);
-        const aiNodeAnim* FindNodeAnim(const aiAnimation* pAnimation, const std::string nodeName);
-        unsigned int FindRotation(float animationTime, const aiNodeAnim* pNodeAnim);
-        void ComputeInterpolatedRotation(aiQuaternion& Out, float animationTime, const aiNodeAnim* pNodeAnim);
-        unsigned int FindScaling(float animationTime, const aiNodeAnim* pNodeAnim);
-        void ComputeInterpolatedScaling(aiVector3D& Out, float animationTime, const aiNodeAnim* pNodeAnim);
-        unsigned int FindPosition(float animationTime, const aiNodeAnim* pNodeAnim);
-        void ComputeInterpolatedPosition(aiVector3D& Out, float animationTime, const aiNodeAnim* pNodeAnim);
+        void BoneTransform(Mesh* mesh, float deltaTimeSeconds);
 
     private:
-
+        AnimationMixer animation;
+        unsigned int clipIndex;
     };
 }   // namespace m2
@@ -0,0 +1,672 @@
+#include "lab_m2/lab8/batch_processing.h"
+
+#include <mutex>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+#include <algorithm>
+#include <condition_variable>
+
+#include "lab_m2/lab8/image_processing.h"
+#include "lab_m2/lab8/tiled_pipeline.h"
+#include "core/gpu/frame_buffer.h"
+#include "core/gpu/frame_capture.h"
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "core/managers/resource_path.h"
+#include "utils/file_utils.h"
+#include "utils/text_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Standard deviation of `blur` without one
+static const float DEFAULT_BLUR_SIGMA = 1.0f;
+
+
+// Lowercase extension of `fileName`, without the dot
+static std::string GetExtension(const std::string &fileName)
+{
+    size_t dot = fileName.find_last_of('.');
+    size_t separator = fileName.find_last_of("\\/");
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator))
+        return "";
+
+    std::string extension = fileName.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+
+// Formats FrameCapture can write
+static bool IsStbFormat(const std::string &extension)
+{
+    return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" || extension == "tga";
+}
+
+
+static bool IsNetpbmFormat(const std::string &extension)
+{
+    return extension == "pgm" || extension == "ppm" || extension == "pnm" || extension == "pam";
+}
+
+
+// Samples the red channel of a one channel texture in all three colors,
+// instead of red alone
+static void SampleAsGray(Texture2D *texture)
+{
+    texture->Bind();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    texture->UnBind();
+}
+
+
+// Prints a whole line at once, as files are processed on several threads
+static void Report(const std::string &message)
+{
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << message << std::endl;
+}
+
+
+BatchProcessor::BatchProcessor()
+{
+    nrJobs = 2;
+    tileSize = 512;
+    gpu = false;
+}
+
+
+bool BatchProcessor::ParseArguments(int argc, char **argv)
+{
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool takesValue = (arg == "-o" || arg == "--output" || arg == "-f" || arg == "--filters" ||
+                           arg == "-j" || arg == "--jobs" || arg == "--format" || arg == "--tile");
+        if (takesValue && i + 1 == argc)
+        {
+            std::cout << arg << " needs a value" << std::endl;
+            return false;
+        }
+
+        if (arg == "-o" || arg == "--output")
+        {
+            outputDirectory = argv[++i];
+        }
+        else if (arg == "-f" || arg == "--filters")
+        {
+            if (!ParseFilters(argv[++i]))
+                return false;
+        }
+        else if (arg == "-j" || arg == "--jobs")
+        {
+            int value = atoi(argv[++i]);
+            if (value <= 0)
+            {
+                std::cout << "The number of jobs must be positive" << std::endl;
+                return false;
+            }
+            nrJobs = value;
+        }
+        else if (arg == "--tile")
+        {
+            int value = atoi(argv[++i]);
+            if (value <= 0)
+            {
+                std::cout << "The tile size must be positive" << std::endl;
+                return false;
+            }
+            tileSize = value;
+        }
+        else if (arg == "--format")
+        {
+            outputFormat = GetExtension(std::string(".") + argv[++i]);
+            if (!IsStbFormat(outputFormat) && !IsNetpbmFormat(outputFormat))
+            {
+                std::cout << "Unknown output format " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--gpu")
+        {
+            gpu = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-')
+        {
+            std::cout << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    if (inputs.empty() || outputDirectory.empty())
+    {
+        std::cout << "Both the input files and the output directory are needed" << std::endl;
+        return false;
+    }
+
+    if (gpu)
+    {
+        for (const Filter &filter : filters)
+        {
+            if (filter.type != FilterType::GRAYSCALE && filter.type != FilterType::BLUR)
+            {
+                std::cout << "Only the gray and blur filters run on the GPU" << std::endl;
+                return false;
+            }
+
+            // The blur of the shaders is a fixed 7x7 box
+            if (filter.type == FilterType::BLUR && filter.sigma != DEFAULT_BLUR_SIGMA)
+            {
+                std::cout << "The GPU blur does not take a standard deviation" << std::endl;
+                return false;
+            }
+        }
+
+        if (IsNetpbmFormat(outputFormat))
+        {
+            std::cout << "The GPU filters write PNG, JPEG, BMP or TGA files" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void BatchProcessor::PrintUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " --batch -o <directory> [options] <inputs>..." << std::endl
+              << std::endl
+              << "Inputs are files, or patterns with * and ? in the file name." << std::endl
+              << std::endl
+              << "  -o, --output <directory>  where the results are written, with the names of the inputs" << std::endl
+              << "  -f, --filters <chain>     filters applied in order, separated by commas:" << std::endl
+              << "                            gray, blur[:sigma], sobel, median, equalize" << std::endl
+              << "  -j, --jobs <count>        files processed at once, 2 by default" << std::endl
+              << "  --format <extension>      png, jpg, bmp, tga, pgm, ppm or pam, instead of the input format" << std::endl
+              << "  --tile <size>             tile size of the CPU filters, 512 by default" << std::endl
+              << "  --gpu                     runs the filters in the Lab8 shaders, on a hidden window." << std::endl
+              << "                            Only gray, and blur as a 7x7 box without a sigma, are available." << std::endl;
+}
+
+
+bool BatchProcessor::UsesGPU() const
+{
+    return gpu;
+}
+
+
+unsigned int BatchProcessor::Run(const std::string &selfDir)
+{
+    // Files matched by several inputs are processed once, as two jobs
+    // must not write the same output
+    std::vector<std::string> files;
+    std::unordered_set<std::string> seen;
+    for (const std::string &input : inputs)
+    {
+        // Files without wildcards are kept even if missing, to be reported as failed
+        std::vector<std::string> matches(1, input);
+        if (input.find_first_of("*?") != std::string::npos)
+        {
+            matches = file_utils::FindFiles(input);
+            if (matches.empty())
+            {
+                std::cout << "No files match " << input << std::endl;
+            }
+        }
+
+        for (const std::string &file : matches)
+        {
+            if (seen.insert(file).second)
+                files.push_back(file);
+        }
+    }
+
+    if (files.empty())
+    {
+        std::cout << "No files to process" << std::endl;
+        return 0;
+    }
+
+    // The outputs only keep the names of the inputs, so files from different
+    // directories, or with different formats, may be written to the same
+    // output. The first one keeps it, and the others fail before any work.
+    unsigned int failed = 0;
+    std::vector<std::string> jobFiles, jobOutputs;
+    std::unordered_map<std::string, std::string> writers;
+    for (const std::string &file : files)
+    {
+        std::string outputFile = GetOutputFile(file);
+        auto writer = writers.insert(std::make_pair(outputFile, file));
+
+        if (outputFile == file)
+        {
+            std::cout << file << ": the output would overwrite the input" << std::endl;
+            failed++;
+        }
+        else if (!writer.second)
+        {
+            std::cout << file << ": " << outputFile << " is also the output of " << writer.first->second << std::endl;
+            failed++;
+        }
+        else
+        {
+            jobFiles.push_back(file);
+            jobOutputs.push_back(outputFile);
+        }
+    }
+
+    if (!file_utils::CreateDirectories(outputDirectory))
+    {
+        std::cout << "Cannot create " << outputDirectory << std::endl;
+        return static_cast<unsigned int>(files.size());
+    }
+
+    std::cout << "Processing " << jobFiles.size() << " files on the " << (gpu ? "GPU" : "CPU") << std::endl;
+
+    unsigned long long pixels = 0;
+    auto start = std::chrono::steady_clock::now();
+    failed += gpu ? RunGPU(jobFiles, jobOutputs, selfDir, pixels) : RunCPU(jobFiles, jobOutputs, pixels);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << files.size() - failed << " files done, " << failed << " failed, "
+              << pixels / 1e6 << " MP in " << seconds << " s, "
+              << (seconds > 0 ? pixels / 1e6 / seconds : 0) << " MP/s" << std::endl;
+    return failed;
+}
+
+
+bool BatchProcessor::ParseFilters(const std::string &chain)
+{
+    filters.clear();
+
+    size_t begin = 0;
+    while (begin <= chain.size())
+    {
+        size_t end = chain.find(',', begin);
+        if (end == std::string::npos)
+            end = chain.size();
+
+        std::string name = chain.substr(begin, end - begin);
+        begin = end + 1;
+        if (name.empty())
+            continue;
+
+        // Blur takes its standard deviation after a colon
+        Filter filter;
+        filter.sigma = DEFAULT_BLUR_SIGMA;
+        size_t colon = name.find(':');
+        if (colon != std::string::npos)
+        {
+            filter.sigma = static_cast<float>(atof(name.c_str() + colon + 1));
+            name = name.substr(0, colon);
+            if (name != "blur" || filter.sigma <= 0)
+            {
+                std::cout << "Only blur takes a standard deviation, which must be positive" << std::endl;
+                return false;
+            }
+        }
+
+        if (name == "gray" || name == "grayscale")
+            filter.type = FilterType::GRAYSCALE;
+        else if (name == "blur")
+            filter.type = FilterType::BLUR;
+        else if (name == "sobel")
+            filter.type = FilterType::SOBEL;
+        else if (name == "median")
+            filter.type = FilterType::MEDIAN;
+        else if (name == "equalize")
+            filter.type = FilterType::EQUALIZE;
+        else
+        {
+            std::cout << "Unknown filter " << name << std::endl;
+            return false;
+        }
+
+        filters.push_back(filter);
+    }
+
+    return true;
+}
+
+
+std::string BatchProcessor::GetOutputFile(const std::string &inputFile) const
+{
+    size_t separator = inputFile.find_last_of("\\/");
+    std::string name = (separator == std::string::npos) ? inputFile : inputFile.substr(separator + 1);
+
+    std::string extension = outputFormat.empty() ? GetExtension(name) : outputFormat;
+    if (name.find('.') != std::string::npos)
+        name = name.substr(0, name.find_last_of('.'));
+
+    // Formats without a writer fall back to PNG
+    if (!IsStbFormat(extension) && (gpu || !IsNetpbmFormat(extension)))
+        extension = "png";
+
+    return PATH_JOIN(outputDirectory, name + "." + extension);
+}
+
+
+unsigned int BatchProcessor::RunCPU(const std::vector<std::string> &files, const std::vector<std::string> &outputs,
+                                    unsigned long long &pixels)
+{
+    // A few files at a time, each split in tiles over the shared pool
+    thread_utils::ThreadPool jobs(nrJobs);
+    std::atomic<unsigned int> failed(0);
+    std::atomic<unsigned long long> totalPixels(0);
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const std::string &file = files[i];
+        const std::string &outputFile = outputs[i];
+        jobs.Enqueue([this, &file, &outputFile, &failed, &totalPixels]()
+        {
+            unsigned long long filePixels = 0;
+            if (ProcessFileCPU(file, outputFile, filePixels))
+                totalPixels += filePixels;
+            else
+                failed++;
+        });
+    }
+
+    jobs.Wait();
+    pixels = totalPixels;
+    return failed;
+}
+
+
+bool BatchProcessor::ProcessFileCPU(const std::string &inputFile, const std::string &outputFile, unsigned long long &pixels) const
+{
+    std::unique_ptr<ImageReader> reader(ImageReader::Open(inputFile));
+    if (!reader)
+    {
+        Report("Cannot read " + inputFile);
+        return false;
+    }
+
+    unsigned int width = reader->GetWidth();
+    unsigned int height = reader->GetHeight();
+    unsigned int channels = reader->GetNrChannels();
+
+    std::unique_ptr<ImageWriter> writer(ImageWriter::Create(outputFile, width, height, channels));
+    if (!writer)
+    {
+        Report("Cannot write " + outputFile);
+        return false;
+    }
+
+    bool wholeImage = false;
+    for (const Filter &filter : filters)
+    {
+        wholeImage = wholeImage || filter.type == FilterType::EQUALIZE;
+    }
+
+    bool done = true;
+    if (!wholeImage)
+    {
+        TiledPipeline pipeline(tileSize);
+        for (const Filter &filter : filters)
+        {
+            switch (filter.type)
+            {
+            case FilterType::GRAYSCALE:
+                pipeline.AddFilter(TileFilter::GrayScale());
+                break;
+            case FilterType::BLUR:
+                pipeline.AddFilter(TileFilter::GaussianBlur(filter.sigma));
+                break;
+            case FilterType::SOBEL:
+                pipeline.AddFilter(TileFilter::Sobel());
+                break;
+            default:
+                pipeline.AddFilter(TileFilter::Median());
+                break;
+            }
+        }
+
+        done = pipeline.Run(*reader, *writer) && writer->Close();
+    }
+    else
+    {
+        // Histogram equalization needs every pixel before it writes any
+        size_t size = static_cast<size_t>(width) * height * channels;
+        std::vector<unsigned char> image(size), result(size);
+        done = reader->ReadRows(image.data(), height);
+
+        for (const Filter &filter : filters)
+        {
+            if (!done)
+                break;
+
+            switch (filter.type)
+            {
+            case FilterType::GRAYSCALE:
+                image_processing::GrayScale(image.data(), result.data(), width, height, channels);
+                break;
+            case FilterType::BLUR:
+                image_processing::GaussianBlur(image.data(), result.data(), width, height, channels, filter.sigma);
+                break;
+            case FilterType::SOBEL:
+                image_processing::Sobel(image.data(), result.data(), width, height, channels);
+                break;
+            case FilterType::MEDIAN:
+                image_processing::Median(image.data(), result.data(), width, height, channels);
+                break;
+            case FilterType::EQUALIZE:
+                image_processing::EqualizeHistogram(image.data(), result.data(), width, height, channels);
+                break;
+            }
+            image.swap(result);
+        }
+
+        done = done && writer->WriteRows(image.data(), height) && writer->Close();
+    }
+
+    if (!done)
+    {
+        Report("Failed to process " + inputFile);
+        return false;
+    }
+
+    pixels = static_cast<unsigned long long>(width) * height;
+    return true;
+}
+
+
+unsigned int BatchProcessor::RunGPU(const std::vector<std::string> &files, const std::vector<std::string> &outputs,
+                                    const std::string &selfDir, unsigned long long &pixels)
+{
+    Shader shader("BatchImageProcessing");
+    std::string shaderPath = PATH_JOIN(selfDir, SOURCE_PATH::M2, "Lab8", "shaders");
+    shader.AddShader(PATH_JOIN(shaderPath, "VertexShader.glsl"), GL_VERTEX_SHADER);
+    shader.AddShader(PATH_JOIN(shaderPath, "FragmentShader.glsl"), GL_FRAGMENT_SHADER);
+    uint64_t grayscaleFeature = shader.AddFeature("GRAYSCALE");
+    uint64_t blurFeature = shader.AddFeature("BLUR");
+
+    Mesh quad("quad");
+    if (!shader.CreateAndLink() || !quad.LoadMesh(PATH_JOIN(selfDir, RESOURCE_PATH::MODELS, "primitives"), "quad.obj"))
+    {
+        std::cout << "Cannot load the Lab8 shaders and quad from " << selfDir << std::endl;
+        return static_cast<unsigned int>(files.size());
+    }
+    quad.UseMaterials(false);
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    // Decoded on worker threads, at most `nrJobs` files ahead of the GPU
+    struct DecodedImage
+    {
+        std::vector<unsigned char> pixels;
+        unsigned int width;
+        unsigned int height;
+        unsigned int channels;
+        bool valid;
+        bool ready;
+    };
+
+    std::vector<DecodedImage> images(files.size());
+    std::mutex mutex;
+    std::condition_variable imageDecoded;
+    thread_utils::ThreadPool decoders(nrJobs);
+
+    auto decode = [&files, &images, &mutex, &imageDecoded](size_t index)
+    {
+        DecodedImage &image = images[index];
+        image.valid = false;
+
+        std::unique_ptr<ImageReader> reader(ImageReader::Open(files[index]));
+        if (reader)
+        {
+            image.width = reader->GetWidth();
+            image.height = reader->GetHeight();
+            image.channels = reader->GetNrChannels();
+            image.pixels.resize(static_cast<size_t>(image.width) * image.height * image.channels);
+            image.valid = reader->ReadRows(image.pixels.data(), image.height);
+        }
+
+        if (!image.valid)
+        {
+            Report("Cannot read " + files[index]);
+            std::vector<unsigned char>().swap(image.pixels);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            image.ready = true;
+        }
+        imageDecoded.notify_all();
+    };
+
+    for (DecodedImage &image : images)
+    {
+        image.ready = false;
+    }
+
+    // Read back and encoded in the background, while the next file is drawn
+    FrameCapture capture(3, nrJobs, 2 * nrJobs);
+
+    static const GLenum targetFormats[5] = { 0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    Texture2D source;
+    FrameBuffer targets[2];
+    glm::ivec2 targetSize(0);
+    unsigned int targetChannels = 0;
+
+    unsigned int failed = 0;
+    size_t nextDecode = 0;
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        while (nextDecode < files.size() && nextDecode < i + nrJobs)
+        {
+            size_t index = nextDecode++;
+            decoders.Enqueue([&decode, index]() { decode(index); });
+        }
+
+        DecodedImage &image = images[i];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            imageDecoded.wait(lock, [&image]() { return image.ready; });
+        }
+
+        if (!image.valid)
+        {
+            failed++;
+            continue;
+        }
+
+        unsigned int width = image.width;
+        unsigned int height = image.height;
+        unsigned int channels = image.channels;
+
+        std::string error;
+        if (width > static_cast<unsigned int>(maxTextureSize) || height > static_cast<unsigned int>(maxTextureSize))
+            error = ": larger than the GPU textures, use the tiled CPU filters";
+        else if (channels == 2)
+            error = ": gray images with alpha need the CPU filters";
+
+        if (!error.empty())
+        {
+            Report(files[i] + error);
+            std::vector<unsigned char>().swap(image.pixels);
+            failed++;
+            continue;
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        source.Create(image.pixels.data(), width, height, channels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        source.SetWrappingMode(GL_CLAMP_TO_EDGE);
+        std::vector<unsigned char>().swap(image.pixels);
+
+        if (channels == 1)
+        {
+            SampleAsGray(&source);
+        }
+
+        if (targetSize != glm::ivec2(width, height) || targetChannels != channels)
+        {
+            for (FrameBuffer &target : targets)
+            {
+                target.Generate(width, height, std::vector<GLenum>(1, targetFormats[channels]), false);
+                target.GetTexture(0)->SetWrappingMode(GL_CLAMP_TO_EDGE);
+                if (channels == 1)
+                {
+                    SampleAsGray(target.GetTexture(0));
+                }
+            }
+            targetSize = glm::ivec2(width, height);
+            targetChannels = channels;
+        }
+
+        // The passes alternate between the two targets. Rows are not
+        // flipped, so the targets keep the top row first, like the source.
+        const Texture2D *input = &source;
+        size_t nrPasses = std::max(filters.size(), static_cast<size_t>(1));
+        for (size_t pass = 0; pass < nrPasses; pass++)
+        {
+            uint64_t feature = 0;
+            if (!filters.empty())
+                feature = (filters[pass].type == FilterType::GRAYSCALE) ? grayscaleFeature : blurFeature;
+
+            Shader *variant = shader.GetVariant(feature);
+            variant->Use();
+            glUniform1i(variant->GetUniformLocation("flipVertical"), 0);
+            glUniform2i(variant->GetUniformLocation("screenSize"), width, height);
+            glUniform1i(variant->GetUniformLocation("textureImage"), 0);
+
+            FrameBuffer &target = targets[pass % 2];
+            target.Bind(false);
+            input->BindToTextureUnit(GL_TEXTURE0);
+            quad.Render();
+            input = target.GetTexture(0);
+        }
+
+        capture.CaptureTexture(input, outputs[i]);
+        capture.Update();
+        pixels += static_cast<unsigned long long>(width) * height;
+    }
+
+    FrameBuffer::BindDefault();
+    capture.Flush();
+    decoders.Wait();
+    source.Release();
+
+    failed += capture.GetNumberOfFailedImages();
+    if (capture.GetNumberOfStalls())
+    {
+        std::cout << capture.GetNumberOfStalls() << " readbacks waited for the GPU or the encoders" << std::endl;
+    }
+    return failed;
+}
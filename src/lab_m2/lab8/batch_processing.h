@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Command line mode of the executable, which runs a chain of the Lab8
+// filters over many files without the interactive scene:
+//
+//     <executable> --batch -o <directory> -f <filters> [options] <inputs>...
+//
+// On the CPU, the files go through a TiledPipeline, a few at a time, so
+// files in the Netpbm formats never sit in memory whole. On the GPU, the
+// images are decoded on worker threads ahead of the render thread, and
+// FrameCapture reads the results back and encodes them in the background.
+// See PrintUsage for the options.
+class BatchProcessor
+{
+ public:
+    BatchProcessor();
+
+    // Arguments after `--batch`. Returns false, after printing why, if they
+    // are not valid.
+    bool ParseArguments(int argc, char **argv);
+    static void PrintUsage(const char *program);
+
+    // GPU filters need a current OpenGL context when Run is called
+    bool UsesGPU() const;
+
+    // Processes every input file, with the shaders and models under
+    // `selfDir` for the GPU filters. Returns the number of files that failed.
+    unsigned int Run(const std::string &selfDir);
+
+ private:
+    enum class FilterType
+    {
+        GRAYSCALE,
+        BLUR,
+        SOBEL,
+        MEDIAN,
+        EQUALIZE
+    };
+
+    struct Filter
+    {
+        FilterType type;
+        float sigma;
+    };
+
+    bool ParseFilters(const std::string &chain);
+    std::string GetOutputFile(const std::string &inputFile) const;
+
+    // Each file is written to the output at the same index
+    unsigned int RunCPU(const std::vector<std::string> &files, const std::vector<std::string> &outputs,
+                        unsigned long long &pixels);
+    unsigned int RunGPU(const std::vector<std::string> &files, const std::vector<std::string> &outputs,
+                        const std::string &selfDir, unsigned long long &pixels);
+
+    // Streams the file through the tiled filters, or filters it whole when
+    // the chain has a filter that needs the whole image
+    bool ProcessFileCPU(const std::string &inputFile, const std::string &outputFile, unsigned long long &pixels) const;
+
+ private:
+    std::vector<std::string> inputs;
+    std::vector<Filter> filters;
+    std::string outputDirectory;
+    std::string outputFormat;
+    unsigned int nrJobs;
+    unsigned int tileSize;
+    bool gpu;
+};
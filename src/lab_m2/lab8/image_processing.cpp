@@ -0,0 +1,540 @@
+#include "lab_m2/lab8/image_processing.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "utils/math_utils.h"
+#include "utils/simd_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Rows processed by each job of the thread pool
+static const unsigned int ROWS_PER_BAND = 32;
+
+// Luma weights out of 256, as in the GRAYSCALE shader
+static const int LUMA_R = 54;
+static const int LUMA_G = 182;
+static const int LUMA_B = 18;
+
+
+// Copies a row to `dst`, with `radius` copies of its edge pixels on both sides
+static void PadRow(const unsigned char *src, unsigned char *dst, unsigned int width, unsigned int channels, unsigned int radius)
+{
+    unsigned int rowBytes = width * channels;
+    for (unsigned int i = 0; i < radius; i++)
+    {
+        memcpy(dst + i * channels, src, channels);
+        memcpy(dst + (radius + width + i) * channels, src + rowBytes - channels, channels);
+    }
+    memcpy(dst + radius * channels, src, rowBytes);
+}
+
+
+#if defined(SIMD_SSE2)
+static inline int Load32(const unsigned char *src)
+{
+    int value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+
+// Eight bytes as 16-bit lanes
+static inline __m128i Load8x16(const unsigned char *src)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), _mm_setzero_si128());
+}
+
+
+static inline __m128i Abs16(__m128i value)
+{
+    return _mm_max_epi16(value, _mm_sub_epi16(_mm_setzero_si128(), value));
+}
+#endif
+
+
+// Luma of a row, or its first channel if it has no color
+static void LumaRow(const unsigned char *src, unsigned char *dst, unsigned int width, unsigned int channels)
+{
+    unsigned int x = 0;
+    if (channels < 3)
+    {
+        for (; x < width; x++)
+        {
+            dst[x] = src[x * channels];
+        }
+        return;
+    }
+
+#if defined(SIMD_SSE2)
+    // Reads four bytes from the start of each pixel, so with three channels
+    // the last pixel of the row is left to the scalar loop
+    const __m128i weights = _mm_setr_epi16(LUMA_R, LUMA_G, LUMA_B, 0, LUMA_R, LUMA_G, LUMA_B, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i zero = _mm_setzero_si128();
+    unsigned int simdEnd = channels == 4 ? width : MAX(width, 1u) - 1;
+
+    for (; x + 4 <= simdEnd; x += 4)
+    {
+        const unsigned char *p = src + x * channels;
+        __m128i pixels = _mm_setr_epi32(Load32(p), Load32(p + channels), Load32(p + 2 * channels), Load32(p + 3 * channels));
+
+        // Weighted red and green, then blue, of two pixels per half
+        __m128i low = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+        __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+        __m128 lowf = _mm_castsi128_ps(low), highf = _mm_castsi128_ps(high);
+        __m128i redGreen = _mm_castps_si128(_mm_shuffle_ps(lowf, highf, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i blue = _mm_castps_si128(_mm_shuffle_ps(lowf, highf, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m128i luma = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(redGreen, blue), round), 8);
+        luma = _mm_packs_epi32(luma, luma);
+        luma = _mm_packus_epi16(luma, luma);
+
+        int packed = _mm_cvtsi128_si32(luma);
+        memcpy(dst + x, &packed, sizeof(packed));
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+        const unsigned char *p = src + x * channels;
+        dst[x] = static_cast<unsigned char>((p[0] * LUMA_R + p[1] * LUMA_G + p[2] * LUMA_B + 128) >> 8);
+    }
+}
+
+
+// Writes `gray` to the color channels of `CHANNELS` interleaved ones, and
+// copies the others from `src`
+template <unsigned int CHANNELS>
+static void WriteGrayPixels(const unsigned char *gray, const unsigned char *src, unsigned char *dst, unsigned int begin, unsigned int end)
+{
+    const unsigned int colorChannels = CHANNELS == 2 ? 1 : MIN(CHANNELS, 3u);
+    for (unsigned int x = begin; x < end; x++)
+    {
+        for (unsigned int c = 0; c < colorChannels; c++)
+        {
+            dst[x * CHANNELS + c] = gray[x];
+        }
+        for (unsigned int c = colorChannels; c < CHANNELS; c++)
+        {
+            dst[x * CHANNELS + c] = src[x * CHANNELS + c];
+        }
+    }
+}
+
+
+// Writes `gray` to the color channels of a row, and copies alpha from `src`
+static void WriteGray(const unsigned char *gray, const unsigned char *src, unsigned char *dst, unsigned int width, unsigned int channels)
+{
+    unsigned int x = 0;
+
+#if defined(SIMD_SSE2)
+    if (channels == 4)
+    {
+        const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i value = _mm_unpacklo_epi8(_mm_cvtsi32_si128(Load32(gray + x)), zero);
+            value = _mm_unpacklo_epi16(value, zero);
+            value = _mm_or_si128(value, _mm_or_si128(_mm_slli_epi32(value, 8), _mm_slli_epi32(value, 16)));
+
+            __m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + x * 4)), alphaMask);
+            _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_or_si128(value, alpha));
+        }
+    }
+#endif
+
+    switch (channels)
+    {
+    case 1: WriteGrayPixels<1>(gray, src, dst, x, width); break;
+    case 2: WriteGrayPixels<2>(gray, src, dst, x, width); break;
+    case 3: WriteGrayPixels<3>(gray, src, dst, x, width); break;
+    default: WriteGrayPixels<4>(gray, src, dst, x, width); break;
+    }
+}
+
+
+// dst[i] is the sum of weights[k] * taps[k][i], with weights out of 256
+static void Convolve(const unsigned char *const *taps, const int *weights, unsigned int nrTaps, unsigned char *dst, unsigned int size)
+{
+    unsigned int i = 0;
+
+#if defined(SIMD_SSE2)
+    // Weights add up to 256, so the sums stay within 16 bits
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i low = round, high = round;
+        for (unsigned int k = 0; k < nrTaps; k++)
+        {
+            __m128i weight = _mm_set1_epi16(static_cast<short>(weights[k]));
+            __m128i value = _mm_loadu_si128((const __m128i *)(taps[k] + i));
+            low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(value, zero), weight));
+            high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(value, zero), weight));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        int sum = 128;
+        for (unsigned int k = 0; k < nrTaps; k++)
+        {
+            sum += weights[k] * taps[k][i];
+        }
+        dst[i] = static_cast<unsigned char>(sum >> 8);
+    }
+}
+
+
+// Sobel edge strength of a row of luma, from the rows above and below. The
+// rows are padded with one pixel on each side.
+static void SobelRow(const unsigned char *above, const unsigned char *middle, const unsigned char *below, unsigned char *dst, unsigned int width)
+{
+    unsigned int x = 0;
+
+#if defined(SIMD_SSE2)
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i a0 = Load8x16(above + x), a1 = Load8x16(above + x + 1), a2 = Load8x16(above + x + 2);
+        __m128i m0 = Load8x16(middle + x), m2 = Load8x16(middle + x + 2);
+        __m128i b0 = Load8x16(below + x), b1 = Load8x16(below + x + 1), b2 = Load8x16(below + x + 2);
+
+        __m128i gx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(b2, b0)),
+                                   _mm_slli_epi16(_mm_sub_epi16(m2, m0), 1));
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(b0, b2), _mm_slli_epi16(b1, 1)),
+                                   _mm_add_epi16(_mm_add_epi16(a0, a2), _mm_slli_epi16(a1, 1)));
+
+        __m128i strength = _mm_add_epi16(Abs16(gx), Abs16(gy));
+        _mm_storel_epi64((__m128i *)(dst + x), _mm_packus_epi16(strength, strength));
+    }
+#endif
+
+    for (; x < width; x++)
+    {
+        int gx = (above[x + 2] - above[x]) + 2 * (middle[x + 2] - middle[x]) + (below[x + 2] - below[x]);
+        int gy = (below[x] + 2 * below[x + 1] + below[x + 2]) - (above[x] + 2 * above[x + 1] + above[x + 2]);
+        dst[x] = static_cast<unsigned char>(MIN(std::abs(gx) + std::abs(gy), 255));
+    }
+}
+
+
+static inline unsigned char Min(unsigned char a, unsigned char b)
+{
+    return a < b ? a : b;
+}
+
+
+static inline unsigned char Max(unsigned char a, unsigned char b)
+{
+    return a < b ? b : a;
+}
+
+
+#if defined(SIMD_SSE2)
+static inline __m128i Min(__m128i a, __m128i b)
+{
+    return _mm_min_epu8(a, b);
+}
+
+
+static inline __m128i Max(__m128i a, __m128i b)
+{
+    return _mm_max_epu8(a, b);
+}
+#endif
+
+
+template <typename T>
+static inline void Sort2(T &a, T &b)
+{
+    T low = Min(a, b);
+    b = Max(a, b);
+    a = low;
+}
+
+
+// Median of nine values, with the network of 19 exchanges of Paeth
+template <typename T>
+static T Median9(T *p)
+{
+    Sort2(p[1], p[2]); Sort2(p[4], p[5]); Sort2(p[7], p[8]);
+    Sort2(p[0], p[1]); Sort2(p[3], p[4]); Sort2(p[6], p[7]);
+    Sort2(p[1], p[2]); Sort2(p[4], p[5]); Sort2(p[7], p[8]);
+    Sort2(p[0], p[3]); Sort2(p[5], p[8]); Sort2(p[4], p[7]);
+    Sort2(p[3], p[6]); Sort2(p[1], p[4]); Sort2(p[2], p[5]);
+    Sort2(p[4], p[7]); Sort2(p[4], p[2]); Sort2(p[6], p[4]);
+    Sort2(p[4], p[2]);
+    return p[4];
+}
+
+
+// 3x3 median of every byte of a row, from the rows above and below. The rows
+// are padded with one pixel, `channels` bytes, on each side.
+static void MedianRow(const unsigned char *const *rows, unsigned char *dst, unsigned int size, unsigned int channels)
+{
+    unsigned int i = 0;
+
+#if defined(SIMD_SSE2)
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i p[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            p[k] = _mm_loadu_si128((const __m128i *)(rows[k / 3] + i + (k % 3) * channels));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), Median9(p));
+    }
+#endif
+
+    for (; i < size; i++)
+    {
+        unsigned char p[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            p[k] = rows[k / 3][i + (k % 3) * channels];
+        }
+        dst[i] = Median9(p);
+    }
+}
+
+
+// Maps the color channels of `nrPixels` pixels through `table`, and copies the others
+template <unsigned int CHANNELS>
+static void MapColors(const unsigned char *table, const unsigned char *src, unsigned char *dst, unsigned int nrPixels)
+{
+    const unsigned int colorChannels = CHANNELS == 2 ? 1 : MIN(CHANNELS, 3u);
+    for (unsigned int i = 0; i < nrPixels * CHANNELS; i += CHANNELS)
+    {
+        for (unsigned int c = 0; c < colorChannels; c++)
+        {
+            dst[i + c] = table[src[i + c]];
+        }
+        for (unsigned int c = colorChannels; c < CHANNELS; c++)
+        {
+            dst[i + c] = src[i + c];
+        }
+    }
+}
+
+
+void image_processing::GrayScale(const unsigned char *src, unsigned char *dst,
+                                 unsigned int width, unsigned int height, unsigned int channels)
+{
+    unsigned int rowBytes = width * channels;
+
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        std::vector<unsigned char> luma(width);
+        for (unsigned int y = begin; y < end; y++)
+        {
+            LumaRow(src + y * rowBytes, luma.data(), width, channels);
+            WriteGray(luma.data(), src + y * rowBytes, dst + y * rowBytes, width, channels);
+        }
+    });
+}
+
+
+void image_processing::GaussianBlur(const unsigned char *src, unsigned char *dst,
+                                    unsigned int width, unsigned int height, unsigned int channels, float sigma)
+{
+    unsigned int rowBytes = width * channels;
+    if (sigma <= 0)
+    {
+        memcpy(dst, src, rowBytes * height);
+        return;
+    }
+
+    unsigned int radius = MIN(MAX(static_cast<unsigned int>(std::ceil(3 * sigma)), 1u), MAX_BLUR_RADIUS);
+    unsigned int nrTaps = 2 * radius + 1;
+
+    // Weights out of 256, the rounding error going to the center
+    std::vector<float> gaussian(nrTaps);
+    float sum = 0;
+    for (unsigned int k = 0; k < nrTaps; k++)
+    {
+        float offset = static_cast<float>(k) - radius;
+        gaussian[k] = std::exp(-offset * offset / (2 * sigma * sigma));
+        sum += gaussian[k];
+    }
+
+    std::vector<int> weights(nrTaps);
+    int total = 0;
+    for (unsigned int k = 0; k < nrTaps; k++)
+    {
+        weights[k] = static_cast<int>(std::floor(gaussian[k] / sum * 256 + 0.5f));
+        total += weights[k];
+    }
+    weights[radius] += 256 - total;
+
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        // Rows of the band and of the halo around it, blurred along x
+        unsigned int first = begin > radius ? begin - radius : 0;
+        unsigned int last = MIN(end + radius, height);
+        std::vector<unsigned char> padded((width + 2 * radius) * channels);
+        std::vector<unsigned char> rows((last - first) * rowBytes);
+        std::vector<const unsigned char *> taps(nrTaps);
+
+        for (unsigned int k = 0; k < nrTaps; k++)
+        {
+            taps[k] = padded.data() + k * channels;
+        }
+        for (unsigned int y = first; y < last; y++)
+        {
+            PadRow(src + y * rowBytes, padded.data(), width, channels, radius);
+            Convolve(taps.data(), weights.data(), nrTaps, &rows[(y - first) * rowBytes], rowBytes);
+        }
+
+        // Then along y
+        for (unsigned int y = begin; y < end; y++)
+        {
+            for (unsigned int k = 0; k < nrTaps; k++)
+            {
+                int row = MIN(MAX(static_cast<int>(y + k) - static_cast<int>(radius), static_cast<int>(first)), static_cast<int>(last) - 1);
+                taps[k] = &rows[(row - first) * rowBytes];
+            }
+            Convolve(taps.data(), weights.data(), nrTaps, dst + y * rowBytes, rowBytes);
+        }
+    });
+}
+
+
+void image_processing::Sobel(const unsigned char *src, unsigned char *dst,
+                             unsigned int width, unsigned int height, unsigned int channels)
+{
+    unsigned int rowBytes = width * channels;
+    unsigned int paddedWidth = width + 2;
+
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        // Luma of the band and of the rows around it
+        unsigned int first = begin ? begin - 1 : 0;
+        unsigned int last = MIN(end + 1, height);
+        std::vector<unsigned char> luma(width), edges(width);
+        std::vector<unsigned char> rows((last - first) * paddedWidth);
+
+        for (unsigned int y = first; y < last; y++)
+        {
+            LumaRow(src + y * rowBytes, luma.data(), width, channels);
+            PadRow(luma.data(), &rows[(y - first) * paddedWidth], width, 1, 1);
+        }
+
+        for (unsigned int y = begin; y < end; y++)
+        {
+            const unsigned char *above = &rows[((y ? y - 1 : 0) - first) * paddedWidth];
+            const unsigned char *middle = &rows[(y - first) * paddedWidth];
+            const unsigned char *below = &rows[(MIN(y + 1, height - 1) - first) * paddedWidth];
+
+            SobelRow(above, middle, below, edges.data(), width);
+            WriteGray(edges.data(), src + y * rowBytes, dst + y * rowBytes, width, channels);
+        }
+    });
+}
+
+
+void image_processing::Median(const unsigned char *src, unsigned char *dst,
+                              unsigned int width, unsigned int height, unsigned int channels)
+{
+    unsigned int rowBytes = width * channels;
+    unsigned int paddedBytes = rowBytes + 2 * channels;
+
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        unsigned int first = begin ? begin - 1 : 0;
+        unsigned int last = MIN(end + 1, height);
+        std::vector<unsigned char> rows((last - first) * paddedBytes);
+
+        for (unsigned int y = first; y < last; y++)
+        {
+            PadRow(src + y * rowBytes, &rows[(y - first) * paddedBytes], width, channels, 1);
+        }
+
+        for (unsigned int y = begin; y < end; y++)
+        {
+            const unsigned char *neighbors[3] =
+            {
+                &rows[((y ? y - 1 : 0) - first) * paddedBytes],
+                &rows[(y - first) * paddedBytes],
+                &rows[(MIN(y + 1, height - 1) - first) * paddedBytes]
+            };
+            MedianRow(neighbors, dst + y * rowBytes, rowBytes, channels);
+        }
+    });
+}
+
+
+void image_processing::EqualizeHistogram(const unsigned char *src, unsigned char *dst,
+                                         unsigned int width, unsigned int height, unsigned int channels)
+{
+    unsigned int rowBytes = width * channels;
+    unsigned int nrBands = (height + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+
+    // Each band counts in its own histogram, so they need no locking. Bands
+    // start at multiples of ROWS_PER_BAND.
+    std::vector<unsigned int> histograms(nrBands * 256, 0);
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        unsigned int *histogram = &histograms[begin / ROWS_PER_BAND * 256];
+        std::vector<unsigned char> luma(width);
+        for (unsigned int y = begin; y < end; y++)
+        {
+            LumaRow(src + y * rowBytes, luma.data(), width, channels);
+            for (unsigned int x = 0; x < width; x++)
+            {
+                histogram[luma[x]]++;
+            }
+        }
+    });
+
+    unsigned int cumulative[256];
+    unsigned int count = 0;
+    for (unsigned int value = 0; value < 256; value++)
+    {
+        for (unsigned int band = 0; band < nrBands; band++)
+        {
+            count += histograms[band * 256 + value];
+        }
+        cumulative[value] = count;
+    }
+
+    // The darkest value present maps to 0, and the brightest to 255
+    unsigned int darkest = 0;
+    for (unsigned int value = 0; value < 256 && !darkest; value++)
+    {
+        darkest = cumulative[value];
+    }
+
+    unsigned char table[256];
+    unsigned int range = count - darkest;
+    for (unsigned int value = 0; value < 256; value++)
+    {
+        if (range == 0)
+            table[value] = static_cast<unsigned char>(value);
+        else if (cumulative[value] <= darkest)
+            table[value] = 0;
+        else
+            table[value] = static_cast<unsigned char>((static_cast<unsigned long long>(cumulative[value] - darkest) * 255 + range / 2) / range);
+    }
+
+    thread_utils::ParallelFor(0, height, ROWS_PER_BAND, [&](unsigned int begin, unsigned int end)
+    {
+        const unsigned char *first = src + begin * rowBytes;
+        unsigned char *out = dst + begin * rowBytes;
+        unsigned int nrPixels = (end - begin) * width;
+
+        switch (channels)
+        {
+        case 1: MapColors<1>(table, first, out, nrPixels); break;
+        case 2: MapColors<2>(table, first, out, nrPixels); break;
+        case 3: MapColors<3>(table, first, out, nrPixels); break;
+        default: MapColors<4>(table, first, out, nrPixels); break;
+        }
+    });
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+
+// -------------------------------------------------------------------------
+// CPU image processing kernels. Images hold 8-bit channels, `channels` per
+// pixel interleaved, with tightly packed rows. The rows are split in bands
+// processed in parallel on the shared thread pool, and each band runs 16
+// bytes at a time with SSE2 where the compiler targets it.
+//
+// The kernels read `src` and write `dst`, which must not overlap. Kernels
+// working on the color leave alpha, the second channel of two and the
+// fourth of four, as it is. Pixels past the edges repeat the edge pixels.
+namespace image_processing
+{
+    // Luma, with the weights of the GRAYSCALE shader, in every color channel
+    void GrayScale(const unsigned char *src, unsigned char *dst,
+                   unsigned int width, unsigned int height, unsigned int channels);
+
+    // Separable Gaussian blur of every channel. The kernel reaches three
+    // standard deviations, up to MAX_BLUR_RADIUS pixels.
+    void GaussianBlur(const unsigned char *src, unsigned char *dst,
+                      unsigned int width, unsigned int height, unsigned int channels, float sigma);
+
+    // Edge strength, the sum of the absolute 3x3 Sobel gradients of the luma
+    void Sobel(const unsigned char *src, unsigned char *dst,
+               unsigned int width, unsigned int height, unsigned int channels);
+
+    // Median of the 3x3 neighborhood, of every channel on its own
+    void Median(const unsigned char *src, unsigned char *dst,
+                unsigned int width, unsigned int height, unsigned int channels);
+
+    // Spreads the histogram of the luma over the whole range, and maps every
+    // color channel through the same table
+    void EqualizeHistogram(const unsigned char *src, unsigned char *dst,
+                           unsigned int width, unsigned int height, unsigned int channels);
+
+    static const unsigned int MAX_BLUR_RADIUS = 32;
+}
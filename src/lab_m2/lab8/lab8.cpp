@@ -1,9 +1,16 @@
 #include "lab_m2/lab8/lab8.h"
 
 #include <vector>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <functional>
+#include <memory>
 
+#include "lab_m2/lab8/image_processing.h"
+#include "lab_m2/lab8/tiled_pipeline.h"
 #include "pfd/portable-file-dialogs.h"
+#include "stb/stb_image.h"
 
 using namespace std;
 using namespace m2;
@@ -20,12 +27,15 @@ Lab8::Lab8()
     outputMode = 0;
     gpuProcessing = false;
     saveScreenToImage = false;
+    capture = nullptr;
     window->SetSize(600, 600);
 }
 
 
 Lab8::~Lab8()
 {
+    // Waits for the images still being saved
+    delete capture;
 }
 
 
@@ -50,9 +60,16 @@ void Lab8::Init()
         shader->AddShader(PATH_JOIN(shaderPath, "VertexShader.glsl"), GL_VERTEX_SHADER);
         shader->AddShader(PATH_JOIN(shaderPath, "FragmentShader.glsl"), GL_FRAGMENT_SHADER);
 
+        // Variant of the program for each output mode
+        outputModeFeatures[0] = 0;
+        outputModeFeatures[1] = shader->AddFeature("GRAYSCALE");
+        outputModeFeatures[2] = shader->AddFeature("BLUR");
+
         shader->CreateAndLink();
         shaders[shader->GetName()] = shader;
     }
+
+    capture = new FrameCapture();
 }
 
 
@@ -65,7 +82,8 @@ void Lab8::Update(float deltaTimeSeconds)
 {
     ClearScreen();
 
-    auto shader = shaders["ImageProcessing"];
+    // On the CPU the image is processed already, and only drawn
+    auto shader = shaders["ImageProcessing"]->GetVariant(gpuProcessing ? outputModeFeatures[outputMode] : 0);
     shader->Use();
 
     if (saveScreenToImage)
@@ -74,15 +92,12 @@ void Lab8::Update(float deltaTimeSeconds)
     }
 
     int flip_loc = shader->GetUniformLocation("flipVertical");
-    glUniform1i(flip_loc, saveScreenToImage ? 0 : 1);
+    glUniform1i(flip_loc, 1);
 
     int screenSize_loc = shader->GetUniformLocation("screenSize");
     glm::ivec2 resolution = window->GetResolution();
     glUniform2i(screenSize_loc, resolution.x, resolution.y);
 
-    int outputMode_loc = shader->GetUniformLocation("outputMode");
-    glUniform1i(outputMode_loc, outputMode);
-
     int locTexture = shader->GetUniformLocation("textureImage");
     glUniform1i(locTexture, 0);
 
@@ -95,15 +110,11 @@ void Lab8::Update(float deltaTimeSeconds)
     {
         saveScreenToImage = false;
 
-        GLenum format = GL_RGB;
-        if (originalImage->GetNrChannels() == 4)
-        {
-            format = GL_RGBA;
-        }
-
-        glReadPixels(0, 0, originalImage->GetWidth(), originalImage->GetHeight(), format, GL_UNSIGNED_BYTE, processedImage->GetImageData());
-        processedImage->UploadNewData(processedImage->GetImageData());
-        SaveImage("shader_processing_" + std::to_string(outputMode));
+        // Read back and written over the next frames
+        std::string fileName = "shader_processing_" + std::to_string(outputMode) + ".png";
+        unsigned int channels = (originalImage->GetNrChannels() == 4) ? 4 : 3;
+        capture->CaptureFrameBuffer(0, 0, originalImage->GetWidth(), originalImage->GetHeight(), channels, fileName);
+        cout << "Saving " << fileName << endl;
 
         float aspectRatio = static_cast<float>(originalImage->GetWidth()) / originalImage->GetHeight();
         window->SetSize(static_cast<int>(600 * aspectRatio), 600);
@@ -113,6 +124,7 @@ void Lab8::Update(float deltaTimeSeconds)
 
 void Lab8::FrameEnd()
 {
+    capture->Update();
     DrawCoordinateSystem();
 }
 
@@ -122,6 +134,18 @@ void Lab8::OnFileSelected(const std::string &fileName)
     if (fileName.size())
     {
         std::cout << fileName << endl;
+
+        // Images too large for a texture, or in a format stb_image cannot
+        // read, go through the tiled pipeline
+        int width, height, channels;
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+        if (!stbi_info(fileName.c_str(), &width, &height, &channels) || width > maxSize || height > maxSize)
+        {
+            ProcessTiled(fileName);
+            return;
+        }
+
         originalImage = TextureManager::LoadTexture(fileName, nullptr, "image", true, true);
         processedImage = TextureManager::LoadTexture(fileName, nullptr, "newImage", true, true);
 
@@ -131,6 +155,42 @@ void Lab8::OnFileSelected(const std::string &fileName)
 }
 
 
+void Lab8::ProcessImage()
+{
+    unsigned int width = originalImage->GetWidth();
+    unsigned int height = originalImage->GetHeight();
+    unsigned int channels = originalImage->GetNrChannels();
+    const unsigned char* data = originalImage->GetImageData();
+    unsigned char* newData = processedImage->GetImageData();
+
+    switch (outputMode)
+    {
+    case 1:
+        image_processing::GrayScale(data, newData, width, height, channels);
+        break;
+    case 2:
+        // Same footprint as the 7x7 blur of the shader
+        image_processing::GaussianBlur(data, newData, width, height, channels, 1.0f);
+        break;
+    case 3:
+        image_processing::Sobel(data, newData, width, height, channels);
+        break;
+    case 4:
+        image_processing::Median(data, newData, width, height, channels);
+        break;
+    case 5:
+        image_processing::EqualizeHistogram(data, newData, width, height, channels);
+        break;
+    default:
+        memcpy(newData, data, width * height * channels);
+        break;
+    }
+
+    processedImage->UploadNewData(newData);
+}
+
+
+// Scalar version of image_processing::GrayScale, kept to compare against
 void Lab8::GrayScale()
 {
     unsigned int channels = originalImage->GetNrChannels();
@@ -153,24 +213,152 @@ void Lab8::GrayScale()
             memset(&newData[offset], value, 3);
         }
     }
+}
 
-    processedImage->UploadNewData(newData);
+
+void Lab8::RunBenchmark()
+{
+    static const int kNrRuns = 10;
+
+    unsigned int width = originalImage->GetWidth();
+    unsigned int height = originalImage->GetHeight();
+    unsigned int channels = originalImage->GetNrChannels();
+    const unsigned char* data = originalImage->GetImageData();
+    std::vector<unsigned char> newData(width * height * channels);
+
+    auto timeCPU = [&](const std::function<void()> &kernel)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < kNrRuns; run++)
+        {
+            kernel();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kNrRuns;
+    };
+
+    // The shader draws the image to a target of its size
+    FrameBuffer target;
+    target.Generate(width, height, 1, false);
+
+    unsigned int query;
+    glGenQueries(1, &query);
+
+    auto timeGPU = [&](uint64_t features)
+    {
+        Shader *shader = shaders["ImageProcessing"]->GetVariant(features);
+        shader->Use();
+        glUniform1i(shader->GetUniformLocation("flipVertical"), 0);
+        glUniform2i(shader->GetUniformLocation("screenSize"), width, height);
+        glUniform1i(shader->GetUniformLocation("textureImage"), 0);
+        originalImage->BindToTextureUnit(GL_TEXTURE0);
+
+        target.Bind();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int run = 0; run < kNrRuns; run++)
+        {
+            RenderMesh(meshes["quad"], shader, glm::mat4(1));
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+
+        // Waits for the GPU
+        GLuint64 time = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &time);
+        return time / 1e6 / kNrRuns;
+    };
+
+    unsigned char* out = newData.data();
+    cout << width << " x " << height << " x " << channels << ", " << kNrRuns << " runs" << endl;
+    cout << "kernel\tscalar (ms)\tCPU (ms)\tGPU (ms)" << endl;
+    cout << "grayscale\t" << timeCPU([&]() { GrayScale(); }) << "\t"
+         << timeCPU([&]() { image_processing::GrayScale(data, out, width, height, channels); }) << "\t"
+         << timeGPU(outputModeFeatures[1]) << endl;
+    cout << "blur\t-\t"
+         << timeCPU([&]() { image_processing::GaussianBlur(data, out, width, height, channels, 1.0f); }) << "\t"
+         << timeGPU(outputModeFeatures[2]) << endl;
+    cout << "sobel\t-\t" << timeCPU([&]() { image_processing::Sobel(data, out, width, height, channels); }) << "\t-" << endl;
+    cout << "median\t-\t" << timeCPU([&]() { image_processing::Median(data, out, width, height, channels); }) << "\t-" << endl;
+    cout << "equalize\t-\t" << timeCPU([&]() { image_processing::EqualizeHistogram(data, out, width, height, channels); }) << "\t-" << endl;
+
+    glDeleteQueries(1, &query);
+    target.Clean();
+    FrameBuffer::BindDefault(window->GetResolution());
+
+    // The scalar loop wrote over the processed image
+    ProcessImage();
 }
 
 
 void Lab8::SaveImage(const std::string &fileName)
 {
-    cout << "Saving image! ";
-    processedImage->SaveToFile((fileName + ".png").c_str());
-    cout << "[Done]" << endl;
+    cout << "Saving " << fileName << ".png" << endl;
+    capture->CaptureTexture(processedImage, fileName + ".png");
 }
 
 
-void Lab8::OpenDialog()
+void Lab8::ProcessTiled(const std::string &fileName)
+{
+    TiledPipeline pipeline;
+    switch (outputMode)
+    {
+    case 1:
+        pipeline.AddFilter(TileFilter::GrayScale());
+        break;
+    case 2:
+        pipeline.AddFilter(TileFilter::GaussianBlur(1.0f));
+        break;
+    case 3:
+        pipeline.AddFilter(TileFilter::Sobel());
+        break;
+    case 4:
+        pipeline.AddFilter(TileFilter::Median());
+        break;
+    case 5:
+        cout << "Histogram equalization needs the whole image, and has no tiled version" << endl;
+        return;
+    }
+
+    std::unique_ptr<ImageReader> reader(ImageReader::Open(fileName));
+    if (!reader)
+    {
+        cout << "Cannot read " << fileName << endl;
+        return;
+    }
+
+    // Written as the strips are done, in the Netpbm format for the channels
+    static const char *extensions[5] = { "", ".pgm", ".pam", ".ppm", ".pam" };
+    unsigned int width = reader->GetWidth();
+    unsigned int height = reader->GetHeight();
+    unsigned int channels = reader->GetNrChannels();
+    std::string outputFile = fileName.substr(0, fileName.find_last_of('.')) + "_tiled_" + std::to_string(outputMode) + extensions[channels];
+
+    std::unique_ptr<ImageWriter> writer(ImageWriter::Create(outputFile, width, height, channels));
+    if (!writer)
+    {
+        cout << "Cannot write " << outputFile << endl;
+        return;
+    }
+
+    cout << "Processing " << width << " x " << height << " in tiles ";
+    auto start = std::chrono::steady_clock::now();
+    bool done = pipeline.Run(*reader, *writer) && writer->Close();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (done)
+    {
+        cout << "[Done] " << outputFile << ", " << width * (double)height / 1e6 / seconds << " MP/s" << endl;
+    }
+    else
+    {
+        cout << "[Failed]" << endl;
+    }
+}
+
+
+std::string Lab8::OpenDialog()
 {
     std::vector<std::string> filters =
     {
-        "Image Files", "*.png *.jpg *.jpeg *.bmp",
+        "Image Files", "*.png *.jpg *.jpeg *.bmp *.pgm *.ppm *.pam",
         "All Files", "*"
     };
 
@@ -178,8 +366,10 @@ void Lab8::OpenDialog()
     if (!selection.empty())
     {
         std::cout << "User selected file " << selection[0] << "\n";
-        OnFileSelected(selection[0]);
+        return selection[0];
     }
+
+    return "";
 }
 
 
@@ -200,28 +390,48 @@ void Lab8::OnKeyPress(int key, int mods)
     // Add key press event
     if (key == GLFW_KEY_F || key == GLFW_KEY_ENTER || key == GLFW_KEY_SPACE)
     {
-        OpenDialog();
+        OnFileSelected(OpenDialog());
     }
 
-    if (key == GLFW_KEY_E)
+    // Filters a file with the current CPU mode without loading it whole
+    if (key == GLFW_KEY_T)
     {
-        gpuProcessing = !gpuProcessing;
-        if (gpuProcessing == false)
+        std::string fileName = OpenDialog();
+        if (fileName.size())
         {
-            outputMode = 0;
+            ProcessTiled(fileName);
         }
+    }
+
+    if (key == GLFW_KEY_E)
+    {
+        gpuProcessing = !gpuProcessing;
+
+        // The shader has fewer modes than the CPU
+        outputMode = 0;
         cout << "Processing on GPU: " << (gpuProcessing ? "true" : "false") << endl;
     }
 
-    if (key - GLFW_KEY_0 >= 0 && key < GLFW_KEY_3)
+    // On the GPU: 0 original, 1 grayscale, 2 blur. On the CPU also 3 Sobel,
+    // 4 median and 5 histogram equalization.
+    if (key >= GLFW_KEY_0 && key <= GLFW_KEY_5)
     {
-        outputMode = key - GLFW_KEY_0;
+        int mode = key - GLFW_KEY_0;
 
         if (gpuProcessing == false)
         {
-            outputMode = 0;
-            GrayScale();
+            outputMode = mode;
+            ProcessImage();
         }
+        else if (mode < 3)
+        {
+            outputMode = mode;
+        }
+    }
+
+    if (key == GLFW_KEY_B)
+    {
+        RunBenchmark();
     }
 
     if (key == GLFW_KEY_S && mods & GLFW_MOD_CONTROL)
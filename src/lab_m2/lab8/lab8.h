@@ -4,6 +4,7 @@
 
 #include "components/simple_scene.h"
 #include "core/gpu/frame_buffer.h"
+#include "core/gpu/frame_capture.h"
 
 
 namespace m2
@@ -30,19 +31,28 @@ namespace m2
         void OnMouseScroll(int mouseX, int mouseY, int offsetX, int offsetY) override;
         void OnWindowResize(int width, int height) override;
 
-        void OpenDialog();
+        std::string OpenDialog();
         void OnFileSelected(const std::string &fileName);
 
+        // Filters a file of any size in tiles, to a file next to it
+        void ProcessTiled(const std::string &fileName);
+
         // Processing effects
+        void ProcessImage();
         void GrayScale();
         void SaveImage(const std::string &fileName);
 
+        // Times the CPU kernels against the scalar loop and the shader
+        void RunBenchmark();
+
      private:
         Texture2D *originalImage;
         Texture2D *processedImage;
 
         int outputMode;
+        uint64_t outputModeFeatures[3];
         bool gpuProcessing;
         bool saveScreenToImage;
+        FrameCapture *capture;
     };
 }   // namespace m2
@@ -7,7 +7,6 @@ in vec2 texture_coord;
 uniform sampler2D textureImage;
 uniform ivec2 screenSize;
 uniform int flipVertical;
-uniform int outputMode = 2; // 0: original, 1: grayscale, 2: blur
 
 // Output
 layout(location = 0) out vec4 out_color;
@@ -20,7 +19,7 @@ vec4 grayscale()
 {
     vec4 color = texture(textureImage, textureCoord);
     float gray = 0.21 * color.r + 0.71 * color.g + 0.07 * color.b; 
-    return vec4(gray, gray, gray,  0);
+    return vec4(gray, gray, gray, color.a);
 }
 
 
@@ -43,22 +42,13 @@ vec4 blur(int blurRadius)
 
 void main()
 {
-    switch (outputMode)
-    {
-        case 1:
-        {
-            out_color = grayscale();
-            break;
-        }
-
-        case 2:
-        {
-            out_color = blur(3);
-            break;
-        }
-
-        default:
-            out_color = texture(textureImage, textureCoord);
-            break;
-    }
+    // The output mode is selected by compiling a variant of the program
+    // with GRAYSCALE or BLUR defined, instead of branching on a uniform
+#if defined(GRAYSCALE)
+    out_color = grayscale();
+#elif defined(BLUR)
+    out_color = blur(3);
+#else
+    out_color = texture(textureImage, textureCoord);
+#endif
 }
@@ -0,0 +1,465 @@
+#include "lab_m2/lab8/tiled_pipeline.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <iostream>
+#include <algorithm>
+
+#include "lab_m2/lab8/image_processing.h"
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+#include "utils/math_utils.h"
+#include "utils/thread_utils.h"
+
+
+// Lowercase extension of `fileName`, without the dot
+static std::string GetExtension(const std::string &fileName)
+{
+    size_t dot = fileName.find_last_of('.');
+    if (dot == std::string::npos)
+        return "";
+
+    std::string extension = fileName.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
+
+
+// -------------------------------------------------------------------------
+// Binary PGM (P5), PPM (P6) and PAM (P7) files with 8-bit channels, whose
+// pixels follow the header as they are in memory
+class NetpbmReader : public ImageReader
+{
+ public:
+    bool Open(const std::string &fileName)
+    {
+        file.open(fileName, std::ios::binary);
+        if (!file)
+            return false;
+
+        std::string magic;
+        if (!ReadToken(magic))
+            return false;
+
+        unsigned int maxValue = 0;
+        if (magic == "P5" || magic == "P6")
+        {
+            std::string w, h, m;
+            if (!ReadToken(w) || !ReadToken(h) || !ReadToken(m))
+                return false;
+
+            width = std::stoul(w);
+            height = std::stoul(h);
+            maxValue = std::stoul(m);
+            channels = magic == "P5" ? 1 : 3;
+        }
+        else if (magic == "P7")
+        {
+            width = height = channels = 0;
+            std::string line;
+            while (std::getline(file, line) && line != "ENDHDR")
+            {
+                std::istringstream fields(line);
+                std::string key;
+                fields >> key;
+                if (key == "WIDTH") fields >> width;
+                else if (key == "HEIGHT") fields >> height;
+                else if (key == "DEPTH") fields >> channels;
+                else if (key == "MAXVAL") fields >> maxValue;
+            }
+        }
+
+        if (maxValue != 255 || !width || !height || channels < 1 || channels > 4)
+        {
+            std::cout << fileName << ": only 8-bit PGM, PPM and PAM files with 1 to 4 channels are supported" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadRows(unsigned char *rows, unsigned int nrRows) override
+    {
+        std::streamsize size = static_cast<std::streamsize>(nrRows) * width * channels;
+        return file.read(reinterpret_cast<char *>(rows), size).gcount() == size;
+    }
+
+ private:
+    // Next word of a PGM or PPM header, skipping comments. Consumes the
+    // single whitespace after it, which ends the header after the last word.
+    bool ReadToken(std::string &token)
+    {
+        token.clear();
+        int c;
+        while ((c = file.get()) != EOF)
+        {
+            if (c == '#' && token.empty())
+            {
+                while ((c = file.get()) != EOF && c != '\n');
+                continue;
+            }
+            if (std::isspace(c))
+            {
+                if (!token.empty())
+                    return true;
+                continue;
+            }
+            token += static_cast<char>(c);
+        }
+        return !token.empty();
+    }
+
+ private:
+    std::ifstream file;
+};
+
+
+// -------------------------------------------------------------------------
+// Any format stb_image reads, decoded whole
+class StbReader : public ImageReader
+{
+ public:
+    StbReader() : pixels(nullptr), nextRow(0) {}
+    ~StbReader() { stbi_image_free(pixels); }
+
+    bool Open(const std::string &fileName)
+    {
+        int w, h, c;
+        pixels = stbi_load(fileName.c_str(), &w, &h, &c, 0);
+        if (!pixels)
+            return false;
+
+        width = w;
+        height = h;
+        channels = c;
+        return true;
+    }
+
+    bool ReadRows(unsigned char *rows, unsigned int nrRows) override
+    {
+        if (nextRow + nrRows > height)
+            return false;
+
+        size_t rowBytes = static_cast<size_t>(width) * channels;
+        memcpy(rows, pixels + nextRow * rowBytes, nrRows * rowBytes);
+        nextRow += nrRows;
+        return true;
+    }
+
+ private:
+    unsigned char *pixels;
+    unsigned int nextRow;
+};
+
+
+ImageReader *ImageReader::Open(const std::string &fileName)
+{
+    std::string extension = GetExtension(fileName);
+    if (extension == "pgm" || extension == "ppm" || extension == "pnm" || extension == "pam")
+    {
+        NetpbmReader *reader = new NetpbmReader();
+        if (reader->Open(fileName))
+            return reader;
+        delete reader;
+        return nullptr;
+    }
+
+    StbReader *reader = new StbReader();
+    if (reader->Open(fileName))
+        return reader;
+    delete reader;
+    return nullptr;
+}
+
+
+// -------------------------------------------------------------------------
+class NetpbmWriter : public ImageWriter
+{
+ public:
+    NetpbmWriter() : rowBytes(0), rowsLeft(0) {}
+
+    bool Open(const std::string &fileName, unsigned int width, unsigned int height, unsigned int channels)
+    {
+        file.open(fileName, std::ios::binary);
+        if (!file)
+            return false;
+
+        // PGM and PPM are the most widely read, PAM covers alpha
+        if (channels == 1 || channels == 3)
+        {
+            file << (channels == 1 ? "P5" : "P6") << "\n" << width << " " << height << "\n255\n";
+        }
+        else
+        {
+            file << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH " << channels
+                 << "\nMAXVAL 255\nTUPLTYPE " << (channels == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA") << "\nENDHDR\n";
+        }
+
+        rowBytes = static_cast<size_t>(width) * channels;
+        rowsLeft = height;
+        return static_cast<bool>(file);
+    }
+
+    bool WriteRows(const unsigned char *rows, unsigned int nrRows) override
+    {
+        if (nrRows > rowsLeft)
+            return false;
+
+        rowsLeft -= nrRows;
+        return static_cast<bool>(file.write(reinterpret_cast<const char *>(rows), nrRows * rowBytes));
+    }
+
+    bool Close() override
+    {
+        file.close();
+        return rowsLeft == 0 && !file.fail();
+    }
+
+ private:
+    std::ofstream file;
+    size_t rowBytes;
+    unsigned int rowsLeft;
+};
+
+
+// -------------------------------------------------------------------------
+class StbWriter : public ImageWriter
+{
+ public:
+    StbWriter(const std::string &fileName, unsigned int width, unsigned int height, unsigned int channels)
+        : fileName(fileName), width(width), height(height), channels(channels)
+    {
+        pixels.reserve(static_cast<size_t>(width) * height * channels);
+    }
+
+    bool WriteRows(const unsigned char *rows, unsigned int nrRows) override
+    {
+        pixels.insert(pixels.end(), rows, rows + static_cast<size_t>(nrRows) * width * channels);
+        return pixels.size() <= static_cast<size_t>(width) * height * channels;
+    }
+
+    bool Close() override
+    {
+        if (pixels.size() != static_cast<size_t>(width) * height * channels)
+            return false;
+
+        std::string extension = GetExtension(fileName);
+        const char *name = fileName.c_str();
+        int w = width, h = height, c = channels;
+
+        if (extension == "jpg" || extension == "jpeg")
+            return stbi_write_jpg(name, w, h, c, pixels.data(), 90) != 0;
+        if (extension == "bmp")
+            return stbi_write_bmp(name, w, h, c, pixels.data()) != 0;
+        if (extension == "tga")
+            return stbi_write_tga(name, w, h, c, pixels.data()) != 0;
+        return stbi_write_png(name, w, h, c, pixels.data(), w * c) != 0;
+    }
+
+ private:
+    std::string fileName;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    std::vector<unsigned char> pixels;
+};
+
+
+ImageWriter *ImageWriter::Create(const std::string &fileName, unsigned int width, unsigned int height, unsigned int channels)
+{
+    std::string extension = GetExtension(fileName);
+    if (extension == "pgm" || extension == "ppm" || extension == "pnm" || extension == "pam")
+    {
+        NetpbmWriter *writer = new NetpbmWriter();
+        if (writer->Open(fileName, width, height, channels))
+            return writer;
+        delete writer;
+        return nullptr;
+    }
+
+    if (extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "bmp" || extension == "tga")
+        return new StbWriter(fileName, width, height, channels);
+
+    std::cout << fileName << ": unknown image format" << std::endl;
+    return nullptr;
+}
+
+
+// -------------------------------------------------------------------------
+TileFilter TileFilter::GrayScale()
+{
+    TileFilter filter;
+    filter.apply = image_processing::GrayScale;
+    filter.halo = 0;
+    return filter;
+}
+
+
+TileFilter TileFilter::GaussianBlur(float sigma)
+{
+    TileFilter filter;
+    filter.apply = [sigma](const unsigned char *src, unsigned char *dst, unsigned int width, unsigned int height, unsigned int channels)
+    {
+        image_processing::GaussianBlur(src, dst, width, height, channels, sigma);
+    };
+    filter.halo = sigma > 0 ? MIN(MAX(static_cast<unsigned int>(std::ceil(3 * sigma)), 1u), image_processing::MAX_BLUR_RADIUS) : 0;
+    return filter;
+}
+
+
+TileFilter TileFilter::Sobel()
+{
+    TileFilter filter;
+    filter.apply = image_processing::Sobel;
+    filter.halo = 1;
+    return filter;
+}
+
+
+TileFilter TileFilter::Median()
+{
+    TileFilter filter;
+    filter.apply = image_processing::Median;
+    filter.halo = 1;
+    return filter;
+}
+
+
+// -------------------------------------------------------------------------
+TiledPipeline::TiledPipeline(unsigned int tileSize)
+{
+    this->tileSize = MAX(tileSize, 1u);
+}
+
+
+void TiledPipeline::AddFilter(const TileFilter &filter)
+{
+    filters.push_back(filter);
+}
+
+
+void TiledPipeline::ClearFilters()
+{
+    filters.clear();
+}
+
+
+unsigned int TiledPipeline::GetHalo() const
+{
+    unsigned int halo = 0;
+    for (const TileFilter &filter : filters)
+    {
+        halo += filter.halo;
+    }
+    return halo;
+}
+
+
+bool TiledPipeline::Run(ImageReader &reader, ImageWriter &writer)
+{
+    unsigned int width = reader.GetWidth();
+    unsigned int height = reader.GetHeight();
+    unsigned int channels = reader.GetNrChannels();
+    unsigned int halo = GetHalo();
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+
+    // Rows [stripFirst, stripLast) of the image: a strip and its halo
+    std::vector<unsigned char> strip((tileSize + 2 * halo) * rowBytes);
+    std::vector<unsigned char> output(tileSize * rowBytes);
+    unsigned int stripFirst = 0;
+    unsigned int stripLast = 0;
+    unsigned int nrTiles = (width + tileSize - 1) / tileSize;
+
+    for (unsigned int y0 = 0; y0 < height; y0 += tileSize)
+    {
+        unsigned int y1 = MIN(y0 + tileSize, height);
+        unsigned int first = y0 > halo ? y0 - halo : 0;
+        unsigned int last = MIN(y1 + halo, height);
+
+        // Keeps the rows the last strip shares with this one, and reads the rest
+        unsigned int kept = stripLast > first ? stripLast - first : 0;
+        memmove(strip.data(), strip.data() + (first - stripFirst) * rowBytes, kept * rowBytes);
+        if (!reader.ReadRows(strip.data() + kept * rowBytes, last - first - kept))
+        {
+            std::cout << "Failed to read rows " << first + kept << " to " << last << std::endl;
+            return false;
+        }
+        stripFirst = first;
+        stripLast = last;
+
+        thread_utils::ParallelFor(0, nrTiles, 1, [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int tile = begin; tile < end; tile++)
+            {
+                unsigned int x0 = tile * tileSize;
+                unsigned int x1 = MIN(x0 + tileSize, width);
+                ProcessTile(strip.data(), stripFirst, stripLast, x0, x1, y0, y1, width, channels, output.data());
+            }
+        });
+
+        if (!writer.WriteRows(output.data(), y1 - y0))
+        {
+            std::cout << "Failed to write rows " << y0 << " to " << y1 << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool TiledPipeline::Run(const std::string &inputFile, const std::string &outputFile)
+{
+    std::unique_ptr<ImageReader> reader(ImageReader::Open(inputFile));
+    if (!reader)
+    {
+        std::cout << "Cannot read " << inputFile << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<ImageWriter> writer(ImageWriter::Create(outputFile, reader->GetWidth(), reader->GetHeight(), reader->GetNrChannels()));
+    if (!writer)
+    {
+        std::cout << "Cannot write " << outputFile << std::endl;
+        return false;
+    }
+
+    return Run(*reader, *writer) && writer->Close();
+}
+
+
+void TiledPipeline::ProcessTile(const unsigned char *strip, unsigned int stripFirst, unsigned int stripLast,
+                                unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1,
+                                unsigned int width, unsigned int channels, unsigned char *output) const
+{
+    // The tile and its halo, stopping at the edges of the image
+    unsigned int halo = GetHalo();
+    unsigned int left = x0 > halo ? x0 - halo : 0;
+    unsigned int right = MIN(x1 + halo, width);
+    unsigned int tileWidth = right - left;
+    unsigned int tileHeight = stripLast - stripFirst;
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    size_t tileRowBytes = static_cast<size_t>(tileWidth) * channels;
+
+    std::vector<unsigned char> tile(tileHeight * tileRowBytes), filtered(tile.size());
+    for (unsigned int y = 0; y < tileHeight; y++)
+    {
+        memcpy(&tile[y * tileRowBytes], strip + y * rowBytes + left * channels, tileRowBytes);
+    }
+
+    for (const TileFilter &filter : filters)
+    {
+        filter.apply(tile.data(), filtered.data(), tileWidth, tileHeight, channels);
+        tile.swap(filtered);
+    }
+
+    // Only the tile itself is kept, the filters ran out of pixels in the halo
+    size_t bytes = static_cast<size_t>(x1 - x0) * channels;
+    for (unsigned int y = y0; y < y1; y++)
+    {
+        memcpy(output + (y - y0) * rowBytes + x0 * channels, &tile[(y - stripFirst) * tileRowBytes + (x0 - left) * channels], bytes);
+    }
+}
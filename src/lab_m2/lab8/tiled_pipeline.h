@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+
+// Source of image rows, read from the top down, with 8-bit channels
+class ImageReader
+{
+ public:
+    virtual ~ImageReader() {}
+
+    // Reads the next `nrRows` rows, tightly packed, to `rows`
+    virtual bool ReadRows(unsigned char *rows, unsigned int nrRows) = 0;
+
+    unsigned int GetWidth() const { return width; }
+    unsigned int GetHeight() const { return height; }
+    unsigned int GetNrChannels() const { return channels; }
+
+    // Binary PGM, PPM and PAM files are read a few rows at a time. Other
+    // formats are decoded whole by stb_image, so they take all their memory
+    // up front. Returns nullptr if the file cannot be read.
+    static ImageReader *Open(const std::string &fileName);
+
+ protected:
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+};
+
+
+// Destination of image rows, written from the top down
+class ImageWriter
+{
+ public:
+    virtual ~ImageWriter() {}
+
+    virtual bool WriteRows(const unsigned char *rows, unsigned int nrRows) = 0;
+
+    // Finishes the file once every row is written
+    virtual bool Close() = 0;
+
+    // Files ending in .pgm, .ppm, .pnm or .pam are written as the rows come,
+    // as PGM, PPM or PAM depending on `channels`. PNG, JPEG, BMP and TGA
+    // files keep the whole image until closed.
+    static ImageWriter *Create(const std::string &fileName, unsigned int width, unsigned int height, unsigned int channels);
+};
+
+
+// Filter of a tiled pipeline, run on each tile with the pixels around it
+struct TileFilter
+{
+    std::function<void(const unsigned char *src, unsigned char *dst,
+                       unsigned int width, unsigned int height, unsigned int channels)> apply;
+
+    // How far from a pixel the filter reads
+    unsigned int halo;
+
+    // The kernels of image_processing that only read near each pixel.
+    // Histogram equalization needs the whole image, so it has no tiled form.
+    static TileFilter GrayScale();
+    static TileFilter GaussianBlur(float sigma);
+    static TileFilter Sobel();
+    static TileFilter Median();
+};
+
+
+// Runs a chain of filters over images of any size in bounded memory. The
+// image is read in strips as tall as a tile, plus the rows the filters
+// reach above and below. The tiles of a strip are processed in parallel,
+// each with a halo as wide as the filters of the chain reach together, and
+// the strip is written before the next is read. Tiles on the edges of the
+// image stop at the edges, where the filters repeat the edge pixels, so the
+// result is the same as filtering the whole image at once.
+//
+// Memory holds two strips of the width of the image, and two tiles with
+// their halo per thread.
+class TiledPipeline
+{
+ public:
+    explicit TiledPipeline(unsigned int tileSize = 512);
+
+    void AddFilter(const TileFilter &filter);
+    void ClearFilters();
+
+    // Sum of the halos of the filters
+    unsigned int GetHalo() const;
+
+    bool Run(ImageReader &reader, ImageWriter &writer);
+    bool Run(const std::string &inputFile, const std::string &outputFile);
+
+ private:
+    void ProcessTile(const unsigned char *strip, unsigned int stripFirst, unsigned int stripLast,
+                     unsigned int x0, unsigned int x1, unsigned int y0, unsigned int y1,
+                     unsigned int width, unsigned int channels, unsigned char *output) const;
+
+ private:
+    unsigned int tileSize;
+    std::vector<TileFilter> filters;
+};
@@ -3,6 +3,7 @@
 
 #include "core/engine.h"
 #include "components/simple_scene.h"
+#include "lab_m2/lab8/batch_processing.h"
 
 #if defined(WITH_LAB_M1)
 #   include "lab_m1/lab_list.h"
@@ -40,8 +41,40 @@ int main(int argc, char **argv)
     wp.vSync = true;
     wp.selfDir = GetParentDir(std::string(argv[0]));
 
+    // Filters image files from the command line, without opening a scene
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        BatchProcessor batch;
+        if (!batch.ParseArguments(argc - 2, argv + 2))
+        {
+            BatchProcessor::PrintUsage(argv[0]);
+            return 1;
+        }
+
+        // The CPU filters need no OpenGL context at all
+        if (batch.UsesGPU())
+        {
+            wp.visible = false;
+            wp.vSync = false;
+            if (!Engine::Init(wp))
+            {
+                std::cout << "The GPU filters need an OpenGL 3.3 context, run without --gpu to use the CPU" << std::endl;
+                return 1;
+            }
+        }
+
+        unsigned int failed = batch.Run(wp.selfDir);
+
+        if (batch.UsesGPU())
+        {
+            Engine::Exit();
+        }
+        return failed ? 1 : 0;
+    }
+
     // Init the Engine and create a new window with the defined properties
-    (void)Engine::Init(wp);
+    if (!Engine::Init(wp))
+        return 1;
 
     // Create a new 3D world and start running it
     World *world = new m1::Tema2();
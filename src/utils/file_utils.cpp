@@ -0,0 +1,448 @@
+#include "utils/file_utils.h"
+
+#include <cerrno>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#   include <direct.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <dirent.h>
+#   include <poll.h>
+#   include <sys/mman.h>
+#endif
+
+#if defined(__linux__)
+#   include <sys/inotify.h>
+#endif
+
+
+// -------------------------------------------------------------------------
+file_utils::MappedFile::MappedFile()
+{
+    data = nullptr;
+    size = 0;
+#if defined(_WIN32)
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = NULL;
+#endif
+}
+
+
+file_utils::MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+bool file_utils::MappedFile::Open(const std::string &fileName)
+{
+    Close();
+
+#if defined(_WIN32)
+    fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    data = static_cast<const unsigned char *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    data = static_cast<const unsigned char *>(mapping);
+    size = static_cast<size_t>(info.st_size);
+#endif
+
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+
+void file_utils::MappedFile::Close()
+{
+#if defined(_WIN32)
+    if (data)
+        UnmapViewOfFile(data);
+    if (mappingHandle)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+    mappingHandle = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data)
+        munmap(const_cast<unsigned char *>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+}
+
+
+const unsigned char *file_utils::MappedFile::GetData() const
+{
+    return data;
+}
+
+
+size_t file_utils::MappedFile::GetSize() const
+{
+    return size;
+}
+
+
+bool file_utils::GetModificationTime(const std::string &fileName, time_t &time)
+{
+    struct stat info;
+    if (stat(fileName.c_str(), &info) != 0)
+        return false;
+
+    time = info.st_mtime;
+    return true;
+}
+
+
+bool file_utils::CreateDirectories(const std::string &path)
+{
+    struct stat info;
+    if (path.empty() || stat(path.c_str(), &info) == 0)
+        return true;
+
+    size_t pos = path.find_last_of("\\/");
+    if (pos != std::string::npos && pos > 0 && !CreateDirectories(path.substr(0, pos)))
+        return false;
+
+#if defined(_WIN32)
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+
+// -------------------------------------------------------------------------
+static void SplitPath(const std::string &fileName, std::string &directory, std::string &name)
+{
+    size_t pos = fileName.find_last_of("\\/");
+    directory = (pos == std::string::npos) ? std::string(".") : fileName.substr(0, pos);
+    name = (pos == std::string::npos) ? fileName : fileName.substr(pos + 1);
+}
+
+
+#if !defined(_WIN32)
+static bool MatchWildcard(const char *name, const char *pattern)
+{
+    // Backtracks to the last `*` on a mismatch, letting it take one more character
+    const char *star = nullptr;
+    const char *starName = nullptr;
+    while (*name)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            starName = name;
+        }
+        else if (*pattern == '?' || *pattern == *name)
+        {
+            pattern++;
+            name++;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            name = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == 0;
+}
+#endif
+
+
+std::vector<std::string> file_utils::FindFiles(const std::string &pattern)
+{
+    std::vector<std::string> files;
+    std::string directory, name;
+    SplitPath(pattern, directory, name);
+
+    if (name.find_first_of("*?") == std::string::npos)
+    {
+        struct stat info;
+        if (stat(pattern.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG)
+            files.push_back(pattern);
+        return files;
+    }
+
+    // Matches keep the directory as it was written in the pattern
+    std::string prefix = pattern.substr(0, pattern.size() - name.size());
+
+#if defined(_WIN32)
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA(pattern.c_str(), &entry);
+    if (search != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                files.push_back(prefix + entry.cFileName);
+        } while (FindNextFileA(search, &entry));
+        FindClose(search);
+    }
+#else
+    DIR *dir = opendir(directory.c_str());
+    if (dir)
+    {
+        while (struct dirent *entry = readdir(dir))
+        {
+            if (entry->d_name[0] == '.' && name[0] != '.')
+                continue;
+            if (!MatchWildcard(entry->d_name, name.c_str()))
+                continue;
+
+            std::string fileName = prefix + entry->d_name;
+            struct stat info;
+            if (stat(fileName.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG)
+                files.push_back(fileName);
+        }
+        closedir(dir);
+    }
+#endif
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+
+file_utils::FileWatcher::FileWatcher(std::chrono::milliseconds settleTime)
+{
+    this->settleTime = settleTime;
+    stopping = false;
+    notifyHandle = -1;
+
+#if defined(__linux__)
+    notifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    thread = std::thread(&FileWatcher::WatchLoop, this);
+}
+
+
+file_utils::FileWatcher::~FileWatcher()
+{
+    stopping = true;
+    thread.join();
+
+#if defined(__linux__)
+    if (notifyHandle >= 0)
+        close(notifyHandle);
+#endif
+}
+
+
+void file_utils::FileWatcher::Watch(const std::string &fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = files.find(fileName);
+    if (it != files.end())
+    {
+        it->second.refCount++;
+        return;
+    }
+
+    WatchedFile &file = files[fileName];
+    file.refCount = 1;
+    file.modificationTime = 0;
+    GetModificationTime(fileName, file.modificationTime);
+
+    if (notifyHandle < 0)
+        return;
+
+#if defined(__linux__)
+    std::string directoryName, name;
+    SplitPath(fileName, directoryName, name);
+
+    auto dir = directories.find(directoryName);
+    if (dir == directories.end())
+    {
+        // Editors often save by renaming a temporary file over the original,
+        // so the directory is watched rather than the file itself
+        int handle = inotify_add_watch(notifyHandle, directoryName.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (handle < 0)
+            return;
+
+        dir = directories.insert(std::make_pair(directoryName, WatchedDirectory())).first;
+        dir->second.handle = handle;
+    }
+
+    dir->second.files[name] = fileName;
+#endif
+}
+
+
+void file_utils::FileWatcher::Unwatch(const std::string &fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = files.find(fileName);
+    if (it == files.end() || --it->second.refCount > 0)
+        return;
+
+    files.erase(it);
+    changes.erase(fileName);
+
+    std::string directoryName, name;
+    SplitPath(fileName, directoryName, name);
+
+    auto dir = directories.find(directoryName);
+    if (dir == directories.end())
+        return;
+
+    dir->second.files.erase(name);
+    if (dir->second.files.empty())
+    {
+#if defined(__linux__)
+        inotify_rm_watch(notifyHandle, dir->second.handle);
+#endif
+        directories.erase(dir);
+    }
+}
+
+
+std::vector<std::string> file_utils::FileWatcher::GetChangedFiles()
+{
+    std::vector<std::string> changedFiles;
+    auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = changes.begin(); it != changes.end();)
+    {
+        if (now - it->second < settleTime)
+        {
+            ++it;
+            continue;
+        }
+
+        changedFiles.push_back(it->first);
+        it = changes.erase(it);
+    }
+
+    return changedFiles;
+}
+
+
+void file_utils::FileWatcher::OnFileChanged(const std::string &fileName)
+{
+    changes[fileName] = std::chrono::steady_clock::now();
+}
+
+
+void file_utils::FileWatcher::WatchLoop()
+{
+    while (!stopping)
+    {
+#if defined(__linux__)
+        if (notifyHandle >= 0)
+        {
+            // Wake up regularly to notice the destructor
+            pollfd request = { notifyHandle, POLLIN, 0 };
+            if (poll(&request, 1, 100) <= 0)
+                continue;
+
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+
+            while ((length = read(notifyHandle, buffer, sizeof(buffer))) > 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                for (char *ptr = buffer; ptr < buffer + length;)
+                {
+                    const inotify_event *event = reinterpret_cast<const inotify_event *>(ptr);
+                    ptr += sizeof(inotify_event) + event->len;
+
+                    if (event->len == 0)
+                        continue;
+
+                    for (auto &dir : directories)
+                    {
+                        if (dir.second.handle != event->wd)
+                            continue;
+
+                        auto file = dir.second.files.find(event->name);
+                        if (file != dir.second.files.end())
+                            OnFileChanged(file->second);
+                        break;
+                    }
+                }
+            }
+
+            continue;
+        }
+#endif
+
+        // Without change notifications, compare modification times twice a second
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            for (auto &file : files)
+            {
+                time_t modificationTime = 0;
+                if (GetModificationTime(file.first, modificationTime) && modificationTime != file.second.modificationTime)
+                {
+                    file.second.modificationTime = modificationTime;
+                    OnFileChanged(file.first);
+                }
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+
+
+// -------------------------------------------------------------------------
+namespace file_utils
+{
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+     public:
+        MappedFile();
+        ~MappedFile();
+
+        bool Open(const std::string &fileName);
+        void Close();
+
+        const unsigned char *GetData() const;
+        size_t GetSize() const;
+
+     private:
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+     private:
+        const unsigned char *data;
+        size_t size;
+#if defined(_WIN32)
+        void *fileHandle;
+        void *mappingHandle;
+#endif
+    };
+
+    // Returns false if the file does not exist
+    bool GetModificationTime(const std::string &fileName, time_t &time);
+
+    // Creates the directory and any missing parents
+    bool CreateDirectories(const std::string &path);
+
+    // Files matching `pattern`, in name order. Only the file name may hold
+    // the wildcards `*` and `?`. A pattern without them names a single file.
+    std::vector<std::string> FindFiles(const std::string &pattern);
+
+    // Detects changes to a set of files from a background thread, with inotify
+    // on Linux and by polling modification times elsewhere. A change is only
+    // reported once the file stayed untouched for `settleTime`, so editors that
+    // save in several steps cause a single notification.
+    class FileWatcher
+    {
+     public:
+        explicit FileWatcher(std::chrono::milliseconds settleTime = std::chrono::milliseconds(100));
+        ~FileWatcher();
+
+        // Watching is reference counted, so a file can be shared by several users
+        void Watch(const std::string &fileName);
+        void Unwatch(const std::string &fileName);
+
+        // Returns, and forgets, the files that changed since the last call
+        std::vector<std::string> GetChangedFiles();
+
+     private:
+        FileWatcher(const FileWatcher &) = delete;
+        FileWatcher &operator=(const FileWatcher &) = delete;
+
+        void WatchLoop();
+        void OnFileChanged(const std::string &fileName);
+
+     private:
+        struct WatchedFile
+        {
+            unsigned int refCount;
+            time_t modificationTime;
+        };
+
+        struct WatchedDirectory
+        {
+            int handle;
+            // File name inside the directory, to the path it was watched with
+            std::unordered_map<std::string, std::string> files;
+        };
+
+        std::chrono::milliseconds settleTime;
+        std::unordered_map<std::string, WatchedFile> files;
+        std::unordered_map<std::string, WatchedDirectory> directories;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> changes;
+        std::mutex mutex;
+        std::atomic<bool> stopping;
+        std::thread thread;
+        int notifyHandle;
+    };
+}
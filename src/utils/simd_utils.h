@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmath>
+
+// SIMD_SSE2 and SIMD_AVX are defined for the instruction sets the compiler targets
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define SIMD_SSE2
+#endif
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#   define SIMD_AVX
+#endif
+
+
+// -------------------------------------------------------------------------
+namespace simd_utils
+{
+    // Operations on the lanes of one register, so that a loop is written
+    // once for every instruction set. Comparisons return a mask that
+    // `Select` uses to pick between two values.
+    struct ScalarLanes
+    {
+        typedef float Type;
+        static const unsigned int WIDTH = 1;
+
+        static Type Load(const float *p) { return *p; }
+        static void Store(float *p, Type a) { *p = a; }
+        static Type Set(float a) { return a; }
+        static Type Add(Type a, Type b) { return a + b; }
+        static Type Sub(Type a, Type b) { return a - b; }
+        static Type Mul(Type a, Type b) { return a * b; }
+        static Type Div(Type a, Type b) { return a / b; }
+        static Type Sqrt(Type a) { return std::sqrt(a); }
+        static Type Less(Type a, Type b) { return a < b ? 1.0f : 0.0f; }
+        static Type Select(Type mask, Type a, Type b) { return mask != 0 ? a : b; }
+    };
+
+
+#if defined(SIMD_SSE2)
+    struct SSELanes
+    {
+        typedef __m128 Type;
+        static const unsigned int WIDTH = 4;
+
+        static Type Load(const float *p) { return _mm_loadu_ps(p); }
+        static void Store(float *p, Type a) { _mm_storeu_ps(p, a); }
+        static Type Set(float a) { return _mm_set1_ps(a); }
+        static Type Add(Type a, Type b) { return _mm_add_ps(a, b); }
+        static Type Sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+        static Type Mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+        static Type Div(Type a, Type b) { return _mm_div_ps(a, b); }
+        static Type Sqrt(Type a) { return _mm_sqrt_ps(a); }
+        static Type Less(Type a, Type b) { return _mm_cmplt_ps(a, b); }
+        static Type Select(Type mask, Type a, Type b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    };
+#endif
+
+
+#if defined(SIMD_AVX)
+    struct AVXLanes
+    {
+        typedef __m256 Type;
+        static const unsigned int WIDTH = 8;
+
+        static Type Load(const float *p) { return _mm256_loadu_ps(p); }
+        static void Store(float *p, Type a) { _mm256_storeu_ps(p, a); }
+        static Type Set(float a) { return _mm256_set1_ps(a); }
+        static Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+        static Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+        static Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+        static Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+        static Type Sqrt(Type a) { return _mm256_sqrt_ps(a); }
+        static Type Less(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static Type Select(Type mask, Type a, Type b) { return _mm256_blendv_ps(b, a, mask); }
+    };
+#endif
+
+
+    // The widest lanes the compiler targets
+#if defined(SIMD_AVX)
+    typedef AVXLanes SIMDLanes;
+#elif defined(SIMD_SSE2)
+    typedef SSELanes SIMDLanes;
+#else
+    typedef ScalarLanes SIMDLanes;
+#endif
+
+    // The widest lanes of at most four floats, for data padded to a multiple of four
+#if defined(SIMD_SSE2)
+    typedef SSELanes SIMD4Lanes;
+#else
+    typedef ScalarLanes SIMD4Lanes;
+#endif
+}
@@ -23,3 +23,17 @@ std::string text_utils::Join(
 
     return os.str();
 }
+
+
+uint64_t text_utils::Hash(
+    const std::string &text,
+    uint64_t seed)
+{
+    uint64_t hash = seed;
+    for (char c : text)
+    {
+        hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+    }
+
+    return hash;
+}
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <sstream>
 #include <iterator>
 
@@ -20,5 +21,10 @@ namespace text_utils
         const std::vector<std::string> &elements,
         const std::string &separator);
 
+    // 64-bit FNV-1a hash. Pass a previous result as `seed` to hash several strings.
+    uint64_t Hash(
+        const std::string &text,
+        uint64_t seed = 14695981039346656037ull);
+
 #define PATH_JOIN(...) text_utils::Join(std::vector<std::string>{__VA_ARGS__}, std::string(1, PATH_SEPARATOR))
 }
@@ -0,0 +1,156 @@
+#include "utils/thread_utils.h"
+
+#include <atomic>
+#include <memory>
+
+
+thread_utils::ThreadPool::ThreadPool(unsigned int nrThreads)
+{
+    activeJobs = 0;
+    stopping = false;
+
+    if (nrThreads == 0)
+    {
+        nrThreads = std::thread::hardware_concurrency();
+        nrThreads = nrThreads ? nrThreads : 1;
+    }
+
+    for (unsigned int i = 0; i < nrThreads; i++)
+    {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+
+thread_utils::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+
+void thread_utils::ThreadPool::Enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push(std::move(job));
+    }
+    jobAvailable.notify_one();
+}
+
+
+void thread_utils::ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsDone.wait(lock, [this]() { return jobs.empty() && activeJobs == 0; });
+}
+
+
+unsigned int thread_utils::ThreadPool::GetNumberOfThreads() const
+{
+    return (unsigned int)workers.size();
+}
+
+
+void thread_utils::ThreadPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+            if (stopping && jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop();
+            activeJobs++;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeJobs--;
+            if (jobs.empty() && activeJobs == 0)
+                jobsDone.notify_all();
+        }
+    }
+}
+
+
+thread_utils::ThreadPool &thread_utils::GetThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+
+void thread_utils::ParallelFor(unsigned int begin, unsigned int end, unsigned int grainSize,
+                               const std::function<void(unsigned int, unsigned int)> &func)
+{
+    if (begin >= end)
+        return;
+
+    grainSize = grainSize ? grainSize : 1;
+    unsigned int nrChunks = (end - begin + grainSize - 1) / grainSize;
+
+    if (nrChunks == 1)
+    {
+        func(begin, end);
+        return;
+    }
+
+    // Chunks are claimed through a shared counter, so the caller can help
+    // out and nested calls from inside a worker never deadlock
+    struct Shared
+    {
+        std::atomic<unsigned int> nextChunk;
+        std::atomic<unsigned int> doneChunks;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+    shared->nextChunk = 0;
+    shared->doneChunks = 0;
+
+    auto runChunks = [=, &func]()
+    {
+        unsigned int chunk;
+        while ((chunk = shared->nextChunk++) < nrChunks)
+        {
+            unsigned int chunkBegin = begin + chunk * grainSize;
+            unsigned int chunkEnd = (end - chunkBegin > grainSize) ? chunkBegin + grainSize : end;
+            func(chunkBegin, chunkEnd);
+
+            if (++shared->doneChunks == nrChunks)
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                shared->done.notify_all();
+            }
+        }
+    };
+
+    ThreadPool &pool = GetThreadPool();
+    unsigned int nrHelpers = nrChunks - 1 < pool.GetNumberOfThreads() ? nrChunks - 1 : pool.GetNumberOfThreads();
+    for (unsigned int i = 0; i < nrHelpers; i++)
+    {
+        pool.Enqueue(runChunks);
+    }
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->done.wait(lock, [&]() { return shared->doneChunks == nrChunks; });
+}
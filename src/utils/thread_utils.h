@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+
+// -------------------------------------------------------------------------
+namespace thread_utils
+{
+    // Fixed-size pool of worker threads consuming jobs in FIFO order
+    class ThreadPool
+    {
+     public:
+        // Zero selects one worker per hardware thread
+        explicit ThreadPool(unsigned int nrThreads = 0);
+        ~ThreadPool();
+
+        void Enqueue(std::function<void()> job);
+
+        // Blocks until every job enqueued so far has finished
+        void Wait();
+
+        unsigned int GetNumberOfThreads() const;
+
+     private:
+        void WorkerLoop();
+
+     private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        std::condition_variable jobsDone;
+        unsigned int activeJobs;
+        bool stopping;
+    };
+
+    // Pool shared by the engine, created on first use
+    ThreadPool &GetThreadPool();
+
+    // Splits [begin, end) into chunks of at most `grainSize` and runs `func(chunkBegin, chunkEnd)`
+    // on the shared pool. The calling thread also processes chunks, and returns when all are done.
+    void ParallelFor(unsigned int begin, unsigned int end, unsigned int grainSize,
+                     const std::function<void(unsigned int, unsigned int)> &func);
+}